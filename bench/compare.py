@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+
+# Compares two hayaku-microbench results and fails when a benchmark got slower.
+#
+# A benchmark regresses when its median grew by more than the threshold and the growth is also
+# larger than NOISE_FACTOR times the combined median absolute deviations, so noisy runs alone
+# don't fail the gate.
+#
+# compare.py <baseline.json> <current.json> [--threshold 0.1]
+
+import json
+import sys
+
+NOISE_FACTOR = 3.0
+
+def load(path: str) -> dict[str, dict]:
+    file = open(path, 'r')
+    results = json.load(file)['results']
+    file.close()
+
+    return {result['name']: result for result in results}
+
+def main(args: list[str]) -> int:
+    threshold = 0.1
+
+    if '--threshold' in args:
+        index = args.index('--threshold')
+        threshold = float(args[index + 1])
+        del args[index:index + 2]
+
+    if len(args) != 2:
+        print('usage: compare.py <baseline.json> <current.json> [--threshold 0.1]')
+        return 2
+
+    baseline = load(args[0])
+    current = load(args[1])
+
+    regressions: list[str] = []
+
+    print(f'{"benchmark":<40} {"baseline us":>12} {"current us":>12} {"change":>8}')
+
+    for name, result in current.items():
+        if name not in baseline:
+            print(f'{name:<40} {"-":>12} {result["median_us"]:>12.2f} {"new":>8}')
+            continue
+
+        before = baseline[name]
+        delta = result['median_us'] - before['median_us']
+        change = delta / before['median_us'] if before['median_us'] > 0.0 else 0.0
+        noise = NOISE_FACTOR * (before['mad_us'] + result['mad_us'])
+
+        mark = ''
+        if change > threshold and delta > noise:
+            regressions.append(name)
+            mark = '  REGRESSION'
+
+        print(f'{name:<40} {before["median_us"]:>12.2f} {result["median_us"]:>12.2f} '
+              f'{change * 100.0:>7.1f}%{mark}')
+
+    for name in baseline:
+        if name not in current:
+            print(f'{name:<40} missing from current results')
+
+    if regressions:
+        print(f'\n{len(regressions)} regression(s) above {threshold * 100.0:.0f}%')
+        return 1
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
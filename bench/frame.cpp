@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <rendering/rendering_device.h>
+#include <rendering/rendering_server.h>
+#include <scene.h>
+
+// Renders a scene headless from fixed cameras circling the origin and prints CPU and GPU frame
+// time percentiles as JSON.
+//
+// With --stream a second scene is loaded halfway through the first camera's frames, the frames
+// from the load on are also reported on their own, which is where upload hitches show. Its uploads
+// are spread over frames within --upload-budget and --upload-time, the first scene is uploaded
+// whole before measuring.
+//
+// hayaku-bench <scene> [--frames N] [--warmup N] [--width W] [--height H] [--distance D]
+//     [--stream scene] [--output path] [--validation] [--no-material-variants]
+//     [--frames-in-flight N] [--present-mode mode] [--dynamic-resolution ms]
+//     [--render-scale-min S] [--render-scale-max S] [--texture-budget MiB]
+//     [--upload-budget MiB] [--upload-time ms]
+
+const uint32_t CAMERA_COUNT = 4;
+
+// frames reported after a streamed load, the load itself runs in the first
+const uint32_t STREAM_FRAME_COUNT = 16;
+
+// read by RS::initialize, skipped so their values aren't taken for the scene
+const char *const RENDERER_VALUE_OPTIONS[] = {
+	"--frames-in-flight",
+	"--present-mode",
+	"--dynamic-resolution",
+	"--render-scale-min",
+	"--render-scale-max",
+	"--texture-budget",
+	"--upload-budget",
+	"--upload-time",
+};
+
+static bool isRendererValueOption(const char *pArg) {
+	for (const char *pOption : RENDERER_VALUE_OPTIONS) {
+		if (strcmp(pOption, pArg) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+typedef struct {
+	const char *pScene;
+	const char *pStreamScene;
+	const char *pOutput;
+	uint32_t frames;
+	uint32_t warmup;
+	uint32_t width;
+	uint32_t height;
+	float distance;
+} Options;
+
+static bool parseOptions(int argc, char **argv, Options *pOptions) {
+	*pOptions = { nullptr, nullptr, nullptr, 400, 20, 1280, 720, 10.0f };
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i < argc - 1;
+
+		if (strcmp("--frames", argv[i]) == 0 && hasValue)
+			pOptions->frames = atoi(argv[++i]);
+		else if (strcmp("--warmup", argv[i]) == 0 && hasValue)
+			pOptions->warmup = atoi(argv[++i]);
+		else if (strcmp("--width", argv[i]) == 0 && hasValue)
+			pOptions->width = atoi(argv[++i]);
+		else if (strcmp("--height", argv[i]) == 0 && hasValue)
+			pOptions->height = atoi(argv[++i]);
+		else if (strcmp("--distance", argv[i]) == 0 && hasValue)
+			pOptions->distance = atof(argv[++i]);
+		else if (strcmp("--stream", argv[i]) == 0 && hasValue)
+			pOptions->pStreamScene = argv[++i];
+		else if (strcmp("--output", argv[i]) == 0 && hasValue)
+			pOptions->pOutput = argv[++i];
+		else if (isRendererValueOption(argv[i]) && hasValue)
+			i++;
+		else if (argv[i][0] != '-')
+			pOptions->pScene = argv[i];
+	}
+
+	return pOptions->pScene != nullptr && pOptions->frames > 0 && pOptions->width > 0 &&
+		   pOptions->height > 0;
+}
+
+static glm::mat4 cameraTransform(uint32_t camera, float distance) {
+	float angle = glm::two_pi<float>() * camera / CAMERA_COUNT;
+
+	glm::vec3 eye(glm::sin(angle) * distance, distance * 0.3f, glm::cos(angle) * distance);
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	return glm::inverse(view);
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction) {
+	size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+static void printTimes(FILE *pFile, const char *pName, std::vector<double> &times, bool isLast) {
+	fprintf(pFile, "\t\"%s\": ", pName);
+
+	if (times.empty()) {
+		fprintf(pFile, "null%s\n", isLast ? "" : ",");
+		return;
+	}
+
+	std::sort(times.begin(), times.end());
+
+	double sum = 0.0;
+	for (double time : times)
+		sum += time;
+
+	fprintf(pFile,
+			"{ \"samples\": %zu, \"min\": %.4f, \"avg\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+			"\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+			times.size(), times.front(), sum / times.size(), percentile(times, 0.5),
+			percentile(times, 0.9), percentile(times, 0.95), percentile(times, 0.99),
+			times.back(), isLast ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+	Options options;
+
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(stderr,
+				"usage: hayaku-bench <scene> [--frames N] [--warmup N] [--width W] [--height H] "
+				"[--distance D] [--stream scene] [--output path] [--validation] "
+				"[--no-material-variants] [--frames-in-flight N] [--present-mode mode] "
+				"[--dynamic-resolution ms] [--render-scale-min S] [--render-scale-max S] "
+				"[--texture-budget MiB] [--upload-budget MiB] [--upload-time ms]\n");
+		return 1;
+	}
+
+	RS &rs = RS::getSingleton();
+	rs.initialize(argc, argv, true);
+
+	// frame times only, profiler events would add their own overhead to the measured frames
+	RD::getSingleton().setGpuTimingRequired(true);
+	rs.headlessInit(options.width, options.height);
+
+	Scene scene;
+
+	if (!scene.load(options.pScene)) {
+		fprintf(stderr, "Failed to load scene: %s\n", options.pScene);
+		return 1;
+	}
+
+	rs.uploadsFlush();
+
+	GpuProfiler &gpuProfiler = RD::getSingleton().getGpuProfiler();
+
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;
+
+	uint32_t framesPerCamera = (options.frames + CAMERA_COUNT - 1) / CAMERA_COUNT;
+
+	Scene streamedScene;
+	uint32_t streamFrame = options.warmup + framesPerCamera / 2;
+	double streamLoadTime = 0.0;
+
+	std::vector<double> streamCpuTimes;
+	std::vector<double> streamGpuTimes;
+
+	for (uint32_t camera = 0; camera < CAMERA_COUNT; camera++) {
+		rs.cameraSetTransform(cameraTransform(camera, options.distance));
+
+		// every view change settles occlusion culling and streaming first
+		for (uint32_t frame = 0; frame < options.warmup + framesPerCamera; frame++) {
+			bool isMeasured = frame >= options.warmup;
+			uint64_t collectedFrameCount = gpuProfiler.getCollectedFrameCount();
+
+			bool isStreamed = options.pStreamScene != nullptr && camera == 0 &&
+					frame >= streamFrame && frame < streamFrame + STREAM_FRAME_COUNT;
+
+			auto start = std::chrono::steady_clock::now();
+
+			if (isStreamed && frame == streamFrame) {
+				if (!streamedScene.load(options.pStreamScene)) {
+					fprintf(stderr, "Failed to load scene: %s\n", options.pStreamScene);
+					return 1;
+				}
+
+				auto loaded = std::chrono::steady_clock::now();
+				streamLoadTime = std::chrono::duration<double, std::milli>(loaded - start).count();
+			}
+
+			scene.update();
+			rs.draw();
+
+			auto end = std::chrono::steady_clock::now();
+
+			if (!isMeasured)
+				continue;
+
+			double cpuTime = std::chrono::duration<double, std::milli>(end - start).count();
+			cpuTimes.push_back(cpuTime);
+
+			if (isStreamed)
+				streamCpuTimes.push_back(cpuTime);
+
+			// results trail by the frames in flight, the first ones may still be warmup frames
+			uint32_t framesInFlight = RD::getSingleton().getFramesInFlight();
+
+			if (gpuProfiler.getCollectedFrameCount() == collectedFrameCount ||
+					frame < options.warmup + framesInFlight)
+				continue;
+
+			gpuTimes.push_back(gpuProfiler.getFrameTime());
+
+			if (options.pStreamScene != nullptr && camera == 0 &&
+					frame >= streamFrame + framesInFlight &&
+					frame < streamFrame + framesInFlight + STREAM_FRAME_COUNT)
+				streamGpuTimes.push_back(gpuProfiler.getFrameTime());
+		}
+	}
+
+	RD::getSingleton().getDevice().waitIdle();
+
+	FILE *pFile = stdout;
+
+	if (options.pOutput != nullptr) {
+		pFile = fopen(options.pOutput, "w");
+
+		if (pFile == nullptr) {
+			fprintf(stderr, "Failed to open output: %s\n", options.pOutput);
+			return 1;
+		}
+	}
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "\t\"scene\": \"%s\",\n", options.pScene);
+	fprintf(pFile, "\t\"width\": %u,\n", options.width);
+	fprintf(pFile, "\t\"height\": %u,\n", options.height);
+	fprintf(pFile, "\t\"cameras\": %u,\n", CAMERA_COUNT);
+	fprintf(pFile, "\t\"frames\": %zu,\n", cpuTimes.size());
+	printTimes(pFile, "cpu_ms", cpuTimes, false);
+	printTimes(pFile, "gpu_ms", gpuTimes, options.pStreamScene == nullptr);
+
+	if (options.pStreamScene != nullptr) {
+		fprintf(pFile, "\t\"stream_load_ms\": %.4f,\n", streamLoadTime);
+		printTimes(pFile, "stream_cpu_ms", streamCpuTimes, false);
+		printTimes(pFile, "stream_gpu_ms", streamGpuTimes, true);
+	}
+	fprintf(pFile, "}\n");
+
+	if (pFile != stdout)
+		fclose(pFile);
+
+	return 0;
+}
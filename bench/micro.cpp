@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <io/asset_loader.h>
+#include <io/image.h>
+#include <io/mesh.h>
+#include <io/meshlet_builder.h>
+#include <rendering/object_owner.h>
+#include <rendering/rendering_server.h>
+#include <rendering/spherical_harmonics.h>
+#include <rendering/storage/light_storage.h>
+#include <rendering/types/resource.h>
+
+// CPU hot paths measured without a device or window. Every case runs warmup repetitions, then
+// timed repetitions each preceded by an untimed setup, and reports median and median absolute
+// deviation. Results are JSON, bench/compare.py gates regressions against a baseline.
+//
+// hayaku-microbench [--filter text] [--warmup N] [--reps N] [--output path]
+
+const uint32_t IMAGE_SIZE = 512;
+const uint32_t GRID_SIZE = 256;
+const uint32_t OBJECT_COUNT = 100000;
+
+typedef struct {
+	std::string name;
+	double median;
+	double mad;
+	double min;
+	double max;
+} Result;
+
+typedef struct {
+	const char *pFilter;
+	const char *pOutput;
+	uint32_t warmup;
+	uint32_t repetitions;
+} Options;
+
+// keeps the compiler from dropping work whose result is never read
+static void keep(const void *pData) {
+	asm volatile("" : : "r"(pData) : "memory");
+}
+
+static double median(std::vector<double> values) {
+	std::sort(values.begin(), values.end());
+
+	size_t middle = values.size() / 2;
+
+	if (values.size() % 2 == 0)
+		return (values[middle - 1] + values[middle]) * 0.5;
+
+	return values[middle];
+}
+
+class Harness {
+private:
+	Options _options;
+	std::vector<Result> _results;
+
+public:
+	void run(const std::string &name, const std::function<void()> &setup,
+			const std::function<void()> &body) {
+		if (_options.pFilter != nullptr && name.find(_options.pFilter) == std::string::npos)
+			return;
+
+		std::vector<double> times;
+
+		for (uint32_t i = 0; i < _options.warmup + _options.repetitions; i++) {
+			setup();
+
+			auto start = std::chrono::steady_clock::now();
+			body();
+			auto end = std::chrono::steady_clock::now();
+
+			if (i >= _options.warmup)
+				times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+		}
+
+		double center = median(times);
+
+		std::vector<double> deviations;
+		for (double time : times)
+			deviations.push_back(std::abs(time - center));
+
+		Result result;
+		result.name = name;
+		result.median = center;
+		result.mad = median(deviations);
+		result.min = *std::min_element(times.begin(), times.end());
+		result.max = *std::max_element(times.begin(), times.end());
+
+		fprintf(stderr, "%-40s median %10.2f us  mad %8.2f us\n", name.c_str(), result.median,
+				result.mad);
+
+		_results.push_back(result);
+	}
+
+	void run(const std::string &name, const std::function<void()> &body) {
+		run(name, [] {}, body);
+	}
+
+	bool write() const {
+		FILE *pFile = stdout;
+
+		if (_options.pOutput != nullptr) {
+			pFile = fopen(_options.pOutput, "w");
+
+			if (pFile == nullptr) {
+				fprintf(stderr, "Failed to open output: %s\n", _options.pOutput);
+				return false;
+			}
+		}
+
+		fprintf(pFile, "{\n\t\"warmup\": %u,\n\t\"repetitions\": %u,\n\t\"results\": [\n",
+				_options.warmup, _options.repetitions);
+
+		for (size_t i = 0; i < _results.size(); i++) {
+			const Result &result = _results[i];
+
+			fprintf(pFile,
+					"\t\t{ \"name\": \"%s\", \"median_us\": %.3f, \"mad_us\": %.3f, "
+					"\"min_us\": %.3f, \"max_us\": %.3f }%s\n",
+					result.name.c_str(), result.median, result.mad, result.min, result.max,
+					i + 1 < _results.size() ? "," : "");
+		}
+
+		fprintf(pFile, "\t]\n}\n");
+
+		if (pFile != stdout)
+			fclose(pFile);
+
+		return true;
+	}
+
+	Harness(const Options &options) : _options(options) {}
+};
+
+static const Image::Format FORMATS[] = {
+	Image::Format::R8,
+	Image::Format::RG8,
+	Image::Format::RGB8,
+	Image::Format::RGBA8,
+	Image::Format::RGBA32F,
+};
+
+static Image randomImage(Image::Format format, std::mt19937 &rng) {
+	uint32_t pixelCount = IMAGE_SIZE * IMAGE_SIZE;
+	std::vector<uint8_t> data(pixelCount * Image::getFormatByteSize(format));
+
+	if (format == Image::Format::RGBA32F) {
+		std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+		float *pData = reinterpret_cast<float *>(data.data());
+
+		for (size_t i = 0; i < data.size() / sizeof(float); i++)
+			pData[i] = distribution(rng);
+	} else {
+		for (uint8_t &byte : data)
+			byte = rng() & 0xFF;
+	}
+
+	return Image(IMAGE_SIZE, IMAGE_SIZE, format, data);
+}
+
+// Wavy grid with UVs, its index and vertex arrays are allocated with malloc like the loader's.
+static void gridCreate(IndexArray &indices, VertexArray &vertices) {
+	uint32_t vertexCount = GRID_SIZE * GRID_SIZE;
+	uint32_t quadCount = (GRID_SIZE - 1) * (GRID_SIZE - 1);
+
+	vertices.count = vertexCount;
+	vertices.pPositions = (glm::vec3 *)malloc(vertexCount * sizeof(glm::vec3));
+	vertices.pAttributes = (VertexAttribute *)calloc(vertexCount, sizeof(VertexAttribute));
+
+	for (uint32_t y = 0; y < GRID_SIZE; y++) {
+		for (uint32_t x = 0; x < GRID_SIZE; x++) {
+			uint32_t i = y * GRID_SIZE + x;
+			glm::vec2 uv = glm::vec2(x, y) / float(GRID_SIZE - 1);
+
+			vertices.pPositions[i] = glm::vec3(uv.x, glm::sin(uv.x * 20.0f) * 0.05f, uv.y);
+			vertices.pAttributes[i].normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			vertices.pAttributes[i].uv = uv;
+		}
+	}
+
+	indices.count = quadCount * 6;
+	indices.pData = (uint32_t *)malloc(indices.count * sizeof(uint32_t));
+
+	uint32_t index = 0;
+
+	for (uint32_t y = 0; y < GRID_SIZE - 1; y++) {
+		for (uint32_t x = 0; x < GRID_SIZE - 1; x++) {
+			uint32_t i = y * GRID_SIZE + x;
+
+			uint32_t quad[6] = { i, i + GRID_SIZE, i + 1, i + 1, i + GRID_SIZE, i + GRID_SIZE + 1 };
+			for (uint32_t corner : quad)
+				indices.pData[index++] = corner;
+		}
+	}
+}
+
+static void benchImage(Harness &harness) {
+	std::mt19937 rng(0);
+
+	std::vector<Image> sources;
+	for (Image::Format format : FORMATS)
+		sources.push_back(randomImage(format, rng));
+
+	for (const Image &source : sources) {
+		for (Image::Format format : FORMATS) {
+			std::string name = std::string("Image::convert ") +
+							   Image::getFormatName(source.getFormat()) + " to " +
+							   Image::getFormatName(format);
+
+			Image image = source;
+
+			harness.run(
+					name, [&] { image = source; }, [&] { image.convert(format); });
+		}
+	}
+
+	const Image &rgba = sources[3];
+
+	const Image::Channel channels[] = {
+		Image::Channel::R,
+		Image::Channel::G,
+		Image::Channel::B,
+		Image::Channel::A,
+	};
+	const char *channelNames[] = { "R", "G", "B", "A" };
+
+	for (uint32_t i = 0; i < 4; i++) {
+		Image *pComponent = nullptr;
+
+		harness.run(
+				std::string("Image::getComponent RGBA8 ") + channelNames[i],
+				[&] {
+					delete pComponent;
+					pComponent = nullptr;
+				},
+				[&] { pComponent = rgba.getComponent(channels[i]); });
+
+		delete pComponent;
+	}
+
+	// square rather than 2:1, the projection doesn't care for the aspect
+	std::vector<uint8_t> sky = sources[4].getData();
+	const float *pSky = reinterpret_cast<const float *>(sky.data());
+
+	harness.run("irradianceProject RGBA32F", [&] {
+		IrradianceSH irradiance = irradianceProject(pSky, IMAGE_SIZE, IMAGE_SIZE);
+		keep(irradiance.data());
+	});
+}
+
+static void benchMesh(Harness &harness) {
+	IndexArray indices;
+	VertexArray vertices;
+	gridCreate(indices, vertices);
+
+	std::vector<VertexAttribute> attributes(
+			vertices.pAttributes, vertices.pAttributes + vertices.count);
+
+	harness.run(
+			"AssetLoader::generateTangents",
+			[&] {
+				memcpy(vertices.pAttributes, attributes.data(),
+						sizeof(VertexAttribute) * vertices.count);
+			},
+			[&] { AssetLoader::generateTangents(indices, vertices); });
+
+	// a few primitives sharing the grid, each with its meshlets as the loader builds them
+	const uint32_t PRIMITIVE_COUNT = 4;
+
+	MeshletArray meshlets = MeshletBuilder::build(indices, vertices);
+
+	std::vector<Primitive> primitives(PRIMITIVE_COUNT);
+
+	for (Primitive &primitive : primitives) {
+		primitive = {};
+		primitive.vertices = vertices;
+		primitive.indices = indices;
+		primitive.meshlets[0] = meshlets;
+	}
+
+	Mesh mesh = { primitives.data(), PRIMITIVE_COUNT, "grid" };
+	RS::MeshStreams streams;
+
+	harness.run("RS::meshFlatten", [&] {
+		RS::meshFlatten(mesh, streams);
+		keep(streams.indices.data());
+	});
+
+	free(meshlets.pData);
+	free(indices.pData);
+	free(vertices.pPositions);
+	free(vertices.pAttributes);
+}
+
+static void benchObjectOwner(Harness &harness) {
+	std::mt19937 rng(0);
+
+	std::vector<ObjectID> lookups(OBJECT_COUNT);
+	for (ObjectID &lookup : lookups)
+		lookup = rng() % OBJECT_COUNT + 1;
+
+	ObjectOwner<MeshInstanceRD> owner;
+
+	auto fill = [&] {
+		owner = ObjectOwner<MeshInstanceRD>();
+
+		for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+			owner.insert({});
+	};
+
+	harness.run(
+			"ObjectOwner insert", [&] { owner = ObjectOwner<MeshInstanceRD>(); },
+			[&] {
+				for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+					owner.insert({});
+			});
+
+	fill();
+
+	harness.run("ObjectOwner lookup", [&] {
+		uint32_t lod = 0;
+
+		for (ObjectID object : lookups)
+			lod += owner[object].lod;
+
+		keep(&lod);
+	});
+
+	harness.run("ObjectOwner iterate", [&] {
+		uint32_t lod = 0;
+
+		for (const auto &[_, instance] : owner.map())
+			lod += instance.lod;
+
+		keep(&lod);
+	});
+
+	harness.run("ObjectOwner free", fill, [&] {
+		for (ObjectID object = 1; object <= OBJECT_COUNT; object++)
+			owner.free(object);
+	});
+}
+
+static void benchLightStorage(Harness &harness) {
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> distribution(-50.0f, 50.0f);
+
+	LightStorage storage;
+
+	for (uint32_t i = 0; i < MAX_DIRECTIONAL_LIGHT_COUNT; i++)
+		storage.lightCreate(LightType::Directional);
+
+	for (uint32_t i = 0; i < MAX_POINT_LIGHT_COUNT; i++) {
+		ObjectID light = storage.lightCreate(LightType::Point);
+
+		glm::vec3 position(distribution(rng), distribution(rng), distribution(rng));
+		glm::mat4 transform = glm::mat4(1.0f);
+		transform[3] = glm::vec4(position, 1.0f);
+
+		storage.lightSetTransform(light, transform);
+	}
+
+	harness.run("LightStorage::pack", [&] { storage.pack(); });
+}
+
+int main(int argc, char **argv) {
+	Options options = { nullptr, nullptr, 3, 25 };
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i < argc - 1;
+
+		if (strcmp("--filter", argv[i]) == 0 && hasValue)
+			options.pFilter = argv[++i];
+		else if (strcmp("--warmup", argv[i]) == 0 && hasValue)
+			options.warmup = atoi(argv[++i]);
+		else if (strcmp("--reps", argv[i]) == 0 && hasValue)
+			options.repetitions = std::max(atoi(argv[++i]), 1);
+		else if (strcmp("--output", argv[i]) == 0 && hasValue)
+			options.pOutput = argv[++i];
+	}
+
+	Harness harness(options);
+
+	benchImage(harness);
+	benchMesh(harness);
+	benchObjectOwner(harness);
+	benchLightStorage(harness);
+
+	return harness.write() ? 0 : 1;
+}
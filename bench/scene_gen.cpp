@@ -0,0 +1,757 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <rendering/storage/light_limits.h>
+#include <zlib/zlib.h>
+
+// Writes a synthetic glTF scene for scalability testing: procedural meshes, textured materials,
+// mesh instances placed in one of several layouts, point lights and a sun. The same options and
+// seed always produce the same file, so loads and frame times can be compared across commits.
+//
+// Everything binary, textures included, lives in one buffer. A .glb output embeds it, a .gltf
+// output writes it next to the JSON as <name>.bin.
+//
+// hayaku-scenegen <output.gltf|output.glb> [--instances N] [--meshes N] [--materials N]
+//     [--textures N] [--texture-size N] [--lights N] [--layout uniform|clustered|city] [--seed N]
+
+const uint32_t MAX_INSTANCE_COUNT = 1000000;
+
+// average area per instance in the uniform and clustered layouts
+const float INSTANCE_SPACING = 4.0f;
+
+// city layout, blocks of lots separated by one lot wide streets
+const float LOT_SIZE = 10.0f;
+const uint32_t BLOCK_LOTS = 4;
+
+const uint32_t GLB_MAGIC = 0x46546C67;
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+const uint32_t TARGET_ARRAY_BUFFER = 34962;
+const uint32_t TARGET_ELEMENT_ARRAY_BUFFER = 34963;
+
+const uint32_t COMPONENT_FLOAT = 5126;
+const uint32_t COMPONENT_UNSIGNED_INT = 5125;
+
+enum class Layout {
+	Uniform,
+	Clustered,
+	City,
+};
+
+typedef struct {
+	const char *pOutput;
+	uint32_t instanceCount;
+	uint32_t meshCount;
+	uint32_t materialCount;
+	uint32_t textureCount;
+	uint32_t textureSize;
+	uint32_t lightCount;
+	Layout layout;
+	uint32_t seed;
+} Options;
+
+typedef struct {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<uint32_t> indices;
+} MeshData;
+
+// Distributions on top of mt19937, whose output is fixed by the standard unlike the ones of
+// std::*_distribution, so a seed gives the same scene with every standard library. Draws are
+// separate statements, the evaluation order of function arguments is unspecified.
+class Random {
+private:
+	std::mt19937 _engine;
+
+public:
+	// [0, 1)
+	float next() {
+		return (_engine() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float range(float min, float max) {
+		return min + (max - min) * next();
+	}
+
+	uint32_t index(uint32_t count) {
+		return _engine() % count;
+	}
+
+	float gaussian() {
+		float u1 = 1.0f - next();
+		float u2 = next();
+
+		return std::sqrt(-2.0f * std::log(u1)) * std::cos(glm::two_pi<float>() * u2);
+	}
+
+	glm::vec2 range2(float min, float max) {
+		float x = range(min, max);
+		float y = range(min, max);
+
+		return glm::vec2(x, y);
+	}
+
+	glm::vec3 range3(float min, float max) {
+		float x = range(min, max);
+		float y = range(min, max);
+		float z = range(min, max);
+
+		return glm::vec3(x, y, z);
+	}
+
+	Random(uint32_t seed) : _engine(seed) {}
+};
+
+// Collects the binary buffer and the JSON arrays referencing it.
+class Gltf {
+private:
+	std::vector<uint8_t> _buffer;
+
+	uint32_t _bufferViewCount = 0;
+	uint32_t _accessorCount = 0;
+
+public:
+	std::string bufferViews;
+	std::string accessors;
+	std::string images;
+	std::string textures;
+	std::string materials;
+	std::string meshes;
+	std::string lights;
+	std::string nodes;
+	std::string rootNodes;
+
+	uint32_t imageCount = 0;
+	uint32_t meshCount = 0;
+	uint32_t nodeCount = 0;
+
+	static void append(std::string &array, const char *pFormat, ...)
+			__attribute__((format(printf, 2, 3)));
+
+	uint32_t bufferViewAdd(const void *pData, size_t size, uint32_t target) {
+		// accessors of every component type stay aligned
+		while (_buffer.size() % 4 != 0)
+			_buffer.push_back(0);
+
+		size_t offset = _buffer.size();
+		_buffer.resize(offset + size);
+		memcpy(_buffer.data() + offset, pData, size);
+
+		if (target != 0) {
+			append(bufferViews,
+					"{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":%u}", offset,
+					size, target);
+		} else {
+			append(bufferViews, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}", offset,
+					size);
+		}
+
+		return _bufferViewCount++;
+	}
+
+	uint32_t accessorAdd(const void *pData, size_t elementSize, uint32_t count,
+			uint32_t componentType, const char *pType, uint32_t target,
+			const std::string &bounds = "") {
+		uint32_t bufferView = bufferViewAdd(pData, elementSize * count, target);
+
+		append(accessors, "{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"%s\"%s}",
+				bufferView, componentType, count, pType, bounds.c_str());
+
+		return _accessorCount++;
+	}
+
+	const std::vector<uint8_t> &getBuffer() const {
+		return _buffer;
+	}
+};
+
+void Gltf::append(std::string &array, const char *pFormat, ...) {
+	char element[512];
+
+	va_list args;
+	va_start(args, pFormat);
+	vsnprintf(element, sizeof(element), pFormat, args);
+	va_end(args);
+
+	if (!array.empty())
+		array += ',';
+
+	array += element;
+}
+
+static bool parseOptions(int argc, char **argv, Options *pOptions) {
+	*pOptions = { nullptr, 10000, 16, 16, 8, 256, 256, Layout::Uniform, 1 };
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i < argc - 1;
+
+		if (strcmp("--instances", argv[i]) == 0 && hasValue) {
+			pOptions->instanceCount = atoi(argv[++i]);
+		} else if (strcmp("--meshes", argv[i]) == 0 && hasValue) {
+			pOptions->meshCount = atoi(argv[++i]);
+		} else if (strcmp("--materials", argv[i]) == 0 && hasValue) {
+			pOptions->materialCount = atoi(argv[++i]);
+		} else if (strcmp("--textures", argv[i]) == 0 && hasValue) {
+			pOptions->textureCount = atoi(argv[++i]);
+		} else if (strcmp("--texture-size", argv[i]) == 0 && hasValue) {
+			pOptions->textureSize = atoi(argv[++i]);
+		} else if (strcmp("--lights", argv[i]) == 0 && hasValue) {
+			pOptions->lightCount = atoi(argv[++i]);
+		} else if (strcmp("--seed", argv[i]) == 0 && hasValue) {
+			pOptions->seed = atoi(argv[++i]);
+		} else if (strcmp("--layout", argv[i]) == 0 && hasValue) {
+			const char *pLayout = argv[++i];
+
+			if (strcmp("uniform", pLayout) == 0)
+				pOptions->layout = Layout::Uniform;
+			else if (strcmp("clustered", pLayout) == 0)
+				pOptions->layout = Layout::Clustered;
+			else if (strcmp("city", pLayout) == 0)
+				pOptions->layout = Layout::City;
+			else
+				return false;
+		} else if (argv[i][0] != '-') {
+			pOptions->pOutput = argv[i];
+		}
+	}
+
+	if (pOptions->lightCount > MAX_POINT_LIGHT_COUNT) {
+		fprintf(stderr, "Light count clamped to %u\n", MAX_POINT_LIGHT_COUNT);
+		pOptions->lightCount = MAX_POINT_LIGHT_COUNT;
+	}
+
+	return pOptions->pOutput != nullptr && pOptions->instanceCount > 0 &&
+		   pOptions->instanceCount <= MAX_INSTANCE_COUNT && pOptions->meshCount > 0 &&
+		   pOptions->materialCount > 0 && pOptions->textureSize > 0;
+}
+
+// Triangles of a (columns + 1) x (rows + 1) vertex grid starting at `base`, counter clockwise
+// when the column direction crossed with the row direction points to the front.
+static void gridIndices(MeshData &mesh, uint32_t base, uint32_t columns, uint32_t rows) {
+	uint32_t stride = columns + 1;
+
+	for (uint32_t row = 0; row < rows; row++) {
+		for (uint32_t column = 0; column < columns; column++) {
+			uint32_t i = base + row * stride + column;
+
+			uint32_t quad[6] = { i, i + 1, i + stride, i + 1, i + stride + 1, i + stride };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Unit box standing on the origin, so instance scale sets its footprint and height.
+static MeshData boxCreate(uint32_t subdivisions) {
+	const glm::vec3 NORMALS[6] = {
+		glm::vec3(1.0f, 0.0f, 0.0f),
+		glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f),
+		glm::vec3(0.0f, 0.0f, -1.0f),
+	};
+
+	MeshData mesh;
+
+	for (const glm::vec3 &normal : NORMALS) {
+		glm::vec3 v = normal.y == 0.0f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+		glm::vec3 u = glm::cross(v, normal);
+
+		glm::vec3 center = normal * 0.5f + glm::vec3(0.0f, 0.5f, 0.0f);
+		glm::vec3 origin = center - u * 0.5f - v * 0.5f;
+
+		uint32_t base = mesh.positions.size();
+
+		for (uint32_t row = 0; row <= subdivisions; row++) {
+			for (uint32_t column = 0; column <= subdivisions; column++) {
+				glm::vec2 uv = glm::vec2(column, row) / float(subdivisions);
+
+				mesh.positions.push_back(origin + u * uv.x + v * uv.y);
+				mesh.normals.push_back(normal);
+				mesh.uvs.push_back(uv);
+			}
+		}
+
+		gridIndices(mesh, base, subdivisions, subdivisions);
+	}
+
+	return mesh;
+}
+
+// Sphere of radius 0.5 resting on the origin. With `roughness` the radius is displaced by a few
+// seeded waves and normals are rebuilt from the triangles.
+static MeshData sphereCreate(uint32_t segments, float roughness, Random &random) {
+	uint32_t rings = segments / 2;
+
+	glm::vec3 waveDirections[4];
+	float wavePhases[4];
+
+	for (uint32_t i = 0; i < 4; i++) {
+		waveDirections[i] = random.range3(-4.0f, 4.0f);
+		wavePhases[i] = random.range(0.0f, glm::two_pi<float>());
+	}
+
+	MeshData mesh;
+
+	for (uint32_t ring = 0; ring <= rings; ring++) {
+		for (uint32_t segment = 0; segment <= segments; segment++) {
+			float theta = glm::pi<float>() * ring / rings;
+			float phi = glm::two_pi<float>() * segment / segments;
+
+			glm::vec3 direction(std::sin(theta) * std::cos(phi), std::cos(theta),
+					std::sin(theta) * std::sin(phi));
+
+			// a function of direction only, so seam and pole vertices stay welded
+			float radius = 0.5f;
+			for (uint32_t i = 0; i < 4; i++) {
+				float wave = std::sin(glm::dot(direction, waveDirections[i]) + wavePhases[i]);
+				radius += roughness * wave;
+			}
+
+			mesh.positions.push_back(direction * radius + glm::vec3(0.0f, 0.5f, 0.0f));
+			mesh.normals.push_back(direction);
+			mesh.uvs.push_back(glm::vec2(float(segment) / segments, float(ring) / rings));
+		}
+	}
+
+	gridIndices(mesh, 0, segments, rings);
+
+	if (roughness == 0.0f)
+		return mesh;
+
+	std::vector<glm::vec3> normals(mesh.positions.size(), glm::vec3(0.0f));
+
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+		uint32_t i0 = mesh.indices[i + 0];
+		uint32_t i1 = mesh.indices[i + 1];
+		uint32_t i2 = mesh.indices[i + 2];
+
+		glm::vec3 normal = glm::cross(mesh.positions[i1] - mesh.positions[i0],
+				mesh.positions[i2] - mesh.positions[i0]);
+
+		normals[i0] += normal;
+		normals[i1] += normal;
+		normals[i2] += normal;
+	}
+
+	// pole vertices may only touch degenerate triangles
+	for (size_t i = 0; i < normals.size(); i++) {
+		if (glm::dot(normals[i], normals[i]) > 0.0f)
+			mesh.normals[i] = glm::normalize(normals[i]);
+	}
+
+	return mesh;
+}
+
+static void meshAdd(Gltf &gltf, const MeshData &mesh, uint32_t material) {
+	glm::vec3 min(INFINITY);
+	glm::vec3 max(-INFINITY);
+
+	for (const glm::vec3 &position : mesh.positions) {
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+
+	char bounds[128];
+	snprintf(bounds, sizeof(bounds), ",\"min\":[%.6g,%.6g,%.6g],\"max\":[%.6g,%.6g,%.6g]", min.x,
+			min.y, min.z, max.x, max.y, max.z);
+
+	uint32_t count = mesh.positions.size();
+
+	uint32_t position = gltf.accessorAdd(mesh.positions.data(), sizeof(glm::vec3), count,
+			COMPONENT_FLOAT, "VEC3", TARGET_ARRAY_BUFFER, bounds);
+	uint32_t normal = gltf.accessorAdd(mesh.normals.data(), sizeof(glm::vec3), count,
+			COMPONENT_FLOAT, "VEC3", TARGET_ARRAY_BUFFER);
+	uint32_t uv = gltf.accessorAdd(mesh.uvs.data(), sizeof(glm::vec2), count, COMPONENT_FLOAT,
+			"VEC2", TARGET_ARRAY_BUFFER);
+	uint32_t indices = gltf.accessorAdd(mesh.indices.data(), sizeof(uint32_t),
+			mesh.indices.size(), COMPONENT_UNSIGNED_INT, "SCALAR", TARGET_ELEMENT_ARRAY_BUFFER);
+
+	Gltf::append(gltf.meshes,
+			"{\"primitives\":[{\"attributes\":{\"POSITION\":%u,\"NORMAL\":%u,\"TEXCOORD_0\":%u},"
+			"\"indices\":%u,\"material\":%u}]}",
+			position, normal, uv, indices, material);
+
+	gltf.meshCount++;
+}
+
+static void pngChunk(std::vector<uint8_t> &png, const char *pType, const uint8_t *pData,
+		uint32_t size) {
+	uint8_t header[8] = {
+		uint8_t(size >> 24),
+		uint8_t(size >> 16),
+		uint8_t(size >> 8),
+		uint8_t(size),
+		uint8_t(pType[0]),
+		uint8_t(pType[1]),
+		uint8_t(pType[2]),
+		uint8_t(pType[3]),
+	};
+
+	png.insert(png.end(), header, header + 8);
+	png.insert(png.end(), pData, pData + size);
+
+	// covers type and data
+	uint32_t crc = crc32(0, header + 4, 4);
+	crc = crc32(crc, pData, size);
+
+	uint8_t footer[4] = { uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc) };
+	png.insert(png.end(), footer, footer + 4);
+}
+
+// RGBA8 PNG, each row prefixed with filter type 0.
+static std::vector<uint8_t> pngEncode(const std::vector<uint8_t> &pixels, uint32_t size) {
+	std::vector<uint8_t> rows;
+	rows.reserve(size * (size * 4 + 1));
+
+	for (uint32_t y = 0; y < size; y++) {
+		rows.push_back(0);
+		rows.insert(rows.end(), pixels.begin() + y * size * 4, pixels.begin() + (y + 1) * size * 4);
+	}
+
+	uLongf compressedSize = compressBound(rows.size());
+	std::vector<uint8_t> compressed(compressedSize);
+	compress2(compressed.data(), &compressedSize, rows.data(), rows.size(), Z_BEST_SPEED);
+
+	const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	// width, height, bit depth 8, color type RGBA, default compression, filter and interlace
+	uint8_t header[13] = {
+		uint8_t(size >> 24),
+		uint8_t(size >> 16),
+		uint8_t(size >> 8),
+		uint8_t(size),
+		uint8_t(size >> 24),
+		uint8_t(size >> 16),
+		uint8_t(size >> 8),
+		uint8_t(size),
+		8,
+		6,
+		0,
+		0,
+		0,
+	};
+
+	std::vector<uint8_t> png(SIGNATURE, SIGNATURE + 8);
+	pngChunk(png, "IHDR", header, sizeof(header));
+	pngChunk(png, "IDAT", compressed.data(), compressedSize);
+	pngChunk(png, "IEND", nullptr, 0);
+
+	return png;
+}
+
+// Checkerboard of two seeded colors with per pixel noise.
+static void textureAdd(Gltf &gltf, uint32_t size, Random &random) {
+	glm::vec3 colors[2];
+	for (glm::vec3 &color : colors)
+		color = random.range3(0.0f, 255.0f);
+
+	uint32_t cellSize = std::max(size / (4 << random.index(3)), 1u);
+
+	std::vector<uint8_t> pixels(size * size * 4);
+
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			const glm::vec3 &color = colors[(x / cellSize + y / cellSize) % 2];
+			float noise = random.range(0.9f, 1.0f);
+
+			uint8_t *pPixel = &pixels[(y * size + x) * 4];
+			pPixel[0] = uint8_t(color.r * noise);
+			pPixel[1] = uint8_t(color.g * noise);
+			pPixel[2] = uint8_t(color.b * noise);
+			pPixel[3] = 255;
+		}
+	}
+
+	std::vector<uint8_t> png = pngEncode(pixels, size);
+	uint32_t bufferView = gltf.bufferViewAdd(png.data(), png.size(), 0);
+
+	Gltf::append(gltf.images, "{\"bufferView\":%u,\"mimeType\":\"image/png\"}", bufferView);
+	Gltf::append(gltf.textures, "{\"source\":%u}", gltf.imageCount);
+
+	gltf.imageCount++;
+}
+
+static void nodeAdd(Gltf &gltf, const glm::vec3 &translation, float yaw, const glm::vec3 &scale,
+		const char *pReference) {
+	float halfYaw = yaw * 0.5f;
+
+	Gltf::append(gltf.nodes,
+			"{\"translation\":[%.6g,%.6g,%.6g],\"rotation\":[0,%.6g,0,%.6g],"
+			"\"scale\":[%.6g,%.6g,%.6g],%s}",
+			translation.x, translation.y, translation.z, std::sin(halfYaw), std::cos(halfYaw),
+			scale.x, scale.y, scale.z, pReference);
+
+	char index[16];
+	snprintf(index, sizeof(index), "%u", gltf.nodeCount);
+	Gltf::append(gltf.rootNodes, "%s", index);
+
+	gltf.nodeCount++;
+}
+
+// Returns half the side of the square the instances occupy.
+static float instancesAdd(Gltf &gltf, const Options &options, Random &random) {
+	uint32_t count = options.instanceCount;
+	char reference[32];
+
+	if (options.layout == Layout::City) {
+		// lots in row major order, every (BLOCK_LOTS + 1)th row and column is a street
+		uint32_t side = std::ceil(std::sqrt(float(count)));
+
+		while ((side - side / (BLOCK_LOTS + 1)) * (side - side / (BLOCK_LOTS + 1)) < count)
+			side++;
+
+		float half = side * LOT_SIZE * 0.5f;
+		uint32_t placed = 0;
+
+		// every third mesh is a box
+		uint32_t boxCount = (gltf.meshCount + 2) / 3;
+
+		for (uint32_t z = 0; z < side && placed < count; z++) {
+			for (uint32_t x = 0; x < side && placed < count; x++) {
+				if (x % (BLOCK_LOTS + 1) == BLOCK_LOTS || z % (BLOCK_LOTS + 1) == BLOCK_LOTS)
+					continue;
+
+				// mostly low rise with a few towers
+				float height = 8.0f + 60.0f * std::pow(random.next(), 3.0f);
+				float footprint = LOT_SIZE * random.range(0.6f, 0.9f);
+
+				glm::vec3 position(
+						(x + 0.5f) * LOT_SIZE - half, 0.0f, (z + 0.5f) * LOT_SIZE - half);
+				glm::vec3 scale(footprint, height, footprint);
+
+				snprintf(reference, sizeof(reference), "\"mesh\":%u", placed % boxCount * 3);
+				nodeAdd(gltf, position, 0.0f, scale, reference);
+
+				placed++;
+			}
+		}
+
+		return half;
+	}
+
+	float half = std::sqrt(float(count)) * INSTANCE_SPACING * 0.5f;
+
+	// clusters of about a thousand instances each
+	uint32_t clusterCount = std::max(count / 1000, 1u);
+	float clusterSigma = half / std::sqrt(float(clusterCount)) * 0.25f;
+
+	std::vector<glm::vec2> clusters(clusterCount);
+	for (glm::vec2 &cluster : clusters)
+		cluster = random.range2(-half, half) * 0.8f;
+
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec2 position;
+
+		if (options.layout == Layout::Clustered) {
+			const glm::vec2 &cluster = clusters[random.index(clusterCount)];
+			float x = random.gaussian();
+			float y = random.gaussian();
+
+			position = cluster + glm::vec2(x, y) * clusterSigma;
+		} else {
+			position = random.range2(-half, half);
+		}
+
+		float yaw = random.range(0.0f, glm::two_pi<float>());
+		float scale = random.range(0.5f, 2.0f);
+
+		snprintf(reference, sizeof(reference), "\"mesh\":%u", random.index(gltf.meshCount));
+		nodeAdd(gltf, glm::vec3(position.x, 0.0f, position.y), yaw, glm::vec3(scale), reference);
+	}
+
+	return half;
+}
+
+static void lightsAdd(Gltf &gltf, const Options &options, float half, Random &random) {
+	char reference[64];
+
+	// sun tilted 60 degrees down, directional lights point along -Z
+	Gltf::append(gltf.lights, "{\"type\":\"directional\",\"color\":[1,0.95,0.9],\"intensity\":3}");
+	Gltf::append(gltf.nodes, "{\"rotation\":[-0.5,0,0,0.866025],%s}",
+			"\"extensions\":{\"KHR_lights_punctual\":{\"light\":0}}");
+
+	snprintf(reference, sizeof(reference), "%u", gltf.nodeCount);
+	Gltf::append(gltf.rootNodes, "%s", reference);
+	gltf.nodeCount++;
+
+	float maxHeight = options.layout == Layout::City ? 40.0f : 12.0f;
+
+	for (uint32_t i = 0; i < options.lightCount; i++) {
+		glm::vec3 color = random.range3(0.5f, 1.0f);
+		float intensity = random.range(50.0f, 500.0f);
+		float range = random.range(10.0f, 30.0f);
+
+		Gltf::append(gltf.lights,
+				"{\"type\":\"point\",\"color\":[%.6g,%.6g,%.6g],\"intensity\":%.6g,\"range\":%.6g}",
+				color.r, color.g, color.b, intensity, range);
+
+		glm::vec3 position = random.range3(-half, half);
+		position.y = random.range(2.0f, maxHeight);
+
+		snprintf(reference, sizeof(reference),
+				"\"extensions\":{\"KHR_lights_punctual\":{\"light\":%u}}", i + 1);
+		nodeAdd(gltf, position, 0.0f, glm::vec3(1.0f), reference);
+	}
+}
+
+static std::string jsonCreate(const Gltf &gltf, const std::string &bufferUri) {
+	std::string json;
+	json.reserve(gltf.nodes.size() + gltf.accessors.size() + gltf.bufferViews.size() + 4096);
+
+	json += "{\"asset\":{\"version\":\"2.0\",\"generator\":\"hayaku-scenegen\"},";
+	json += "\"extensionsUsed\":[\"KHR_lights_punctual\"],";
+	json += "\"extensions\":{\"KHR_lights_punctual\":{\"lights\":[" + gltf.lights + "]}},";
+	json += "\"scene\":0,\"scenes\":[{\"nodes\":[" + gltf.rootNodes + "]}],";
+	json += "\"nodes\":[" + gltf.nodes + "],";
+	json += "\"meshes\":[" + gltf.meshes + "],";
+	json += "\"materials\":[" + gltf.materials + "],";
+
+	if (!gltf.textures.empty()) {
+		json += "\"textures\":[" + gltf.textures + "],";
+		json += "\"images\":[" + gltf.images + "],";
+	}
+
+	json += "\"accessors\":[" + gltf.accessors + "],";
+	json += "\"bufferViews\":[" + gltf.bufferViews + "],";
+
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "{\"byteLength\":%zu", gltf.getBuffer().size());
+	json += "\"buffers\":[" + std::string(buffer);
+
+	if (!bufferUri.empty())
+		json += ",\"uri\":\"" + bufferUri + "\"";
+
+	json += "}]}";
+
+	return json;
+}
+
+static bool writeFile(const std::filesystem::path &path, const std::vector<const void *> &parts,
+		const std::vector<size_t> &sizes) {
+	FILE *pFile = fopen(path.c_str(), "wb");
+
+	if (pFile == nullptr) {
+		fprintf(stderr, "Failed to open output: %s\n", path.c_str());
+		return false;
+	}
+
+	for (size_t i = 0; i < parts.size(); i++)
+		fwrite(parts[i], 1, sizes[i], pFile);
+
+	fclose(pFile);
+	return true;
+}
+
+static bool writeGlb(const std::filesystem::path &path, const Gltf &gltf) {
+	std::string json = jsonCreate(gltf, "");
+	std::vector<uint8_t> buffer = gltf.getBuffer();
+
+	// chunks are 4 byte aligned, JSON with spaces and binary with zeros
+	while (json.size() % 4 != 0)
+		json += ' ';
+
+	while (buffer.size() % 4 != 0)
+		buffer.push_back(0);
+
+	uint32_t jsonHeader[2] = { uint32_t(json.size()), GLB_CHUNK_JSON };
+	uint32_t binHeader[2] = { uint32_t(buffer.size()), GLB_CHUNK_BIN };
+	uint32_t header[3] = { GLB_MAGIC, 2, uint32_t(12 + 8 + json.size() + 8 + buffer.size()) };
+
+	return writeFile(path, { header, jsonHeader, json.data(), binHeader, buffer.data() },
+			{ sizeof(header), sizeof(jsonHeader), json.size(), sizeof(binHeader), buffer.size() });
+}
+
+static bool writeGltf(const std::filesystem::path &path, const Gltf &gltf) {
+	std::filesystem::path bufferPath = path;
+	bufferPath.replace_extension(".bin");
+
+	const std::vector<uint8_t> &buffer = gltf.getBuffer();
+	std::string json = jsonCreate(gltf, bufferPath.filename().string());
+
+	return writeFile(bufferPath, { buffer.data() }, { buffer.size() }) &&
+		   writeFile(path, { json.data() }, { json.size() });
+}
+
+int main(int argc, char **argv) {
+	Options options;
+
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(stderr,
+				"usage: hayaku-scenegen <output.gltf|output.glb> [--instances 1..%u] [--meshes N] "
+				"[--materials N] [--textures N] [--texture-size N] [--lights 0..%u] "
+				"[--layout uniform|clustered|city] [--seed N]\n",
+				MAX_INSTANCE_COUNT, MAX_POINT_LIGHT_COUNT);
+		return 1;
+	}
+
+	Random random(options.seed);
+	Gltf gltf;
+
+	for (uint32_t i = 0; i < options.textureCount; i++)
+		textureAdd(gltf, options.textureSize, random);
+
+	for (uint32_t i = 0; i < options.materialCount; i++) {
+		glm::vec3 tint = random.range3(0.7f, 1.0f);
+		float metallic = random.next() < 0.2f ? 1.0f : 0.0f;
+		float roughness = random.range(0.2f, 0.9f);
+
+		char texture[48] = "";
+		if (options.textureCount > 0)
+			snprintf(texture, sizeof(texture), ",\"baseColorTexture\":{\"index\":%u}",
+					i % options.textureCount);
+
+		Gltf::append(gltf.materials,
+				"{\"pbrMetallicRoughness\":{\"baseColorFactor\":[%.6g,%.6g,%.6g,1],"
+				"\"metallicFactor\":%.6g,\"roughnessFactor\":%.6g%s}}",
+				tint.r, tint.g, tint.b, metallic, roughness, texture);
+	}
+
+	// starts with a box, the city layout builds with boxes only
+	for (uint32_t i = 0; i < options.meshCount; i++) {
+		MeshData mesh;
+
+		switch (i % 3) {
+			case 0:
+				mesh = boxCreate(1 + random.index(8));
+				break;
+			case 1:
+				mesh = sphereCreate(8 + 2 * random.index(12), 0.0f, random);
+				break;
+			case 2:
+				mesh = sphereCreate(16 + 2 * random.index(16), 0.04f, random);
+				break;
+		}
+
+		meshAdd(gltf, mesh, i % options.materialCount);
+	}
+
+	float half = instancesAdd(gltf, options, random);
+	lightsAdd(gltf, options, half, random);
+
+	std::filesystem::path path(options.pOutput);
+	bool isWritten = path.extension() == ".glb" ? writeGlb(path, gltf) : writeGltf(path, gltf);
+
+	if (!isWritten)
+		return 1;
+
+	printf("Wrote %s: %u instances, %u meshes, %u materials, %u textures, %u lights, %.0f m wide\n",
+			options.pOutput, options.instanceCount, options.meshCount, options.materialCount,
+			options.textureCount, options.lightCount, half * 2.0f);
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <transform_hierarchy.h>
+
+// Updates a 100k node hierarchy with 1% of local transforms changed per frame, compared to
+// recomputing every node.
+
+const uint32_t NODE_COUNT = 100000;
+const uint32_t MAX_DEPTH = 6;
+const float CHANGED_FRACTION = 0.01f;
+
+const uint32_t WARMUP_FRAMES = 10;
+const uint32_t FRAMES = 200;
+
+static glm::mat4 randomTransform(std::mt19937 &rng) {
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	glm::vec3 translation(distribution(rng), distribution(rng), distribution(rng));
+	glm::vec3 axis = glm::normalize(glm::vec3(distribution(rng), distribution(rng), 1.0f));
+
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation);
+	return glm::rotate(transform, distribution(rng), axis);
+}
+
+static void printStats(const char *pName, std::vector<double> &times) {
+	std::sort(times.begin(), times.end());
+
+	double sum = 0.0;
+	for (double time : times)
+		sum += time;
+
+	printf("%-12s min %8.3f ms  median %8.3f ms  avg %8.3f ms  max %8.3f ms\n", pName,
+			times.front(), times[times.size() / 2], sum / times.size(), times.back());
+}
+
+int main() {
+	std::mt19937 rng(0);
+
+	TransformHierarchy hierarchy;
+	std::vector<uint32_t> depths;
+
+	for (uint32_t i = 0; i < NODE_COUNT; i++) {
+		uint32_t parent = NO_PARENT;
+
+		// roughly 1 in 16 nodes is a root, others attach to an earlier node within depth limit
+		if (i > 0 && rng() % 16 != 0) {
+			parent = rng() % i;
+
+			while (depths[parent] + 1 >= MAX_DEPTH)
+				parent = hierarchy.getParent(parent);
+		}
+
+		depths.push_back(parent == NO_PARENT ? 0 : depths[parent] + 1);
+		hierarchy.add(parent, randomTransform(rng));
+	}
+
+	hierarchy.update();
+
+	uint32_t changedCount = static_cast<uint32_t>(NODE_COUNT * CHANGED_FRACTION);
+
+	std::vector<double> incremental;
+	std::vector<double> full;
+
+	std::vector<uint32_t> recomputed;
+
+	for (uint32_t frame = 0; frame < WARMUP_FRAMES + FRAMES; frame++) {
+		for (uint32_t i = 0; i < changedCount; i++) {
+			uint32_t node = rng() % NODE_COUNT;
+			hierarchy.setLocalTransform(node, randomTransform(rng));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		hierarchy.update();
+		auto end = std::chrono::steady_clock::now();
+
+		recomputed.push_back(static_cast<uint32_t>(hierarchy.getChanged().size()));
+
+		if (frame >= WARMUP_FRAMES)
+			incremental.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+
+	for (uint32_t frame = 0; frame < WARMUP_FRAMES + FRAMES; frame++) {
+		for (uint32_t node = 0; node < NODE_COUNT; node++)
+			hierarchy.setLocalTransform(node, hierarchy.getLocalTransform(node));
+
+		auto start = std::chrono::steady_clock::now();
+		hierarchy.update();
+		auto end = std::chrono::steady_clock::now();
+
+		if (frame >= WARMUP_FRAMES)
+			full.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+
+	uint64_t recomputedSum = 0;
+	for (uint32_t count : recomputed)
+		recomputedSum += count;
+
+	printf("%u nodes, %u changed per frame, %llu recomputed on average\n", NODE_COUNT,
+			changedCount, (unsigned long long)(recomputedSum / recomputed.size()));
+
+	printStats("incremental", incremental);
+	printStats("full", full);
+
+	return 0;
+}
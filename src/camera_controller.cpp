@@ -57,6 +57,10 @@ void CameraController::update(float deltaTime) {
 	_move(velocity);
 }
 
+const glm::mat4 &CameraController::getTransform() const {
+	return _transform;
+}
+
 CameraController::CameraController() {
 	_update();
 }
@@ -22,6 +22,9 @@ private:
 public:
 	void update(float deltaTime);
 
+	// As last passed to RS::cameraSetTransform.
+	const glm::mat4 &getTransform() const;
+
 	CameraController();
 };
 
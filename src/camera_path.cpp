@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <SDL3/SDL_log.h>
+#include <SDL3/SDL_timer.h>
+
+#include "rendering/rendering_device.h"
+#include "rendering/rendering_server.h"
+
+#include "camera_path.h"
+
+void CameraPath::record(double time, const glm::mat4 &transform) {
+	_keys.push_back({ time, transform });
+}
+
+glm::mat4 CameraPath::sample(double time) const {
+	if (_keys.empty())
+		return glm::mat4(1.0f);
+
+	auto next = std::upper_bound(_keys.begin(), _keys.end(), time,
+			[](double time, const Key &key) { return time < key.time; });
+
+	if (next == _keys.begin())
+		return _keys.front().transform;
+
+	if (next == _keys.end())
+		return _keys.back().transform;
+
+	const Key &a = *(next - 1);
+	const Key &b = *next;
+
+	float weight = static_cast<float>((time - a.time) / (b.time - a.time));
+
+	// camera transforms carry no scale
+	glm::quat rotation = glm::slerp(
+			glm::quat_cast(glm::mat3(a.transform)), glm::quat_cast(glm::mat3(b.transform)), weight);
+	glm::vec3 translation = glm::mix(glm::vec3(a.transform[3]), glm::vec3(b.transform[3]), weight);
+
+	glm::mat4 transform = glm::mat4_cast(rotation);
+	transform[3] = glm::vec4(translation, 1.0f);
+
+	return transform;
+}
+
+double CameraPath::getDuration() const {
+	if (_keys.empty())
+		return 0.0;
+
+	return _keys.back().time - _keys.front().time;
+}
+
+bool CameraPath::isEmpty() const {
+	return _keys.empty();
+}
+
+bool CameraPath::load(const char *pPath) {
+	FILE *pFile = fopen(pPath, "r");
+
+	if (pFile == nullptr) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Opening camera path (%s) failed", pPath);
+		return false;
+	}
+
+	_keys.clear();
+
+	Key key;
+	float *pValues = &key.transform[0][0];
+
+	bool isValid = true;
+
+	while (isValid && fscanf(pFile, "%lf", &key.time) == 1) {
+		for (uint32_t i = 0; i < 16; i++)
+			isValid = isValid && fscanf(pFile, "%f", &pValues[i]) == 1;
+
+		if (isValid)
+			_keys.push_back(key);
+	}
+
+	isValid = isValid && feof(pFile) && !_keys.empty();
+	fclose(pFile);
+
+	if (!isValid) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Reading camera path (%s) failed", pPath);
+		_keys.clear();
+		return false;
+	}
+
+	// recordings may start at any time
+	double start = _keys.front().time;
+	for (Key &key : _keys)
+		key.time -= start;
+
+	SDL_Log("Loaded camera path: %s, %zu keys, %.2f s", pPath, _keys.size(), getDuration());
+	return true;
+}
+
+bool CameraPath::save(const char *pPath) const {
+	FILE *pFile = fopen(pPath, "w");
+
+	if (pFile == nullptr) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Opening camera path (%s) failed", pPath);
+		return false;
+	}
+
+	for (const Key &key : _keys) {
+		const float *pValues = &key.transform[0][0];
+
+		// enough digits to read back the same values
+		fprintf(pFile, "%.17g", key.time);
+		for (uint32_t i = 0; i < 16; i++)
+			fprintf(pFile, " %.9g", pValues[i]);
+
+		fprintf(pFile, "\n");
+	}
+
+	fclose(pFile);
+	return true;
+}
+
+bool CameraPathPlayback::load(const char *pPath, double step) {
+	if (!_path.load(pPath) || step <= 0.0)
+		return false;
+
+	_step = step;
+	_frame = 0;
+	_frameCount = static_cast<uint32_t>(_path.getDuration() / step) + 1;
+
+	_timings.assign(_frameCount, { 0.0, 0.0, -1.0 });
+	return true;
+}
+
+void CameraPathPlayback::frameBegin() {
+	if (_frame == 0) {
+		GpuProfiler &gpuProfiler = RD::getSingleton().getGpuProfiler();
+
+		_gpuFrameOffset = gpuProfiler.getFrameCount();
+		_collectedFrameCount = gpuProfiler.getCollectedFrameCount();
+	}
+
+	// past the end the camera holds still while the last GPU results come in
+	uint32_t step = std::min(_frame, _frameCount - 1);
+	RS::getSingleton().cameraSetTransform(_path.sample(step * _step));
+
+	_start = SDL_GetPerformanceCounter();
+}
+
+void CameraPathPlayback::frameEnd() {
+	uint64_t end = SDL_GetPerformanceCounter();
+
+	if (_frame < _frameCount) {
+		Timing &timing = _timings[_frame];
+		timing.time = _frame * _step;
+		timing.cpuTime = (end - _start) * 1000.0 / SDL_GetPerformanceFrequency();
+	}
+
+	GpuProfiler &gpuProfiler = RD::getSingleton().getGpuProfiler();
+
+	if (gpuProfiler.getCollectedFrameCount() != _collectedFrameCount) {
+		_collectedFrameCount = gpuProfiler.getCollectedFrameCount();
+
+		uint64_t index = gpuProfiler.getFrameTimeIndex();
+
+		if (index >= _gpuFrameOffset && index - _gpuFrameOffset < _frameCount)
+			_timings[index - _gpuFrameOffset].gpuTime = gpuProfiler.getFrameTime();
+	}
+
+	_frame++;
+}
+
+bool CameraPathPlayback::isFinished() const {
+	// a frame's GPU time is read back when its slot is reused
+	return _frame >= _frameCount + RD::getSingleton().getFramesInFlight();
+}
+
+bool CameraPathPlayback::writeTimings(const char *pPath) const {
+	FILE *pFile = stdout;
+
+	if (pPath != nullptr) {
+		pFile = fopen(pPath, "w");
+
+		if (pFile == nullptr) {
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Opening timings (%s) failed", pPath);
+			return false;
+		}
+	}
+
+	fprintf(pFile, "frame,time_s,cpu_ms,gpu_ms\n");
+
+	for (uint32_t i = 0; i < _frameCount; i++) {
+		const Timing &timing = _timings[i];
+
+		if (timing.gpuTime < 0.0)
+			fprintf(pFile, "%u,%.6f,%.4f,\n", i, timing.time, timing.cpuTime);
+		else
+			fprintf(pFile, "%u,%.6f,%.4f,%.4f\n", i, timing.time, timing.cpuTime, timing.gpuTime);
+	}
+
+	if (pFile != stdout)
+		fclose(pFile);
+
+	return true;
+}
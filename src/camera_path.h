@@ -0,0 +1,76 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Camera transforms, as passed to RS::cameraSetTransform, keyed by time in seconds. Saved as text,
+// one key per line: the time followed by the 16 floats of the column major transform.
+class CameraPath {
+private:
+	typedef struct {
+		double time;
+		glm::mat4 transform;
+	} Key;
+
+	std::vector<Key> _keys;
+
+public:
+	// Times must not decrease.
+	void record(double time, const glm::mat4 &transform);
+
+	// Interpolates position and rotation between the surrounding keys, clamped to the ends.
+	glm::mat4 sample(double time) const;
+
+	double getDuration() const;
+	bool isEmpty() const;
+
+	// Shifts keys to start at time 0.
+	bool load(const char *pPath);
+	bool save(const char *pPath) const;
+};
+
+// Plays a path back one fixed step per frame, independent of how long frames take, and times
+// every frame so two builds can be compared frame by frame along the same flythrough.
+//
+// CPU time spans frameBegin() to frameEnd(). GPU time comes from the GpuProfiler, so it's only
+// measured while GPU timing is required or the Profiler is enabled.
+class CameraPathPlayback {
+private:
+	typedef struct {
+		double time;
+		double cpuTime;
+		// negative when not measured
+		double gpuTime;
+	} Timing;
+
+	CameraPath _path;
+	double _step = 0.0;
+
+	uint32_t _frame = 0;
+	uint32_t _frameCount = 0;
+	uint64_t _start = 0;
+
+	// GPU frames recorded before playback started and the results read back so far
+	uint64_t _gpuFrameOffset = 0;
+	uint64_t _collectedFrameCount = 0;
+
+	std::vector<Timing> _timings;
+
+public:
+	bool load(const char *pPath, double step);
+
+	// Moves the camera to the frame's position on the path.
+	void frameBegin();
+	void frameEnd();
+
+	// True once every step was drawn and the GPU times of the last ones were read back.
+	bool isFinished() const;
+
+	// CSV of frame, path time in seconds, CPU and GPU time in milliseconds, stdout when null.
+	bool writeTimings(const char *pPath) const;
+};
+
+#endif // !CAMERA_PATH_H
@@ -20,13 +20,24 @@
 
 #include <SDL3/SDL_log.h>
 
+#include <load_profiler.h>
+#include <profiler.h>
+
 #include "image_loader.h"
 #include "mesh.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+#include "vertex_welder.h"
 
 #include "asset_loader.h"
 
 const float CANDELA_TO_LUMEN = 12.5663706144; // PI * 4
 
+// below this simplification stops, small meshes are cheap enough at full detail
+const uint32_t LOD_MIN_TRIANGLE_COUNT = 256;
+// a level that keeps more than this fraction of its parent is not worth the memory
+const float LOD_MAX_REDUCTION = 0.9f;
+
 using namespace AssetLoader;
 
 glm::mat4 _extractTransform(const fastgltf::Node &node, const glm::mat4 &base = glm::mat4(1.0f)) {
@@ -45,7 +56,7 @@ glm::mat4 _extractTransform(const fastgltf::Node &node, const glm::mat4 &base =
 	return base;
 }
 
-std::shared_ptr<Image> _loadImage(const fastgltf::Asset &asset, const fastgltf::Image &image,
+std::shared_ptr<Image> _decodeImage(const fastgltf::Asset &asset, const fastgltf::Image &image,
 		const std::filesystem::path &directory) {
 	const fastgltf::sources::URI *pFile = std::get_if<fastgltf::sources::URI>(&image.data);
 
@@ -80,47 +91,45 @@ std::shared_ptr<Image> _loadImage(const fastgltf::Asset &asset, const fastgltf::
 	return nullptr;
 }
 
-void _generateTangents(const IndexArray &indices, VertexArray &vertices) {
-	assert(indices.count % 3 == 0);
+std::shared_ptr<Image> _loadImage(const fastgltf::Asset &asset, const fastgltf::Image &image,
+		const std::filesystem::path &directory) {
+	LoadPhase phase("Image decode", image.name.c_str());
 
-	uint32_t averageCount = vertices.count;
-	float *pAverage = (float *)calloc(averageCount, sizeof(float));
+	std::shared_ptr<Image> decoded = _decodeImage(asset, image, directory);
 
-	for (size_t i = 0; i < indices.count; i += 3) {
-		Vertex &v0 = vertices.pData[indices.pData[i + 0]];
-		Vertex &v1 = vertices.pData[indices.pData[i + 1]];
-		Vertex &v2 = vertices.pData[indices.pData[i + 2]];
+	if (decoded != nullptr)
+		phase.addBytes(decoded->getByteSize());
 
-		glm::vec3 pos0 = v0.position;
-		glm::vec3 pos1 = v1.position;
-		glm::vec3 pos2 = v2.position;
+	return decoded;
+}
 
-		glm::vec2 uv0 = v0.uv;
-		glm::vec2 uv1 = v1.uv;
-		glm::vec2 uv2 = v2.uv;
+uint32_t _generateLods(const IndexArray &indices, const VertexArray &vertices,
+		IndexArray (&lods)[MAX_LOD_COUNT - 1]) {
+	uint32_t lodCount = 0;
+	const IndexArray *pSource = &indices;
 
-		glm::vec3 deltaPos1 = pos1 - pos0;
-		glm::vec3 deltaPos2 = pos2 - pos0;
+	for (uint32_t i = 1; i < MAX_LOD_COUNT; i++) {
+		uint32_t targetIndexCount = (indices.count >> i) / 3 * 3;
 
-		glm::vec2 deltaUV1 = uv1 - uv0;
-		glm::vec2 deltaUV2 = uv2 - uv0;
+		if (targetIndexCount < LOD_MIN_TRIANGLE_COUNT * 3)
+			break;
 
-		float r = 1.0 / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-		glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+		// each level simplifies the previous one, which is cheaper than starting from full detail
+		uint32_t *pData = (uint32_t *)malloc(pSource->count * sizeof(uint32_t));
+		uint32_t count = MeshSimplifier::simplify(pData, *pSource, vertices, targetIndexCount);
 
-		v0.tangent += tangent;
-		v1.tangent += tangent;
-		v2.tangent += tangent;
+		if (count > pSource->count * LOD_MAX_REDUCTION) {
+			free(pData);
+			break;
+		}
 
-		pAverage[indices.pData[i + 0]] += 1.0;
-		pAverage[indices.pData[i + 1]] += 1.0;
-		pAverage[indices.pData[i + 2]] += 1.0;
+		pData = (uint32_t *)realloc(pData, count * sizeof(uint32_t));
+		lods[lodCount] = { pData, count };
+		pSource = &lods[lodCount];
+		lodCount++;
 	}
 
-	for (uint32_t i = 0; i < averageCount; i++) {
-		float denom = 1.0 / pAverage[i];
-		vertices.pData[i].tangent *= denom;
-	}
+	return lodCount;
 }
 
 Mesh _loadMesh(const fastgltf::Asset &asset, const fastgltf::Mesh &mesh) {
@@ -151,15 +160,16 @@ Mesh _loadMesh(const fastgltf::Asset &asset, const fastgltf::Mesh &mesh) {
 			if (!positionAccessor.bufferViewIndex.has_value())
 				continue;
 
-			vertices.pData = (Vertex *)malloc(positionAccessor.count * sizeof(Vertex));
-			vertices.count = positionAccessor.count;
+			size_t count = positionAccessor.count;
 
-			fastgltf::iterateAccessorWithIndex<glm::vec3>(
-					asset, positionAccessor, [&](const glm::vec3 &position, size_t idx) {
-						vertices.pData[idx].position = position;
+			vertices.pPositions = (glm::vec3 *)malloc(count * sizeof(glm::vec3));
+			vertices.pAttributes = (VertexAttribute *)calloc(count, sizeof(VertexAttribute));
+			vertices.count = count;
 
-						// initialize tangent
-						vertices.pData[idx].tangent = glm::vec3(0.0);
+			// attributes are zero initialized, including tangent
+			fastgltf::iterateAccessorWithIndex<glm::vec3>(asset, positionAccessor,
+					[&](const glm::vec3 &position, size_t idx) {
+						vertices.pPositions[idx] = position;
 					});
 		}
 
@@ -173,44 +183,83 @@ Mesh _loadMesh(const fastgltf::Asset &asset, const fastgltf::Mesh &mesh) {
 			if (strcmp(pName, "NORMAL") == 0) {
 				fastgltf::iterateAccessorWithIndex<glm::vec3>(
 						asset, accessor, [&](const glm::vec3 &normal, size_t idx) {
-							vertices.pData[idx].normal = normal;
+							vertices.pAttributes[idx].normal = normal;
 						});
 			}
 
 			if (strcmp(pName, "TEXCOORD_0") == 0) {
 				fastgltf::iterateAccessorWithIndex<glm::vec2>(
 						asset, accessor, [&](const glm::vec2 &texCoord, size_t idx) {
-							vertices.pData[idx].uv = texCoord;
+							vertices.pAttributes[idx].uv = texCoord;
 						});
 			}
 		}
 
-		_generateTangents(indices, vertices);
+		{
+			LoadPhase phase("Tangents", mesh.name.c_str());
+			phase.addBytes(vertices.count * sizeof(VertexAttribute));
+
+			generateTangents(indices, vertices);
+		}
+
+		{
+			LoadPhase phase("Weld", mesh.name.c_str());
+
+			uint32_t vertexCount = vertices.count;
+			uint32_t weldedCount = VertexWelder::weld(indices, vertices);
+
+			size_t vertexSize = sizeof(glm::vec3) + sizeof(VertexAttribute);
+			size_t savedBytes = (vertexCount - weldedCount) * vertexSize;
+
+			SDL_LogVerbose(SDL_LOG_CATEGORY_APPLICATION,
+					"Mesh %s: welded %u -> %u vertices, %zu bytes saved", mesh.name.c_str(),
+					vertexCount, weldedCount, savedBytes);
+		}
 
 		uint64_t materialIndex = primitive.materialIndex.value_or(0);
 
-		pPrimitives[idx] = {
-			vertices,
-			indices,
-			materialIndex,
-		};
+		Primitive &_primitive = pPrimitives[idx];
+		_primitive.vertices = vertices;
+		_primitive.indices = indices;
+		_primitive.materialIndex = materialIndex;
+
+		{
+			LoadPhase phase("LODs", mesh.name.c_str());
+			_primitive.lodCount = _generateLods(indices, vertices, _primitive.lods);
+		}
+
+		{
+			LoadPhase phase("Meshlets", mesh.name.c_str());
+			_primitive.meshlets[0] = MeshletBuilder::build(_primitive.indices, vertices);
+
+			for (uint32_t lod = 0; lod < _primitive.lodCount; lod++) {
+				_primitive.meshlets[lod + 1] =
+						MeshletBuilder::build(_primitive.lods[lod], vertices);
+			}
+		}
+
+		if (_primitive.lodCount > 0) {
+			const IndexArray &coarsest = _primitive.lods[_primitive.lodCount - 1];
+			SDL_LogVerbose(SDL_LOG_CATEGORY_APPLICATION,
+					"Mesh %s: %u LODs, %u -> %u triangles", mesh.name.c_str(),
+					_primitive.lodCount + 1, indices.count / 3, coarsest.count / 3);
+		}
 
 		idx++;
 	}
 
-	const char *pName = mesh.name.c_str();
-
+	// asset is freed once loading finishes, keep own copy of the name
 	return {
 		pPrimitives,
 		primitiveCount,
-		pName,
+		std::string(mesh.name),
 	};
 }
 
-Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
-	fastgltf::Parser parser(fastgltf::Extensions::KHR_lights_punctual);
+fastgltf::Expected<fastgltf::Asset> _parseGltf(fastgltf::Parser &parser,
+		fastgltf::GltfDataBuffer &data, const std::filesystem::path &file) {
+	LoadPhase phase("Parse", file.filename().c_str());
 
-	fastgltf::GltfDataBuffer data;
 	data.loadFromFile(file);
 
 	fastgltf::Options options = fastgltf::Options::LoadExternalBuffers |
@@ -220,6 +269,29 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 	std::filesystem::path assetRoot = file.parent_path();
 	fastgltf::Expected<fastgltf::Asset> result = parser.loadGltf(&data, assetRoot, options);
 
+	if (result.error() == fastgltf::Error::None) {
+		uint64_t bytes = data.getBufferSize();
+
+		// a GLB carries its buffer, a glTF loads external ones
+		if (file.extension() != ".glb") {
+			for (const fastgltf::Buffer &buffer : result.get().buffers)
+				bytes += buffer.byteLength;
+		}
+
+		phase.addBytes(bytes);
+	}
+
+	return result;
+}
+
+Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
+	PROFILE_SCOPE("AssetLoader::loadGltf");
+
+	fastgltf::Parser parser(fastgltf::Extensions::KHR_lights_punctual);
+	fastgltf::GltfDataBuffer data;
+
+	fastgltf::Expected<fastgltf::Asset> result = _parseGltf(parser, data, file);
+
 	if (fastgltf::Error err = result.error(); err != fastgltf::Error::None) {
 		const char *pMsg = fastgltf::getErrorMessage(err).data();
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Asset loading failed: %s", pMsg);
@@ -241,7 +313,9 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 			std::shared_ptr<Image> albedoMap(_loadImage(asset, image, file.parent_path()));
 
 			if (albedoMap != nullptr) {
+				LoadPhase phase("Image convert", image.name.c_str());
 				albedoMap->convert(Image::Format::RGBA8);
+				phase.addBytes(albedoMap->getByteSize());
 
 				uint32_t idx = scene.images.size();
 				scene.images.push_back(albedoMap);
@@ -256,7 +330,9 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 			std::shared_ptr<Image> normalMap(_loadImage(asset, image, file.parent_path()));
 
 			if (normalMap != nullptr) {
+				LoadPhase phase("Image convert", image.name.c_str());
 				normalMap->convert(Image::Format::RG8);
+				phase.addBytes(normalMap->getByteSize());
 
 				uint32_t idx = scene.images.size();
 				scene.images.push_back(normalMap);
@@ -273,10 +349,13 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 					_loadImage(asset, image, file.parent_path()));
 
 			if (_metallicRoughnessimage != nullptr) {
+				LoadPhase phase("Image convert", image.name.c_str());
+
 				{
 					// metallic in blue channel
 					std::shared_ptr<Image> metallicMap(
 							_metallicRoughnessimage->getComponent(Image::Channel::B));
+					phase.addBytes(metallicMap->getByteSize());
 
 					uint32_t idx = scene.images.size();
 					scene.images.push_back(metallicMap);
@@ -288,6 +367,7 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 					// roughness in green channel
 					std::shared_ptr<Image> roughnessMap(
 							_metallicRoughnessimage->getComponent(Image::Channel::G));
+					phase.addBytes(roughnessMap->getByteSize());
 
 					uint32_t idx = scene.images.size();
 					scene.images.push_back(roughnessMap);
@@ -301,18 +381,67 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 	}
 
 	for (const fastgltf::Mesh &mesh : asset.meshes) {
+		LoadPhase phase("Mesh load", mesh.name.c_str());
+
 		Mesh _mesh = _loadMesh(asset, mesh);
 		scene.meshes.push_back(_mesh);
+
+		phase.addBytes(meshGetByteSize(_mesh));
 	}
 
-	for (const fastgltf::Node &node : asset.nodes) {
+	// Nodes are emitted breadth first from the roots, which keeps parents before children and
+	// every depth level contiguous.
+	std::vector<size_t> order;
+	std::vector<std::optional<uint64_t>> parents(asset.nodes.size());
+
+	{
+		std::vector<bool> hasParent(asset.nodes.size(), false);
+
+		for (const fastgltf::Node &node : asset.nodes) {
+			for (size_t child : node.children)
+				hasParent[child] = true;
+		}
+
+		for (size_t i = 0; i < asset.nodes.size(); i++) {
+			if (!hasParent[i])
+				order.push_back(i);
+		}
+
+		for (size_t i = 0; i < order.size(); i++) {
+			for (size_t child : asset.nodes[order[i]].children) {
+				parents[child] = order[i];
+				order.push_back(child);
+			}
+		}
+	}
+
+	// glTF node index -> emitted node index
+	std::vector<uint64_t> nodeIndices(asset.nodes.size());
+
+	for (size_t nodeIndex : order) {
+		const fastgltf::Node &node = asset.nodes[nodeIndex];
+
 		glm::mat4 transform = _extractTransform(node);
 		std::string name = node.name.c_str();
 
+		std::optional<uint64_t> parentIndex = {};
+
+		if (parents[nodeIndex].has_value())
+			parentIndex = nodeIndices[parents[nodeIndex].value()];
+
+		uint64_t index = scene.nodes.size();
+		nodeIndices[nodeIndex] = index;
+
+		scene.nodes.push_back({
+				transform,
+				parentIndex,
+				name,
+		});
+
 		const fastgltf::Optional<size_t> &meshIndex = node.meshIndex;
 		if (meshIndex.has_value()) {
 			MeshInstance meshInstance = {
-				transform,
+				index,
 				node.meshIndex.value(),
 				name,
 			};
@@ -343,7 +472,7 @@ Scene AssetLoader::loadGltf(const std::filesystem::path &file) {
 			}
 
 			Light _light = {
-				transform,
+				index,
 				lightType,
 				color,
 				intensity,
@@ -28,14 +28,21 @@ struct Material {
 	std::string name;
 };
 
-struct MeshInstance {
+// Parents are stored before their children.
+struct Node {
 	glm::mat4 transform;
+	std::optional<uint64_t> parentIndex;
+	std::string name;
+};
+
+struct MeshInstance {
+	uint64_t nodeIndex;
 	uint64_t meshIndex;
 	std::string name;
 };
 
 struct Light {
-	glm::mat4 transform;
+	uint64_t nodeIndex;
 	LightType type;
 
 	glm::vec3 color;
@@ -49,12 +56,16 @@ struct Scene {
 	std::vector<std::shared_ptr<Image>> images;
 	std::vector<Material> materials;
 	std::vector<Mesh> meshes;
+	std::vector<Node> nodes;
 	std::vector<MeshInstance> meshInstances;
 	std::vector<Light> lights;
 };
 
 Scene loadGltf(const std::filesystem::path &file);
 
+// Averages per triangle tangents from positions and UVs into the vertex attributes.
+void generateTangents(const IndexArray &indices, VertexArray &vertices);
+
 } // namespace AssetLoader
 
 #endif // !ASSET_LOADER_H
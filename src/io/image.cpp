@@ -209,6 +209,10 @@ std::vector<uint8_t> Image::getData() const {
 	return _data;
 }
 
+size_t Image::getByteSize() const {
+	return _data.size();
+}
+
 Image::Image(uint32_t width, uint32_t height, Format format, const std::vector<uint8_t> &data) {
 	_width = width;
 	_height = height;
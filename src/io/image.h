@@ -38,6 +38,7 @@ public:
 	uint32_t getHeight() const;
 	Format getFormat() const;
 	std::vector<uint8_t> getData() const;
+	size_t getByteSize() const;
 
 	Image(uint32_t width, uint32_t height, Format format, const std::vector<uint8_t> &data);
 };
@@ -9,6 +9,8 @@
 #include <SDL3/SDL_iostream.h>
 #include <SDL3/SDL_log.h>
 
+#include <profiler.h>
+
 #include "image_loader.h"
 
 #define STBI_FAILURE 0
@@ -213,6 +215,8 @@ bool ImageLoader::isImage(const char *pFile) {
 }
 
 std::shared_ptr<Image> ImageLoader::loadFromFile(const char *pFile) {
+	PROFILE_SCOPE("ImageLoader::loadFromFile");
+
 	size_t bufferSize;
 	uint8_t *pBuffer = static_cast<uint8_t *>(SDL_LoadFile(pFile, &bufferSize));
 
@@ -236,6 +240,8 @@ std::shared_ptr<Image> ImageLoader::loadFromFile(const char *pFile) {
 }
 
 std::shared_ptr<Image> ImageLoader::loadFromMemory(const uint8_t *pBuffer, size_t bufferSize) {
+	PROFILE_SCOPE("ImageLoader::loadFromMemory");
+
 	int w, h, c;
 	int result = stbi_info_from_memory(pBuffer, bufferSize, &w, &h, &c);
 
@@ -1,11 +1,23 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <cstddef>
 #include <cstdint>
+#include <string>
+
 #include <rendering/types/vertex.h>
 
+// Full detail mesh plus simplified levels at 50%, 25%, 12.5% and 6.25% of its triangles.
+const uint32_t MAX_LOD_COUNT = 5;
+
+// Meshlet limits, one compute workgroup culls one meshlet.
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Structure of arrays: both streams hold `count` elements.
 typedef struct {
-	Vertex *pData;
+	glm::vec3 *pPositions;
+	VertexAttribute *pAttributes;
 	uint32_t count;
 } VertexArray;
 
@@ -14,17 +26,57 @@ typedef struct {
 	uint32_t count;
 } IndexArray;
 
+typedef struct {
+	// bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	// normal cone, cutoff is sine of the cone angle, 1.0 when the meshlet can't be cone culled
+	glm::vec3 coneAxis;
+	float coneCutoff;
+
+	// triangles of the meshlet are contiguous in the index list it was built from
+	uint32_t firstIndex;
+	uint32_t triangleCount;
+} Meshlet;
+
+typedef struct {
+	Meshlet *pData;
+	uint32_t count;
+} MeshletArray;
+
 typedef struct {
 	VertexArray vertices;
 	IndexArray indices;
 	uint64_t materialIndex;
+
+	// Simplified index lists into the same vertices, coarsest last. Only `lodCount` are valid.
+	IndexArray lods[MAX_LOD_COUNT - 1];
+	uint32_t lodCount;
+
+	// Per level, level 0 indexes `indices`. Index lists are reordered to keep meshlets contiguous.
+	MeshletArray meshlets[MAX_LOD_COUNT];
 } Primitive;
 
 typedef struct {
 	Primitive *pPrimitives;
 	uint32_t primitiveCount;
 
-	const char *pName;
+	std::string name;
 } Mesh;
 
+// Vertex and full detail index bytes of all primitives.
+inline size_t meshGetByteSize(const Mesh &mesh) {
+	size_t size = 0;
+
+	for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
+		const Primitive &primitive = mesh.pPrimitives[i];
+
+		size += primitive.vertices.count * (sizeof(glm::vec3) + sizeof(VertexAttribute));
+		size += primitive.indices.count * sizeof(uint32_t);
+	}
+
+	return size;
+}
+
 #endif // !MESH_H
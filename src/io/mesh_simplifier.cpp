@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include "mesh_simplifier.h"
+
+const uint32_t INVALID_INDEX = UINT32_MAX;
+
+typedef struct {
+	float a00, a01, a02, a03;
+	float a11, a12, a13;
+	float a22, a23;
+	float a33;
+} Quadric;
+
+typedef struct {
+	float cost;
+	uint32_t from;
+	uint32_t to;
+} Collapse;
+
+static Quadric _quadricFromTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
+	glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	float length = glm::length(normal);
+
+	if (length == 0.0f)
+		return {};
+
+	normal /= length;
+
+	// weight by area so large triangles dominate the error
+	float weight = length * 0.5f;
+
+	float a = normal.x;
+	float b = normal.y;
+	float c = normal.z;
+	float d = -glm::dot(normal, p0);
+
+	Quadric q;
+	q.a00 = a * a * weight;
+	q.a01 = a * b * weight;
+	q.a02 = a * c * weight;
+	q.a03 = a * d * weight;
+	q.a11 = b * b * weight;
+	q.a12 = b * c * weight;
+	q.a13 = b * d * weight;
+	q.a22 = c * c * weight;
+	q.a23 = c * d * weight;
+	q.a33 = d * d * weight;
+
+	return q;
+}
+
+static void _quadricAdd(Quadric &q, const Quadric &r) {
+	q.a00 += r.a00;
+	q.a01 += r.a01;
+	q.a02 += r.a02;
+	q.a03 += r.a03;
+	q.a11 += r.a11;
+	q.a12 += r.a12;
+	q.a13 += r.a13;
+	q.a22 += r.a22;
+	q.a23 += r.a23;
+	q.a33 += r.a33;
+}
+
+static float _quadricError(const Quadric &q, const glm::vec3 &v) {
+	float rx = q.a00 * v.x + q.a01 * v.y + q.a02 * v.z + q.a03;
+	float ry = q.a01 * v.x + q.a11 * v.y + q.a12 * v.z + q.a13;
+	float rz = q.a02 * v.x + q.a12 * v.y + q.a22 * v.z + q.a23;
+	float rw = q.a03 * v.x + q.a13 * v.y + q.a23 * v.z + q.a33;
+
+	return std::fabs(rx * v.x + ry * v.y + rz * v.z + rw);
+}
+
+// Vertex -> triangles adjacency in compressed rows, indexed by position representative.
+typedef struct {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+} Adjacency;
+
+static void _buildAdjacency(Adjacency &adjacency, const std::vector<uint32_t> &indices,
+		const std::vector<uint32_t> &position, uint32_t vertexCount) {
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	adjacency.triangles.resize(indices.size());
+
+	for (uint32_t index : indices)
+		adjacency.offsets[position[index] + 1]++;
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+		adjacency.offsets[i + 1] += adjacency.offsets[i];
+
+	std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+
+	for (size_t i = 0; i < indices.size(); i++) {
+		uint32_t v = position[indices[i]];
+		adjacency.triangles[fill[v]++] = static_cast<uint32_t>(i / 3);
+	}
+}
+
+static bool _hasFlip(const Adjacency &adjacency, const std::vector<uint32_t> &indices,
+		const std::vector<uint32_t> &position, const glm::vec3 *pPositions, uint32_t from,
+		uint32_t to) {
+	const glm::vec3 &target = pPositions[to];
+
+	for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++) {
+		uint32_t triangle = adjacency.triangles[i];
+
+		uint32_t v[3] = {
+			position[indices[triangle * 3 + 0]],
+			position[indices[triangle * 3 + 1]],
+			position[indices[triangle * 3 + 2]],
+		};
+
+		// triangles on the collapsed edge disappear
+		if (v[0] == to || v[1] == to || v[2] == to)
+			continue;
+
+		glm::vec3 p[3] = { pPositions[v[0]], pPositions[v[1]], pPositions[v[2]] };
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+		for (uint32_t k = 0; k < 3; k++) {
+			if (v[k] == from)
+				p[k] = target;
+		}
+
+		glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+		if (glm::dot(before, after) <= 0.0f)
+			return true;
+	}
+
+	return false;
+}
+
+uint32_t MeshSimplifier::simplify(uint32_t *pDstIndices, const IndexArray &indices,
+		const VertexArray &vertices, uint32_t targetIndexCount) {
+	uint32_t vertexCount = vertices.count;
+	const glm::vec3 *pPositions = vertices.pPositions;
+
+	// Unwelded input is common, so vertices are grouped twice: `wedge` merges exact duplicates
+	// (tangents are derived data and ignored), `position` merges everything sharing a location.
+	std::vector<uint32_t> wedge(vertexCount);
+	std::vector<uint32_t> position(vertexCount);
+
+	{
+		std::unordered_map<Vertex, uint32_t> wedges;
+		std::unordered_map<glm::vec3, uint32_t> positions;
+
+		wedges.reserve(vertexCount);
+		positions.reserve(vertexCount);
+
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			const VertexAttribute &attribute = vertices.pAttributes[i];
+			Vertex key = { pPositions[i], attribute.normal, glm::vec3(0.0f), attribute.uv };
+
+			wedge[i] = wedges.emplace(key, i).first->second;
+			position[i] = positions.emplace(pPositions[i], i).first->second;
+		}
+	}
+
+	std::vector<uint32_t> triangles(indices.count);
+	for (uint32_t i = 0; i < indices.count; i++)
+		triangles[i] = wedge[indices.pData[i]];
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	std::vector<bool> locked(vertexCount, false);
+
+	{
+		for (uint32_t i = 0; i < triangles.size(); i += 3) {
+			uint32_t v0 = position[triangles[i + 0]];
+			uint32_t v1 = position[triangles[i + 1]];
+			uint32_t v2 = position[triangles[i + 2]];
+
+			Quadric q = _quadricFromTriangle(pPositions[v0], pPositions[v1], pPositions[v2]);
+
+			_quadricAdd(quadrics[v0], q);
+			_quadricAdd(quadrics[v1], q);
+			_quadricAdd(quadrics[v2], q);
+		}
+
+		// lock seams: positions referenced through more than one wedge
+		std::vector<uint32_t> firstWedge(vertexCount, INVALID_INDEX);
+
+		for (uint32_t index : triangles) {
+			uint32_t v = position[index];
+
+			if (firstWedge[v] == INVALID_INDEX)
+				firstWedge[v] = index;
+			else if (firstWedge[v] != index)
+				locked[v] = true;
+		}
+
+		// lock borders and non-manifold edges: edges not shared by exactly two triangles
+		std::unordered_map<uint64_t, uint32_t> edges;
+		edges.reserve(triangles.size());
+
+		for (uint32_t i = 0; i < triangles.size(); i += 3) {
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t a = position[triangles[i + k]];
+				uint32_t b = position[triangles[i + (k + 1) % 3]];
+
+				uint64_t key = (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+				edges[key]++;
+			}
+		}
+
+		for (const auto &[key, count] : edges) {
+			if (count == 2)
+				continue;
+
+			locked[key >> 32] = true;
+			locked[key & 0xFFFFFFFF] = true;
+		}
+	}
+
+	Adjacency adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> collapseWedge(vertexCount, INVALID_INDEX);
+
+	while (triangles.size() > targetIndexCount) {
+		_buildAdjacency(adjacency, triangles, position, vertexCount);
+
+		collapses.clear();
+
+		for (uint32_t i = 0; i < triangles.size(); i += 3) {
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t a = position[triangles[i + k]];
+				uint32_t b = position[triangles[i + (k + 1) % 3]];
+
+				// interior edges are seen from both triangles, take them once
+				if (a > b || (locked[a] && locked[b]))
+					continue;
+
+				Quadric q = quadrics[a];
+				_quadricAdd(q, quadrics[b]);
+
+				float costAB = locked[a] ? INFINITY : _quadricError(q, pPositions[b]);
+				float costBA = locked[b] ? INFINITY : _quadricError(q, pPositions[a]);
+
+				if (costAB <= costBA)
+					collapses.push_back({ costAB, a, b });
+				else
+					collapses.push_back({ costBA, b, a });
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(),
+				[](const Collapse &l, const Collapse &r) { return l.cost < r.cost; });
+
+		std::fill(touched.begin(), touched.end(), false);
+
+		uint32_t triangleCount = triangles.size() / 3;
+		uint32_t targetTriangleCount = targetIndexCount / 3;
+		uint32_t collapseCount = 0;
+
+		for (const Collapse &collapse : collapses) {
+			// each interior collapse removes two triangles
+			if (triangleCount <= targetTriangleCount)
+				break;
+
+			uint32_t from = collapse.from;
+			uint32_t to = collapse.to;
+
+			if (touched[from] || touched[to])
+				continue;
+
+			if (_hasFlip(adjacency, triangles, position, pPositions, from, to))
+				continue;
+
+			// corners moving onto `to` take the wedge used on the collapsed edge
+			uint32_t edgeWedge = INVALID_INDEX;
+
+			for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++) {
+				uint32_t triangle = adjacency.triangles[i];
+
+				for (uint32_t k = 0; k < 3; k++) {
+					uint32_t index = triangles[triangle * 3 + k];
+
+					if (position[index] == to && edgeWedge == INVALID_INDEX)
+						edgeWedge = index;
+
+					// keep neighbouring collapses independent within a pass
+					touched[position[index]] = true;
+				}
+			}
+
+			if (edgeWedge == INVALID_INDEX)
+				continue;
+
+			touched[from] = true;
+			touched[to] = true;
+
+			collapseWedge[from] = edgeWedge;
+			_quadricAdd(quadrics[to], quadrics[from]);
+
+			triangleCount -= 2;
+			collapseCount++;
+		}
+
+		if (collapseCount == 0)
+			break;
+
+		size_t writeIndex = 0;
+
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			uint32_t v[3];
+
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t index = triangles[i + k];
+				uint32_t replacement = collapseWedge[position[index]];
+
+				v[k] = replacement != INVALID_INDEX ? replacement : index;
+			}
+
+			uint32_t p0 = position[v[0]];
+			uint32_t p1 = position[v[1]];
+			uint32_t p2 = position[v[2]];
+
+			if (p0 == p1 || p1 == p2 || p2 == p0)
+				continue;
+
+			triangles[writeIndex + 0] = v[0];
+			triangles[writeIndex + 1] = v[1];
+			triangles[writeIndex + 2] = v[2];
+			writeIndex += 3;
+		}
+
+		triangles.resize(writeIndex);
+		std::fill(collapseWedge.begin(), collapseWedge.end(), INVALID_INDEX);
+	}
+
+	memcpy(pDstIndices, triangles.data(), triangles.size() * sizeof(uint32_t));
+	return static_cast<uint32_t>(triangles.size());
+}
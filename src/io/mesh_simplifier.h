@@ -0,0 +1,20 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstdint>
+
+#include "mesh.h"
+
+namespace MeshSimplifier {
+
+// Quadric error edge collapse simplification of a triangle list.
+//
+// Collapses only move a vertex onto one of its neighbours, so the result indexes the original
+// vertex array. Open borders and attribute seams are locked to keep the silhouette and UVs intact.
+// `pDstIndices` must hold at least `indices.count` elements, returns the number of indices written.
+uint32_t simplify(uint32_t *pDstIndices, const IndexArray &indices, const VertexArray &vertices,
+		uint32_t targetIndexCount);
+
+} // namespace MeshSimplifier
+
+#endif // !MESH_SIMPLIFIER_H
@@ -0,0 +1,198 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include "meshlet_builder.h"
+
+const uint32_t INVALID_INDEX = UINT32_MAX;
+
+static void _computeBounds(Meshlet &meshlet, const uint32_t *pIndices,
+		const std::vector<uint32_t> &meshletVertices, const glm::vec3 *pPositions) {
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+
+	for (uint32_t vertex : meshletVertices) {
+		min = glm::min(min, pPositions[vertex]);
+		max = glm::max(max, pPositions[vertex]);
+	}
+
+	meshlet.center = (min + max) * 0.5f;
+	meshlet.radius = 0.0f;
+
+	for (uint32_t vertex : meshletVertices)
+		meshlet.radius = glm::max(meshlet.radius, glm::distance(meshlet.center, pPositions[vertex]));
+
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangleCount);
+
+	glm::vec3 axis = glm::vec3(0.0f);
+
+	for (uint32_t i = 0; i < meshlet.triangleCount; i++) {
+		const uint32_t *pTriangle = &pIndices[meshlet.firstIndex + i * 3];
+
+		glm::vec3 p0 = pPositions[pTriangle[0]];
+		glm::vec3 p1 = pPositions[pTriangle[1]];
+		glm::vec3 p2 = pPositions[pTriangle[2]];
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+
+		// degenerate triangles are never rasterized, they don't constrain the cone
+		if (length == 0.0f)
+			continue;
+
+		normal /= length;
+		normals.push_back(normal);
+		axis += normal;
+	}
+
+	// disabled unless every normal is within 90 degrees of the axis
+	meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 1.0f;
+
+	float axisLength = glm::length(axis);
+
+	if (axisLength == 0.0f)
+		return;
+
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (const glm::vec3 &normal : normals)
+		minDot = glm::min(minDot, glm::dot(axis, normal));
+
+	if (minDot <= 0.0f)
+		return;
+
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = glm::sqrt(1.0f - minDot * minDot);
+}
+
+MeshletArray MeshletBuilder::build(IndexArray &indices, const VertexArray &vertices) {
+	uint32_t vertexCount = vertices.count;
+	uint32_t triangleCount = indices.count / 3;
+
+	// vertex -> triangles adjacency in compressed rows
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	std::vector<uint32_t> adjacency(indices.count);
+
+	for (uint32_t i = 0; i < indices.count; i++)
+		offsets[indices.pData[i] + 1]++;
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+		offsets[i + 1] += offsets[i];
+
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+		for (uint32_t i = 0; i < indices.count; i++)
+			adjacency[fill[indices.pData[i]]++] = i / 3;
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<bool> used(vertexCount, false);
+
+	std::vector<uint32_t> ordered;
+	ordered.reserve(indices.count);
+
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(MESHLET_MAX_VERTICES);
+
+	std::vector<Meshlet> meshlets;
+
+	Meshlet meshlet = {};
+	uint32_t cursor = 0;
+
+	auto countNewVertices = [&](uint32_t triangle) {
+		uint32_t count = 0;
+
+		for (uint32_t k = 0; k < 3; k++)
+			count += used[indices.pData[triangle * 3 + k]] ? 0 : 1;
+
+		return count;
+	};
+
+	auto flush = [&]() {
+		_computeBounds(meshlet, ordered.data(), meshletVertices, vertices.pPositions);
+		meshlets.push_back(meshlet);
+
+		for (uint32_t vertex : meshletVertices)
+			used[vertex] = false;
+
+		meshletVertices.clear();
+
+		meshlet = {};
+		meshlet.firstIndex = static_cast<uint32_t>(ordered.size());
+	};
+
+	while (true) {
+		// prefer the neighbour that adds the fewest vertices, keeps meshlets round and small
+		uint32_t best = INVALID_INDEX;
+		uint32_t bestNewCount = 4;
+
+		for (uint32_t vertex : meshletVertices) {
+			for (uint32_t i = offsets[vertex]; i < offsets[vertex + 1]; i++) {
+				uint32_t triangle = adjacency[i];
+
+				if (emitted[triangle])
+					continue;
+
+				uint32_t newCount = countNewVertices(triangle);
+
+				if (newCount < bestNewCount) {
+					best = triangle;
+					bestNewCount = newCount;
+				}
+			}
+		}
+
+		if (best == INVALID_INDEX) {
+			while (cursor < triangleCount && emitted[cursor])
+				cursor++;
+
+			if (cursor == triangleCount)
+				break;
+
+			best = cursor;
+			bestNewCount = countNewVertices(best);
+		}
+
+		bool isVertexLimit = meshletVertices.size() + bestNewCount > MESHLET_MAX_VERTICES;
+		bool isTriangleLimit = meshlet.triangleCount == MESHLET_MAX_TRIANGLES;
+
+		if (isVertexLimit || isTriangleLimit) {
+			flush();
+			continue;
+		}
+
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t vertex = indices.pData[best * 3 + k];
+
+			if (!used[vertex]) {
+				used[vertex] = true;
+				meshletVertices.push_back(vertex);
+			}
+
+			ordered.push_back(vertex);
+		}
+
+		emitted[best] = true;
+		meshlet.triangleCount++;
+	}
+
+	if (meshlet.triangleCount > 0)
+		flush();
+
+	memcpy(indices.pData, ordered.data(), ordered.size() * sizeof(uint32_t));
+
+	Meshlet *pData = (Meshlet *)malloc(meshlets.size() * sizeof(Meshlet));
+	memcpy(pData, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+
+	return { pData, static_cast<uint32_t>(meshlets.size()) };
+}
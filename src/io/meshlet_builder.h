@@ -0,0 +1,17 @@
+#ifndef MESHLET_BUILDER_H
+#define MESHLET_BUILDER_H
+
+#include "mesh.h"
+
+namespace MeshletBuilder {
+
+// Splits a triangle list into meshlets of at most MESHLET_MAX_VERTICES unique vertices and
+// MESHLET_MAX_TRIANGLES triangles, growing each one through shared vertices to keep it compact.
+//
+// `indices` is reordered in place so every meshlet is a contiguous range. The returned array is
+// allocated with malloc.
+MeshletArray build(IndexArray &indices, const VertexArray &vertices);
+
+} // namespace MeshletBuilder
+
+#endif // !MESHLET_BUILDER_H
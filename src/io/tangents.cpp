@@ -0,0 +1,58 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include "asset_loader.h"
+
+void AssetLoader::generateTangents(const IndexArray &indices, VertexArray &vertices) {
+	assert(indices.count % 3 == 0);
+
+	uint32_t averageCount = vertices.count;
+	float *pAverage = (float *)calloc(averageCount, sizeof(float));
+
+	for (size_t i = 0; i < indices.count; i += 3) {
+		uint32_t i0 = indices.pData[i + 0];
+		uint32_t i1 = indices.pData[i + 1];
+		uint32_t i2 = indices.pData[i + 2];
+
+		VertexAttribute &a0 = vertices.pAttributes[i0];
+		VertexAttribute &a1 = vertices.pAttributes[i1];
+		VertexAttribute &a2 = vertices.pAttributes[i2];
+
+		glm::vec3 pos0 = vertices.pPositions[i0];
+		glm::vec3 pos1 = vertices.pPositions[i1];
+		glm::vec3 pos2 = vertices.pPositions[i2];
+
+		glm::vec2 uv0 = a0.uv;
+		glm::vec2 uv1 = a1.uv;
+		glm::vec2 uv2 = a2.uv;
+
+		glm::vec3 deltaPos1 = pos1 - pos0;
+		glm::vec3 deltaPos2 = pos2 - pos0;
+
+		glm::vec2 deltaUV1 = uv1 - uv0;
+		glm::vec2 deltaUV2 = uv2 - uv0;
+
+		float r = 1.0 / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+		glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+
+		a0.tangent += tangent;
+		a1.tangent += tangent;
+		a2.tangent += tangent;
+
+		pAverage[i0] += 1.0;
+		pAverage[i1] += 1.0;
+		pAverage[i2] += 1.0;
+	}
+
+	for (uint32_t i = 0; i < averageCount; i++) {
+		float denom = 1.0 / pAverage[i];
+		vertices.pAttributes[i].tangent *= denom;
+	}
+
+	free(pAverage);
+}
@@ -0,0 +1,78 @@
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include "vertex_welder.h"
+
+const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+// Tangents depend on the faces a vertex belongs to, unwelded duplicates never share them.
+static Vertex _getKey(const VertexArray &vertices, uint32_t index) {
+	const VertexAttribute &attribute = vertices.pAttributes[index];
+	return { vertices.pPositions[index], attribute.normal, glm::vec3(0.0f), attribute.uv };
+}
+
+uint32_t VertexWelder::weld(IndexArray &indices, VertexArray &vertices) {
+	uint32_t vertexCount = vertices.count;
+
+	// open addressing with linear probing, kept at most half full
+	uint32_t capacity = 1;
+	while (capacity < vertexCount * 2)
+		capacity <<= 1;
+
+	uint32_t mask = capacity - 1;
+	std::vector<uint32_t> table(capacity, EMPTY_SLOT);
+
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint32_t> mergeCounts;
+	mergeCounts.reserve(vertexCount);
+
+	std::hash<Vertex> hasher;
+	uint32_t uniqueCount = 0;
+
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		Vertex key = _getKey(vertices, i);
+		uint32_t slot = static_cast<uint32_t>(hasher(key)) & mask;
+
+		while (table[slot] != EMPTY_SLOT && !(_getKey(vertices, table[slot]) == key))
+			slot = (slot + 1) & mask;
+
+		if (table[slot] != EMPTY_SLOT) {
+			// table entries index the compacted vertices
+			uint32_t target = table[slot];
+			vertices.pAttributes[target].tangent += vertices.pAttributes[i].tangent;
+			mergeCounts[target]++;
+
+			remap[i] = target;
+			continue;
+		}
+
+		// compaction never overtakes `i`, so unread vertices are not overwritten
+		vertices.pPositions[uniqueCount] = vertices.pPositions[i];
+		vertices.pAttributes[uniqueCount] = vertices.pAttributes[i];
+		mergeCounts.push_back(1);
+
+		table[slot] = uniqueCount;
+		remap[i] = uniqueCount;
+		uniqueCount++;
+	}
+
+	for (uint32_t i = 0; i < uniqueCount; i++)
+		vertices.pAttributes[i].tangent /= static_cast<float>(mergeCounts[i]);
+
+	for (uint32_t i = 0; i < indices.count; i++)
+		indices.pData[i] = remap[indices.pData[i]];
+
+	vertices.pPositions =
+			(glm::vec3 *)realloc(vertices.pPositions, uniqueCount * sizeof(glm::vec3));
+	vertices.pAttributes = (VertexAttribute *)realloc(
+			vertices.pAttributes, uniqueCount * sizeof(VertexAttribute));
+	vertices.count = uniqueCount;
+
+	return uniqueCount;
+}
@@ -0,0 +1,17 @@
+#ifndef VERTEX_WELDER_H
+#define VERTEX_WELDER_H
+
+#include <cstdint>
+
+#include "mesh.h"
+
+namespace VertexWelder {
+
+// Merges vertices with equal position, normal and uv, compacting `vertices` in place and
+// remapping `indices`. Tangents of merged vertices are averaged, which matches generating them
+// on the welded mesh. Returns the new vertex count.
+uint32_t weld(IndexArray &indices, VertexArray &vertices);
+
+} // namespace VertexWelder
+
+#endif // !VERTEX_WELDER_H
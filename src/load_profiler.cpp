@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <SDL3/SDL_log.h>
+#include <SDL3/SDL_timer.h>
+
+#include "load_profiler.h"
+
+const double BYTES_PER_MB = 1024.0 * 1024.0;
+
+static double _elapsed(uint64_t start) {
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// VmHWM in bytes, 0 without /proc
+static uint64_t _readPeakResident() {
+	FILE *pFile = fopen("/proc/self/status", "r");
+
+	if (pFile == nullptr)
+		return 0;
+
+	char line[128];
+	unsigned long long kilobytes = 0;
+
+	while (fgets(line, sizeof(line), pFile) != nullptr) {
+		if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1)
+			break;
+	}
+
+	fclose(pFile);
+	return kilobytes * 1024;
+}
+
+// sets VmHWM back to the current resident size
+static void _resetPeakResident() {
+	FILE *pFile = fopen("/proc/self/clear_refs", "w");
+
+	if (pFile == nullptr)
+		return;
+
+	fputs("5", pFile);
+	fclose(pFile);
+}
+
+static std::string _escape(const std::string &text) {
+	std::string escaped;
+
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+
+		// control characters have no place in asset names
+		if (static_cast<unsigned char>(c) >= 0x20)
+			escaped += c;
+	}
+
+	return escaped;
+}
+
+void LoadProfiler::_samplePeakResident() {
+	// the mark was reset when the top-level phase began
+	uint64_t peak = _readPeakResident();
+
+	for (OpenPhase &open : _stack)
+		open.peakResident = std::max(open.peakResident, peak);
+
+	_loadPeakResident = std::max(_loadPeakResident, peak);
+}
+
+void LoadProfiler::enable() {
+	_isEnabled = true;
+}
+
+void LoadProfiler::loadBegin(const char *pScene) {
+	if (!_isEnabled)
+		return;
+
+	_phases.clear();
+	_stack.clear();
+
+	_scene = pScene;
+	_loadTime = 0.0;
+
+	_resetPeakResident();
+	_loadPeakResident = _readPeakResident();
+	_loadStart = SDL_GetPerformanceCounter();
+}
+
+void LoadProfiler::loadEnd() {
+	if (!_isEnabled)
+		return;
+
+	_loadTime = _elapsed(_loadStart);
+	_samplePeakResident();
+
+	SDL_Log("Scene load %s: %.2f ms, peak resident %.1f MB", _scene.c_str(), _loadTime,
+			_loadPeakResident / BYTES_PER_MB);
+	SDL_Log("%-28s %7s %10s %6s %10s %9s %10s", "phase", "calls", "ms", "%", "MB", "MB/s",
+			"peak MB");
+
+	for (const Phase &phase : _phases) {
+		std::string name = std::string(phase.depth * 2, ' ') + phase.pName;
+
+		double share = _loadTime > 0.0 ? phase.time / _loadTime * 100.0 : 0.0;
+		double megabytes = phase.bytes / BYTES_PER_MB;
+		double throughput = phase.time > 0.0 ? megabytes / (phase.time / 1000.0) : 0.0;
+
+		// nested phases have no peak of their own
+		char peak[16] = "-";
+
+		if (phase.depth == 0)
+			snprintf(peak, sizeof(peak), "%.1f", phase.peakResident / BYTES_PER_MB);
+
+		SDL_Log("%-28s %7u %10.2f %6.1f %10.2f %9.1f %10s", name.c_str(), phase.callCount,
+				phase.time, share, megabytes, throughput, peak);
+	}
+
+	for (const Phase &phase : _phases) {
+		if (phase.records.size() < 2)
+			continue;
+
+		SDL_Log("Slowest in %s:", phase.pName);
+
+		for (const Record &record : phase.records) {
+			SDL_Log("  %10.2f ms %10.2f MB  %s", record.time, record.bytes / BYTES_PER_MB,
+					record.asset.c_str());
+		}
+	}
+}
+
+void LoadProfiler::phaseBegin(const char *pName, const char *pAsset) {
+	// nested phases run per asset, reading /proc for each would show up in their parents' times
+	bool isTopLevel = _stack.empty();
+
+	if (isTopLevel)
+		_samplePeakResident();
+
+	uint32_t index = 0;
+
+	while (index < _phases.size() && strcmp(_phases[index].pName, pName) != 0)
+		index++;
+
+	if (index == _phases.size()) {
+		uint32_t depth = _stack.size();
+		_phases.push_back({ pName, depth, 0, 0.0, 0, 0, {} });
+	}
+
+	uint64_t peakResident = 0;
+
+	if (isTopLevel) {
+		_resetPeakResident();
+		peakResident = _readPeakResident();
+	}
+
+	_stack.push_back({ index, SDL_GetPerformanceCounter(), 0, peakResident, pAsset });
+}
+
+void LoadProfiler::phaseAddBytes(uint64_t bytes) {
+	if (!_stack.empty())
+		_stack.back().bytes += bytes;
+}
+
+void LoadProfiler::phaseEnd() {
+	if (_stack.empty())
+		return;
+
+	double time = _elapsed(_stack.back().start);
+
+	if (_stack.size() == 1)
+		_samplePeakResident();
+
+	OpenPhase open = _stack.back();
+	_stack.pop_back();
+
+	Phase &phase = _phases[open.phase];
+	phase.callCount++;
+	phase.time += time;
+	phase.bytes += open.bytes;
+	phase.peakResident = std::max(phase.peakResident, open.peakResident);
+
+	// keep only the slowest, sorted slowest first
+	Record record = { open.asset, time, open.bytes };
+
+	auto slower = [](const Record &a, const Record &b) { return a.time > b.time; };
+	auto position = std::upper_bound(phase.records.begin(), phase.records.end(), record, slower);
+
+	if (static_cast<uint32_t>(position - phase.records.begin()) < LOAD_PROFILE_TOP_COUNT) {
+		phase.records.insert(position, record);
+
+		if (phase.records.size() > LOAD_PROFILE_TOP_COUNT)
+			phase.records.pop_back();
+	}
+}
+
+bool LoadProfiler::writeJson(const char *pPath) const {
+	FILE *pFile = fopen(pPath, "w");
+
+	if (pFile == nullptr) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to open load profile: %s", pPath);
+		return false;
+	}
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "\t\"scene\": \"%s\",\n", _escape(_scene).c_str());
+	fprintf(pFile, "\t\"total_ms\": %.3f,\n", _loadTime);
+	fprintf(pFile, "\t\"peak_resident_bytes\": %llu,\n", (unsigned long long)_loadPeakResident);
+	fprintf(pFile, "\t\"phases\": [\n");
+
+	for (size_t i = 0; i < _phases.size(); i++) {
+		const Phase &phase = _phases[i];
+
+		fprintf(pFile,
+				"\t\t{ \"name\": \"%s\", \"depth\": %u, \"calls\": %u, \"total_ms\": %.3f, "
+				"\"bytes\": %llu, \"peak_resident_bytes\": %llu, \"slowest\": [",
+				phase.pName, phase.depth, phase.callCount, phase.time,
+				(unsigned long long)phase.bytes, (unsigned long long)phase.peakResident);
+
+		for (size_t j = 0; j < phase.records.size(); j++) {
+			const Record &record = phase.records[j];
+
+			fprintf(pFile, "%s{ \"asset\": \"%s\", \"ms\": %.3f, \"bytes\": %llu }",
+					j > 0 ? ", " : "", _escape(record.asset).c_str(), record.time,
+					(unsigned long long)record.bytes);
+		}
+
+		fprintf(pFile, "] }%s\n", i + 1 < _phases.size() ? "," : "");
+	}
+
+	fprintf(pFile, "\t]\n}\n");
+	fclose(pFile);
+
+	SDL_Log("Load profile written to %s", pPath);
+	return true;
+}
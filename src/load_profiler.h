@@ -0,0 +1,111 @@
+#ifndef LOAD_PROFILER_H
+#define LOAD_PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// phases list this many of their slowest assets
+const uint32_t LOAD_PROFILE_TOP_COUNT = 5;
+
+// Breaks a scene load down into phases: wall clock time, bytes processed, peak resident memory
+// and the slowest assets of each phase. Phases nest, times are inclusive of nested phases.
+//
+// Peak memory is the resident set high water mark, reset at every top-level phase start through
+// /proc/self/clear_refs, so it's Linux only and reads 0 elsewhere. Nested phases report 0, they
+// are timed without touching /proc.
+class LoadProfiler {
+public:
+	static LoadProfiler &getSingleton() {
+		static LoadProfiler instance;
+		return instance;
+	}
+
+private:
+	LoadProfiler() {}
+
+	typedef struct {
+		std::string asset;
+		double time;
+		uint64_t bytes;
+	} Record;
+
+	typedef struct {
+		const char *pName;
+		uint32_t depth;
+		uint32_t callCount;
+		double time;
+		uint64_t bytes;
+		uint64_t peakResident;
+		std::vector<Record> records;
+	} Phase;
+
+	typedef struct {
+		uint32_t phase;
+		uint64_t start;
+		uint64_t bytes;
+		uint64_t peakResident;
+		std::string asset;
+	} OpenPhase;
+
+	std::vector<Phase> _phases;
+	std::vector<OpenPhase> _stack;
+
+	std::string _scene;
+	uint64_t _loadStart = 0;
+	double _loadTime = 0.0;
+	uint64_t _loadPeakResident = 0;
+
+	bool _isEnabled = false;
+
+	void _samplePeakResident();
+
+public:
+	LoadProfiler(LoadProfiler const &) = delete;
+	void operator=(LoadProfiler const &) = delete;
+
+	void enable();
+
+	bool isEnabled() const {
+		return _isEnabled;
+	}
+
+	// Starts a new report, the previous one is dropped.
+	void loadBegin(const char *pScene);
+	// Logs the report as a table.
+	void loadEnd();
+
+	// Names must outlive the profiler, assets are copied.
+	void phaseBegin(const char *pName, const char *pAsset);
+	void phaseAddBytes(uint64_t bytes);
+	void phaseEnd();
+
+	bool writeJson(const char *pPath) const;
+};
+
+// Times the enclosing C++ scope as a load phase.
+class LoadPhase {
+public:
+	LoadPhase(const char *pName, const char *pAsset = "") {
+		LoadProfiler &profiler = LoadProfiler::getSingleton();
+
+		if (profiler.isEnabled())
+			profiler.phaseBegin(pName, pAsset);
+	}
+
+	void addBytes(uint64_t bytes) {
+		LoadProfiler &profiler = LoadProfiler::getSingleton();
+
+		if (profiler.isEnabled())
+			profiler.phaseAddBytes(bytes);
+	}
+
+	~LoadPhase() {
+		LoadProfiler &profiler = LoadProfiler::getSingleton();
+
+		if (profiler.isEnabled())
+			profiler.phaseEnd();
+	}
+};
+
+#endif // !LOAD_PROFILER_H
@@ -12,7 +12,11 @@
 #include <SDL3/SDL_video.h>
 
 #include "camera_controller.h"
+#include "camera_path.h"
 #include "io/image_loader.h"
+#include "load_profiler.h"
+#include "profiler.h"
+#include "rendering/rendering_device.h"
 #include "rendering/rendering_server.h"
 #include "scene.h"
 #include "timer.h"
@@ -23,11 +27,26 @@ typedef struct {
 	CameraController camera;
 	Timer timer;
 	Scene scene;
+
+	const char *pProfilePath;
+	const char *pLoadProfilePath;
+
+	// --record-camera-path, saved on quit
+	const char *pCameraRecordPath;
+	CameraPath cameraRecord;
+	double cameraRecordTime;
+
+	// --camera-path, replaces the camera controller and quits at the end
+	bool isCameraPlaying;
+	CameraPathPlayback cameraPlayback;
+	const char *pCameraTimingsPath;
 } AppState;
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+const double CAMERA_PATH_STEP = 1.0 / 60.0;
+
 int SDL_AppInit(void **appstate, int argc, char **argv) {
 	SDL_WindowFlags flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_VULKAN;
 	SDL_Window *pWindow = SDL_CreateWindow("Hayaku Engine", WIDTH, HEIGHT, flags);
@@ -37,32 +56,122 @@ int SDL_AppInit(void **appstate, int argc, char **argv) {
 		return -1;
 	}
 
+	const char *pProfilePath = nullptr;
+	const char *pLoadProfilePath = nullptr;
+	const char *pCameraPath = nullptr;
+	const char *pCameraRecordPath = nullptr;
+	const char *pCameraTimingsPath = nullptr;
+	double cameraPathStep = CAMERA_PATH_STEP;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i < argc - 1;
+
+		// --profile <path>, enabled before the renderer so its GPU queries get created
+		if (strcmp("--profile", argv[i]) == 0 && hasValue) {
+			pProfilePath = argv[i + 1];
+			Profiler::getSingleton().enable();
+		}
+
+		// --load-profile <path>, per phase breakdown of every scene load
+		if (strcmp("--load-profile", argv[i]) == 0 && hasValue) {
+			pLoadProfilePath = argv[i + 1];
+			LoadProfiler::getSingleton().enable();
+		}
+
+		// --camera-path <path> [--camera-path-step <seconds>] [--camera-path-timings <csv>]
+		if (strcmp("--camera-path", argv[i]) == 0 && hasValue)
+			pCameraPath = argv[i + 1];
+
+		if (strcmp("--camera-path-step", argv[i]) == 0 && hasValue)
+			cameraPathStep = atof(argv[i + 1]);
+
+		if (strcmp("--camera-path-timings", argv[i]) == 0 && hasValue)
+			pCameraTimingsPath = argv[i + 1];
+
+		// --record-camera-path <path>
+		if (strcmp("--record-camera-path", argv[i]) == 0 && hasValue)
+			pCameraRecordPath = argv[i + 1];
+	}
+
 	RS::getSingleton().initialize(argc, argv);
+
+	// playback measures GPU frame times, without the overhead of profiler events
+	if (pCameraPath != nullptr)
+		RD::getSingleton().setGpuTimingRequired(true);
+
 	RS::getSingleton().windowInit(pWindow);
 
 	AppState *pState = new AppState;
+	appstate[0] = reinterpret_cast<void *>(pState);
+
 	pState->pWindow = pWindow;
+	pState->pProfilePath = pProfilePath;
+	pState->pLoadProfilePath = pLoadProfilePath;
+	pState->pCameraRecordPath = pCameraRecordPath;
+	pState->cameraRecordTime = 0.0;
+	pState->isCameraPlaying = false;
+	pState->pCameraTimingsPath = pCameraTimingsPath;
+
+	if (pCameraPath != nullptr) {
+		if (!pState->cameraPlayback.load(pCameraPath, cameraPathStep))
+			return -1;
+
+		pState->isCameraPlaying = true;
+	}
 
 	for (int i = 1; i < argc; i++) {
 		// --scene <path>
 		if (strcmp("--scene", argv[i]) == 0 && i < argc - 1) {
 			const char *pFile = argv[i + 1];
 			pState->scene.load(pFile);
+
+			if (pLoadProfilePath != nullptr)
+				LoadProfiler::getSingleton().writeJson(pLoadProfilePath);
 		}
 	}
 
-	appstate[0] = reinterpret_cast<void *>(pState);
+	// the first played frames would otherwise time the scene's uploads
+	if (pState->isCameraPlaying)
+		RS::getSingleton().uploadsFlush();
+
 	return 0;
 }
 
 int SDL_AppIterate(void *appstate) {
 	AppState *pState = reinterpret_cast<AppState *>(appstate);
 
+	// with --low-latency this waits for the GPU, the time step and input come after
+	RS::getSingleton().inputBegin();
 	pState->timer.tick();
 
 	float deltaTime = pState->timer.deltaTime();
+
+	if (pState->isCameraPlaying) {
+		CameraPathPlayback &playback = pState->cameraPlayback;
+
+		playback.frameBegin();
+		pState->scene.update();
+		RS::getSingleton().draw();
+		playback.frameEnd();
+
+		if (!playback.isFinished())
+			return 0;
+
+		return playback.writeTimings(pState->pCameraTimingsPath) ? 1 : -1;
+	}
+
 	pState->camera.update(deltaTime);
 
+	if (pState->pCameraRecordPath != nullptr) {
+		// the first key is at 0, later ones at the time since
+		if (!pState->cameraRecord.isEmpty())
+			pState->cameraRecordTime += deltaTime;
+
+		pState->cameraRecord.record(pState->cameraRecordTime, pState->camera.getTransform());
+	}
+
+	pState->scene.update();
+
 	RS::getSingleton().draw();
 
 	return 0;
@@ -92,6 +201,10 @@ int SDL_AppEvent(void *appstate, const SDL_Event *event) {
 
 		pState->scene.clear();
 		pState->scene.load(pFile);
+
+		if (pState->pLoadProfilePath != nullptr)
+			LoadProfiler::getSingleton().writeJson(pState->pLoadProfilePath);
+
 		return 0;
 	}
 
@@ -105,6 +218,13 @@ int SDL_AppEvent(void *appstate, const SDL_Event *event) {
 
 void SDL_AppQuit(void *appstate) {
 	AppState *pState = reinterpret_cast<AppState *>(appstate);
+
+	if (pState->pProfilePath != nullptr)
+		Profiler::getSingleton().writeTrace(pState->pProfilePath);
+
+	if (pState->pCameraRecordPath != nullptr)
+		pState->cameraRecord.save(pState->pCameraRecordPath);
+
 	SDL_DestroyWindow(pState->pWindow);
-	free(pState);
+	delete pState;
 }
@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <cstdio>
+
+#include <SDL3/SDL_log.h>
+#include <SDL3/SDL_timer.h>
+
+#include "profiler.h"
+
+void Profiler::enable() {
+	_origin = SDL_GetPerformanceCounter();
+	_frequency = 1000000.0 / SDL_GetPerformanceFrequency();
+
+	_events.clear();
+	_counters.clear();
+
+	_isEnabled = true;
+}
+
+void Profiler::addEvent(const char *pName, double start, double duration, uint32_t track) {
+	_events.push_back({ pName, start, duration, track });
+}
+
+void Profiler::addCounter(const char *pName, double timestamp, uint64_t value) {
+	_counters.push_back({ pName, timestamp, value });
+}
+
+bool Profiler::writeTrace(const char *pPath) const {
+	FILE *pFile = fopen(pPath, "w");
+
+	if (pFile == nullptr) {
+		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to open trace file: %s", pPath);
+		return false;
+	}
+
+	fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	// name the tracks
+	fprintf(pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+				   "\"args\":{\"name\":\"CPU\"}},\n",
+			CPU_TRACK);
+	fprintf(pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+				   "\"args\":{\"name\":\"GPU\"}}",
+			GPU_TRACK);
+
+	for (const Event &event : _events) {
+		fprintf(pFile,
+				",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+				event.pName, event.start, event.duration, event.track);
+	}
+
+	for (const Counter &counter : _counters) {
+		fprintf(pFile,
+				",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,"
+				"\"args\":{\"value\":%llu}}",
+				counter.pName, counter.timestamp, (unsigned long long)counter.value);
+	}
+
+	fprintf(pFile, "\n]}\n");
+	fclose(pFile);
+
+	SDL_Log("Profile written to %s: %zu events, %zu counters", pPath, _events.size(),
+			_counters.size());
+
+	return true;
+}
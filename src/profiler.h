@@ -0,0 +1,91 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <SDL3/SDL_timer.h>
+
+const uint32_t CPU_TRACK = 1;
+const uint32_t GPU_TRACK = 2;
+
+// Collects timed scopes and counters while enabled and writes them as a Chrome trace
+// (chrome://tracing, Perfetto). Times are microseconds since enable(). Names must outlive the
+// profiler, string literals in practice.
+class Profiler {
+public:
+	static Profiler &getSingleton() {
+		static Profiler instance;
+		return instance;
+	}
+
+private:
+	Profiler() {}
+
+	typedef struct {
+		const char *pName;
+		double start;
+		double duration;
+		uint32_t track;
+	} Event;
+
+	typedef struct {
+		const char *pName;
+		double timestamp;
+		uint64_t value;
+	} Counter;
+
+	std::vector<Event> _events;
+	std::vector<Counter> _counters;
+
+	uint64_t _origin = 0;
+	double _frequency = 1.0;
+
+	bool _isEnabled = false;
+
+public:
+	Profiler(Profiler const &) = delete;
+	void operator=(Profiler const &) = delete;
+
+	void enable();
+
+	bool isEnabled() const {
+		return _isEnabled;
+	}
+
+	double now() const {
+		return (SDL_GetPerformanceCounter() - _origin) * _frequency;
+	}
+
+	void addEvent(const char *pName, double start, double duration, uint32_t track = CPU_TRACK);
+	void addCounter(const char *pName, double timestamp, uint64_t value);
+
+	bool writeTrace(const char *pPath) const;
+};
+
+// Times the enclosing C++ scope on the CPU track, nested scopes show nested in the trace.
+class ProfileScope {
+private:
+	const char *_pName;
+	double _start;
+
+public:
+	ProfileScope(const char *pName) : _pName(pName) {
+		Profiler &profiler = Profiler::getSingleton();
+		_start = profiler.isEnabled() ? profiler.now() : 0.0;
+	}
+
+	~ProfileScope() {
+		Profiler &profiler = Profiler::getSingleton();
+
+		if (profiler.isEnabled())
+			profiler.addEvent(_pName, _start, profiler.now() - _start);
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(name)
+
+#endif // !PROFILER_H
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cmath>
+
+#include "dynamic_resolution.h"
+
+// weight of the newest frame time
+const double SMOOTHING = 0.1;
+
+// scale changes smaller than this are skipped, larger ones are limited per frame
+const float SCALE_DEADBAND = 0.02f;
+const float SCALE_MAX_STEP = 0.05f;
+
+void DynamicResolution::enable(double targetTime, float minScale, float maxScale) {
+	_targetTime = targetTime;
+	_minScale = std::min(minScale, maxScale);
+	_maxScale = maxScale;
+
+	_scale = _maxScale;
+	_smoothedTime = 0.0;
+
+	_isEnabled = true;
+}
+
+bool DynamicResolution::isEnabled() const {
+	return _isEnabled;
+}
+
+void DynamicResolution::setScale(float scale) {
+	_minScale = scale;
+	_maxScale = scale;
+	_scale = scale;
+
+	_isEnabled = false;
+}
+
+void DynamicResolution::update(double gpuTime) {
+	if (!_isEnabled || gpuTime <= 0.0)
+		return;
+
+	if (_smoothedTime == 0.0)
+		_smoothedTime = gpuTime;
+	else
+		_smoothedTime += (gpuTime - _smoothedTime) * SMOOTHING;
+
+	// frame time is roughly proportional to the pixel count, the square of the scale
+	float desired = _scale * static_cast<float>(std::sqrt(_targetTime / _smoothedTime));
+	desired = std::clamp(desired, _minScale, _maxScale);
+
+	float step = desired - _scale;
+
+	if (std::abs(step) < SCALE_DEADBAND)
+		return;
+
+	_scale += std::clamp(step, -SCALE_MAX_STEP, SCALE_MAX_STEP);
+}
+
+float DynamicResolution::getScale() const {
+	return _scale;
+}
+
+float DynamicResolution::getMaxScale() const {
+	return _maxScale;
+}
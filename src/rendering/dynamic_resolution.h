@@ -0,0 +1,35 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <cstdint>
+
+// Picks the render scale, a fraction of the swapchain size per axis, so the GPU frame time stays
+// near a target. Fed with GPU frame times as they are read back, so it reacts a few frames late;
+// times are smoothed and small corrections skipped to keep the scale from oscillating.
+class DynamicResolution {
+private:
+	double _targetTime = 0.0;
+	float _minScale = 1.0f;
+	float _maxScale = 1.0f;
+
+	float _scale = 1.0f;
+	double _smoothedTime = 0.0;
+
+	bool _isEnabled = false;
+
+public:
+	// Target frame time in milliseconds, the scale stays within min and max, starting at max.
+	void enable(double targetTime, float minScale, float maxScale);
+	bool isEnabled() const;
+
+	// Renders at a fixed scale, the controller is disabled.
+	void setScale(float scale);
+
+	// GPU time of a completed frame in milliseconds.
+	void update(double gpuTime);
+
+	float getScale() const;
+	float getMaxScale() const;
+};
+
+#endif // !DYNAMIC_RESOLUTION_H
@@ -0,0 +1,484 @@
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_access.hpp>
+
+#include <rendering/rendering_device.h>
+
+#include "shaders/cluster_cull.gen.h"
+
+#include "cluster_culling.h"
+
+// compacted index storage is grown with headroom to avoid reallocating every frame
+const float GROWTH_FACTOR = 1.5f;
+
+static vk::ShaderModule createModule(vk::Device device, const uint32_t *pCode, size_t size) {
+	vk::ShaderModuleCreateInfo createInfo = {};
+	createInfo.setPCode(pCode);
+	createInfo.setCodeSize(size);
+
+	return device.createShaderModule(createInfo);
+}
+
+void ClusterCulling::_createDescriptors() {
+	// meshlet
+
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		vk::DescriptorSetLayoutCreateInfo createInfo = {};
+		createInfo.setBindings(bindings);
+
+		vk::Result err =
+				_device.createDescriptorSetLayout(&createInfo, nullptr, &_meshletSetLayout);
+
+		if (err != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to create meshlet set layout!");
+	}
+
+	// frame
+
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 4> bindings = {};
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[2].setBinding(2);
+		bindings[2].setDescriptorType(vk::DescriptorType::eUniformBuffer);
+		bindings[2].setDescriptorCount(1);
+		bindings[2].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[3].setBinding(3);
+		bindings[3].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[3].setDescriptorCount(1);
+		bindings[3].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		vk::DescriptorSetLayoutCreateInfo createInfo = {};
+		createInfo.setBindings(bindings);
+
+		vk::Result err = _device.createDescriptorSetLayout(&createInfo, nullptr, &_frameSetLayout);
+
+		if (err != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to create cluster culling set layout!");
+
+		std::vector<vk::DescriptorSetLayout> layouts(_frames.size(), _frameSetLayout);
+
+		vk::DescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.setDescriptorPool(_descriptorPool);
+		allocInfo.setSetLayouts(layouts);
+
+		std::vector<vk::DescriptorSet> sets = _device.allocateDescriptorSets(allocInfo);
+
+		for (size_t i = 0; i < _frames.size(); i++)
+			_frames[i].set = sets[i];
+	}
+}
+
+void ClusterCulling::_createPipeline() {
+	vk::PushConstantRange pushConstants;
+	pushConstants.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+	pushConstants.setOffset(0);
+	pushConstants.setSize(sizeof(CullConstants));
+
+	std::array<vk::DescriptorSetLayout, 3> layouts = {
+		_meshletSetLayout,
+		_frameSetLayout,
+		RD::getSingleton().getDepthPyramid().getCullSetLayout(),
+	};
+
+	vk::PipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.setSetLayouts(layouts);
+	layoutCreateInfo.setPushConstantRanges(pushConstants);
+
+	_pipelineLayout = _device.createPipelineLayout(layoutCreateInfo);
+
+	ClusterCullShader shader;
+
+	uint32_t codeSize = sizeof(shader.computeCode);
+	vk::ShaderModule computeModule = createModule(_device, shader.computeCode, codeSize);
+
+	vk::PipelineShaderStageCreateInfo computeStageInfo = {};
+	computeStageInfo.setModule(computeModule);
+	computeStageInfo.setStage(vk::ShaderStageFlagBits::eCompute);
+	computeStageInfo.setPName("main");
+
+	vk::ComputePipelineCreateInfo createInfo = {};
+	createInfo.setStage(computeStageInfo);
+	createInfo.setLayout(_pipelineLayout);
+
+	vk::ResultValue<vk::Pipeline> result = _device.createComputePipeline({}, createInfo);
+
+	if (result.result != vk::Result::eSuccess)
+		throw std::runtime_error("Failed to create cluster culling compute pipeline!");
+
+	_pipeline = result.value;
+
+	_device.destroyShaderModule(computeModule);
+}
+
+void ClusterCulling::_reserve(
+		FrameData &frame, uint32_t drawCount, uint32_t indexCount, uint32_t instanceCount) {
+	// frame fence was waited on, its buffers are no longer in use
+	RD &rd = RD::getSingleton();
+
+	bool isUpdated = false;
+
+	if (indexCount > frame.indexCapacity) {
+		if (frame.indexCapacity > 0)
+			rd.bufferDestroy(frame.indexBuffer);
+
+		frame.indexCapacity = static_cast<uint32_t>(indexCount * GROWTH_FACTOR);
+		frame.indexBuffer = rd.bufferCreate(MemoryCategory::Frame,
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
+				sizeof(uint32_t) * frame.indexCapacity);
+
+		isUpdated = true;
+	}
+
+	if (drawCount > frame.drawCapacity) {
+		if (frame.drawCapacity > 0)
+			rd.bufferDestroy(frame.drawBuffer);
+
+		frame.drawCapacity = static_cast<uint32_t>(drawCount * GROWTH_FACTOR);
+		frame.drawBuffer = rd.bufferCreate(MemoryCategory::Frame,
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+				sizeof(vk::DrawIndexedIndirectCommand) * frame.drawCapacity,
+				&frame.drawAllocInfo);
+
+		isUpdated = true;
+	}
+
+	if (instanceCount > frame.instanceCapacity) {
+		if (frame.instanceCapacity > 0)
+			rd.bufferDestroy(frame.instanceBuffer);
+
+		frame.instanceCapacity = static_cast<uint32_t>(instanceCount * GROWTH_FACTOR);
+		frame.instanceBuffer = rd.bufferCreate(MemoryCategory::Frame,
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+				sizeof(glm::mat4) * frame.instanceCapacity, &frame.instanceAllocInfo);
+
+		isUpdated = true;
+	}
+
+	if (!isUpdated)
+		return;
+
+	vk::DescriptorBufferInfo indexBufferInfo = frame.indexBuffer.getBufferInfo();
+	vk::DescriptorBufferInfo drawBufferInfo = frame.drawBuffer.getBufferInfo();
+	vk::DescriptorBufferInfo instanceBufferInfo = frame.instanceBuffer.getBufferInfo();
+
+	std::array<vk::WriteDescriptorSet, 3> writeInfos = {};
+	writeInfos[0].setDstSet(frame.set);
+	writeInfos[0].setDstBinding(0);
+	writeInfos[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[0].setDescriptorCount(1);
+	writeInfos[0].setBufferInfo(indexBufferInfo);
+
+	writeInfos[1].setDstSet(frame.set);
+	writeInfos[1].setDstBinding(1);
+	writeInfos[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[1].setDescriptorCount(1);
+	writeInfos[1].setBufferInfo(drawBufferInfo);
+
+	writeInfos[2].setDstSet(frame.set);
+	writeInfos[2].setDstBinding(3);
+	writeInfos[2].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[2].setDescriptorCount(1);
+	writeInfos[2].setBufferInfo(instanceBufferInfo);
+
+	_device.updateDescriptorSets(writeInfos, nullptr);
+}
+
+vk::DescriptorSet ClusterCulling::meshletSetCreate(
+		vk::Buffer meshletBuffer, vk::Buffer indexBuffer) {
+	vk::DescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.setDescriptorPool(_descriptorPool);
+	allocInfo.setDescriptorSetCount(1);
+	allocInfo.setSetLayouts(_meshletSetLayout);
+
+	vk::DescriptorSet set = _device.allocateDescriptorSets(allocInfo)[0];
+
+	vk::DescriptorBufferInfo meshletBufferInfo(meshletBuffer, 0, VK_WHOLE_SIZE);
+	vk::DescriptorBufferInfo indexBufferInfo(indexBuffer, 0, VK_WHOLE_SIZE);
+
+	std::array<vk::WriteDescriptorSet, 2> writeInfos = {};
+	writeInfos[0].setDstSet(set);
+	writeInfos[0].setDstBinding(0);
+	writeInfos[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[0].setDescriptorCount(1);
+	writeInfos[0].setBufferInfo(meshletBufferInfo);
+
+	writeInfos[1].setDstSet(set);
+	writeInfos[1].setDstBinding(1);
+	writeInfos[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[1].setDescriptorCount(1);
+	writeInfos[1].setBufferInfo(indexBufferInfo);
+
+	_device.updateDescriptorSets(writeInfos, nullptr);
+
+	return set;
+}
+
+void ClusterCulling::frustumPlanes(const glm::mat4 &projView, glm::vec4 *pPlanes) {
+	// Gribb-Hartmann, depth range is [0, 1] so near plane is the third row alone
+	glm::vec4 row0 = glm::row(projView, 0);
+	glm::vec4 row1 = glm::row(projView, 1);
+	glm::vec4 row2 = glm::row(projView, 2);
+	glm::vec4 row3 = glm::row(projView, 3);
+
+	pPlanes[0] = row3 + row0;
+	pPlanes[1] = row3 - row0;
+	pPlanes[2] = row3 + row1;
+	pPlanes[3] = row3 - row1;
+	pPlanes[4] = row2;
+	pPlanes[5] = row3 - row2;
+
+	for (uint32_t i = 0; i < 6; i++)
+		pPlanes[i] /= glm::length(glm::vec3(pPlanes[i]));
+}
+
+void ClusterCulling::begin(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t drawCount,
+		uint32_t indexCount, const glm::mat4 *pInstances, uint32_t instanceCount,
+		const View &view) {
+	assert(frame < _frames.size());
+
+	RD &rd = RD::getSingleton();
+	DepthPyramid &depthPyramid = rd.getDepthPyramid();
+	FrameCounters &counters = rd.getFrameCounters();
+
+	_frame = frame;
+	_drawCount = 0;
+	_drawReserve = glm::max(drawCount, 1u);
+	_indexCount = 0;
+	_isOcclusionEnabled = depthPyramid.isPreviousValid();
+
+	_dispatches.clear();
+
+	FrameData &frameData = _frames[frame];
+
+	// buffers can't be empty, late commands follow the early ones
+	_reserve(frameData, _drawReserve * 2, glm::max(indexCount, 3u), glm::max(instanceCount, 1u));
+
+	memcpy(frameData.instanceAllocInfo.pMappedData, pInstances,
+			sizeof(glm::mat4) * instanceCount);
+
+	CullData data = {};
+	frustumPlanes(view.projView, data.planes);
+	data.viewPosition = view.position;
+	data.isOcclusionEnabled = _isOcclusionEnabled;
+	data.projView = view.projView;
+	data.previousProjView = view.previousProjView;
+
+	memcpy(frameData.uniformAllocInfo.pMappedData, &data, sizeof(data));
+
+	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	commandBuffer.bindPipeline(bindPoint, _pipeline);
+	commandBuffer.bindDescriptorSets(bindPoint, _pipelineLayout, 1, frameData.set, nullptr);
+	commandBuffer.bindDescriptorSets(
+			bindPoint, _pipelineLayout, 2, depthPyramid.getCullSet(), nullptr);
+
+	counters.uploadBytes += sizeof(glm::mat4) * instanceCount + sizeof(data);
+	counters.pipelineBindCount++;
+	counters.descriptorSetBindCount += 2;
+}
+
+uint32_t ClusterCulling::cull(vk::CommandBuffer commandBuffer, vk::DescriptorSet meshletSet,
+		uint32_t firstInstance, uint32_t instanceCount, uint32_t firstMeshlet,
+		uint32_t meshletCount, uint32_t indexCount) {
+	FrameData &frameData = _frames[_frame];
+
+	uint32_t drawIndex = _drawCount;
+	uint32_t lateDrawIndex = _drawReserve + drawIndex;
+	assert(lateDrawIndex < frameData.drawCapacity);
+	assert(_indexCount + indexCount <= frameData.indexCapacity);
+	assert(firstInstance + instanceCount <= frameData.instanceCapacity);
+
+	// shader appends visible triangles to the reserved range
+	vk::DrawIndexedIndirectCommand command = {};
+	command.setIndexCount(0);
+	command.setInstanceCount(instanceCount);
+	command.setFirstIndex(_indexCount);
+	command.setVertexOffset(0);
+	command.setFirstInstance(firstInstance);
+
+	vk::DrawIndexedIndirectCommand *pCommands =
+			(vk::DrawIndexedIndirectCommand *)frameData.drawAllocInfo.pMappedData;
+	pCommands[drawIndex] = command;
+
+	// late triangles go after the early ones, shader sets the first index
+	pCommands[lateDrawIndex] = command;
+
+	_drawCount++;
+	_indexCount += indexCount;
+
+	if (meshletCount == 0 || instanceCount == 0)
+		return drawIndex;
+
+	CullConstants constants = {};
+	constants.firstInstance = firstInstance;
+	constants.instanceCount = instanceCount;
+	constants.firstMeshlet = firstMeshlet;
+	constants.meshletCount = meshletCount;
+	constants.drawIndex = drawIndex;
+	constants.lateDrawIndex = lateDrawIndex;
+	constants.isLate = false;
+
+	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	commandBuffer.bindDescriptorSets(bindPoint, _pipelineLayout, 0, meshletSet, nullptr);
+	commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+			sizeof(constants), &constants);
+
+	commandBuffer.dispatch(meshletCount, 1, 1);
+
+	FrameCounters &counters = RD::getSingleton().getFrameCounters();
+	counters.descriptorSetBindCount++;
+	counters.pushConstantBytes += sizeof(constants);
+
+	_dispatches.push_back({ meshletSet, constants });
+
+	return drawIndex;
+}
+
+void ClusterCulling::cullLate(vk::CommandBuffer commandBuffer) {
+	// without a previous pyramid the early pass kept everything in view
+	if (!_isOcclusionEnabled)
+		return;
+
+	RD &rd = RD::getSingleton();
+	FrameCounters &counters = rd.getFrameCounters();
+
+	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	commandBuffer.bindPipeline(bindPoint, _pipeline);
+	commandBuffer.bindDescriptorSets(bindPoint, _pipelineLayout, 1, _frames[_frame].set, nullptr);
+	commandBuffer.bindDescriptorSets(
+			bindPoint, _pipelineLayout, 2, rd.getDepthPyramid().getCullSet(), nullptr);
+
+	counters.pipelineBindCount++;
+	counters.descriptorSetBindCount += 2;
+
+	vk::DescriptorSet meshletSet = VK_NULL_HANDLE;
+
+	for (Dispatch &dispatch : _dispatches) {
+		if (dispatch.meshletSet != meshletSet) {
+			meshletSet = dispatch.meshletSet;
+			commandBuffer.bindDescriptorSets(bindPoint, _pipelineLayout, 0, meshletSet, nullptr);
+			counters.descriptorSetBindCount++;
+		}
+
+		dispatch.constants.isLate = true;
+
+		commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+				sizeof(CullConstants), &dispatch.constants);
+		counters.pushConstantBytes += sizeof(CullConstants);
+
+		commandBuffer.dispatch(dispatch.constants.meshletCount, 1, 1);
+	}
+}
+
+void ClusterCulling::end(vk::CommandBuffer commandBuffer) {
+	vk::MemoryBarrier barrier = {};
+	barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
+	barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead |
+							 vk::AccessFlagBits::eIndirectCommandRead |
+							 vk::AccessFlagBits::eIndexRead);
+
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect |
+					vk::PipelineStageFlagBits::eVertexInput,
+			{}, barrier, nullptr, nullptr);
+}
+
+void ClusterCulling::drawIndexed(
+		vk::CommandBuffer commandBuffer, uint32_t drawIndex, bool isLate) const {
+	const FrameData &frameData = _frames[_frame];
+
+	if (isLate)
+		drawIndex += _drawReserve;
+
+	vk::DeviceSize stride = sizeof(vk::DrawIndexedIndirectCommand);
+	commandBuffer.drawIndexedIndirect(frameData.drawBuffer.buffer, drawIndex * stride, 1, stride);
+}
+
+vk::Buffer ClusterCulling::getIndexBuffer() const {
+	return _frames[_frame].indexBuffer.buffer;
+}
+
+vk::Buffer ClusterCulling::getInstanceBuffer() const {
+	return _frames[_frame].instanceBuffer.buffer;
+}
+
+void ClusterCulling::init(uint32_t frameCount) {
+	RD &rd = RD::getSingleton();
+
+	_device = rd.getDevice();
+	_descriptorPool = rd.getDescriptorPool();
+
+	_frames.resize(frameCount, FrameData{});
+
+	_createDescriptors();
+	_createPipeline();
+
+	for (FrameData &frame : _frames) {
+		frame.uniformBuffer = rd.bufferCreate(MemoryCategory::Frame,
+				vk::BufferUsageFlagBits::eUniformBuffer, sizeof(CullData), &frame.uniformAllocInfo);
+
+		vk::DescriptorBufferInfo bufferInfo = frame.uniformBuffer.getBufferInfo();
+
+		vk::WriteDescriptorSet writeInfo = {};
+		writeInfo.setDstSet(frame.set);
+		writeInfo.setDstBinding(2);
+		writeInfo.setDescriptorType(vk::DescriptorType::eUniformBuffer);
+		writeInfo.setDescriptorCount(1);
+		writeInfo.setBufferInfo(bufferInfo);
+
+		_device.updateDescriptorSets(writeInfo, nullptr);
+	}
+
+	_initialized = true;
+}
+
+ClusterCulling::~ClusterCulling() {
+	if (!_initialized)
+		return;
+
+	RD &rd = RD::getSingleton();
+
+	// the others are created on first use, capacities tell which were
+	for (FrameData &frame : _frames) {
+		rd.bufferDestroy(frame.uniformBuffer);
+
+		if (frame.indexCapacity > 0)
+			rd.bufferDestroy(frame.indexBuffer);
+
+		if (frame.drawCapacity > 0)
+			rd.bufferDestroy(frame.drawBuffer);
+
+		if (frame.instanceCapacity > 0)
+			rd.bufferDestroy(frame.instanceBuffer);
+	}
+
+	_device.destroyPipeline(_pipeline);
+	_device.destroyPipelineLayout(_pipelineLayout);
+
+	_device.destroyDescriptorSetLayout(_meshletSetLayout);
+	_device.destroyDescriptorSetLayout(_frameSetLayout);
+}
@@ -0,0 +1,151 @@
+#ifndef CLUSTER_CULLING_H
+#define CLUSTER_CULLING_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "../types/allocated.h"
+
+// invocations of a cull workgroup, draws of at most this many instances test each one once
+const uint32_t CULL_BATCH_INSTANCES = 64;
+
+// Culls meshlets against the view frustum and their normal cones in a compute pass, then
+// compacts surviving triangles into a per-frame index buffer drawn with indirect commands.
+// Uses only core compute and drawIndexedIndirect, so it runs without mesh shader support.
+//
+// Instance transforms of the frame live in a buffer read both by culling and as the instance
+// vertex stream. A draw covers a range of instances, a meshlet survives if any of them sees it.
+//
+// Occlusion runs in two passes against the depth pyramid. The early pass keeps meshlets visible
+// in the previous frame's pyramid, once their depth is drawn and reduced the late pass keeps
+// meshlets the early pass rejected but the current pyramid shows. Every draw has an early and
+// a late indirect command sharing one index range.
+class ClusterCulling {
+public:
+	struct View {
+		glm::mat4 projView;
+		glm::vec3 position;
+
+		// view the previous depth pyramid was rendered with
+		glm::mat4 previousProjView;
+	};
+
+	struct MeshletData {
+		float center[3];
+		float radius;
+
+		float coneAxis[3];
+		float coneCutoff;
+
+		uint32_t firstIndex;
+		uint32_t triangleCount;
+		uint32_t _padding[2];
+	};
+	static_assert(sizeof(MeshletData) % 16 == 0, "MeshletData is not multiple of 16");
+
+private:
+	struct CullConstants {
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t drawIndex;
+		uint32_t lateDrawIndex;
+		uint32_t isLate;
+	};
+
+	struct CullData {
+		glm::vec4 planes[6];
+		glm::vec3 viewPosition;
+		uint32_t isOcclusionEnabled;
+		glm::mat4 projView;
+		glm::mat4 previousProjView;
+	};
+
+	typedef struct {
+		vk::DescriptorSet meshletSet;
+		CullConstants constants;
+	} Dispatch;
+
+	typedef struct {
+		AllocatedBuffer indexBuffer;
+		uint32_t indexCapacity;
+
+		AllocatedBuffer drawBuffer;
+		VmaAllocationInfo drawAllocInfo;
+		uint32_t drawCapacity;
+
+		AllocatedBuffer instanceBuffer;
+		VmaAllocationInfo instanceAllocInfo;
+		uint32_t instanceCapacity;
+
+		AllocatedBuffer uniformBuffer;
+		VmaAllocationInfo uniformAllocInfo;
+
+		vk::DescriptorSet set;
+	} FrameData;
+
+	vk::Device _device;
+	vk::DescriptorPool _descriptorPool;
+
+	vk::DescriptorSetLayout _meshletSetLayout;
+	vk::DescriptorSetLayout _frameSetLayout;
+
+	vk::PipelineLayout _pipelineLayout;
+	vk::Pipeline _pipeline;
+
+	std::vector<FrameData> _frames;
+	std::vector<Dispatch> _dispatches;
+
+	uint32_t _frame = 0;
+	uint32_t _drawCount = 0;
+	uint32_t _drawReserve = 0;
+	uint32_t _indexCount = 0;
+
+	bool _isOcclusionEnabled = false;
+
+	bool _initialized = false;
+
+	void _createDescriptors();
+	void _createPipeline();
+
+	void _reserve(
+			FrameData &frame, uint32_t drawCount, uint32_t indexCount, uint32_t instanceCount);
+
+public:
+	// Normalized frustum planes, a sphere is outside when its distance to one is below -radius.
+	static void frustumPlanes(const glm::mat4 &projView, glm::vec4 *pPlanes);
+
+	vk::DescriptorSet meshletSetCreate(vk::Buffer meshletBuffer, vk::Buffer indexBuffer);
+
+	// Starts recording culling work for `frame` and uploads its instance transforms. Draw and
+	// index counts are upper bounds for the whole frame.
+	void begin(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t drawCount,
+			uint32_t indexCount, const glm::mat4 *pInstances, uint32_t instanceCount,
+			const View &view);
+
+	// Early culls a meshlet range for a range of instances. `indexCount` is the index count of
+	// the meshlet range, returns draw index.
+	uint32_t cull(vk::CommandBuffer commandBuffer, vk::DescriptorSet meshletSet,
+			uint32_t firstInstance, uint32_t instanceCount, uint32_t firstMeshlet,
+			uint32_t meshletCount, uint32_t indexCount);
+
+	// Repeats every cull() of the frame against the current depth pyramid, which has to be built
+	// from the early draws.
+	void cullLate(vk::CommandBuffer commandBuffer);
+
+	// Makes results visible to late culling, index fetch and indirect draws.
+	void end(vk::CommandBuffer commandBuffer);
+
+	void drawIndexed(vk::CommandBuffer commandBuffer, uint32_t drawIndex, bool isLate) const;
+	vk::Buffer getIndexBuffer() const;
+	vk::Buffer getInstanceBuffer() const;
+
+	void init(uint32_t frameCount);
+	~ClusterCulling();
+};
+
+#endif // !CLUSTER_CULLING_H
@@ -0,0 +1,409 @@
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <rendering/rendering_device.h>
+
+#include "shaders/depth_pyramid.gen.h"
+
+#include "depth_pyramid.h"
+
+const vk::Format PYRAMID_FORMAT = vk::Format::eR32Sfloat;
+
+static vk::ShaderModule createModule(vk::Device device, const uint32_t *pCode, size_t size) {
+	vk::ShaderModuleCreateInfo createInfo = {};
+	createInfo.setPCode(pCode);
+	createInfo.setCodeSize(size);
+
+	return device.createShaderModule(createInfo);
+}
+
+static uint32_t previousPowerOfTwo(uint32_t value) {
+	uint32_t result = 1;
+
+	while (result * 2 <= value)
+		result *= 2;
+
+	return result;
+}
+
+static vk::ImageView createLevelView(vk::Device device, vk::Image image, uint32_t level) {
+	vk::ImageSubresourceRange subresourceRange = {};
+	subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+	subresourceRange.setBaseMipLevel(level);
+	subresourceRange.setLevelCount(1);
+	subresourceRange.setBaseArrayLayer(0);
+	subresourceRange.setLayerCount(1);
+
+	vk::ImageViewCreateInfo createInfo = {};
+	createInfo.setImage(image);
+	createInfo.setViewType(vk::ImageViewType::e2D);
+	createInfo.setFormat(PYRAMID_FORMAT);
+	createInfo.setSubresourceRange(subresourceRange);
+
+	return device.createImageView(createInfo);
+}
+
+void DepthPyramid::_createSetLayouts() {
+	// level
+
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		vk::DescriptorSetLayoutCreateInfo createInfo = {};
+		createInfo.setBindings(bindings);
+
+		vk::Result err = _device.createDescriptorSetLayout(&createInfo, nullptr, &_levelSetLayout);
+
+		if (err != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to create depth pyramid level set layout!");
+	}
+
+	// cull
+
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		vk::DescriptorSetLayoutCreateInfo createInfo = {};
+		createInfo.setBindings(bindings);
+
+		vk::Result err = _device.createDescriptorSetLayout(&createInfo, nullptr, &_cullSetLayout);
+
+		if (err != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to create depth pyramid cull set layout!");
+	}
+}
+
+void DepthPyramid::_allocateSets() {
+	{
+		std::vector<vk::DescriptorSetLayout> layouts(_levelCount, _levelSetLayout);
+
+		vk::DescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.setDescriptorPool(_descriptorPool);
+		allocInfo.setSetLayouts(layouts);
+
+		for (Pyramid &pyramid : _pyramids) {
+			std::vector<vk::DescriptorSet> sets = _device.allocateDescriptorSets(allocInfo);
+
+			for (uint32_t i = 0; i < _levelCount; i++)
+				pyramid.levelSets[i] = sets[i];
+		}
+	}
+
+	{
+		std::array<vk::DescriptorSetLayout, 2> layouts = { _cullSetLayout, _cullSetLayout };
+
+		vk::DescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.setDescriptorPool(_descriptorPool);
+		allocInfo.setSetLayouts(layouts);
+
+		std::vector<vk::DescriptorSet> sets = _device.allocateDescriptorSets(allocInfo);
+		_cullSets[0] = sets[0];
+		_cullSets[1] = sets[1];
+	}
+}
+
+void DepthPyramid::_createPipeline() {
+	vk::PushConstantRange pushConstants;
+	pushConstants.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+	pushConstants.setOffset(0);
+	pushConstants.setSize(sizeof(PyramidConstants));
+
+	vk::PipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.setSetLayouts(_levelSetLayout);
+	layoutCreateInfo.setPushConstantRanges(pushConstants);
+
+	_pipelineLayout = _device.createPipelineLayout(layoutCreateInfo);
+
+	DepthPyramidShader shader;
+
+	uint32_t codeSize = sizeof(shader.computeCode);
+	vk::ShaderModule computeModule = createModule(_device, shader.computeCode, codeSize);
+
+	vk::PipelineShaderStageCreateInfo computeStageInfo = {};
+	computeStageInfo.setModule(computeModule);
+	computeStageInfo.setStage(vk::ShaderStageFlagBits::eCompute);
+	computeStageInfo.setPName("main");
+
+	vk::ComputePipelineCreateInfo createInfo = {};
+	createInfo.setStage(computeStageInfo);
+	createInfo.setLayout(_pipelineLayout);
+
+	vk::ResultValue<vk::Pipeline> result = _device.createComputePipeline({}, createInfo);
+
+	if (result.result != vk::Result::eSuccess)
+		throw std::runtime_error("Failed to create depth pyramid compute pipeline!");
+
+	_pipeline = result.value;
+
+	_device.destroyShaderModule(computeModule);
+
+	// nearest, culling picks the level where the tested rectangle spans two texels
+	vk::SamplerCreateInfo samplerInfo = {};
+	samplerInfo.setMagFilter(vk::Filter::eNearest);
+	samplerInfo.setMinFilter(vk::Filter::eNearest);
+	samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eNearest);
+	samplerInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setAddressModeV(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setMinLod(0.0f);
+	samplerInfo.setMaxLod(static_cast<float>(MAX_PYRAMID_LEVEL_COUNT));
+
+	_sampler = _device.createSampler(samplerInfo);
+}
+
+void DepthPyramid::_retirePyramids() {
+	if (_levelCount == 0)
+		return;
+
+	vk::Device device = _device;
+	vk::DescriptorPool descriptorPool = _descriptorPool;
+	std::array<Pyramid, 2> pyramids = _pyramids;
+	std::array<vk::DescriptorSet, 2> cullSets = _cullSets;
+	uint32_t levelCount = _levelCount;
+
+	RD::getSingleton().retire([=]() {
+		_destroyPyramids(device, descriptorPool, pyramids, cullSets, levelCount);
+	});
+
+	_levelCount = 0;
+}
+
+void DepthPyramid::_destroyPyramids(vk::Device device, vk::DescriptorPool descriptorPool,
+		const std::array<Pyramid, 2> &pyramids, const std::array<vk::DescriptorSet, 2> &cullSets,
+		uint32_t levelCount) {
+	RD &rd = RD::getSingleton();
+
+	for (const Pyramid &pyramid : pyramids) {
+		for (uint32_t i = 0; i < levelCount; i++)
+			device.destroyImageView(pyramid.levelViews[i]);
+
+		device.destroyImageView(pyramid.view);
+		rd.imageDestroy(pyramid.image);
+
+		(void)device.freeDescriptorSets(descriptorPool, levelCount, pyramid.levelSets);
+	}
+
+	device.freeDescriptorSets(descriptorPool, cullSets);
+}
+
+void DepthPyramid::create(vk::ImageView depthView, uint32_t width, uint32_t height) {
+	_retirePyramids();
+
+	_depthView = depthView;
+
+	_width = previousPowerOfTwo(width);
+	_height = previousPowerOfTwo(height);
+
+	_levelCount = 1;
+	while ((glm::max(_width, _height) >> _levelCount) > 0)
+		_levelCount++;
+
+	_levelCount = glm::min(_levelCount, MAX_PYRAMID_LEVEL_COUNT);
+
+	_allocateSets();
+
+	RD &rd = RD::getSingleton();
+
+	vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+
+	for (Pyramid &pyramid : _pyramids) {
+		pyramid.image = rd.imageCreate(
+				MemoryCategory::Attachments, _width, _height, PYRAMID_FORMAT, _levelCount, usage);
+		pyramid.view = rd.imageViewCreate(pyramid.image.image, PYRAMID_FORMAT, _levelCount);
+
+		for (uint32_t i = 0; i < _levelCount; i++)
+			pyramid.levelViews[i] = createLevelView(_device, pyramid.image.image, i);
+	}
+
+	for (Pyramid &pyramid : _pyramids) {
+		for (uint32_t i = 0; i < _levelCount; i++) {
+			vk::DescriptorImageInfo inputInfo = {};
+			inputInfo.setSampler(_sampler);
+
+			if (i == 0) {
+				inputInfo.setImageView(_depthView);
+				inputInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+			} else {
+				inputInfo.setImageView(pyramid.levelViews[i - 1]);
+				inputInfo.setImageLayout(vk::ImageLayout::eGeneral);
+			}
+
+			vk::DescriptorImageInfo outputInfo = {};
+			outputInfo.setImageView(pyramid.levelViews[i]);
+			outputInfo.setImageLayout(vk::ImageLayout::eGeneral);
+
+			std::array<vk::WriteDescriptorSet, 2> writeInfos = {};
+			writeInfos[0].setDstSet(pyramid.levelSets[i]);
+			writeInfos[0].setDstBinding(0);
+			writeInfos[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+			writeInfos[0].setDescriptorCount(1);
+			writeInfos[0].setImageInfo(inputInfo);
+
+			writeInfos[1].setDstSet(pyramid.levelSets[i]);
+			writeInfos[1].setDstBinding(1);
+			writeInfos[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+			writeInfos[1].setDescriptorCount(1);
+			writeInfos[1].setImageInfo(outputInfo);
+
+			_device.updateDescriptorSets(writeInfos, nullptr);
+		}
+	}
+
+	for (uint32_t i = 0; i < 2; i++) {
+		vk::DescriptorImageInfo previousInfo = {};
+		previousInfo.setSampler(_sampler);
+		previousInfo.setImageView(_pyramids[1 - i].view);
+		previousInfo.setImageLayout(vk::ImageLayout::eGeneral);
+
+		vk::DescriptorImageInfo currentInfo = {};
+		currentInfo.setSampler(_sampler);
+		currentInfo.setImageView(_pyramids[i].view);
+		currentInfo.setImageLayout(vk::ImageLayout::eGeneral);
+
+		std::array<vk::WriteDescriptorSet, 2> writeInfos = {};
+		writeInfos[0].setDstSet(_cullSets[i]);
+		writeInfos[0].setDstBinding(0);
+		writeInfos[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		writeInfos[0].setDescriptorCount(1);
+		writeInfos[0].setImageInfo(previousInfo);
+
+		writeInfos[1].setDstSet(_cullSets[i]);
+		writeInfos[1].setDstBinding(1);
+		writeInfos[1].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		writeInfos[1].setDescriptorCount(1);
+		writeInfos[1].setImageInfo(currentInfo);
+
+		_device.updateDescriptorSets(writeInfos, nullptr);
+	}
+
+	_buildCount = 0;
+	_isPreviousValid = false;
+}
+
+void DepthPyramid::swap() {
+	_current = 1 - _current;
+	_isPreviousValid = _buildCount > 0;
+}
+
+void DepthPyramid::build(vk::CommandBuffer commandBuffer, uint32_t width, uint32_t height) {
+	const Pyramid &pyramid = _pyramids[_current];
+
+	vk::ImageSubresourceRange pyramidRange = {};
+	pyramidRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+	pyramidRange.setBaseMipLevel(0);
+	pyramidRange.setLevelCount(_levelCount);
+	pyramidRange.setBaseArrayLayer(0);
+	pyramidRange.setLayerCount(1);
+
+	{
+		// last read two frames ago, old contents are discarded
+		vk::ImageMemoryBarrier barrier = {};
+		barrier.setImage(pyramid.image.image);
+		barrier.setSubresourceRange(pyramidRange);
+		barrier.setOldLayout(vk::ImageLayout::eUndefined);
+		barrier.setNewLayout(vk::ImageLayout::eGeneral);
+		barrier.setSrcAccessMask({});
+		barrier.setDstAccessMask(vk::AccessFlagBits::eShaderWrite);
+		barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+		barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+	}
+
+	FrameCounters &counters = RD::getSingleton().getFrameCounters();
+
+	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	commandBuffer.bindPipeline(bindPoint, _pipeline);
+
+	counters.pipelineBindCount++;
+	counters.descriptorSetBindCount += _levelCount;
+	counters.pushConstantBytes += sizeof(PyramidConstants) * _levelCount;
+
+	for (uint32_t i = 0; i < _levelCount; i++) {
+		PyramidConstants constants = {};
+		constants.width = glm::max(_width >> i, 1u);
+		constants.height = glm::max(_height >> i, 1u);
+		constants.inputWidth = i > 0 ? glm::max(_width >> (i - 1), 1u) : width;
+		constants.inputHeight = i > 0 ? glm::max(_height >> (i - 1), 1u) : height;
+
+		commandBuffer.bindDescriptorSets(
+				bindPoint, _pipelineLayout, 0, pyramid.levelSets[i], nullptr);
+		commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+				sizeof(constants), &constants);
+
+		commandBuffer.dispatch((constants.width + 7) / 8, (constants.height + 7) / 8, 1);
+
+		// next level and culling read what was written
+		vk::MemoryBarrier barrier = {};
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
+		barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+	}
+
+	_buildCount++;
+}
+
+vk::DescriptorSet DepthPyramid::getCullSet() const {
+	return _cullSets[_current];
+}
+
+vk::DescriptorSetLayout DepthPyramid::getCullSetLayout() const {
+	return _cullSetLayout;
+}
+
+bool DepthPyramid::isPreviousValid() const {
+	return _isPreviousValid;
+}
+
+void DepthPyramid::init() {
+	RD &rd = RD::getSingleton();
+
+	_device = rd.getDevice();
+	_descriptorPool = rd.getDescriptorPool();
+
+	_createSetLayouts();
+	_createPipeline();
+
+	_initialized = true;
+}
+
+DepthPyramid::~DepthPyramid() {
+	if (!_initialized)
+		return;
+
+	if (_levelCount > 0)
+		_destroyPyramids(_device, _descriptorPool, _pyramids, _cullSets, _levelCount);
+
+	_device.destroySampler(_sampler);
+
+	_device.destroyPipeline(_pipeline);
+	_device.destroyPipelineLayout(_pipelineLayout);
+
+	_device.destroyDescriptorSetLayout(_levelSetLayout);
+	_device.destroyDescriptorSetLayout(_cullSetLayout);
+}
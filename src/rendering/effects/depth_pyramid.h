@@ -0,0 +1,92 @@
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+#include "../types/allocated.h"
+
+const uint32_t MAX_PYRAMID_LEVEL_COUNT = 16;
+
+// Hierarchical depth built by compute from the depth attachment, every texel keeps the farthest
+// depth below it. Two pyramids alternate, so this frame's culling can still read the previous
+// frame's pyramid while the current one is built.
+class DepthPyramid {
+private:
+	struct PyramidConstants {
+		uint32_t width;
+		uint32_t height;
+		uint32_t inputWidth;
+		uint32_t inputHeight;
+	};
+
+	typedef struct {
+		AllocatedImage image;
+		vk::ImageView view;
+		vk::ImageView levelViews[MAX_PYRAMID_LEVEL_COUNT];
+		vk::DescriptorSet levelSets[MAX_PYRAMID_LEVEL_COUNT];
+	} Pyramid;
+
+	vk::Device _device;
+	vk::DescriptorPool _descriptorPool;
+
+	vk::DescriptorSetLayout _levelSetLayout;
+	vk::DescriptorSetLayout _cullSetLayout;
+
+	vk::PipelineLayout _pipelineLayout;
+	vk::Pipeline _pipeline;
+
+	vk::Sampler _sampler;
+
+	std::array<Pyramid, 2> _pyramids = {};
+	std::array<vk::DescriptorSet, 2> _cullSets = {};
+
+	vk::ImageView _depthView;
+
+	uint32_t _width = 0;
+	uint32_t _height = 0;
+	uint32_t _levelCount = 0;
+
+	uint32_t _current = 0;
+	uint32_t _buildCount = 0;
+	bool _isPreviousValid = false;
+
+	bool _initialized = false;
+
+	void _createSetLayouts();
+	void _createPipeline();
+
+	void _allocateSets();
+	// Frames in flight may still read the pyramids, RD destroys them once those completed.
+	void _retirePyramids();
+
+	static void _destroyPyramids(vk::Device device, vk::DescriptorPool descriptorPool,
+			const std::array<Pyramid, 2> &pyramids,
+			const std::array<vk::DescriptorSet, 2> &cullSets, uint32_t levelCount);
+
+public:
+	// (Re)creates both pyramids for a depth attachment, the previous frame's becomes invalid. Old
+	// pyramids and their sets are retired, so resizing doesn't wait for the device.
+	void create(vk::ImageView depthView, uint32_t width, uint32_t height);
+
+	// Called once per frame before culling, the pyramid built last frame becomes the previous.
+	void swap();
+
+	// Reduces the depth attachment into the current pyramid. Depth has to be in shader read only
+	// layout, the frame graph pass running this samples it. Only the rendered width by height
+	// corner of the attachment is read, the pyramid covers the viewport whatever the render scale.
+	void build(vk::CommandBuffer commandBuffer, uint32_t width, uint32_t height);
+
+	// Binding 0 is the previous pyramid, binding 1 the current one.
+	vk::DescriptorSet getCullSet() const;
+	vk::DescriptorSetLayout getCullSetLayout() const;
+
+	bool isPreviousValid() const;
+
+	void init();
+	~DepthPyramid();
+};
+
+#endif // !DEPTH_PYRAMID_H
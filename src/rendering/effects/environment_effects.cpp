@@ -1,16 +1,44 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <stdexcept>
+#include <string>
 
+#include <SDL3/SDL_log.h>
+#include <SDL3/SDL_timer.h>
+#include <glm/gtc/constants.hpp>
+
+#include <profiler.h>
+
+#include <rendering/render_graph.h>
 #include <rendering/rendering_device.h>
-#include <rendering/types/attachment.h>
 
 #include "shaders/brdf.gen.h"
 #include "shaders/cubemap.gen.h"
-#include "shaders/irradiance_filter.gen.h"
+#include "shaders/irradiance_sh.gen.h"
 #include "shaders/specular_filter.gen.h"
 
 #include "environment_effects.h"
 
+const vk::Format FILTER_FORMAT = vk::Format::eR32G32B32A32Sfloat;
+
+// write from layer 0 (last bit) to layer 5
+const uint32_t CUBE_VIEW_MASK = 0b00111111;
+
+// of irradiance_sh.comp, every group strides over the sky and sums its part
+const uint32_t IRRADIANCE_GROUP_COUNT = 64;
+
+// levels of the specular cube, from a mirror to a roughness of one
+const uint32_t SPECULAR_BASE_SIZE = 128;
+const uint32_t SPECULAR_LEVEL_COUNT = 5;
+
+// what every level took before sample tables, the reference filter
+const uint32_t SPECULAR_REFERENCE_SAMPLES = 2048;
+const uint32_t SPECULAR_MIN_SAMPLES = 64;
+
 static vk::ShaderModule createModule(vk::Device device, const uint32_t *pCode, size_t size) {
 	vk::ShaderModuleCreateInfo createInfo = {};
 	createInfo.setPCode(pCode);
@@ -127,103 +155,71 @@ static vk::Sampler createSampler(vk::Device device, uint32_t mipLevels) {
 	return device.createSampler(createInfo);
 }
 
-RenderTarget RenderTarget::create(
-		vk::Device device, uint32_t size, vk::PhysicalDeviceMemoryProperties memProperties) {
-	vk::Format format = vk::Format::eR32G32B32A32Sfloat;
-	vk::ImageUsageFlags usage =
-			vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
-
-	vk::ImageAspectFlagBits aspectFlags = vk::ImageAspectFlagBits::eColor;
-
-	assert(size > 0);
-
-	uint32_t arrayLayers = 6;
-
-	Attachment color = Attachment::create(device, size, size, format, usage, aspectFlags,
-			memProperties, arrayLayers, vk::ImageViewType::eCube,
-			vk::ImageCreateFlagBits::eCubeCompatible);
-
-	vk::AttachmentDescription colorAttachmentDescription = {};
-	colorAttachmentDescription.setFormat(format);
-	colorAttachmentDescription.setSamples(vk::SampleCountFlagBits::e1);
-	colorAttachmentDescription.setLoadOp(vk::AttachmentLoadOp::eDontCare);
-	colorAttachmentDescription.setStoreOp(vk::AttachmentStoreOp::eStore);
-	colorAttachmentDescription.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
-	colorAttachmentDescription.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
-	colorAttachmentDescription.setInitialLayout(vk::ImageLayout::eUndefined);
-	colorAttachmentDescription.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-	vk::AttachmentReference colorRef = {};
-	colorRef.setAttachment(0);
-	colorRef.setLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-	vk::SubpassDescription subpass = {};
-	subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics);
-	subpass.setColorAttachments(colorRef);
+// Van der Corput sequence, the second coordinate of Hammersley points.
+static float radicalInverse(uint32_t bits) {
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
 
-	// write from layer 0 (last bit) to layer 5
-	uint32_t viewMask = 0b00111111;
-	uint32_t correlationMask = 0b00111111;
-
-	vk::RenderPassMultiviewCreateInfo multiviewCreateInfo = {};
-	multiviewCreateInfo.setSubpassCount(1);
-	multiviewCreateInfo.setViewMasks(viewMask);
-	multiviewCreateInfo.setCorrelationMasks(correlationMask);
-
-	vk::RenderPassCreateInfo renderPassInfo = {};
-	renderPassInfo.setAttachments(colorAttachmentDescription);
-	renderPassInfo.setSubpasses(subpass);
-	renderPassInfo.setPNext(&multiviewCreateInfo);
+	return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
 
-	vk::RenderPass renderPass = device.createRenderPass(renderPassInfo);
+static float distributionGGX(float nDotH, float roughness) {
+	float a = roughness * roughness;
+	float a2 = a * a;
 
-	vk::ImageView colorView = color.getImageView();
+	float denom = nDotH * nDotH * (a2 - 1.0f) + 1.0f;
 
-	vk::FramebufferCreateInfo framebufferInfo = {};
-	framebufferInfo.setRenderPass(renderPass);
-	framebufferInfo.setAttachments(colorView);
-	framebufferInfo.setWidth(size);
-	framebufferInfo.setHeight(size);
-	framebufferInfo.setLayers(1);
+	return a2 / (glm::pi<float>() * denom * denom);
+}
 
-	vk::Framebuffer framebuffer;
-	vk::Result err = device.createFramebuffer(&framebufferInfo, nullptr, &framebuffer);
+static float specularRoughness(uint32_t level) {
+	return static_cast<float>(level) / static_cast<float>(SPECULAR_LEVEL_COUNT - 1);
+}
 
-	if (err != vk::Result::eSuccess)
-		throw std::runtime_error("Failed to create multiview framebuffer!");
+// The mirror level copies the source. Wider lobes read blurrier source levels and smaller levels
+// hide noise, so counts shrink with the level.
+static uint32_t specularSampleCount(uint32_t level) {
+	if (level == 0)
+		return 1;
 
-	return RenderTarget(framebuffer, renderPass, color, size);
+	uint32_t levelSize = SPECULAR_BASE_SIZE >> level;
+	return std::clamp(levelSize * 4, SPECULAR_MIN_SAMPLES, SPECULAR_REFERENCE_SAMPLES);
 }
 
-vk::Framebuffer RenderTarget::getFramebuffer() const {
-	return _framebuffer;
-}
+// every level of the specular cube, one after another
+static vk::DeviceSize specularTexelCount() {
+	vk::DeviceSize count = 0;
 
-vk::RenderPass RenderTarget::getRenderPass() const {
-	return _renderPass;
-}
+	for (uint32_t level = 0; level < SPECULAR_LEVEL_COUNT; level++) {
+		vk::DeviceSize levelSize = SPECULAR_BASE_SIZE >> level;
+		count += levelSize * levelSize * 6;
+	}
 
-Attachment RenderTarget::getColorAttachment() const {
-	return _color;
+	return count;
 }
 
-uint32_t RenderTarget::getSize() const {
-	return _size;
-}
+// Compiles the graph and runs it, waiting for the device.
+static void executeGraph(RenderGraph &graph) {
+	RD &rd = RD::getSingleton();
 
-void RenderTarget::destroy(vk::Device device) {
-	_color.destroy(device);
+	graph.compile();
 
-	device.destroyFramebuffer(_framebuffer, nullptr);
-	device.destroyRenderPass(_renderPass, nullptr);
+	vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
+	graph.execute(commandBuffer);
+	rd.endSingleTimeCommands(commandBuffer);
 }
 
-RenderTarget::RenderTarget(
-		vk::Framebuffer framebuffer, vk::RenderPass renderPass, Attachment color, uint32_t size) {
-	_framebuffer = framebuffer;
-	_renderPass = renderPass;
-	_color = color;
-	_size = size;
+static RenderGraph::ImageDesc cubeDesc(uint32_t size, uint32_t mipLevels) {
+	RenderGraph::ImageDesc desc = { FILTER_FORMAT, size, size };
+	desc.arrayLayers = 6;
+	desc.mipLevels = mipLevels;
+	desc.flags = vk::ImageCreateFlagBits::eCubeCompatible;
+	desc.viewType = vk::ImageViewType::eCube;
+
+	return desc;
 }
 
 void EnvironmentEffects::_createDescriptors(vk::DescriptorPool descriptorPool) {
@@ -289,17 +285,56 @@ void EnvironmentEffects::_createDescriptors(vk::DescriptorPool descriptorPool) {
 			throw std::runtime_error("Failed to allocate cubemap set!");
 	}
 
+	// irradiance
+
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eStorageImage);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+		vk::DescriptorSetLayoutCreateInfo createInfo = {};
+		createInfo.setBindings(bindings);
+
+		vk::Result err =
+				_device.createDescriptorSetLayout(&createInfo, nullptr, &_irradianceSetLayout);
+
+		if (err != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to create irradiance set layout!");
+
+		vk::DescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.setDescriptorPool(descriptorPool);
+		allocInfo.setDescriptorSetCount(1);
+		allocInfo.setSetLayouts(_irradianceSetLayout);
+
+		err = _device.allocateDescriptorSets(&allocInfo, &_irradianceSet);
+
+		if (err != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to allocate irradiance set!");
+	}
+
 	// filter
 
 	{
-		vk::DescriptorSetLayoutBinding binding = {};
-		binding.setBinding(0);
-		binding.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		binding.setDescriptorCount(1);
-		binding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
 		vk::DescriptorSetLayoutCreateInfo createInfo = {};
-		createInfo.setBindings(binding);
+		createInfo.setBindings(bindings);
 
 		vk::Result err = _device.createDescriptorSetLayout(&createInfo, nullptr, &_filterSetLayout);
 
@@ -379,29 +414,39 @@ void EnvironmentEffects::_createPipelines() {
 		_device.destroyShaderModule(computeModule);
 	}
 
-	RenderTarget rt = RenderTarget::create(_device, 1, _memProperties);
-
 	{
 		vk::PipelineLayoutCreateInfo layoutCreateInfo = {};
-		layoutCreateInfo.setSetLayouts(_filterSetLayout);
+		layoutCreateInfo.setSetLayouts(_irradianceSetLayout);
 
 		_irradiancePipelineLayout = _device.createPipelineLayout(layoutCreateInfo);
 
-		IrradianceFilterShader shader;
+		IrradianceShShader shader;
 
-		uint32_t codeSize = sizeof(shader.vertexCode);
-		vk::ShaderModule vertexStage = createModule(_device, shader.vertexCode, codeSize);
+		uint32_t codeSize = sizeof(shader.computeCode);
+		vk::ShaderModule computeModule = createModule(_device, shader.computeCode, codeSize);
 
-		codeSize = sizeof(shader.fragmentCode);
-		vk::ShaderModule fragmentStage = createModule(_device, shader.fragmentCode, codeSize);
+		vk::PipelineShaderStageCreateInfo computeStageInfo = {};
+		computeStageInfo.setModule(computeModule);
+		computeStageInfo.setStage(vk::ShaderStageFlagBits::eCompute);
+		computeStageInfo.setPName("main");
+
+		vk::ComputePipelineCreateInfo createInfo = {};
+		createInfo.setStage(computeStageInfo);
+		createInfo.setLayout(_irradiancePipelineLayout);
 
-		_irradiancePipeline = createPipeline(
-				_device, vertexStage, fragmentStage, _irradiancePipelineLayout, rt.getRenderPass());
+		vk::ResultValue<vk::Pipeline> result = _device.createComputePipeline({}, createInfo);
 
-		_device.destroyShaderModule(vertexStage);
-		_device.destroyShaderModule(fragmentStage);
+		if (result.result != vk::Result::eSuccess)
+			throw std::runtime_error("Failed to create irradiance compute pipeline!");
+
+		_irradiancePipeline = result.value;
+
+		_device.destroyShaderModule(computeModule);
 	}
 
+	vk::RenderPass renderPass = RD::getSingleton().getFrameGraph().getRenderPass(
+			{ FILTER_FORMAT }, vk::Format::eUndefined, CUBE_VIEW_MASK);
+
 	{
 		vk::PushConstantRange pushConstants;
 		pushConstants.setStageFlags(vk::ShaderStageFlagBits::eFragment);
@@ -423,13 +468,11 @@ void EnvironmentEffects::_createPipelines() {
 		vk::ShaderModule fragmentStage = createModule(_device, shader.fragmentCode, codeSize);
 
 		_specularPipeline = createPipeline(
-				_device, vertexStage, fragmentStage, _specularPipelineLayout, rt.getRenderPass());
+				_device, vertexStage, fragmentStage, _specularPipelineLayout, renderPass);
 
 		_device.destroyShaderModule(vertexStage);
 		_device.destroyShaderModule(fragmentStage);
 	}
-
-	rt.destroy(_device);
 }
 
 void EnvironmentEffects::_updateBrdfSet(vk::ImageView dstImageView) {
@@ -474,6 +517,21 @@ void EnvironmentEffects::_updateCubemapSet(
 	_device.updateDescriptorSets(writeInfos, nullptr);
 }
 
+void EnvironmentEffects::_updateIrradianceSet(vk::ImageView srcImageView) {
+	vk::DescriptorImageInfo imageInfo = {};
+	imageInfo.setImageView(srcImageView);
+	imageInfo.setImageLayout(vk::ImageLayout::eGeneral);
+
+	vk::WriteDescriptorSet writeInfo = {};
+	writeInfo.setDstSet(_irradianceSet);
+	writeInfo.setDstBinding(0);
+	writeInfo.setDescriptorType(vk::DescriptorType::eStorageImage);
+	writeInfo.setDescriptorCount(1);
+	writeInfo.setImageInfo(imageInfo);
+
+	_device.updateDescriptorSets(writeInfo, nullptr);
+}
+
 void EnvironmentEffects::_updateFilterSet(vk::ImageView srcImageView, vk::Sampler sampler) {
 	vk::DescriptorImageInfo imageInfo = {};
 	imageInfo.setImageView(srcImageView);
@@ -490,95 +548,101 @@ void EnvironmentEffects::_updateFilterSet(vk::ImageView srcImageView, vk::Sample
 	_device.updateDescriptorSets(writeInfo, nullptr);
 }
 
-void EnvironmentEffects::_drawIrradianceFilter(
-		vk::CommandBuffer commandBuffer, RenderTarget renderTarget) {
-	vk::Viewport viewport = {};
-	viewport.setX(0.0f);
-	viewport.setY(0.0f);
-	viewport.setWidth(renderTarget.getSize());
-	viewport.setHeight(renderTarget.getSize());
-	viewport.setMinDepth(0.0f);
-	viewport.setMaxDepth(1.0f);
+void EnvironmentEffects::_updateFilterSamples(const AllocatedBuffer &samples) {
+	vk::DescriptorBufferInfo bufferInfo = samples.getBufferInfo();
 
-	vk::Extent2D extent(renderTarget.getSize(), renderTarget.getSize());
-	vk::Offset2D offset(0, 0);
+	vk::WriteDescriptorSet writeInfo = {};
+	writeInfo.setDstSet(_filterSet);
+	writeInfo.setDstBinding(1);
+	writeInfo.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfo.setDescriptorCount(1);
+	writeInfo.setBufferInfo(bufferInfo);
 
-	vk::Rect2D scissor = {};
-	scissor.setExtent(extent);
-	scissor.setOffset(offset);
+	_device.updateDescriptorSets(writeInfo, nullptr);
+}
 
-	vk::Rect2D renderArea = {};
-	renderArea.setExtent(extent);
-	renderArea.setOffset(offset);
+std::vector<EnvironmentEffects::FilterSample> EnvironmentEffects::_specularSamples(
+		uint32_t size, bool isReference, std::vector<uint32_t> &levelOffsets) const {
+	const float PI = glm::pi<float>();
 
-	vk::RenderPassBeginInfo renderPassBeginInfo = {};
-	renderPassBeginInfo.setRenderPass(renderTarget.getRenderPass());
-	renderPassBeginInfo.setFramebuffer(renderTarget.getFramebuffer());
-	renderPassBeginInfo.setRenderArea(renderArea);
+	bool isFiltered = isReference || _isSpecularFiltered;
+	float texelSolidAngle = 4.0f * PI / (6.0f * size * size);
 
-	commandBuffer.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
+	std::vector<FilterSample> samples;
+	levelOffsets.clear();
 
-	commandBuffer.setViewport(0, viewport);
-	commandBuffer.setScissor(0, scissor);
+	for (uint32_t level = 0; level < SPECULAR_LEVEL_COUNT; level++) {
+		float roughness = specularRoughness(level);
+		float a = roughness * roughness;
 
-	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eGraphics;
-	commandBuffer.bindPipeline(bindPoint, _irradiancePipeline);
-	commandBuffer.bindDescriptorSets(bindPoint, _irradiancePipelineLayout, 0, _filterSet, nullptr);
+		// unfiltered samples all read the top level, they need the reference count to converge
+		uint32_t count = SPECULAR_REFERENCE_SAMPLES;
 
-	commandBuffer.draw(3, 1, 0, 0);
+		if (!isReference && _isSpecularFiltered)
+			count = specularSampleCount(level);
 
-	commandBuffer.endRenderPass();
-}
+		uint32_t offset = static_cast<uint32_t>(samples.size());
+		levelOffsets.push_back(offset);
+
+		float totalWeight = 0.0f;
 
-void EnvironmentEffects::_drawSpecularFilter(vk::CommandBuffer commandBuffer,
-		RenderTarget renderTarget, uint32_t size, float roughness) {
-	vk::Viewport viewport = {};
-	viewport.setX(0.0f);
-	viewport.setY(0.0f);
-	viewport.setWidth(renderTarget.getSize());
-	viewport.setHeight(renderTarget.getSize());
-	viewport.setMinDepth(0.0f);
-	viewport.setMaxDepth(1.0f);
+		for (uint32_t i = 0; i < count; i++) {
+			// GGX importance sampled half vector of a Hammersley point, around +Z
+			float phi = 2.0f * PI * static_cast<float>(i) / static_cast<float>(count);
+			float xi = radicalInverse(i);
 
-	vk::Extent2D extent(renderTarget.getSize(), renderTarget.getSize());
-	vk::Offset2D offset(0, 0);
+			float cosTheta = std::sqrt((1.0f - xi) / (1.0f + (a * a - 1.0f) * xi));
+			float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+			glm::vec3 h = glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
 
-	vk::Rect2D scissor = {};
-	scissor.setExtent(extent);
-	scissor.setOffset(offset);
+			// the normal and view are +Z, reflected around the half vector
+			glm::vec3 l = 2.0f * cosTheta * h - glm::vec3(0.0f, 0.0f, 1.0f);
+			float nDotL = l.z;
 
-	vk::Rect2D renderArea = {};
-	renderArea.setExtent(extent);
-	renderArea.setOffset(offset);
+			if (nDotL <= 0.0f)
+				continue;
 
-	vk::RenderPassBeginInfo renderPassBeginInfo = {};
-	renderPassBeginInfo.setRenderPass(renderTarget.getRenderPass());
-	renderPassBeginInfo.setFramebuffer(renderTarget.getFramebuffer());
-	renderPassBeginInfo.setRenderArea(renderArea);
+			float lod = 0.0f;
 
-	commandBuffer.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
+			// the source level whose texels cover the sample's share of the lobe, nDotH and
+			// hDotV cancel in the pdf as the view is the normal
+			if (isFiltered && roughness > 0.0f) {
+				float pdf = distributionGGX(cosTheta, roughness) / 4.0f + 0.0001f;
+				float sampleSolidAngle = 1.0f / (count * pdf + 0.0001f);
 
-	commandBuffer.setViewport(0, viewport);
-	commandBuffer.setScissor(0, scissor);
+				lod = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle), 0.0f);
+			}
+
+			samples.push_back({ glm::normalize(l), nDotL, lod, {} });
+			totalWeight += nDotL;
+		}
+
+		for (uint32_t i = offset; i < samples.size(); i++)
+			samples[i].weight /= totalWeight;
+	}
+
+	levelOffsets.push_back(static_cast<uint32_t>(samples.size()));
+	return samples;
+}
 
+void EnvironmentEffects::_drawSpecularFilter(
+		vk::CommandBuffer commandBuffer, uint32_t sampleOffset, uint32_t sampleCount) {
 	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eGraphics;
 	commandBuffer.bindPipeline(bindPoint, _specularPipeline);
 	commandBuffer.bindDescriptorSets(bindPoint, _specularPipelineLayout, 0, _filterSet, nullptr);
 
 	SpecularFilterConstants constants = {};
-	constants.size = size;
-	constants.roughness = roughness;
+	constants.sampleOffset = sampleOffset;
+	constants.sampleCount = sampleCount;
 
 	commandBuffer.pushConstants(_specularPipelineLayout, vk::ShaderStageFlagBits::eFragment, 0,
 			sizeof(constants), &constants);
 
 	commandBuffer.draw(3, 1, 0, 0);
-
-	commandBuffer.endRenderPass();
 }
 
-void EnvironmentEffects::_copyImageToLevel(
-		vk::Image srcImage, vk::Image dstImage, uint32_t level, uint32_t size) {
+void EnvironmentEffects::_copyImageToLevel(vk::CommandBuffer commandBuffer, vk::Image srcImage,
+		vk::Image dstImage, uint32_t level, uint32_t size) {
 	vk::ImageSubresourceLayers srcSubresource = {};
 	srcSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
 	srcSubresource.setMipLevel(0);
@@ -598,15 +662,9 @@ void EnvironmentEffects::_copyImageToLevel(
 	copyInfo.setDstSubresource(dstSubresource);
 	copyInfo.setExtent(extent);
 
-	{
-		vk::CommandBuffer commandBuffer = RD::getSingleton().beginSingleTimeCommands();
-
-		// clone framebuffer image level 0 to level i of filteredCube
-		commandBuffer.copyImage(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstImage,
-				vk::ImageLayout::eTransferDstOptimal, copyInfo);
-
-		RD::getSingleton().endSingleTimeCommands(commandBuffer);
-	}
+	// clone framebuffer image level 0 to level i of filteredCube
+	commandBuffer.copyImage(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstImage,
+			vk::ImageLayout::eTransferDstOptimal, copyInfo);
 }
 
 AllocatedImage EnvironmentEffects::generateBRDF() {
@@ -615,197 +673,406 @@ AllocatedImage EnvironmentEffects::generateBRDF() {
 	const vk::Format FORMAT = vk::Format::eR16G16Sfloat;
 	const uint32_t SIZE = 256;
 
-	AllocatedImage outImage = rd.imageCreate(SIZE, SIZE, FORMAT, 1,
+	AllocatedImage outImage = rd.imageCreate(MemoryCategory::Environment, SIZE, SIZE, FORMAT, 1,
 			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled);
 
-	rd.imageLayoutTransition(
-			outImage.image, FORMAT, 1, 1, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
-
 	vk::ImageView imageView = rd.imageViewCreate(outImage.image, FORMAT, 1);
 
 	_updateBrdfSet(imageView);
 
-	vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
+	RenderGraph graph;
+	graph.init(_device, &rd.getMemory(), MemoryCategory::Environment);
 
-	uint32_t groupCount = (SIZE + 15) / 16;
-	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	RenderGraph::ImageDesc desc = { FORMAT, SIZE, SIZE };
+	RenderGraph::Resource brdf = graph.importImage("BRDF", outImage.image, imageView, desc,
+			vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
 
-	commandBuffer.bindPipeline(bindPoint, _brdfPipeline);
-	commandBuffer.bindDescriptorSets(bindPoint, _brdfPipelineLayout, 0, _brdfSet, nullptr);
-	commandBuffer.dispatch(groupCount, groupCount, 1);
+	graph.setOutput(brdf);
 
-	rd.endSingleTimeCommands(commandBuffer);
+	RenderGraph::Pass pass = graph.addPass(
+			"BRDF", RenderGraph::PassType::Compute, [&](vk::CommandBuffer commandBuffer) {
+				uint32_t groupCount = (SIZE + 15) / 16;
+				vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
 
-	rd.imageViewDestroy(imageView);
+				commandBuffer.bindPipeline(bindPoint, _brdfPipeline);
+				commandBuffer.bindDescriptorSets(
+						bindPoint, _brdfPipelineLayout, 0, _brdfSet, nullptr);
+				commandBuffer.dispatch(groupCount, groupCount, 1);
+			});
 
-	rd.imageLayoutTransition(outImage.image, FORMAT, 1, 1, vk::ImageLayout::eGeneral,
-			vk::ImageLayout::eShaderReadOnlyOptimal);
+	graph.write(pass, brdf, RenderGraph::ImageAccess::Storage);
+
+	executeGraph(graph);
+
+	rd.imageViewDestroy(imageView);
 
 	return outImage;
 }
 
-AllocatedImage EnvironmentEffects::cubemapCreate(vk::ImageView imageView, uint32_t size) {
+AllocatedImage EnvironmentEffects::_recordCubemap(vk::CommandBuffer commandBuffer,
+		vk::ImageView skyView, uint32_t size, uint32_t mipLevels) {
 	RD &rd = RD::getSingleton();
 
-	const vk::Format FORMAT = vk::Format::eR32G32B32A32Sfloat;
-
-	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
-
-	AllocatedImage outImage = rd.imageCubeCreate(size, FORMAT, mipLevels,
+	AllocatedImage outImage = rd.imageCubeCreate(
+			MemoryCategory::Environment, size, FILTER_FORMAT, mipLevels,
 			vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
 					vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled);
 
-	rd.imageLayoutTransition(outImage.image, FORMAT, mipLevels, 6, vk::ImageLayout::eUndefined,
-			vk::ImageLayout::eGeneral);
+	// written here and sampled by the specular filter
+	_bakeCubemapView = rd.imageViewCreate(
+			outImage.image, FILTER_FORMAT, mipLevels, 6, vk::ImageViewType::eCube);
 
-	vk::ImageView outImageView =
-			rd.imageViewCreate(outImage.image, FORMAT, mipLevels, 6, vk::ImageViewType::eCube);
+	_updateCubemapSet(skyView, _bakeCubemapView);
 
-	_updateCubemapSet(imageView, outImageView);
+	// a single compute pass owns nothing the commands read, the graph can go once recorded
+	RenderGraph graph;
+	graph.init(_device, &rd.getMemory(), MemoryCategory::Environment);
 
-	vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
+	// left for the mipmap blits
+	RenderGraph::Resource cubemap = graph.importImage("Cubemap", outImage.image,
+			_bakeCubemapView, cubeDesc(size, mipLevels), vk::ImageLayout::eUndefined,
+			vk::ImageLayout::eTransferDstOptimal);
 
-	uint32_t groupCount = (size + 15) / 16;
-	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	graph.setOutput(cubemap);
 
-	commandBuffer.bindPipeline(bindPoint, _cubemapPipeline);
-	commandBuffer.bindDescriptorSets(bindPoint, _cubemapPipelineLayout, 0, _cubemapSet, nullptr);
-	commandBuffer.dispatch(groupCount, groupCount, 6);
+	RenderGraph::Pass pass = graph.addPass(
+			"Cubemap", RenderGraph::PassType::Compute, [&](vk::CommandBuffer commandBuffer) {
+				uint32_t groupCount = (size + 15) / 16;
+				vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
 
-	rd.endSingleTimeCommands(commandBuffer);
+				commandBuffer.bindPipeline(bindPoint, _cubemapPipeline);
+				commandBuffer.bindDescriptorSets(
+						bindPoint, _cubemapPipelineLayout, 0, _cubemapSet, nullptr);
+				commandBuffer.dispatch(groupCount, groupCount, 6);
+			});
 
-	rd.imageViewDestroy(outImageView);
+	graph.write(pass, cubemap, RenderGraph::ImageAccess::Storage);
 
-	rd.imageLayoutTransition(outImage.image, FORMAT, mipLevels, 6, vk::ImageLayout::eGeneral,
-			vk::ImageLayout::eTransferDstOptimal);
+	graph.compile();
+	graph.execute(commandBuffer);
 
-	rd.imageGenerateMipmaps(outImage.image, size, size, FORMAT, mipLevels, 6);
+	rd.imageRecordMipmaps(commandBuffer, outImage.image, size, size, mipLevels, 6);
 
 	return outImage;
 }
 
-AllocatedImage EnvironmentEffects::filterIrradiance(vk::ImageView imageView) {
-	vk::Sampler sampler = createSampler(_device, 1);
-	_updateFilterSet(imageView, sampler);
+void EnvironmentEffects::_recordIrradiance(vk::CommandBuffer commandBuffer, vk::ImageView skyView) {
+	_updateIrradianceSet(skyView);
 
-	vk::Format format = vk::Format::eR32G32B32A32Sfloat;
+	// the sky isn't tracked by a graph, nor is the buffer, a single dispatch needs no passes
+	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eCompute;
+	commandBuffer.bindPipeline(bindPoint, _irradiancePipeline);
+	commandBuffer.bindDescriptorSets(
+			bindPoint, _irradiancePipelineLayout, 0, _irradianceSet, nullptr);
+	commandBuffer.dispatch(IRRADIANCE_GROUP_COUNT, 1, 1);
+
+	vk::BufferMemoryBarrier barrier = {};
+	barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
+	barrier.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+	barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+	barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+	barrier.setBuffer(_irradianceBuffer.buffer);
+	barrier.setOffset(0);
+	barrier.setSize(VK_WHOLE_SIZE);
+
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eHost, {}, nullptr, barrier, nullptr);
+}
 
-	const uint32_t FILTERED_SIZE = 32;
+AllocatedImage EnvironmentEffects::_filterSpecular(vk::CommandBuffer commandBuffer,
+		RenderGraph &graph, uint32_t size, bool isReference, AllocatedBuffer &samples,
+		const AllocatedBuffer *pReadback) {
+	RD &rd = RD::getSingleton();
 
-	RenderTarget rt = RenderTarget::create(_device, FILTERED_SIZE, _memProperties);
+	std::vector<uint32_t> levelOffsets;
+	std::vector<FilterSample> filterSamples = _specularSamples(size, isReference, levelOffsets);
 
-	RD &rd = RD::getSingleton();
+	VmaAllocationInfo samplesAllocInfo;
+	samples = rd.bufferCreate(MemoryCategory::Environment, vk::BufferUsageFlagBits::eStorageBuffer,
+			filterSamples.size() * sizeof(FilterSample), &samplesAllocInfo);
 
-	AllocatedImage outImage = rd.imageCubeCreate(FILTERED_SIZE, format, 1,
-			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+	VmaAllocator allocator = rd.getMemory().getAllocator();
 
-	rd.imageLayoutTransition(outImage.image, format, 1, 6, vk::ImageLayout::eUndefined,
-			vk::ImageLayout::eTransferDstOptimal);
+	memcpy(samplesAllocInfo.pMappedData, filterSamples.data(),
+			filterSamples.size() * sizeof(FilterSample));
+	vmaFlushAllocation(allocator, samples.allocation, 0, VK_WHOLE_SIZE);
 
-	{
-		vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
-		_drawIrradianceFilter(commandBuffer, rt);
-		rd.endSingleTimeCommands(commandBuffer);
-	}
+	_updateFilterSamples(samples);
 
-	vk::Image framebufferImage = rt.getColorAttachment().getImage();
+	AllocatedImage outImage = rd.imageCubeCreate(MemoryCategory::Environment,
+			SPECULAR_BASE_SIZE, FILTER_FORMAT, SPECULAR_LEVEL_COUNT,
+			vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
+					vk::ImageUsageFlagBits::eSampled);
 
-	// make framebuffer image valid source
-	rd.imageLayoutTransition(framebufferImage, format, 1, 6,
-			vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal);
+	// every level renders into a target of its own size, used one after another, so they share
+	// the memory of the largest
+	graph.reset();
 
-	vk::ImageSubresourceLayers subresource = {};
-	subresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
-	subresource.setMipLevel(0);
-	subresource.setBaseArrayLayer(0);
-	subresource.setLayerCount(6);
+	RenderGraph::Resource specular = graph.importImage("Specular", outImage.image,
+			VK_NULL_HANDLE, cubeDesc(SPECULAR_BASE_SIZE, SPECULAR_LEVEL_COUNT),
+			vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
 
-	vk::ImageCopy copyInfo = {};
-	copyInfo.setSrcSubresource(subresource);
-	copyInfo.setDstSubresource(subresource);
-	copyInfo.setExtent(vk::Extent3D(FILTERED_SIZE, FILTERED_SIZE, 1));
+	graph.setOutput(specular);
 
-	{
-		vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
+	for (uint32_t level = 0; level < SPECULAR_LEVEL_COUNT; level++) {
+		uint32_t levelSize = SPECULAR_BASE_SIZE >> level;
+		uint32_t sampleOffset = levelOffsets[level];
+		uint32_t sampleCount = levelOffsets[level + 1] - sampleOffset;
+
+		RenderGraph::Resource target =
+				graph.createImage("Specular target", cubeDesc(levelSize, 1));
 
-		commandBuffer.copyImage(framebufferImage, vk::ImageLayout::eTransferSrcOptimal,
-				outImage.image, vk::ImageLayout::eTransferDstOptimal, copyInfo);
+		RenderGraph::Pass filterPass = graph.addPass("Specular filter",
+				RenderGraph::PassType::Graphics,
+				[this, sampleOffset, sampleCount](vk::CommandBuffer commandBuffer) {
+					_drawSpecularFilter(commandBuffer, sampleOffset, sampleCount);
+				});
 
-		rd.endSingleTimeCommands(commandBuffer);
+		graph.write(filterPass, target, RenderGraph::ImageAccess::ColorAttachment);
+		graph.setViewMask(filterPass, CUBE_VIEW_MASK);
+
+		RenderGraph::Pass copyPass = graph.addPass("Specular copy",
+				RenderGraph::PassType::Transfer,
+				[this, &graph, &outImage, target, level, levelSize](
+						vk::CommandBuffer commandBuffer) {
+					_copyImageToLevel(commandBuffer, graph.getImage(target), outImage.image,
+							level, levelSize);
+				});
+
+		graph.read(copyPass, target, RenderGraph::ImageAccess::TransferSrc);
+		graph.write(copyPass, specular, RenderGraph::ImageAccess::TransferDst);
 	}
 
-	// render target is no longer needed
-	rt.destroy(_device);
-	_device.destroySampler(sampler);
+	if (pReadback != nullptr) {
+		RenderGraph::Pass readbackPass = graph.addPass("Specular readback",
+				RenderGraph::PassType::Transfer, [&](vk::CommandBuffer commandBuffer) {
+					std::vector<vk::BufferImageCopy> regions;
+					vk::DeviceSize offset = 0;
+
+					for (uint32_t level = 0; level < SPECULAR_LEVEL_COUNT; level++) {
+						uint32_t levelSize = SPECULAR_BASE_SIZE >> level;
+
+						vk::ImageSubresourceLayers subresource = {};
+						subresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
+						subresource.setMipLevel(level);
+						subresource.setBaseArrayLayer(0);
+						subresource.setLayerCount(6);
+
+						vk::BufferImageCopy region = {};
+						region.setBufferOffset(offset);
+						region.setImageSubresource(subresource);
+						region.setImageExtent(vk::Extent3D(levelSize, levelSize, 1));
+						regions.push_back(region);
+
+						offset += levelSize * levelSize * 6 * sizeof(glm::vec4);
+					}
+
+					commandBuffer.copyImageToBuffer(outImage.image,
+							vk::ImageLayout::eTransferSrcOptimal, pReadback->buffer, regions);
+
+					vk::BufferMemoryBarrier barrier = {};
+					barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+					barrier.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+					barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+					barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+					barrier.setBuffer(pReadback->buffer);
+					barrier.setOffset(0);
+					barrier.setSize(VK_WHOLE_SIZE);
+
+					commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+							vk::PipelineStageFlagBits::eHost, {}, nullptr, barrier, nullptr);
+				});
+
+		graph.read(readbackPass, specular, RenderGraph::ImageAccess::TransferSrc);
+		graph.setSideEffects(readbackPass);
+	}
 
-	rd.imageLayoutTransition(outImage.image, format, 1, 6, vk::ImageLayout::eTransferDstOptimal,
-			vk::ImageLayout::eShaderReadOnlyOptimal);
+	graph.compile();
+	graph.execute(commandBuffer);
 
 	return outImage;
 }
 
-AllocatedImage EnvironmentEffects::filterSpecular(
-		vk::ImageView imageView, uint32_t size, uint32_t mipLevels) {
-	vk::Sampler sampler = createSampler(_device, mipLevels);
-	_updateFilterSet(imageView, sampler);
+double EnvironmentEffects::_timeSpecular(
+		uint32_t size, bool isReference, const AllocatedBuffer &readback) {
+	RD &rd = RD::getSingleton();
+
+	uint64_t start = SDL_GetPerformanceCounter();
+
+	RenderGraph graph;
+	graph.init(_device, &rd.getMemory(), MemoryCategory::Environment);
 
-	vk::Format format = vk::Format::eR32G32B32A32Sfloat;
+	AllocatedBuffer samples;
 
-	const uint32_t BASE_SIZE = 128;
-	const uint32_t LEVEL_COUNT = 5;
+	vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
+	AllocatedImage outImage =
+			_filterSpecular(commandBuffer, graph, size, isReference, samples, &readback);
+	rd.endSingleTimeCommands(commandBuffer);
 
-	uint32_t levelSize = BASE_SIZE;
+	uint64_t elapsed = SDL_GetPerformanceCounter() - start;
 
+	rd.bufferDestroy(samples);
+	rd.imageDestroy(outImage);
+
+	return elapsed * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void EnvironmentEffects::_compareSpecular(uint32_t size) {
 	RD &rd = RD::getSingleton();
 
-	AllocatedImage outImage = rd.imageCubeCreate(BASE_SIZE, format, LEVEL_COUNT,
-			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+	VmaAllocator allocator = rd.getMemory().getAllocator();
 
-	rd.imageLayoutTransition(outImage.image, format, LEVEL_COUNT, 6, vk::ImageLayout::eUndefined,
-			vk::ImageLayout::eTransferDstOptimal);
+	vk::DeviceSize texelCount = specularTexelCount();
 
-	for (uint32_t level = 0; level < LEVEL_COUNT; level++) {
-		float roughness = static_cast<float>(level) / static_cast<float>(LEVEL_COUNT - 1);
+	// both bakes read back, so they are timed alike
+	VmaAllocationInfo allocInfo;
+	AllocatedBuffer readback = rd.bufferCreate(MemoryCategory::Staging,
+			vk::BufferUsageFlagBits::eTransferDst, texelCount * sizeof(glm::vec4), &allocInfo,
+			true);
 
-		RenderTarget rt = RenderTarget::create(_device, levelSize, _memProperties);
+	double time = _timeSpecular(size, false, readback);
 
-		{
-			vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
-			_drawSpecularFilter(commandBuffer, rt, size, roughness);
-			rd.endSingleTimeCommands(commandBuffer);
-		}
+	// the reference reads back into the same buffer
+	std::vector<glm::vec4> filtered(texelCount);
+
+	vmaInvalidateAllocation(allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+	memcpy(filtered.data(), allocInfo.pMappedData, texelCount * sizeof(glm::vec4));
+
+	double referenceTime = _timeSpecular(size, true, readback);
+
+	vmaInvalidateAllocation(allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+	const glm::vec4 *pReference = static_cast<const glm::vec4 *>(allocInfo.pMappedData);
+
+	// root mean square of the difference over that of the reference, per level
+	std::string errors;
+	vk::DeviceSize offset = 0;
+
+	for (uint32_t level = 0; level < SPECULAR_LEVEL_COUNT; level++) {
+		vk::DeviceSize levelSize = SPECULAR_BASE_SIZE >> level;
+		vk::DeviceSize levelEnd = offset + levelSize * levelSize * 6;
+
+		double error = 0.0;
+		double energy = 0.0;
 
-		vk::Image framebufferImage = rt.getColorAttachment().getImage();
+		for (; offset < levelEnd; offset++) {
+			glm::dvec3 value = glm::dvec3(pReference[offset]);
+			glm::dvec3 difference = glm::dvec3(filtered[offset]) - value;
 
-		rd.imageLayoutTransition(framebufferImage, format, 1, 6,
-				vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal);
+			error += glm::dot(difference, difference);
+			energy += glm::dot(value, value);
+		}
 
-		_copyImageToLevel(framebufferImage, outImage.image, level, levelSize);
+		char levelError[32];
+		snprintf(levelError, sizeof(levelError), " %.4f",
+				energy > 0.0 ? std::sqrt(error / energy) : 0.0);
 
-		// render target is no longer needed
-		rt.destroy(_device);
-		levelSize = levelSize >> 1;
+		errors += levelError;
 	}
 
-	_device.destroySampler(sampler);
+	rd.bufferDestroy(readback);
+
+	SDL_Log("Specular filter: %.2f ms, reference %.2f ms, relative error per level%s", time,
+			referenceTime, errors.c_str());
+}
 
-	rd.imageLayoutTransition(outImage.image, format, LEVEL_COUNT, 6,
-			vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+EnvironmentEffects::Bake EnvironmentEffects::bakeRecord(
+		vk::CommandBuffer commandBuffer, vk::ImageView skyView, uint32_t size) {
+	PROFILE_SCOPE("EnvironmentEffects::bakeRecord");
 
-	return outImage;
+	// the sets below are still read by the previous bake
+	assert(!_isBaking);
+
+	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
+
+	Bake bake;
+	bake.cubemap = _recordCubemap(commandBuffer, skyView, size, mipLevels);
+
+	_recordIrradiance(commandBuffer, skyView);
+
+	_bakeSampler = createSampler(_device, mipLevels);
+	_updateFilterSet(_bakeCubemapView, _bakeSampler);
+
+	bake.specular = _filterSpecular(commandBuffer, _specularGraph, size, false, _bakeSamples);
+
+	_bakeSize = size;
+	_isBaking = true;
+
+	return bake;
+}
+
+IrradianceSH EnvironmentEffects::bakeFinish() {
+	PROFILE_SCOPE("EnvironmentEffects::bakeFinish");
+
+	assert(_isBaking);
+
+	RD &rd = RD::getSingleton();
+
+	// the filter set still samples the bake's cube
+	if (_isSpecularCompared)
+		_compareSpecular(_bakeSize);
+
+	rd.bufferDestroy(_bakeSamples);
+	_device.destroySampler(_bakeSampler);
+	rd.imageViewDestroy(_bakeCubemapView);
+
+	_isBaking = false;
+
+	VmaAllocator allocator = rd.getMemory().getAllocator();
+	vmaInvalidateAllocation(allocator, _irradianceBuffer.allocation, 0, VK_WHOLE_SIZE);
+
+	const glm::vec4 *pPartialSums =
+			static_cast<const glm::vec4 *>(_irradianceAllocInfo.pMappedData);
+
+	IrradianceSH irradiance;
+
+	for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+		glm::dvec3 sum = glm::dvec3(0.0);
+
+		for (uint32_t group = 0; group < IRRADIANCE_GROUP_COUNT; group++)
+			sum += glm::dvec3(pPartialSums[group * SH_COEFFICIENT_COUNT + i]);
+
+		irradiance[i] = glm::vec4(glm::vec3(sum) * SH_IRRADIANCE_SCALES[i], 0.0f);
+	}
+
+	return irradiance;
+}
+
+void EnvironmentEffects::setSpecularFilter(bool isFiltered, bool isCompared) {
+	_isSpecularFiltered = isFiltered;
+	_isSpecularCompared = isCompared;
 }
 
 void EnvironmentEffects::init() {
 	RD &rd = RD::getSingleton();
 
 	_device = rd.getDevice();
-	_memProperties = rd.getPhysicalDevice().getMemoryProperties();
 
 	vk::DescriptorPool descriptorPool = rd.getDescriptorPool();
 
 	_createDescriptors(descriptorPool);
 	_createPipelines();
 
+	_specularGraph.init(_device, &rd.getMemory(), MemoryCategory::Environment);
+
+	{
+		vk::DeviceSize size = IRRADIANCE_GROUP_COUNT * SH_COEFFICIENT_COUNT * sizeof(glm::vec4);
+
+		// partial sums are summed on the CPU
+		_irradianceBuffer = rd.bufferCreate(MemoryCategory::Environment,
+				vk::BufferUsageFlagBits::eStorageBuffer, size, &_irradianceAllocInfo, true);
+
+		vk::DescriptorBufferInfo bufferInfo = _irradianceBuffer.getBufferInfo();
+
+		vk::WriteDescriptorSet writeInfo = {};
+		writeInfo.setDstSet(_irradianceSet);
+		writeInfo.setDstBinding(1);
+		writeInfo.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		writeInfo.setDescriptorCount(1);
+		writeInfo.setBufferInfo(bufferInfo);
+
+		_device.updateDescriptorSets(writeInfo, nullptr);
+	}
+
 	_initialized = true;
 }
 
@@ -823,6 +1090,9 @@ EnvironmentEffects::~EnvironmentEffects() {
 
 	_device.destroyPipeline(_irradiancePipeline);
 	_device.destroyPipelineLayout(_irradiancePipelineLayout);
+	_device.destroyDescriptorSetLayout(_irradianceSetLayout);
+
+	RD::getSingleton().bufferDestroy(_irradianceBuffer);
 
 	_device.destroyPipeline(_specularPipeline);
 	_device.destroyPipelineLayout(_specularPipelineLayout);
@@ -2,39 +2,18 @@
 #define CUBEMAP_H
 
 #include <cstdint>
-#include <vulkan/vulkan.hpp>
-
-#include "../types/attachment.h"
-
-class RenderTarget {
-private:
-	vk::Framebuffer _framebuffer;
-	vk::RenderPass _renderPass;
-
-	Attachment _color;
-	uint32_t _size;
+#include <vector>
 
-public:
-	static RenderTarget create(
-			vk::Device device, uint32_t size, vk::PhysicalDeviceMemoryProperties memProperties);
-
-	void destroy(vk::Device device);
-
-	vk::Framebuffer getFramebuffer() const;
-	vk::RenderPass getRenderPass() const;
-	Attachment getColorAttachment() const;
-	uint32_t getSize() const;
-
-	RenderTarget(vk::Framebuffer framebuffer, vk::RenderPass renderPass, Attachment color,
-			uint32_t size);
-};
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
 
-class AllocatedImage;
+#include "../render_graph.h"
+#include "../spherical_harmonics.h"
+#include "../types/allocated.h"
 
 class EnvironmentEffects {
 private:
 	vk::Device _device;
-	vk::PhysicalDeviceMemoryProperties _memProperties;
 
 	vk::PipelineLayout _brdfPipelineLayout;
 	vk::Pipeline _brdfPipeline;
@@ -51,9 +30,25 @@ private:
 	vk::PipelineLayout _irradiancePipelineLayout;
 	vk::Pipeline _irradiancePipeline;
 
+	vk::DescriptorSetLayout _irradianceSetLayout;
+	vk::DescriptorSet _irradianceSet;
+
+	// coefficients summed by every group of the projection, read back on the CPU
+	AllocatedBuffer _irradianceBuffer;
+	VmaAllocationInfo _irradianceAllocInfo;
+
+	// A sample of a specular filter level, in the tangent space of the filtered direction. The
+	// weights of a level sum to one. std430, specular_filter.frag declares the same.
+	typedef struct {
+		glm::vec3 direction;
+		float weight;
+		float lod;
+		float _padding[3];
+	} FilterSample;
+
 	typedef struct {
-		uint32_t size;
-		float roughness;
+		uint32_t sampleOffset;
+		uint32_t sampleCount;
 	} SpecularFilterConstants;
 
 	vk::PipelineLayout _specularPipelineLayout;
@@ -62,6 +57,19 @@ private:
 	vk::DescriptorSetLayout _filterSetLayout;
 	vk::DescriptorSet _filterSet;
 
+	bool _isSpecularFiltered = true;
+	bool _isSpecularCompared = false;
+
+	// Reused by every bake, its targets are rendered into until the bake's commands complete.
+	RenderGraph _specularGraph;
+
+	// read by the recorded bake, released by bakeFinish
+	vk::ImageView _bakeCubemapView;
+	vk::Sampler _bakeSampler;
+	AllocatedBuffer _bakeSamples;
+	uint32_t _bakeSize = 0;
+	bool _isBaking = false;
+
 	bool _initialized = false;
 
 	void _createDescriptors(vk::DescriptorPool descriptorPool);
@@ -69,20 +77,58 @@ private:
 
 	void _updateBrdfSet(vk::ImageView dstImageView);
 	void _updateCubemapSet(vk::ImageView srcImageView, vk::ImageView dstCubemapView);
+	void _updateIrradianceSet(vk::ImageView srcImageView);
 	void _updateFilterSet(vk::ImageView srcImageView, vk::Sampler sampler);
-
-	void _drawIrradianceFilter(vk::CommandBuffer commandBuffer, RenderTarget renderTarget);
-	void _drawSpecularFilter(vk::CommandBuffer commandBuffer, RenderTarget renderTarget,
-			uint32_t size, float roughness);
-
-	void _copyImageToLevel(vk::Image srcImage, vk::Image dstImage, uint32_t level, uint32_t size);
+	void _updateFilterSamples(const AllocatedBuffer &samples);
+
+	// Samples of every level one after another, for a source cube of the given size. The
+	// reference takes as many samples at every level as the filter did before it had tables.
+	std::vector<FilterSample> _specularSamples(
+			uint32_t size, bool isReference, std::vector<uint32_t> &levelOffsets) const;
+
+	// Drawn into all six faces at once, from a render graph pass that set the viewport.
+	void _drawSpecularFilter(
+			vk::CommandBuffer commandBuffer, uint32_t sampleOffset, uint32_t sampleCount);
+
+	void _copyImageToLevel(vk::CommandBuffer commandBuffer, vk::Image srcImage,
+			vk::Image dstImage, uint32_t level, uint32_t size);
+
+	// Converted from the sky, with mipmaps, ending in shader read only layout.
+	AllocatedImage _recordCubemap(vk::CommandBuffer commandBuffer, vk::ImageView skyView,
+			uint32_t size, uint32_t mipLevels);
+	// Projects the sky on spherical harmonics with a compute reduction, summed by bakeFinish.
+	void _recordIrradiance(vk::CommandBuffer commandBuffer, vk::ImageView skyView);
+	// Filters the source bound to the filter set into a new cube. The graph's targets and the
+	// samples are read until the commands complete. Every level is copied into the readback
+	// buffer too when there is one.
+	AllocatedImage _filterSpecular(vk::CommandBuffer commandBuffer, RenderGraph &graph,
+			uint32_t size, bool isReference, AllocatedBuffer &samples,
+			const AllocatedBuffer *pReadback = nullptr);
+	// Bakes the filter or the reference into the readback, waiting for the GPU, in milliseconds.
+	double _timeSpecular(uint32_t size, bool isReference, const AllocatedBuffer &readback);
+	// Bakes the filter and the reference alike and logs both times and the error of every level
+	// of the filter against the reference.
+	void _compareSpecular(uint32_t size);
 
 public:
+	typedef struct {
+		AllocatedImage cubemap;
+		AllocatedImage specular;
+	} Bake;
+
 	AllocatedImage generateBRDF();
 
-	AllocatedImage cubemapCreate(vk::ImageView imageView, uint32_t size);
-	AllocatedImage filterIrradiance(vk::ImageView imageView);
-	AllocatedImage filterSpecular(vk::ImageView imageView, uint32_t size, uint32_t mipLevels);
+	// Records the bake of an equirectangular sky, in general layout, into the command buffer,
+	// which nothing waits on here. One bake at a time, bakeFinish once its commands completed.
+	Bake bakeRecord(vk::CommandBuffer commandBuffer, vk::ImageView skyView, uint32_t size);
+	// Sums the irradiance of the bake and releases what its commands read. Comparing bakes the
+	// filter and the reference again here, waiting for the GPU.
+	IrradianceSH bakeFinish();
+
+	// Filtered importance sampling reads every sample from the source level whose texels cover
+	// its share of the lobe, so few samples don't alias. Comparing bakes the reference filter
+	// after every specular bake and logs its time and error.
+	void setSpecularFilter(bool isFiltered, bool isCompared);
 
 	void init();
 	~EnvironmentEffects();
@@ -4,66 +4,44 @@
 #extension GL_EXT_multiview : enable
 
 #include "include/cubemap_incl.glsl"
-#include "include/filter_incl.glsl"
 
 layout(location = 0) in vec2 inCoords;
 layout(location = 0) out vec4 outFragColor;
 
-layout(set = 0, binding = 0) uniform samplerCube cubeSampler;
-
-layout(push_constant) uniform PreFilterPushConstants {
-	uint size;
-	float roughness;
+// in the tangent space of the filtered direction, the weights of a level sum to one
+struct FilterSample {
+	vec3 direction;
+	float weight;
+	float lod;
 };
 
-float distributionGGX(float nDotH, float roughness) {
-	float a = roughness * roughness;
-	float a2 = a * a;
-	float nDotH2 = nDotH * nDotH;
+layout(set = 0, binding = 0) uniform samplerCube cubeSampler;
 
-	float nom = a2;
-	float denom = (nDotH2 * (a2 - 1.0) + 1.0);
-	denom = PI * denom * denom;
+layout(set = 0, binding = 1) readonly buffer FilterSampleBuffer {
+	FilterSample samples[];
+};
 
-	return nom / denom;
-}
+layout(push_constant) uniform PreFilterPushConstants {
+	uint sampleOffset;
+	uint sampleCount;
+};
 
 void main() {
+	// the normal and view are the filtered direction, samples only need rotating around it
 	vec3 n = mapToCube(inCoords, gl_ViewIndex, true);
-	vec3 r = n;
-	vec3 v = r;
 
-	vec3 filteredColor = vec3(0.0);
-	float totalWeight = 0.0;
-
-	const uint SAMPLE_COUNT = 2048u;
-
-	for (uint i = 0u; i < SAMPLE_COUNT; i++) {
-		// generates a sample vector that's biased towards the preferred alignment direction (importance sampling).
-		vec2 xi = hammersley(i, SAMPLE_COUNT);
-		vec3 h = importanceSampleGGX(xi, n, roughness);
-		vec3 l = normalize(2.0 * dot(v, h) * h - v);
-
-		float nDotL = max(dot(n, l), 0.0);
+	vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+	vec3 tangent = normalize(cross(up, n));
+	vec3 bitangent = cross(n, tangent);
 
-		if (nDotL > 0.0) {
-			float nDotH = max(dot(n, h), 0.0);
-			float hDotV = max(dot(h, v), 0.0);
-
-			// sample from the environment's mip level based on roughness/pdf
-			float d = distributionGGX(nDotH, roughness);
-			float pdf = d * nDotH / (4.0 * hDotV) + 0.0001;
-
-			float saSample = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
-			float saTexel = 4.0 * PI / (6.0 * float(size) * float(size));
+	vec3 filteredColor = vec3(0.0);
 
-			float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel);
+	for (uint i = 0u; i < sampleCount; i++) {
+		FilterSample s = samples[sampleOffset + i];
+		vec3 l = tangent * s.direction.x + bitangent * s.direction.y + n * s.direction.z;
 
-			filteredColor += textureLod(cubeSampler, l, mipLevel).rgb * nDotL;
-			totalWeight += nDotL;
-		}
+		filteredColor += textureLod(cubeSampler, l, s.lod).rgb * s.weight;
 	}
 
-	filteredColor = filteredColor / totalWeight;
 	outFragColor = vec4(filteredColor, 1.0);
 }
@@ -0,0 +1,373 @@
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include <rendering/rendering_device.h>
+
+#include "shadow_maps.h"
+
+// cascades cover the view up to this distance, split between linear and logarithmic
+const float SHADOW_DISTANCE = 100.0f;
+const float SPLIT_LAMBDA = 0.75f;
+
+// Regions are enlarged by this fraction of their radius and move in steps of about as much, the
+// view slice stays inside while the snapped center lags behind the camera.
+const float SNAP_FRACTION = 0.125f;
+
+// how far toward the light, past the region, casters are rendered
+const float CASTER_DISTANCE = 100.0f;
+
+// instance storage is grown with headroom to avoid reallocating every frame
+const float GROWTH_FACTOR = 1.5f;
+
+static const char *const STATIC_MAP_NAMES[SHADOW_CASCADE_COUNT] = {
+	"Shadow cascade 0",
+	"Shadow cascade 1",
+	"Shadow cascade 2",
+	"Shadow cascade 3",
+};
+
+static const char *const OVERLAY_MAP_NAMES[SHADOW_CASCADE_COUNT] = {
+	"Shadow overlay 0",
+	"Shadow overlay 1",
+	"Shadow overlay 2",
+	"Shadow overlay 3",
+};
+
+void ShadowMaps::_createDescriptors() {
+	std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].setBinding(0);
+	bindings[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+	bindings[0].setDescriptorCount(SHADOW_CASCADE_COUNT);
+	bindings[0].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+	bindings[1].setBinding(1);
+	bindings[1].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+	bindings[1].setDescriptorCount(SHADOW_CASCADE_COUNT);
+	bindings[1].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+	vk::DescriptorSetLayoutCreateInfo createInfo = {};
+	createInfo.setBindings(bindings);
+
+	vk::Result err = _device.createDescriptorSetLayout(&createInfo, nullptr, &_setLayout);
+
+	if (err != vk::Result::eSuccess)
+		throw std::runtime_error("Failed to create shadow map set layout!");
+
+	vk::DescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.setDescriptorPool(_descriptorPool);
+	allocInfo.setDescriptorSetCount(1);
+	allocInfo.setSetLayouts(_setLayout);
+
+	err = _device.allocateDescriptorSets(&allocInfo, &_set);
+
+	if (err != vk::Result::eSuccess)
+		throw std::runtime_error("Failed to allocate shadow map set!");
+
+	// depth compare in hardware, reverse-Z so nearer to the light is greater
+	vk::SamplerCreateInfo samplerInfo = {};
+	samplerInfo.setMagFilter(vk::Filter::eLinear);
+	samplerInfo.setMinFilter(vk::Filter::eLinear);
+	samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eNearest);
+	samplerInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setAddressModeV(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setCompareEnable(true);
+	samplerInfo.setCompareOp(vk::CompareOp::eGreaterOrEqual);
+	samplerInfo.setMinLod(0.0f);
+	samplerInfo.setMaxLod(0.0f);
+
+	_sampler = _device.createSampler(samplerInfo);
+}
+
+void ShadowMaps::_createMaps() {
+	RD &rd = RD::getSingleton();
+
+	vk::ImageUsageFlags usage =
+			vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled;
+
+	std::array<vk::DescriptorImageInfo, SHADOW_CASCADE_COUNT> staticInfos = {};
+	std::array<vk::DescriptorImageInfo, SHADOW_CASCADE_COUNT> overlayInfos = {};
+
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+		Map &staticMap = _staticMaps[i];
+		staticMap.image = rd.imageCreate(MemoryCategory::Attachments, SHADOW_MAP_SIZE,
+				SHADOW_MAP_SIZE, SHADOW_FORMAT, 1, usage);
+		staticMap.view = rd.imageViewCreate(staticMap.image.image, SHADOW_FORMAT, 1);
+
+		Map &overlayMap = _overlayMaps[i];
+		overlayMap.image = rd.imageCreate(MemoryCategory::Attachments, SHADOW_OVERLAY_SIZE,
+				SHADOW_OVERLAY_SIZE, SHADOW_OVERLAY_FORMAT, 1, usage);
+		overlayMap.view = rd.imageViewCreate(overlayMap.image.image, SHADOW_OVERLAY_FORMAT, 1);
+
+		// frame graph passes rendering them take them from and back to the layout they are read in
+		rd.imageLayoutTransition(staticMap.image.image, SHADOW_FORMAT, 1, 1,
+				vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+		rd.imageLayoutTransition(overlayMap.image.image, SHADOW_OVERLAY_FORMAT, 1, 1,
+				vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		staticInfos[i].setSampler(_sampler);
+		staticInfos[i].setImageView(staticMap.view);
+		staticInfos[i].setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		overlayInfos[i].setSampler(_sampler);
+		overlayInfos[i].setImageView(overlayMap.view);
+		overlayInfos[i].setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+	}
+
+	std::array<vk::WriteDescriptorSet, 2> writeInfos = {};
+	writeInfos[0].setDstSet(_set);
+	writeInfos[0].setDstBinding(0);
+	writeInfos[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+	writeInfos[0].setImageInfo(staticInfos);
+
+	writeInfos[1].setDstSet(_set);
+	writeInfos[1].setDstBinding(1);
+	writeInfos[1].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+	writeInfos[1].setImageInfo(overlayInfos);
+
+	_device.updateDescriptorSets(writeInfos, nullptr);
+}
+
+void ShadowMaps::_updateCascade(Cascade &cascade, const glm::vec3 &center, float radius) {
+	float halfExtent = radius * (1.0f + SNAP_FRACTION);
+	float texelSize = 2.0f * halfExtent / static_cast<float>(SHADOW_MAP_SIZE);
+
+	// whole texels, cached content stays aligned to the texel grid when the region moves
+	float step = texelSize * glm::max(glm::floor(radius * SNAP_FRACTION / texelSize), 1.0f);
+
+	glm::vec3 lightCenter = glm::vec3(_lightView * glm::vec4(center, 1.0f));
+	lightCenter = glm::floor(lightCenter / step + 0.5f) * step;
+
+	if (lightCenter != cascade.center || halfExtent != cascade.halfExtent)
+		cascade.isCached = false;
+
+	cascade.center = lightCenter;
+	cascade.halfExtent = halfExtent;
+	cascade.texelSize = texelSize;
+
+	// light view looks down -Z, casters toward the light are nearer
+	glm::mat4 proj = glm::orthoRH(lightCenter.x - halfExtent, lightCenter.x + halfExtent,
+			lightCenter.y - halfExtent, lightCenter.y + halfExtent,
+			-lightCenter.z - halfExtent - CASTER_DISTANCE, -lightCenter.z + halfExtent);
+
+	cascade.projView = REVERSE_Z_MATRIX * OPENGL_TO_VULKAN_MATRIX * proj * _lightView;
+}
+
+void ShadowMaps::update(const Camera &camera, float aspect, const glm::vec3 &lightDirection) {
+	glm::vec3 direction = glm::normalize(lightDirection);
+
+	if (_cascadeCount == 0 || direction != _lightDirection) {
+		for (Cascade &cascade : _cascades)
+			cascade.isCached = false;
+
+		glm::vec3 up = glm::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : CAMERA_UP;
+
+		_lightDirection = direction;
+		_lightView = glm::lookAtRH(glm::vec3(0.0f), direction, up);
+	}
+
+	_cascadeCount = SHADOW_CASCADE_COUNT;
+
+	float zNear = camera.zNear;
+	float zFar = glm::max(glm::min(camera.zFar, SHADOW_DISTANCE), zNear * 2.0f);
+
+	// squared distance of a frustum corner from the view axis, per unit of depth squared
+	float tanHalfFovY = glm::tan(camera.fovY * 0.5f);
+	float cornerScale = tanHalfFovY * tanHalfFovY * (1.0f + aspect * aspect);
+
+	glm::vec3 position = glm::vec3(camera.transform[3]);
+	glm::vec3 front = glm::normalize(glm::mat3(camera.transform) * CAMERA_FRONT);
+
+	float splitNear = zNear;
+
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+		float t = static_cast<float>(i + 1) / static_cast<float>(SHADOW_CASCADE_COUNT);
+
+		float linearSplit = zNear + (zFar - zNear) * t;
+		float logSplit = zNear * glm::pow(zFar / zNear, t);
+		float splitFar = glm::mix(linearSplit, logSplit, SPLIT_LAMBDA);
+
+		// smallest sphere through the slice's corners, centered on the view axis
+		float depth = glm::min((splitNear + splitFar) * 0.5f * (1.0f + cornerScale), splitFar);
+
+		float farDistance = (splitFar - depth) * (splitFar - depth) +
+				splitFar * splitFar * cornerScale;
+		float nearDistance = (depth - splitNear) * (depth - splitNear) +
+				splitNear * splitNear * cornerScale;
+
+		float radius = glm::sqrt(glm::max(farDistance, nearDistance));
+
+		_updateCascade(_cascades[i], position + front * depth, radius);
+		splitNear = splitFar;
+	}
+}
+
+void ShadowMaps::disable() {
+	for (Cascade &cascade : _cascades) {
+		cascade.isCached = false;
+		cascade.hasOverlay = false;
+	}
+
+	_cascadeCount = 0;
+}
+
+void ShadowMaps::invalidate(const glm::vec3 &center, float radius) {
+	for (uint32_t i = 0; i < _cascadeCount; i++) {
+		if (_cascades[i].isCached && intersects(i, center, radius))
+			_cascades[i].isCached = false;
+	}
+}
+
+bool ShadowMaps::intersects(uint32_t cascade, const glm::vec3 &center, float radius) const {
+	assert(cascade < _cascadeCount);
+
+	const Cascade &data = _cascades[cascade];
+
+	glm::vec3 offset = glm::vec3(_lightView * glm::vec4(center, 1.0f)) - data.center;
+	float extent = data.halfExtent + radius;
+
+	return glm::abs(offset.x) <= extent && glm::abs(offset.y) <= extent && offset.z >= -extent &&
+			offset.z <= extent + CASTER_DISTANCE;
+}
+
+bool ShadowMaps::isCached(uint32_t cascade) const {
+	return _cascades[cascade].isCached;
+}
+
+bool ShadowMaps::setOverlayCasters(uint32_t cascade, bool hasCasters) {
+	Cascade &data = _cascades[cascade];
+
+	bool isRendered = hasCasters || data.hasOverlay;
+	data.hasOverlay = hasCasters;
+
+	return isRendered;
+}
+
+void ShadowMaps::upload(uint32_t frame, const glm::mat4 *pInstances, uint32_t instanceCount) {
+	assert(frame < _frames.size());
+
+	RD &rd = RD::getSingleton();
+
+	_frame = frame;
+	FrameData &frameData = _frames[frame];
+
+	// frame fence was waited on, its buffer is no longer in use
+	if (instanceCount > frameData.instanceCapacity) {
+		if (frameData.instanceCapacity > 0)
+			rd.bufferDestroy(frameData.instanceBuffer);
+
+		frameData.instanceCapacity = static_cast<uint32_t>(instanceCount * GROWTH_FACTOR);
+		frameData.instanceBuffer = rd.bufferCreate(MemoryCategory::Frame,
+				vk::BufferUsageFlagBits::eVertexBuffer,
+				sizeof(glm::mat4) * frameData.instanceCapacity, &frameData.instanceAllocInfo);
+	}
+
+	if (instanceCount == 0)
+		return;
+
+	memcpy(frameData.instanceAllocInfo.pMappedData, pInstances,
+			sizeof(glm::mat4) * instanceCount);
+
+	rd.getFrameCounters().uploadBytes += sizeof(glm::mat4) * instanceCount;
+}
+
+RenderGraph::Resource ShadowMaps::importMap(
+		RenderGraph &graph, uint32_t cascade, bool isOverlay) {
+	assert(cascade < _cascadeCount);
+
+	const Map &map = isOverlay ? _overlayMaps[cascade] : _staticMaps[cascade];
+
+	RenderGraph::ImageDesc desc = {
+		isOverlay ? SHADOW_OVERLAY_FORMAT : SHADOW_FORMAT,
+		isOverlay ? SHADOW_OVERLAY_SIZE : SHADOW_MAP_SIZE,
+		isOverlay ? SHADOW_OVERLAY_SIZE : SHADOW_MAP_SIZE,
+	};
+
+	if (!isOverlay)
+		_cascades[cascade].isCached = true;
+
+	return graph.importImage(getMapName(cascade, isOverlay), map.image.image, map.view, desc,
+			vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+}
+
+const char *ShadowMaps::getMapName(uint32_t cascade, bool isOverlay) {
+	return isOverlay ? OVERLAY_MAP_NAMES[cascade] : STATIC_MAP_NAMES[cascade];
+}
+
+uint32_t ShadowMaps::getCascadeCount() const {
+	return _cascadeCount;
+}
+
+const glm::mat4 &ShadowMaps::getProjView(uint32_t cascade) const {
+	return _cascades[cascade].projView;
+}
+
+float ShadowMaps::getTexelSize(uint32_t cascade) const {
+	return _cascades[cascade].texelSize;
+}
+
+uint32_t ShadowMaps::getOverlayMask() const {
+	uint32_t mask = 0;
+
+	for (uint32_t i = 0; i < _cascadeCount; i++) {
+		if (_cascades[i].hasOverlay)
+			mask |= 1u << i;
+	}
+
+	return mask;
+}
+
+vk::Buffer ShadowMaps::getInstanceBuffer() const {
+	return _frames[_frame].instanceBuffer.buffer;
+}
+
+vk::DescriptorSet ShadowMaps::getSet() const {
+	return _set;
+}
+
+vk::DescriptorSetLayout ShadowMaps::getSetLayout() const {
+	return _setLayout;
+}
+
+void ShadowMaps::init(uint32_t frameCount) {
+	RD &rd = RD::getSingleton();
+
+	_device = rd.getDevice();
+	_descriptorPool = rd.getDescriptorPool();
+
+	_frames.resize(frameCount, FrameData{});
+
+	_createDescriptors();
+	_createMaps();
+
+	_initialized = true;
+}
+
+ShadowMaps::~ShadowMaps() {
+	if (!_initialized)
+		return;
+
+	RD &rd = RD::getSingleton();
+
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+		_device.destroyImageView(_staticMaps[i].view);
+		rd.imageDestroy(_staticMaps[i].image);
+
+		_device.destroyImageView(_overlayMaps[i].view);
+		rd.imageDestroy(_overlayMaps[i].image);
+	}
+
+	for (FrameData &frameData : _frames) {
+		if (frameData.instanceCapacity > 0)
+			rd.bufferDestroy(frameData.instanceBuffer);
+	}
+
+	_device.destroySampler(_sampler);
+	_device.destroyDescriptorSetLayout(_setLayout);
+}
@@ -0,0 +1,129 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "../render_graph.h"
+#include "../types/allocated.h"
+#include "../types/camera.h"
+
+const uint32_t SHADOW_CASCADE_COUNT = 4;
+
+const uint32_t SHADOW_MAP_SIZE = 2048;
+const uint32_t SHADOW_OVERLAY_SIZE = 1024;
+
+const vk::Format SHADOW_FORMAT = vk::Format::eD32Sfloat;
+const vk::Format SHADOW_OVERLAY_FORMAT = vk::Format::eD16Unorm;
+
+// Cascaded shadow maps of the first directional light. Every cascade keeps a map of static
+// casters between frames, re-rendered only when the light turns, the cascade's region moves or a
+// static instance inside it changes. Dynamic casters go into a smaller overlay rendered every
+// frame they are present, shading takes the darker of both.
+//
+// Regions are spheres around slices of the view frustum, so their size doesn't change as the
+// camera turns. Centers are snapped to steps of whole texels in light space, a moving camera
+// neither shimmers nor invalidates the cache until it crosses a step.
+class ShadowMaps {
+private:
+	typedef struct {
+		AllocatedImage image;
+		vk::ImageView view;
+	} Map;
+
+	typedef struct {
+		glm::mat4 projView;
+		// light space center and half size of the region, casters toward the light are included
+		glm::vec3 center;
+		float halfExtent;
+		// world size of a static map texel
+		float texelSize;
+
+		// the static map holds the casters of this region
+		bool isCached;
+		// the overlay holds dynamic casters
+		bool hasOverlay;
+	} Cascade;
+
+	typedef struct {
+		AllocatedBuffer instanceBuffer;
+		VmaAllocationInfo instanceAllocInfo;
+		uint32_t instanceCapacity;
+	} FrameData;
+
+	vk::Device _device;
+	vk::DescriptorPool _descriptorPool;
+
+	vk::DescriptorSetLayout _setLayout;
+	vk::DescriptorSet _set;
+	vk::Sampler _sampler;
+
+	std::array<Map, SHADOW_CASCADE_COUNT> _staticMaps = {};
+	std::array<Map, SHADOW_CASCADE_COUNT> _overlayMaps = {};
+	std::array<Cascade, SHADOW_CASCADE_COUNT> _cascades = {};
+
+	std::vector<FrameData> _frames;
+	uint32_t _frame = 0;
+
+	glm::vec3 _lightDirection = glm::vec3(0.0f);
+	glm::mat4 _lightView = glm::mat4(1.0f);
+
+	// zero without a shadow casting light
+	uint32_t _cascadeCount = 0;
+
+	bool _initialized = false;
+
+	void _createDescriptors();
+	void _createMaps();
+
+	void _updateCascade(Cascade &cascade, const glm::vec3 &center, float radius);
+
+public:
+	// Fits the cascades to the camera, caches of cascades whose region moved are dropped.
+	void update(const Camera &camera, float aspect, const glm::vec3 &lightDirection);
+	// No shadow casting light, every cache is dropped.
+	void disable();
+
+	// Drops the caches of cascades a changed static caster's world bounding sphere overlaps.
+	void invalidate(const glm::vec3 &center, float radius);
+
+	// Whether a caster's world bounding sphere can cast into the cascade.
+	bool intersects(uint32_t cascade, const glm::vec3 &center, float radius) const;
+
+	bool isCached(uint32_t cascade) const;
+
+	// Set once per frame for every cascade. Returns whether the overlay has to be rendered, which
+	// is also needed for one frame after the last dynamic caster left to clear it.
+	bool setOverlayCasters(uint32_t cascade, bool hasCasters);
+
+	// Uploads the caster transforms of `frame`, read as the instance stream by shadow draws.
+	void upload(uint32_t frame, const glm::mat4 *pInstances, uint32_t instanceCount);
+
+	// Imports a map for a pass rendering it this frame, static maps count as cached from then on.
+	// Maps stay in shader read only layout between frames.
+	RenderGraph::Resource importMap(RenderGraph &graph, uint32_t cascade, bool isOverlay);
+
+	// Names the map's resource, and passes rendering it, in the frame graph.
+	static const char *getMapName(uint32_t cascade, bool isOverlay);
+
+	uint32_t getCascadeCount() const;
+	const glm::mat4 &getProjView(uint32_t cascade) const;
+	float getTexelSize(uint32_t cascade) const;
+	// bit per cascade whose overlay holds dynamic casters this frame
+	uint32_t getOverlayMask() const;
+
+	vk::Buffer getInstanceBuffer() const;
+
+	// Binding 0 are the static maps, binding 1 the overlays, both compare samplers.
+	vk::DescriptorSet getSet() const;
+	vk::DescriptorSetLayout getSetLayout() const;
+
+	void init(uint32_t frameCount);
+	~ShadowMaps();
+};
+
+#endif // !SHADOW_MAPS_H
@@ -0,0 +1,202 @@
+#include <SDL3/SDL_log.h>
+
+#include "gpu_memory.h"
+
+static unsigned long long toMiB(VkDeviceSize size) {
+	return static_cast<unsigned long long>(size >> 20);
+}
+
+VmaPool GpuMemory::_getPool(MemoryCategory category, uint32_t memoryTypeIndex) {
+	Category &data = _categories[static_cast<uint32_t>(category)];
+
+	for (const Pool &pool : data.pools) {
+		if (pool.memoryTypeIndex == memoryTypeIndex)
+			return pool.pool;
+	}
+
+	// default block size, allocations over half of it get memory of their own
+	VmaPoolCreateInfo poolInfo = {};
+	poolInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VmaPool pool;
+	if (vmaCreatePool(_allocator, &poolInfo, &pool) != VK_SUCCESS) {
+		// allocated outside the pools, missing from the category stats
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "%s pool creation failed for memory type %u!",
+				getCategoryName(category), memoryTypeIndex);
+		return VK_NULL_HANDLE;
+	}
+
+	vmaSetPoolName(_allocator, pool, getCategoryName(category));
+	data.pools.push_back({ memoryTypeIndex, pool });
+
+	return pool;
+}
+
+const char *GpuMemory::getCategoryName(MemoryCategory category) {
+	switch (category) {
+		case MemoryCategory::Textures:
+			return "Textures";
+		case MemoryCategory::Geometry:
+			return "Geometry";
+		case MemoryCategory::Attachments:
+			return "Attachments";
+		case MemoryCategory::Staging:
+			return "Staging";
+		case MemoryCategory::Environment:
+			return "Environment";
+		case MemoryCategory::Frame:
+			return "Frame";
+	}
+
+	return "Unknown";
+}
+
+VkResult GpuMemory::createImage(MemoryCategory category, const VkImageCreateInfo *pImageInfo,
+		VmaAllocationCreateInfo allocInfo, VkImage *pImage, VmaAllocation *pAllocation,
+		VmaAllocationInfo *pAllocationInfo) {
+	uint32_t memoryTypeIndex;
+	VkResult err = vmaFindMemoryTypeIndexForImageInfo(
+			_allocator, pImageInfo, &allocInfo, &memoryTypeIndex);
+
+	if (err != VK_SUCCESS)
+		return err;
+
+	allocInfo.pool = _getPool(category, memoryTypeIndex);
+
+	return vmaCreateImage(
+			_allocator, pImageInfo, &allocInfo, pImage, pAllocation, pAllocationInfo);
+}
+
+VkResult GpuMemory::createBuffer(MemoryCategory category, const VkBufferCreateInfo *pBufferInfo,
+		VmaAllocationCreateInfo allocInfo, VkBuffer *pBuffer, VmaAllocation *pAllocation,
+		VmaAllocationInfo *pAllocationInfo) {
+	uint32_t memoryTypeIndex;
+	VkResult err = vmaFindMemoryTypeIndexForBufferInfo(
+			_allocator, pBufferInfo, &allocInfo, &memoryTypeIndex);
+
+	if (err != VK_SUCCESS)
+		return err;
+
+	allocInfo.pool = _getPool(category, memoryTypeIndex);
+
+	return vmaCreateBuffer(
+			_allocator, pBufferInfo, &allocInfo, pBuffer, pAllocation, pAllocationInfo);
+}
+
+VkResult GpuMemory::allocateMemory(MemoryCategory category,
+		const VkMemoryRequirements *pRequirements, VmaAllocationCreateInfo allocInfo,
+		VmaAllocation *pAllocation) {
+	uint32_t memoryTypeIndex;
+	VkResult err = vmaFindMemoryTypeIndex(
+			_allocator, pRequirements->memoryTypeBits, &allocInfo, &memoryTypeIndex);
+
+	if (err != VK_SUCCESS)
+		return err;
+
+	allocInfo.pool = _getPool(category, memoryTypeIndex);
+
+	return vmaAllocateMemory(_allocator, pRequirements, &allocInfo, pAllocation, nullptr);
+}
+
+void GpuMemory::setBudget(MemoryCategory category, VkDeviceSize budget) {
+	_categories[static_cast<uint32_t>(category)].budget = budget;
+}
+
+GpuMemory::CategoryStats GpuMemory::getStats(MemoryCategory category) const {
+	const Category &data = _categories[static_cast<uint32_t>(category)];
+
+	CategoryStats stats = {};
+	stats.budget = data.budget;
+
+	for (const Pool &pool : data.pools) {
+		VmaStatistics poolStats;
+		vmaGetPoolStatistics(_allocator, pool.pool, &poolStats);
+
+		stats.usage += poolStats.allocationBytes;
+		stats.blockBytes += poolStats.blockBytes;
+		stats.allocationCount += poolStats.allocationCount;
+		stats.blockCount += poolStats.blockCount;
+	}
+
+	return stats;
+}
+
+bool GpuMemory::isWithinBudget(MemoryCategory category, VkDeviceSize size) const {
+	CategoryStats stats = getStats(category);
+
+	if (stats.budget != 0 && stats.usage + size > stats.budget)
+		return false;
+
+	if (_allocator == VK_NULL_HANDLE)
+		return true;
+
+	const VkPhysicalDeviceMemoryProperties *pProperties;
+	vmaGetMemoryProperties(_allocator, &pProperties);
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(_allocator, budgets);
+
+	const Category &data = _categories[static_cast<uint32_t>(category)];
+
+	for (const Pool &pool : data.pools) {
+		uint32_t heapIndex = pProperties->memoryTypes[pool.memoryTypeIndex].heapIndex;
+		const VmaBudget &budget = budgets[heapIndex];
+
+		if (budget.usage + size > budget.budget)
+			return false;
+	}
+
+	return true;
+}
+
+void GpuMemory::log() const {
+	for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+		MemoryCategory category = static_cast<MemoryCategory>(i);
+		CategoryStats stats = getStats(category);
+
+		if (stats.budget == 0) {
+			SDL_Log("Memory %s: %llu MiB in %u allocations, %llu MiB in %u blocks",
+					getCategoryName(category), toMiB(stats.usage), stats.allocationCount,
+					toMiB(stats.blockBytes), stats.blockCount);
+		} else {
+			SDL_Log("Memory %s: %llu/%llu MiB in %u allocations, %llu MiB in %u blocks",
+					getCategoryName(category), toMiB(stats.usage), toMiB(stats.budget),
+					stats.allocationCount, toMiB(stats.blockBytes), stats.blockCount);
+		}
+	}
+
+	if (_allocator == VK_NULL_HANDLE)
+		return;
+
+	const VkPhysicalDeviceMemoryProperties *pProperties;
+	vmaGetMemoryProperties(_allocator, &pProperties);
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(_allocator, budgets);
+
+	// usage counts other processes too when the budget extension is present
+	for (uint32_t i = 0; i < pProperties->memoryHeapCount; i++) {
+		SDL_Log("Memory heap %u: %llu/%llu MiB, %llu MiB allocated by us", i,
+				toMiB(budgets[i].usage), toMiB(budgets[i].budget),
+				toMiB(budgets[i].statistics.blockBytes));
+	}
+}
+
+VmaAllocator GpuMemory::getAllocator() const {
+	return _allocator;
+}
+
+void GpuMemory::init(VmaAllocator allocator) {
+	_allocator = allocator;
+}
+
+void GpuMemory::finish() {
+	for (Category &category : _categories) {
+		for (const Pool &pool : category.pools)
+			vmaDestroyPool(_allocator, pool.pool);
+
+		category.pools.clear();
+	}
+
+	_allocator = VK_NULL_HANDLE;
+}
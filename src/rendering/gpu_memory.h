@@ -0,0 +1,89 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vma/vk_mem_alloc.h>
+
+// What an allocation is for, each category is reported and budgeted on its own. Frame data are
+// buffers rewritten every frame, uniforms, lights and draw lists.
+enum class MemoryCategory {
+	Textures,
+	Geometry,
+	Attachments,
+	Staging,
+	Environment,
+	Frame,
+};
+
+const uint32_t MEMORY_CATEGORY_COUNT = 6;
+
+// Routes every allocation through a VMA custom pool of its category, one pool per memory type the
+// category asked for so far. Resources are suballocated from the pools' blocks instead of taking
+// a device allocation each, only ones larger than half a block get memory of their own.
+//
+// Heap budgets come from VK_EXT_memory_budget when the device has it, VMA estimates them from the
+// heap sizes otherwise. Category budgets are set by the user and only checked, through
+// isWithinBudget, by the code deciding what to load.
+class GpuMemory {
+public:
+	typedef struct {
+		// bytes of live allocations and of device memory the pools hold for them
+		VkDeviceSize usage;
+		VkDeviceSize blockBytes;
+		uint32_t allocationCount;
+		uint32_t blockCount;
+		// zero is unlimited
+		VkDeviceSize budget;
+	} CategoryStats;
+
+private:
+	typedef struct {
+		uint32_t memoryTypeIndex;
+		VmaPool pool;
+	} Pool;
+
+	typedef struct {
+		std::vector<Pool> pools;
+		VkDeviceSize budget;
+	} Category;
+
+	VmaAllocator _allocator = VK_NULL_HANDLE;
+	Category _categories[MEMORY_CATEGORY_COUNT] = {};
+
+	VmaPool _getPool(MemoryCategory category, uint32_t memoryTypeIndex);
+
+public:
+	static const char *getCategoryName(MemoryCategory category);
+
+	// Like their VMA counterparts, the pool is picked from the memory type allocInfo selects.
+	VkResult createImage(MemoryCategory category, const VkImageCreateInfo *pImageInfo,
+			VmaAllocationCreateInfo allocInfo, VkImage *pImage, VmaAllocation *pAllocation,
+			VmaAllocationInfo *pAllocationInfo = nullptr);
+	VkResult createBuffer(MemoryCategory category, const VkBufferCreateInfo *pBufferInfo,
+			VmaAllocationCreateInfo allocInfo, VkBuffer *pBuffer, VmaAllocation *pAllocation,
+			VmaAllocationInfo *pAllocationInfo = nullptr);
+	// allocInfo can't use VMA_MEMORY_USAGE_AUTO, there is no resource to derive the type from.
+	VkResult allocateMemory(MemoryCategory category, const VkMemoryRequirements *pRequirements,
+			VmaAllocationCreateInfo allocInfo, VmaAllocation *pAllocation);
+
+	// In bytes, zero removes the budget.
+	void setBudget(MemoryCategory category, VkDeviceSize budget);
+	CategoryStats getStats(MemoryCategory category) const;
+
+	// Whether size more bytes fit the category budget and the budgets of the heaps its pools
+	// allocate from.
+	bool isWithinBudget(MemoryCategory category, VkDeviceSize size) const;
+
+	// Usage and budget of every category and heap.
+	void log() const;
+
+	VmaAllocator getAllocator() const;
+
+	void init(VmaAllocator allocator);
+	// Destroys the pools, every allocation from them has to be freed and the allocator still live.
+	void finish();
+};
+
+#endif // !GPU_MEMORY_H
@@ -0,0 +1,229 @@
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <SDL3/SDL_log.h>
+
+#include <profiler.h>
+#include <rendering/rendering_device.h>
+
+#include "gpu_profiler.h"
+
+// in the order results are written, which is the order of the flag bits
+const vk::QueryPipelineStatisticFlags STATISTIC_FLAGS =
+		vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices |
+		vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+		vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+		vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+		vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations |
+		vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+
+const std::array<const char *, 6> STATISTIC_NAMES = {
+	"Input vertices",
+	"Input primitives",
+	"Vertex shader invocations",
+	"Clipped primitives",
+	"Fragment shader invocations",
+	"Compute shader invocations",
+};
+
+void GpuProfiler::_collect(Frame &frame) {
+	if (!frame.isPending)
+		return;
+
+	frame.isPending = false;
+
+	Profiler &profiler = Profiler::getSingleton();
+
+	uint32_t queryCount = frame.scopeNames.size() * 2;
+	std::array<uint64_t, MAX_GPU_SCOPE_COUNT * 2> timestamps;
+
+	vk::Result result = _device.getQueryPoolResults(frame.timestampPool, 0, queryCount,
+			sizeof(uint64_t) * queryCount, timestamps.data(), sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64);
+
+	// the fence was waited on, so this only misses if a scope was left open
+	if (result != vk::Result::eSuccess)
+		return;
+
+	uint64_t origin = timestamps[0] & _timestampMask;
+
+	for (uint32_t i = 0; i < frame.scopeNames.size(); i++) {
+		uint64_t begin = timestamps[i * 2] & _timestampMask;
+		uint64_t end = timestamps[i * 2 + 1] & _timestampMask;
+
+		double start = frame.submitTime + (begin - origin) * _timestampPeriod;
+		double duration = (end - begin) * _timestampPeriod;
+
+		if (_isEventsEnabled)
+			profiler.addEvent(frame.scopeNames[i], start, duration, GPU_TRACK);
+	}
+
+	// scope 0 is the frame
+	_frameTime = ((timestamps[1] & _timestampMask) - origin) * _timestampPeriod / 1000.0;
+	_frameTimeIndex = frame.index;
+	_collectedFrameCount++;
+
+	if (!_isStatisticsEnabled)
+		return;
+
+	std::array<uint64_t, STATISTIC_NAMES.size()> statistics;
+
+	result = _device.getQueryPoolResults(frame.statisticsPool, 0, 1, sizeof(statistics),
+			statistics.data(), sizeof(statistics), vk::QueryResultFlagBits::e64);
+
+	if (result != vk::Result::eSuccess)
+		return;
+
+	for (size_t i = 0; i < statistics.size(); i++)
+		profiler.addCounter(STATISTIC_NAMES[i], frame.submitTime, statistics[i]);
+}
+
+void GpuProfiler::frameBegin(vk::CommandBuffer commandBuffer, uint32_t frame) {
+	if (!_initialized)
+		return;
+
+	_frame = frame;
+
+	Frame &current = _frames[_frame];
+	_collect(current);
+
+	current.scopeNames.clear();
+
+	commandBuffer.resetQueryPool(current.timestampPool, 0, MAX_GPU_SCOPE_COUNT * 2);
+
+	if (_isStatisticsEnabled) {
+		commandBuffer.resetQueryPool(current.statisticsPool, 0, 1);
+		commandBuffer.beginQuery(current.statisticsPool, 0, {});
+	}
+
+	// scope 0 spans the whole frame, other scopes are aligned to its start
+	begin(commandBuffer, "Frame");
+}
+
+void GpuProfiler::frameEnd(vk::CommandBuffer commandBuffer) {
+	if (!_initialized)
+		return;
+
+	Frame &current = _frames[_frame];
+
+	end(commandBuffer, 0);
+
+	if (_isStatisticsEnabled)
+		commandBuffer.endQuery(current.statisticsPool, 0);
+
+	current.submitTime = Profiler::getSingleton().now();
+	current.index = _frameCount++;
+	current.isPending = true;
+}
+
+uint32_t GpuProfiler::begin(vk::CommandBuffer commandBuffer, const char *pName) {
+	if (!_initialized)
+		return UINT32_MAX;
+
+	Frame &current = _frames[_frame];
+
+	if (current.scopeNames.size() == MAX_GPU_SCOPE_COUNT)
+		return UINT32_MAX;
+
+	uint32_t scope = current.scopeNames.size();
+	current.scopeNames.push_back(pName);
+
+	commandBuffer.writeTimestamp(
+			vk::PipelineStageFlagBits::eTopOfPipe, current.timestampPool, scope * 2);
+
+	return scope;
+}
+
+void GpuProfiler::end(vk::CommandBuffer commandBuffer, uint32_t scope) {
+	if (!_initialized || scope == UINT32_MAX)
+		return;
+
+	commandBuffer.writeTimestamp(
+			vk::PipelineStageFlagBits::eBottomOfPipe, _frames[_frame].timestampPool, scope * 2 + 1);
+}
+
+double GpuProfiler::getFrameTime() const {
+	return _frameTime;
+}
+
+uint64_t GpuProfiler::getCollectedFrameCount() const {
+	return _collectedFrameCount;
+}
+
+uint64_t GpuProfiler::getFrameCount() const {
+	return _frameCount;
+}
+
+uint64_t GpuProfiler::getFrameTimeIndex() const {
+	return _frameTimeIndex;
+}
+
+bool GpuProfiler::isInitialized() const {
+	return _initialized;
+}
+
+void GpuProfiler::init(uint32_t frameCount, uint32_t queueFamily, bool isTimingRequired) {
+	_isEventsEnabled = Profiler::getSingleton().isEnabled();
+
+	if (!_isEventsEnabled && !isTimingRequired)
+		return;
+
+	RD &rd = RD::getSingleton();
+
+	vk::PhysicalDevice physicalDevice = rd.getPhysicalDevice();
+	_device = rd.getDevice();
+
+	uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+
+	if (validBits == 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Queue has no timestamp support, GPU profiling off");
+		return;
+	}
+
+	_timestampMask = validBits == 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+	// nanoseconds per tick, events are in microseconds
+	_timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod / 1000.0;
+
+	// enabled at device creation whenever supported, only the Profiler reads them
+	_isStatisticsEnabled =
+			_isEventsEnabled && physicalDevice.getFeatures().pipelineStatisticsQuery;
+
+	vk::QueryPoolCreateInfo timestampInfo;
+	timestampInfo.setQueryType(vk::QueryType::eTimestamp);
+	timestampInfo.setQueryCount(MAX_GPU_SCOPE_COUNT * 2);
+
+	vk::QueryPoolCreateInfo statisticsInfo;
+	statisticsInfo.setQueryType(vk::QueryType::ePipelineStatistics);
+	statisticsInfo.setQueryCount(1);
+	statisticsInfo.setPipelineStatistics(STATISTIC_FLAGS);
+
+	_frames.resize(frameCount);
+
+	for (Frame &frame : _frames) {
+		frame.timestampPool = _device.createQueryPool(timestampInfo);
+
+		if (_isStatisticsEnabled)
+			frame.statisticsPool = _device.createQueryPool(statisticsInfo);
+
+		frame.scopeNames.reserve(MAX_GPU_SCOPE_COUNT);
+		frame.submitTime = 0.0;
+		frame.index = 0;
+		frame.isPending = false;
+	}
+
+	_initialized = true;
+}
+
+GpuProfiler::~GpuProfiler() {
+	if (!_initialized)
+		return;
+
+	for (Frame &frame : _frames) {
+		_device.destroyQueryPool(frame.timestampPool);
+
+		if (_isStatisticsEnabled)
+			_device.destroyQueryPool(frame.statisticsPool);
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+const uint32_t MAX_GPU_SCOPE_COUNT = 32;
+
+// Times command buffer ranges with timestamp queries and counts pipeline statistics for the
+// whole frame, feeding both into the Profiler's GPU track. Every frame in flight has its own
+// query pools, they are read back once the frame's fence was waited on, so reading never stalls.
+//
+// Timestamps are placed on the CPU timeline relative to the submit of their frame, the GPU starts
+// somewhat later, so spans are exact but the offset to the CPU track is approximate.
+class GpuProfiler {
+private:
+	typedef struct {
+		vk::QueryPool timestampPool;
+		vk::QueryPool statisticsPool;
+		// scope i is written to queries 2 * i and 2 * i + 1
+		std::vector<const char *> scopeNames;
+		double submitTime;
+		uint64_t index;
+		bool isPending;
+	} Frame;
+
+	vk::Device _device;
+
+	std::vector<Frame> _frames;
+	uint32_t _frame = 0;
+
+	double _timestampPeriod = 1.0;
+	uint64_t _timestampMask = UINT64_MAX;
+	bool _isStatisticsEnabled = false;
+	// frame times are kept for dynamic resolution without profiling
+	bool _isEventsEnabled = false;
+
+	double _frameTime = 0.0;
+	uint64_t _frameTimeIndex = 0;
+	uint64_t _collectedFrameCount = 0;
+	uint64_t _frameCount = 0;
+
+	bool _initialized = false;
+
+	void _collect(Frame &frame);
+
+public:
+	// Called right after the frame's command buffer begins, its fence must have been waited on.
+	void frameBegin(vk::CommandBuffer commandBuffer, uint32_t frame);
+
+	// Called outside of a render pass before the command buffer ends.
+	void frameEnd(vk::CommandBuffer commandBuffer);
+
+	// Returns the scope to pass to end(), scopes past MAX_GPU_SCOPE_COUNT are dropped.
+	uint32_t begin(vk::CommandBuffer commandBuffer, const char *pName);
+	void end(vk::CommandBuffer commandBuffer, uint32_t scope);
+
+	// GPU time of the last frame read back in milliseconds, it trails the CPU by the frames in
+	// flight. The count tells new results apart.
+	double getFrameTime() const;
+	uint64_t getCollectedFrameCount() const;
+
+	// Frames recorded so far and the one getFrameTime() belongs to, counted the same way.
+	uint64_t getFrameCount() const;
+	uint64_t getFrameTimeIndex() const;
+
+	// Does nothing unless the Profiler is enabled or timing is required, nor when the queue has
+	// no timestamp support. Only the frame time is measured when the Profiler is disabled.
+	void init(uint32_t frameCount, uint32_t queueFamily, bool isTimingRequired = false);
+
+	bool isInitialized() const;
+	~GpuProfiler();
+};
+
+#endif // !GPU_PROFILER_H
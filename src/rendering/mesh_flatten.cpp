@@ -0,0 +1,107 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <io/mesh.h>
+
+#include "rendering_server.h"
+
+void RS::meshFlatten(const Mesh &mesh, MeshStreams &streams) {
+	std::vector<glm::vec3> &positions = streams.positions;
+	std::vector<VertexAttribute> &attributes = streams.attributes;
+	std::vector<uint32_t> &indices = streams.indices;
+
+	{
+		size_t totalVertexCount = 0;
+		size_t totalIndexCount = 0;
+
+		for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
+			const Primitive &primitive = mesh.pPrimitives[i];
+			totalVertexCount += primitive.vertices.count;
+			totalIndexCount += primitive.indices.count;
+
+			for (uint32_t j = 0; j < primitive.lodCount; j++)
+				totalIndexCount += primitive.lods[j].count;
+		}
+
+		positions.resize(totalVertexCount);
+		attributes.resize(totalVertexCount);
+		indices.resize(totalIndexCount);
+	}
+
+	uint32_t vertexOffset = 0;
+	uint32_t indexOffset = 0;
+
+	std::vector<PrimitiveRD> &_primitives = streams.primitives;
+	std::vector<ClusterCulling::MeshletData> &meshlets = streams.meshlets;
+
+	_primitives.clear();
+	meshlets.clear();
+
+	for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
+		const Primitive &primitive = mesh.pPrimitives[i];
+
+		PrimitiveRD _primitive = {};
+		_primitive.lodCount = primitive.lodCount + 1;
+		_primitive.material = primitive.materialIndex;
+
+		for (uint32_t lod = 0; lod < _primitive.lodCount; lod++) {
+			const IndexArray &lodIndices = lod == 0 ? primitive.indices : primitive.lods[lod - 1];
+			_primitive.lods[lod] = { lodIndices.count, indexOffset };
+
+			const MeshletArray &lodMeshlets = primitive.meshlets[lod];
+			_primitive.meshlets[lod] = { static_cast<uint32_t>(meshlets.size()), lodMeshlets.count };
+
+			for (uint32_t j = 0; j < lodMeshlets.count; j++) {
+				const Meshlet &meshlet = lodMeshlets.pData[j];
+
+				ClusterCulling::MeshletData data = {};
+				memcpy(data.center, &meshlet.center, sizeof(data.center));
+				data.radius = meshlet.radius;
+				memcpy(data.coneAxis, &meshlet.coneAxis, sizeof(data.coneAxis));
+				data.coneCutoff = meshlet.coneCutoff;
+				data.firstIndex = indexOffset + meshlet.firstIndex;
+				data.triangleCount = meshlet.triangleCount;
+
+				meshlets.push_back(data);
+			}
+
+			for (uint32_t j = 0; j < lodIndices.count; j++) {
+				indices[indexOffset] = vertexOffset + lodIndices.pData[j];
+				indexOffset++;
+			}
+		}
+
+		_primitives.push_back(_primitive);
+
+		const VertexArray &vertices = primitive.vertices;
+		size_t vertexCount = vertices.count;
+
+		memcpy(&positions[vertexOffset], vertices.pPositions, sizeof(glm::vec3) * vertexCount);
+		memcpy(&attributes[vertexOffset], vertices.pAttributes,
+				sizeof(VertexAttribute) * vertexCount);
+
+		vertexOffset += vertexCount;
+	}
+
+	// bounding sphere around the box center, good enough for LOD selection
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+
+	for (const glm::vec3 &position : positions) {
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+
+	glm::vec3 center = positions.empty() ? glm::vec3(0.0f) : (min + max) * 0.5f;
+	float radius = 0.0f;
+
+	for (const glm::vec3 &position : positions)
+		radius = glm::max(radius, glm::distance(center, position));
+
+	streams.center = center;
+	streams.radius = radius;
+}
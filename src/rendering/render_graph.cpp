@@ -0,0 +1,1008 @@
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <stdexcept>
+
+#include <rendering/rendering_device.h>
+
+#include "render_graph.h"
+
+// accesses a later use has to make visible, reads only need execution ordering
+const vk::AccessFlags WRITE_ACCESS = vk::AccessFlagBits::eShaderWrite |
+		vk::AccessFlagBits::eColorAttachmentWrite |
+		vk::AccessFlagBits::eDepthStencilAttachmentWrite | vk::AccessFlagBits::eTransferWrite |
+		vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eMemoryWrite;
+
+static bool isSameDesc(const RenderGraph::ImageDesc &a, const RenderGraph::ImageDesc &b) {
+	return a.format == b.format && a.width == b.width && a.height == b.height &&
+			a.arrayLayers == b.arrayLayers && a.mipLevels == b.mipLevels && a.flags == b.flags &&
+			a.viewType == b.viewType;
+}
+
+static bool isOverlapping(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+	return firstA <= lastB && firstB <= lastA;
+}
+
+void RenderGraph::getLayoutAccess(
+		vk::ImageLayout layout, vk::PipelineStageFlags &stages, vk::AccessFlags &access) {
+	switch (layout) {
+		case vk::ImageLayout::eUndefined:
+			stages = vk::PipelineStageFlagBits::eTopOfPipe;
+			access = {};
+			break;
+		case vk::ImageLayout::eGeneral:
+			stages = vk::PipelineStageFlagBits::eComputeShader |
+					vk::PipelineStageFlagBits::eFragmentShader;
+			access = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+			break;
+		case vk::ImageLayout::eColorAttachmentOptimal:
+			stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+			access = vk::AccessFlagBits::eColorAttachmentRead |
+					vk::AccessFlagBits::eColorAttachmentWrite;
+			break;
+		case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+			stages = vk::PipelineStageFlagBits::eEarlyFragmentTests |
+					vk::PipelineStageFlagBits::eLateFragmentTests;
+			access = vk::AccessFlagBits::eDepthStencilAttachmentRead |
+					vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+			break;
+		case vk::ImageLayout::eShaderReadOnlyOptimal:
+			stages = vk::PipelineStageFlagBits::eComputeShader |
+					vk::PipelineStageFlagBits::eFragmentShader;
+			access = vk::AccessFlagBits::eShaderRead;
+			break;
+		case vk::ImageLayout::eTransferSrcOptimal:
+			stages = vk::PipelineStageFlagBits::eTransfer;
+			access = vk::AccessFlagBits::eTransferRead;
+			break;
+		case vk::ImageLayout::eTransferDstOptimal:
+			stages = vk::PipelineStageFlagBits::eTransfer;
+			access = vk::AccessFlagBits::eTransferWrite;
+			break;
+		case vk::ImageLayout::ePresentSrcKHR:
+			// presentation waits on a semaphore, not on the barrier
+			stages = vk::PipelineStageFlagBits::eBottomOfPipe;
+			access = {};
+			break;
+		default:
+			stages = vk::PipelineStageFlagBits::eAllCommands;
+			access = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+			break;
+	}
+}
+
+vk::ImageAspectFlags RenderGraph::getAspect(vk::Format format) {
+	switch (format) {
+		case vk::Format::eD16Unorm:
+		case vk::Format::eX8D24UnormPack32:
+		case vk::Format::eD32Sfloat:
+			return vk::ImageAspectFlagBits::eDepth;
+		case vk::Format::eD16UnormS8Uint:
+		case vk::Format::eD24UnormS8Uint:
+		case vk::Format::eD32SfloatS8Uint:
+			return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+		case vk::Format::eS8Uint:
+			return vk::ImageAspectFlagBits::eStencil;
+		default:
+			return vk::ImageAspectFlagBits::eColor;
+	}
+}
+
+RenderGraph::AccessInfo RenderGraph::_getAccessInfo(ImageAccess access, PassType type) {
+	vk::PipelineStageFlags shaderStage = type == PassType::Graphics
+			? vk::PipelineStageFlagBits::eFragmentShader
+			: vk::PipelineStageFlagBits::eComputeShader;
+
+	switch (access) {
+		case ImageAccess::ColorAttachment:
+			return {
+				vk::ImageLayout::eColorAttachmentOptimal,
+				vk::PipelineStageFlagBits::eColorAttachmentOutput,
+				vk::AccessFlagBits::eColorAttachmentRead |
+						vk::AccessFlagBits::eColorAttachmentWrite,
+				vk::ImageUsageFlagBits::eColorAttachment,
+				true,
+			};
+		case ImageAccess::DepthAttachment:
+			return {
+				vk::ImageLayout::eDepthStencilAttachmentOptimal,
+				vk::PipelineStageFlagBits::eEarlyFragmentTests |
+						vk::PipelineStageFlagBits::eLateFragmentTests,
+				vk::AccessFlagBits::eDepthStencilAttachmentRead |
+						vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+				vk::ImageUsageFlagBits::eDepthStencilAttachment,
+				true,
+			};
+		case ImageAccess::Sampled:
+			return {
+				vk::ImageLayout::eShaderReadOnlyOptimal,
+				shaderStage,
+				vk::AccessFlagBits::eShaderRead,
+				vk::ImageUsageFlagBits::eSampled,
+				false,
+			};
+		case ImageAccess::Storage:
+			return {
+				vk::ImageLayout::eGeneral,
+				shaderStage,
+				vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+				vk::ImageUsageFlagBits::eStorage,
+				true,
+			};
+		case ImageAccess::TransferSrc:
+			return {
+				vk::ImageLayout::eTransferSrcOptimal,
+				vk::PipelineStageFlagBits::eTransfer,
+				vk::AccessFlagBits::eTransferRead,
+				vk::ImageUsageFlagBits::eTransferSrc,
+				false,
+			};
+		case ImageAccess::TransferDst:
+		default:
+			return {
+				vk::ImageLayout::eTransferDstOptimal,
+				vk::PipelineStageFlagBits::eTransfer,
+				vk::AccessFlagBits::eTransferWrite,
+				vk::ImageUsageFlagBits::eTransferDst,
+				true,
+			};
+	}
+}
+
+bool RenderGraph::_isAttachment(ImageAccess access) {
+	return access == ImageAccess::ColorAttachment || access == ImageAccess::DepthAttachment;
+}
+
+vk::Image RenderGraph::_getImage(const ResourceData &resource) const {
+	if (resource.isImported)
+		return resource.image;
+
+	if (resource.physical >= _images.size())
+		return VK_NULL_HANDLE;
+
+	return _images[resource.physical].image;
+}
+
+vk::ImageView RenderGraph::_getImageView(const ResourceData &resource) const {
+	if (resource.isImported)
+		return resource.view;
+
+	if (resource.physical >= _images.size())
+		return VK_NULL_HANDLE;
+
+	return _images[resource.physical].view;
+}
+
+void RenderGraph::_cull() {
+	// walked from the last pass, a resource is needed while a later kept pass reads it
+	std::vector<bool> isNeeded(_resources.size());
+
+	for (size_t i = 0; i < _resources.size(); i++)
+		isNeeded[i] = _resources[i].isOutput;
+
+	for (size_t i = _passes.size(); i-- > 0;) {
+		PassData &pass = _passes[i];
+
+		bool isUsed = pass.hasSideEffects;
+
+		for (const Use &use : pass.uses) {
+			if (_getAccessInfo(use.access, pass.type).isWrite && isNeeded[use.resource])
+				isUsed = true;
+		}
+
+		pass.isCulled = !isUsed;
+
+		if (pass.isCulled)
+			continue;
+
+		// attachments not loaded are overwritten, earlier writers no longer matter
+		for (const Use &use : pass.uses) {
+			if (_isAttachment(use.access) && use.loadOp != vk::AttachmentLoadOp::eLoad)
+				isNeeded[use.resource] = false;
+		}
+
+		for (const Use &use : pass.uses) {
+			bool isLoaded = _isAttachment(use.access) && use.loadOp == vk::AttachmentLoadOp::eLoad;
+			bool isWrite = _getAccessInfo(use.access, pass.type).isWrite;
+
+			if (!isWrite || isLoaded || use.access == ImageAccess::Storage)
+				isNeeded[use.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::_computeLifetimes() {
+	for (ResourceData &resource : _resources) {
+		resource.usage = {};
+		resource.firstPass = UINT32_MAX;
+		resource.lastPass = 0;
+		resource.isLazy = false;
+		resource.physical = UINT32_MAX;
+	}
+
+	for (uint32_t i = 0; i < _passes.size(); i++) {
+		const PassData &pass = _passes[i];
+
+		if (pass.isCulled)
+			continue;
+
+		for (const Use &use : pass.uses) {
+			ResourceData &resource = _resources[use.resource];
+
+			resource.usage |= _getAccessInfo(use.access, pass.type).usage;
+			resource.firstPass = std::min(resource.firstPass, i);
+			resource.lastPass = i;
+		}
+	}
+
+	// An attachment written and discarded within one render pass never has to leave tile
+	// memory, where the device supports it such images get no backing memory at all.
+	vk::ImageUsageFlags attachmentUsage = vk::ImageUsageFlagBits::eColorAttachment |
+			vk::ImageUsageFlagBits::eDepthStencilAttachment;
+
+	for (ResourceData &resource : _resources) {
+		if (resource.isImported || resource.isOutput || resource.firstPass == UINT32_MAX)
+			continue;
+
+		if (resource.firstPass != resource.lastPass || (resource.usage & ~attachmentUsage))
+			continue;
+
+		resource.isLazy = true;
+
+		for (const Use &use : _passes[resource.firstPass].uses) {
+			if (&_resources[use.resource] == &resource &&
+					use.loadOp == vk::AttachmentLoadOp::eLoad)
+				resource.isLazy = false;
+		}
+	}
+}
+
+void RenderGraph::_allocateImages() {
+	std::vector<PhysicalImage> images;
+
+	for (ResourceData &resource : _resources) {
+		if (resource.isImported || resource.firstPass == UINT32_MAX)
+			continue;
+
+		PhysicalImage image = {};
+		image.desc = resource.desc;
+		image.usage = resource.usage;
+		image.isLazy = resource.isLazy;
+		image.firstPass = resource.firstPass;
+		image.lastPass = resource.lastPass;
+
+		resource.physical = static_cast<uint32_t>(images.size());
+		images.push_back(image);
+	}
+
+	// same declarations as last compile, physical images are reused in the same order
+	bool isMatching = images.size() == _images.size();
+
+	for (size_t i = 0; isMatching && i < images.size(); i++) {
+		const PhysicalImage &a = images[i];
+		const PhysicalImage &b = _images[i];
+
+		isMatching = isSameDesc(a.desc, b.desc) && a.usage == b.usage && a.isLazy == b.isLazy &&
+				a.firstPass == b.firstPass && a.lastPass == b.lastPass;
+	}
+
+	if (isMatching)
+		return;
+
+	_releaseImages();
+	_images = images;
+
+	std::vector<VkMemoryRequirements> requirements(_images.size());
+
+	for (size_t i = 0; i < _images.size(); i++) {
+		PhysicalImage &image = _images[i];
+
+		vk::ImageUsageFlags usage = image.usage;
+
+		if (image.isLazy)
+			usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+
+		vk::ImageCreateInfo createInfo;
+		createInfo.setFlags(image.desc.flags);
+		createInfo.setImageType(vk::ImageType::e2D);
+		createInfo.setFormat(image.desc.format);
+		createInfo.setExtent(vk::Extent3D(image.desc.width, image.desc.height, 1));
+		createInfo.setMipLevels(image.desc.mipLevels);
+		createInfo.setArrayLayers(image.desc.arrayLayers);
+		createInfo.setSamples(vk::SampleCountFlagBits::e1);
+		createInfo.setTiling(vk::ImageTiling::eOptimal);
+		createInfo.setUsage(usage);
+		createInfo.setSharingMode(vk::SharingMode::eExclusive);
+		createInfo.setInitialLayout(vk::ImageLayout::eUndefined);
+
+		image.image = _device.createImage(createInfo);
+		requirements[i] = _device.getImageMemoryRequirements(image.image);
+	}
+
+	// Largest first, each image joins the first block whose images are all used at other times
+	// and whose memory types it accepts.
+	std::vector<uint32_t> order(_images.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return requirements[a].size > requirements[b].size;
+	});
+
+	typedef struct {
+		VkMemoryRequirements requirements;
+		std::vector<uint32_t> images;
+		bool isLazy;
+	} BlockLayout;
+
+	std::vector<BlockLayout> layouts;
+
+	for (uint32_t i : order) {
+		PhysicalImage &image = _images[i];
+		image.block = UINT32_MAX;
+
+		for (uint32_t b = 0; b < layouts.size() && !image.isLazy; b++) {
+			BlockLayout &layout = layouts[b];
+
+			uint32_t memoryTypeBits = layout.requirements.memoryTypeBits;
+
+			if (layout.isLazy || !(memoryTypeBits & requirements[i].memoryTypeBits))
+				continue;
+
+			bool isFree = true;
+
+			for (uint32_t j : layout.images) {
+				if (isOverlapping(image.firstPass, image.lastPass, _images[j].firstPass,
+							_images[j].lastPass))
+					isFree = false;
+			}
+
+			if (!isFree)
+				continue;
+
+			layout.requirements.size = std::max(layout.requirements.size, requirements[i].size);
+			layout.requirements.alignment =
+					std::max(layout.requirements.alignment, requirements[i].alignment);
+			layout.requirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+
+			image.block = b;
+			break;
+		}
+
+		if (image.block == UINT32_MAX) {
+			image.block = static_cast<uint32_t>(layouts.size());
+			layouts.push_back({ requirements[i], {}, image.isLazy });
+		}
+
+		layouts[image.block].images.push_back(i);
+	}
+
+	for (const BlockLayout &layout : layouts) {
+		const VkMemoryRequirements *pRequirements = &layout.requirements;
+
+		VmaAllocationCreateInfo allocInfo = {};
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkResult err = VK_ERROR_FEATURE_NOT_PRESENT;
+
+		if (layout.isLazy) {
+			allocInfo.requiredFlags =
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			err = _pMemory->allocateMemory(_category, pRequirements, allocInfo, &allocation);
+		}
+
+		// desktop devices rarely have lazy memory
+		if (err != VK_SUCCESS) {
+			allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			err = _pMemory->allocateMemory(_category, pRequirements, allocInfo, &allocation);
+		}
+
+		if (err != VK_SUCCESS)
+			throw std::runtime_error("Render graph memory allocation failed!");
+
+		_blocks.push_back({ allocation, {}, {} });
+
+		for (uint32_t i : layout.images)
+			vmaBindImageMemory(_allocator, allocation, _images[i].image);
+	}
+
+	for (PhysicalImage &image : _images) {
+		vk::ImageAspectFlags aspect = getAspect(image.desc.format);
+
+		// views sample depth, stencil would need a view of its own
+		if (aspect & vk::ImageAspectFlagBits::eDepth)
+			aspect = vk::ImageAspectFlagBits::eDepth;
+
+		vk::ImageSubresourceRange subresourceRange;
+		subresourceRange.setAspectMask(aspect);
+		subresourceRange.setBaseMipLevel(0);
+		subresourceRange.setLevelCount(image.desc.mipLevels);
+		subresourceRange.setBaseArrayLayer(0);
+		subresourceRange.setLayerCount(image.desc.arrayLayers);
+
+		vk::ImageViewCreateInfo createInfo;
+		createInfo.setImage(image.image);
+		createInfo.setViewType(image.desc.viewType);
+		createInfo.setFormat(image.desc.format);
+		createInfo.setSubresourceRange(subresourceRange);
+
+		image.view = _device.createImageView(createInfo);
+	}
+}
+
+void RenderGraph::_computeBarriers() {
+	// what happened to a resource so far, decides what its next use waits on
+	typedef struct {
+		vk::ImageLayout layout;
+		vk::PipelineStageFlags writeStages;
+		vk::AccessFlags writeAccess;
+		vk::PipelineStageFlags readStages;
+		// stages the last write was made visible to
+		vk::PipelineStageFlags visibleStages;
+	} State;
+
+	std::vector<State> states(_resources.size());
+
+	for (size_t i = 0; i < _resources.size(); i++) {
+		const ResourceData &resource = _resources[i];
+		State &state = states[i];
+
+		state = {};
+		state.layout = resource.isImported ? resource.initialLayout : vk::ImageLayout::eUndefined;
+
+		if (state.layout != vk::ImageLayout::eUndefined) {
+			getLayoutAccess(state.layout, state.writeStages, state.writeAccess);
+			state.writeAccess &= WRITE_ACCESS;
+		}
+	}
+
+	std::vector<vk::PipelineStageFlags> blockStages(_blocks.size());
+	std::vector<vk::AccessFlags> blockWrites(_blocks.size());
+
+	for (uint32_t i = 0; i < _passes.size(); i++) {
+		PassData &pass = _passes[i];
+
+		pass.barriers.clear();
+		pass.srcStages = {};
+		pass.dstStages = {};
+
+		if (pass.isCulled)
+			continue;
+
+		for (const Use &use : pass.uses) {
+			const ResourceData &resource = _resources[use.resource];
+			AccessInfo info = _getAccessInfo(use.access, pass.type);
+			State &state = states[use.resource];
+
+			bool isFirstUse = i == resource.firstPass;
+			bool isLayoutChange = info.layout != state.layout;
+			bool isBarrier = false;
+
+			vk::PipelineStageFlags srcStages;
+			vk::AccessFlags srcAccess;
+
+			if (isFirstUse && !resource.isImported) {
+				// the memory held another transient before, or this one last compile
+				uint32_t blockIndex = _images[resource.physical].block;
+
+				srcStages = _blocks[blockIndex].stages | blockStages[blockIndex];
+				srcAccess = _blocks[blockIndex].writes | blockWrites[blockIndex];
+				isBarrier = true;
+			} else if (isFirstUse && state.layout == vk::ImageLayout::eUndefined) {
+				// Waits on its own stages, so an acquire semaphore waited on at those stages
+				// orders the transition after the image is released.
+				srcStages = info.stages;
+				isBarrier = true;
+			} else {
+				bool isHazard = info.isWrite
+						? static_cast<bool>(state.writeStages | state.readStages)
+						: static_cast<bool>(state.writeStages) &&
+								static_cast<bool>(info.stages & ~state.visibleStages);
+
+				isBarrier = isLayoutChange || isHazard;
+
+				srcStages = state.writeStages;
+				srcAccess = state.writeAccess;
+
+				if (info.isWrite || isLayoutChange)
+					srcStages |= state.readStages;
+			}
+
+			if (isBarrier) {
+				vk::ImageSubresourceRange subresourceRange;
+				subresourceRange.setAspectMask(getAspect(resource.desc.format));
+				subresourceRange.setBaseMipLevel(0);
+				subresourceRange.setLevelCount(resource.desc.mipLevels);
+				subresourceRange.setBaseArrayLayer(0);
+				subresourceRange.setLayerCount(resource.desc.arrayLayers);
+
+				vk::ImageMemoryBarrier barrier;
+				barrier.setOldLayout(state.layout);
+				barrier.setNewLayout(info.layout);
+				barrier.setSrcAccessMask(srcAccess);
+				barrier.setDstAccessMask(info.access);
+				barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+				barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+				barrier.setImage(_getImage(resource));
+				barrier.setSubresourceRange(subresourceRange);
+
+				pass.barriers.push_back(barrier);
+				pass.srcStages |= srcStages ? srcStages : vk::PipelineStageFlagBits::eTopOfPipe;
+				pass.dstStages |= info.stages;
+
+				state.visibleStages =
+						isLayoutChange ? info.stages : state.visibleStages | info.stages;
+			}
+
+			state.layout = info.layout;
+
+			if (info.isWrite) {
+				state.writeStages = info.stages;
+				state.writeAccess = info.access & WRITE_ACCESS;
+				state.readStages = {};
+				state.visibleStages = {};
+			} else {
+				// a transition is a write, later reads wait on it
+				if (isLayoutChange) {
+					state.writeStages = info.stages;
+					state.writeAccess = {};
+					state.readStages = {};
+				}
+
+				state.readStages |= info.stages;
+			}
+
+			if (!resource.isImported) {
+				uint32_t blockIndex = _images[resource.physical].block;
+
+				blockStages[blockIndex] |= info.stages;
+				blockWrites[blockIndex] |= info.access & WRITE_ACCESS;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		_blocks[i].stages = blockStages[i];
+		_blocks[i].writes = blockWrites[i];
+	}
+
+	// imported images are left as their owner expects
+	_finalBarriers.clear();
+	_finalSrcStages = {};
+	_finalDstStages = {};
+
+	for (size_t i = 0; i < _resources.size(); i++) {
+		const ResourceData &resource = _resources[i];
+		const State &state = states[i];
+
+		if (!resource.isImported || resource.finalLayout == vk::ImageLayout::eUndefined ||
+				resource.finalLayout == state.layout)
+			continue;
+
+		vk::PipelineStageFlags dstStages;
+		vk::AccessFlags dstAccess;
+		getLayoutAccess(resource.finalLayout, dstStages, dstAccess);
+
+		vk::PipelineStageFlags srcStages = state.writeStages | state.readStages;
+
+		vk::ImageSubresourceRange subresourceRange;
+		subresourceRange.setAspectMask(getAspect(resource.desc.format));
+		subresourceRange.setBaseMipLevel(0);
+		subresourceRange.setLevelCount(resource.desc.mipLevels);
+		subresourceRange.setBaseArrayLayer(0);
+		subresourceRange.setLayerCount(resource.desc.arrayLayers);
+
+		vk::ImageMemoryBarrier barrier;
+		barrier.setOldLayout(state.layout);
+		barrier.setNewLayout(resource.finalLayout);
+		barrier.setSrcAccessMask(state.writeAccess);
+		barrier.setDstAccessMask(dstAccess);
+		barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+		barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+		barrier.setImage(resource.image);
+		barrier.setSubresourceRange(subresourceRange);
+
+		_finalBarriers.push_back(barrier);
+		_finalSrcStages |= srcStages ? srcStages : vk::PipelineStageFlagBits::eTopOfPipe;
+		_finalDstStages |= dstStages;
+	}
+}
+
+void RenderGraph::_createPassObjects() {
+	for (uint32_t i = 0; i < _passes.size(); i++) {
+		PassData &pass = _passes[i];
+
+		pass.renderPass = VK_NULL_HANDLE;
+		pass.framebuffer = VK_NULL_HANDLE;
+		pass.clearValues.clear();
+
+		if (pass.isCulled || pass.type != PassType::Graphics)
+			continue;
+
+		std::vector<vk::AttachmentDescription> attachments;
+		std::vector<vk::ImageView> views;
+
+		vk::Extent2D extent(UINT32_MAX, UINT32_MAX);
+
+		for (const Use &use : pass.uses) {
+			if (!_isAttachment(use.access))
+				continue;
+
+			const ResourceData &resource = _resources[use.resource];
+			AccessInfo info = _getAccessInfo(use.access, pass.type);
+
+			// nothing after this pass reads a transient it is the last user of
+			bool isStored = resource.isImported || resource.isOutput || resource.lastPass > i;
+
+			vk::AttachmentStoreOp storeOp =
+					isStored ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+
+			bool hasStencil = static_cast<bool>(
+					getAspect(resource.desc.format) & vk::ImageAspectFlagBits::eStencil);
+
+			// layouts were set by barriers, the render pass leaves them alone
+			vk::AttachmentDescription attachment;
+			attachment.setFormat(resource.desc.format);
+			attachment.setSamples(vk::SampleCountFlagBits::e1);
+			attachment.setLoadOp(use.loadOp);
+			attachment.setStoreOp(storeOp);
+			attachment.setStencilLoadOp(
+					hasStencil ? use.loadOp : vk::AttachmentLoadOp::eDontCare);
+			attachment.setStencilStoreOp(hasStencil ? storeOp : vk::AttachmentStoreOp::eDontCare);
+			attachment.setInitialLayout(info.layout);
+			attachment.setFinalLayout(info.layout);
+
+			attachments.push_back(attachment);
+			views.push_back(_getImageView(resource));
+			pass.clearValues.push_back(use.clearValue);
+
+			extent.width = std::min(extent.width, resource.desc.width);
+			extent.height = std::min(extent.height, resource.desc.height);
+		}
+
+		assert(!attachments.empty());
+
+		pass.extent = extent;
+		pass.renderPass = _getRenderPass(attachments, pass.viewMask);
+		pass.framebuffer = _getFramebuffer(pass.renderPass, views, extent);
+	}
+}
+
+vk::RenderPass RenderGraph::_getRenderPass(
+		const std::vector<vk::AttachmentDescription> &attachments, uint32_t viewMask) {
+	for (const RenderPassEntry &entry : _renderPasses) {
+		if (entry.viewMask == viewMask && entry.attachments == attachments)
+			return entry.renderPass;
+	}
+
+	std::vector<vk::AttachmentReference> colorRefs;
+	vk::AttachmentReference depthRef;
+	bool hasDepth = false;
+
+	for (uint32_t i = 0; i < attachments.size(); i++) {
+		vk::ImageAspectFlags aspect = getAspect(attachments[i].format);
+
+		if (aspect & vk::ImageAspectFlagBits::eColor) {
+			colorRefs.push_back({ i, vk::ImageLayout::eColorAttachmentOptimal });
+		} else {
+			depthRef = vk::AttachmentReference(i, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+			hasDepth = true;
+		}
+	}
+
+	vk::SubpassDescription subpass;
+	subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics);
+	subpass.setColorAttachments(colorRefs);
+
+	if (hasDepth)
+		subpass.setPDepthStencilAttachment(&depthRef);
+
+	// bit i renders view i into layer i
+	vk::RenderPassMultiviewCreateInfo multiviewInfo;
+	multiviewInfo.setViewMasks(viewMask);
+	multiviewInfo.setCorrelationMasks(viewMask);
+
+	vk::RenderPassCreateInfo createInfo;
+	createInfo.setAttachments(attachments);
+	createInfo.setSubpasses(subpass);
+
+	if (viewMask != 0)
+		createInfo.setPNext(&multiviewInfo);
+
+	vk::RenderPass renderPass = _device.createRenderPass(createInfo);
+	_renderPasses.push_back({ attachments, viewMask, renderPass });
+
+	return renderPass;
+}
+
+vk::Framebuffer RenderGraph::_getFramebuffer(vk::RenderPass renderPass,
+		const std::vector<vk::ImageView> &views, vk::Extent2D extent) {
+	for (const FramebufferEntry &entry : _framebuffers) {
+		if (entry.renderPass == renderPass && entry.views == views && entry.extent == extent)
+			return entry.framebuffer;
+	}
+
+	vk::FramebufferCreateInfo createInfo;
+	createInfo.setRenderPass(renderPass);
+	createInfo.setAttachments(views);
+	createInfo.setWidth(extent.width);
+	createInfo.setHeight(extent.height);
+	createInfo.setLayers(1);
+
+	vk::Framebuffer framebuffer = _device.createFramebuffer(createInfo);
+	_framebuffers.push_back({ renderPass, views, extent, framebuffer });
+
+	return framebuffer;
+}
+
+void RenderGraph::_releaseImages() {
+	if (_images.empty() && _blocks.empty())
+		return;
+
+	// framebuffers may reference the views
+	releaseFramebuffers();
+
+	vk::Device device = _device;
+	VmaAllocator allocator = _allocator;
+	std::vector<PhysicalImage> images = _images;
+	std::vector<Block> blocks = _blocks;
+
+	RD::getSingleton().retire([device, allocator, images, blocks]() {
+		_destroyImages(device, allocator, images, blocks);
+	});
+
+	_images.clear();
+	_blocks.clear();
+}
+
+void RenderGraph::_destroyImages(vk::Device device, VmaAllocator allocator,
+		const std::vector<PhysicalImage> &images, const std::vector<Block> &blocks) {
+	for (const PhysicalImage &image : images) {
+		device.destroyImageView(image.view);
+		device.destroyImage(image.image);
+	}
+
+	for (const Block &block : blocks)
+		vmaFreeMemory(allocator, block.allocation);
+}
+
+void RenderGraph::reset() {
+	_resources.clear();
+	_passes.clear();
+	_finalBarriers.clear();
+
+	_isCompiled = false;
+}
+
+RenderGraph::Resource RenderGraph::importImage(const char *pName, vk::Image image,
+		vk::ImageView view, const ImageDesc &desc, vk::ImageLayout initialLayout,
+		vk::ImageLayout finalLayout) {
+	ResourceData resource = {};
+	resource.pName = pName;
+	resource.desc = desc;
+	resource.isImported = true;
+	resource.image = image;
+	resource.view = view;
+	resource.initialLayout = initialLayout;
+	resource.finalLayout = finalLayout;
+
+	_resources.push_back(resource);
+	return static_cast<Resource>(_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createImage(const char *pName, const ImageDesc &desc) {
+	ResourceData resource = {};
+	resource.pName = pName;
+	resource.desc = desc;
+
+	_resources.push_back(resource);
+	return static_cast<Resource>(_resources.size() - 1);
+}
+
+void RenderGraph::setOutput(Resource resource) {
+	_resources[resource].isOutput = true;
+}
+
+RenderGraph::Pass RenderGraph::addPass(const char *pName, PassType type, Execute execute) {
+	PassData pass = {};
+	pass.pName = pName;
+	pass.type = type;
+	pass.execute = execute;
+
+	_passes.push_back(std::move(pass));
+	return static_cast<Pass>(_passes.size() - 1);
+}
+
+void RenderGraph::read(Pass pass, Resource resource, ImageAccess access) {
+	_passes[pass].uses.push_back({ resource, access, vk::AttachmentLoadOp::eLoad, {} });
+}
+
+void RenderGraph::write(Pass pass, Resource resource, ImageAccess access,
+		vk::AttachmentLoadOp loadOp, vk::ClearValue clearValue) {
+	_passes[pass].uses.push_back({ resource, access, loadOp, clearValue });
+}
+
+void RenderGraph::setRenderArea(Pass pass, vk::Extent2D extent) {
+	_passes[pass].renderArea = extent;
+}
+
+void RenderGraph::setViewMask(Pass pass, uint32_t viewMask) {
+	_passes[pass].viewMask = viewMask;
+}
+
+void RenderGraph::setSideEffects(Pass pass) {
+	_passes[pass].hasSideEffects = true;
+}
+
+void RenderGraph::compile() {
+	assert(_initialized && !_isCompiled);
+
+	_cull();
+	_computeLifetimes();
+	_allocateImages();
+	_computeBarriers();
+	_createPassObjects();
+
+	_isCompiled = true;
+}
+
+void RenderGraph::execute(vk::CommandBuffer commandBuffer) {
+	assert(_isCompiled);
+
+	for (PassData &pass : _passes) {
+		if (pass.isCulled)
+			continue;
+
+		if (!pass.barriers.empty()) {
+			commandBuffer.pipelineBarrier(
+					pass.srcStages, pass.dstStages, {}, nullptr, nullptr, pass.barriers);
+		}
+
+		if (pass.type == PassType::Graphics) {
+			vk::Extent2D extent = pass.extent;
+
+			if (pass.renderArea.width != 0 && pass.renderArea.height != 0) {
+				extent.width = std::min(extent.width, pass.renderArea.width);
+				extent.height = std::min(extent.height, pass.renderArea.height);
+			}
+
+			vk::Rect2D renderArea;
+			renderArea.setOffset({ 0, 0 });
+			renderArea.setExtent(extent);
+
+			vk::RenderPassBeginInfo beginInfo;
+			beginInfo.setRenderPass(pass.renderPass);
+			beginInfo.setFramebuffer(pass.framebuffer);
+			beginInfo.setRenderArea(renderArea);
+			beginInfo.setClearValues(pass.clearValues);
+
+			commandBuffer.beginRenderPass(beginInfo, vk::SubpassContents::eInline);
+
+			vk::Viewport viewport;
+			viewport.setX(0.0f);
+			viewport.setY(0.0f);
+			viewport.setWidth(extent.width);
+			viewport.setHeight(extent.height);
+			viewport.setMinDepth(0.0f);
+			viewport.setMaxDepth(1.0f);
+
+			commandBuffer.setViewport(0, viewport);
+			commandBuffer.setScissor(0, renderArea);
+		}
+
+		pass.execute(commandBuffer);
+
+		if (pass.type == PassType::Graphics)
+			commandBuffer.endRenderPass();
+	}
+
+	if (!_finalBarriers.empty()) {
+		commandBuffer.pipelineBarrier(
+				_finalSrcStages, _finalDstStages, {}, nullptr, nullptr, _finalBarriers);
+	}
+}
+
+vk::Image RenderGraph::getImage(Resource resource) const {
+	return _getImage(_resources[resource]);
+}
+
+vk::ImageView RenderGraph::getImageView(Resource resource) const {
+	return _getImageView(_resources[resource]);
+}
+
+vk::RenderPass RenderGraph::getRenderPass(
+		const std::vector<vk::Format> &colorFormats, vk::Format depthFormat, uint32_t viewMask) {
+	// compatibility ignores load and store ops, any match serves
+	for (const RenderPassEntry &entry : _renderPasses) {
+		if (entry.viewMask != viewMask)
+			continue;
+
+		size_t count = colorFormats.size() + (depthFormat != vk::Format::eUndefined ? 1 : 0);
+
+		if (entry.attachments.size() != count)
+			continue;
+
+		bool isMatching = true;
+		size_t color = 0;
+
+		for (const vk::AttachmentDescription &attachment : entry.attachments) {
+			bool isColor = static_cast<bool>(
+					getAspect(attachment.format) & vk::ImageAspectFlagBits::eColor);
+
+			if (isColor)
+				isMatching = isMatching && color < colorFormats.size() &&
+						attachment.format == colorFormats[color++];
+			else
+				isMatching = isMatching && attachment.format == depthFormat;
+		}
+
+		if (isMatching)
+			return entry.renderPass;
+	}
+
+	std::vector<vk::AttachmentDescription> attachments;
+
+	for (vk::Format format : colorFormats) {
+		vk::AttachmentDescription attachment;
+		attachment.setFormat(format);
+		attachment.setSamples(vk::SampleCountFlagBits::e1);
+		attachment.setLoadOp(vk::AttachmentLoadOp::eDontCare);
+		attachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+		attachment.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
+		attachment.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+		attachment.setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal);
+		attachment.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
+
+		attachments.push_back(attachment);
+	}
+
+	if (depthFormat != vk::Format::eUndefined) {
+		vk::AttachmentDescription attachment;
+		attachment.setFormat(depthFormat);
+		attachment.setSamples(vk::SampleCountFlagBits::e1);
+		attachment.setLoadOp(vk::AttachmentLoadOp::eDontCare);
+		attachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+		attachment.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
+		attachment.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+		attachment.setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+		attachment.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+		attachments.push_back(attachment);
+	}
+
+	return _getRenderPass(attachments, viewMask);
+}
+
+void RenderGraph::releaseFramebuffers() {
+	if (_framebuffers.empty())
+		return;
+
+	vk::Device device = _device;
+	std::vector<FramebufferEntry> framebuffers = _framebuffers;
+
+	RD::getSingleton().retire([device, framebuffers]() {
+		for (const FramebufferEntry &entry : framebuffers)
+			device.destroyFramebuffer(entry.framebuffer);
+	});
+
+	_framebuffers.clear();
+}
+
+void RenderGraph::init(vk::Device device, GpuMemory *pMemory, MemoryCategory category) {
+	_device = device;
+	_allocator = pMemory->getAllocator();
+	_pMemory = pMemory;
+	_category = category;
+
+	_initialized = true;
+}
+
+RenderGraph::~RenderGraph() {
+	if (!_initialized)
+		return;
+
+	for (const FramebufferEntry &entry : _framebuffers)
+		_device.destroyFramebuffer(entry.framebuffer);
+
+	for (const RenderPassEntry &entry : _renderPasses)
+		_device.destroyRenderPass(entry.renderPass);
+
+	_destroyImages(_device, _allocator, _images, _blocks);
+}
@@ -0,0 +1,241 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <vma/vk_mem_alloc.h>
+#include <vulkan/vulkan.hpp>
+
+#include "gpu_memory.h"
+
+// Records passes that declare the images they read and write. Passes run in the order they were
+// added, compile() culls the ones no output depends on, derives layouts and barriers, builds
+// render passes and framebuffers for graphics passes and allocates transient images, aliasing
+// the memory of those whose lifetimes don't overlap.
+//
+// The frame graph is rebuilt every frame, physical images, render passes and framebuffers are
+// kept as long as the declarations match. Buffers are not tracked, passes synchronizing through
+// them keep their own barriers and are marked with setSideEffects so they aren't culled.
+class RenderGraph {
+public:
+	enum class PassType {
+		Graphics,
+		Compute,
+		Transfer,
+	};
+
+	// How a pass uses an image, decides its layout, the stages that wait on it and its access.
+	// Sampled and Storage are fragment shader stages in graphics passes, compute in others.
+	enum class ImageAccess {
+		ColorAttachment,
+		DepthAttachment,
+		Sampled,
+		Storage,
+		TransferSrc,
+		TransferDst,
+	};
+
+	struct ImageDesc {
+		vk::Format format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t arrayLayers = 1;
+		uint32_t mipLevels = 1;
+		vk::ImageCreateFlags flags = {};
+		vk::ImageViewType viewType = vk::ImageViewType::e2D;
+	};
+
+	typedef uint32_t Resource;
+	typedef uint32_t Pass;
+
+	typedef std::function<void(vk::CommandBuffer)> Execute;
+
+private:
+	typedef struct {
+		Resource resource;
+		ImageAccess access;
+		vk::AttachmentLoadOp loadOp;
+		vk::ClearValue clearValue;
+	} Use;
+
+	typedef struct {
+		vk::ImageLayout layout;
+		vk::PipelineStageFlags stages;
+		vk::AccessFlags access;
+		vk::ImageUsageFlags usage;
+		bool isWrite;
+	} AccessInfo;
+
+	typedef struct {
+		const char *pName;
+		ImageDesc desc;
+		bool isImported;
+		bool isOutput;
+
+		vk::Image image;
+		vk::ImageView view;
+		// imported only, undefined final layout leaves the image as the last pass did
+		vk::ImageLayout initialLayout;
+		vk::ImageLayout finalLayout;
+
+		// filled by compile
+		vk::ImageUsageFlags usage;
+		uint32_t firstPass;
+		uint32_t lastPass;
+		bool isLazy;
+		uint32_t physical;
+	} ResourceData;
+
+	typedef struct {
+		const char *pName;
+		PassType type;
+		Execute execute;
+		std::vector<Use> uses;
+		// zero is the whole attachment size
+		vk::Extent2D renderArea;
+		uint32_t viewMask;
+		bool hasSideEffects;
+
+		// filled by compile
+		bool isCulled;
+		vk::PipelineStageFlags srcStages;
+		vk::PipelineStageFlags dstStages;
+		std::vector<vk::ImageMemoryBarrier> barriers;
+		vk::RenderPass renderPass;
+		vk::Framebuffer framebuffer;
+		vk::Extent2D extent;
+		std::vector<vk::ClearValue> clearValues;
+	} PassData;
+
+	// A transient image the graph owns, images sharing a block alias its memory.
+	typedef struct {
+		ImageDesc desc;
+		vk::ImageUsageFlags usage;
+		bool isLazy;
+		uint32_t firstPass;
+		uint32_t lastPass;
+
+		vk::Image image;
+		vk::ImageView view;
+		uint32_t block;
+	} PhysicalImage;
+
+	typedef struct {
+		VmaAllocation allocation;
+		// every stage that touched the block last compile, the first use this compile waits on them
+		vk::PipelineStageFlags stages;
+		vk::AccessFlags writes;
+	} Block;
+
+	typedef struct {
+		std::vector<vk::AttachmentDescription> attachments;
+		uint32_t viewMask;
+		vk::RenderPass renderPass;
+	} RenderPassEntry;
+
+	typedef struct {
+		vk::RenderPass renderPass;
+		std::vector<vk::ImageView> views;
+		vk::Extent2D extent;
+		vk::Framebuffer framebuffer;
+	} FramebufferEntry;
+
+	vk::Device _device;
+	VmaAllocator _allocator;
+	GpuMemory *_pMemory = nullptr;
+	MemoryCategory _category = MemoryCategory::Attachments;
+
+	std::vector<ResourceData> _resources;
+	std::vector<PassData> _passes;
+
+	std::vector<PhysicalImage> _images;
+	std::vector<Block> _blocks;
+
+	std::vector<RenderPassEntry> _renderPasses;
+	std::vector<FramebufferEntry> _framebuffers;
+
+	vk::PipelineStageFlags _finalSrcStages;
+	vk::PipelineStageFlags _finalDstStages;
+	std::vector<vk::ImageMemoryBarrier> _finalBarriers;
+
+	bool _isCompiled = false;
+	bool _initialized = false;
+
+	static AccessInfo _getAccessInfo(ImageAccess access, PassType type);
+	static bool _isAttachment(ImageAccess access);
+
+	vk::Image _getImage(const ResourceData &resource) const;
+	vk::ImageView _getImageView(const ResourceData &resource) const;
+
+	void _cull();
+	void _computeLifetimes();
+	void _allocateImages();
+	void _computeBarriers();
+	void _createPassObjects();
+
+	vk::RenderPass _getRenderPass(
+			const std::vector<vk::AttachmentDescription> &attachments, uint32_t viewMask);
+	vk::Framebuffer _getFramebuffer(vk::RenderPass renderPass,
+			const std::vector<vk::ImageView> &views, vk::Extent2D extent);
+
+	// Frames in flight may still use them, destroyed through RD once those completed.
+	void _releaseImages();
+
+	static void _destroyImages(vk::Device device, VmaAllocator allocator,
+			const std::vector<PhysicalImage> &images, const std::vector<Block> &blocks);
+
+public:
+	// Stages and access a layout implies, conservative for layouts the graph doesn't produce.
+	static void getLayoutAccess(
+			vk::ImageLayout layout, vk::PipelineStageFlags &stages, vk::AccessFlags &access);
+	static vk::ImageAspectFlags getAspect(vk::Format format);
+
+	// Clears passes and resources, physical images and render passes are kept for reuse.
+	void reset();
+
+	// An image owned elsewhere, in initial layout before the graph and left in final layout.
+	Resource importImage(const char *pName, vk::Image image, vk::ImageView view,
+			const ImageDesc &desc, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout);
+	// Contents don't outlive the graph, memory is shared with transients used at other times.
+	Resource createImage(const char *pName, const ImageDesc &desc);
+	// Passes writing outputs are kept, along with everything they depend on.
+	void setOutput(Resource resource);
+
+	Pass addPass(const char *pName, PassType type, Execute execute);
+
+	// Each resource is used once per pass. Reading an attachment loads it, writing one with a
+	// load op other than load discards what earlier passes wrote.
+	void read(Pass pass, Resource resource, ImageAccess access);
+	void write(Pass pass, Resource resource, ImageAccess access,
+			vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eDontCare,
+			vk::ClearValue clearValue = {});
+
+	// Graphics passes only, viewport and scissor are set to the render area before the pass runs.
+	void setRenderArea(Pass pass, vk::Extent2D extent);
+	void setViewMask(Pass pass, uint32_t viewMask);
+	// Kept even when no output depends on it.
+	void setSideEffects(Pass pass);
+
+	void compile();
+	void execute(vk::CommandBuffer commandBuffer);
+
+	// Valid after compile, transients may change when their declarations do.
+	vk::Image getImage(Resource resource) const;
+	vk::ImageView getImageView(Resource resource) const;
+
+	// A render pass compatible with graph passes writing these formats, for pipeline creation.
+	vk::RenderPass getRenderPass(const std::vector<vk::Format> &colorFormats,
+			vk::Format depthFormat = vk::Format::eUndefined, uint32_t viewMask = 0);
+
+	// Drops framebuffers, for when imported views they reference are destroyed.
+	void releaseFramebuffers();
+
+	// Transients are allocated from the category's pools.
+	void init(vk::Device device, GpuMemory *pMemory,
+			MemoryCategory category = MemoryCategory::Attachments);
+	~RenderGraph();
+};
+
+#endif // !RENDER_GRAPH_H
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
@@ -5,8 +6,10 @@
 #include <stdexcept>
 
 #include <SDL3/SDL_log.h>
+#include <SDL3/SDL_timer.h>
 
 #include <io/image.h>
+#include <profiler.h>
 
 #include "shaders/depth.gen.h"
 #include "shaders/material.gen.h"
@@ -37,6 +40,58 @@ static vk::Format getVkFormat(Image::Format format) {
 	}
 }
 
+// Box filtered to half the size, odd edges repeat their last texel.
+static std::vector<uint8_t> halveImage(
+		const std::vector<uint8_t> &data, uint32_t width, uint32_t height, Image::Format format) {
+	uint32_t halfWidth = std::max(width / 2, 1u);
+	uint32_t halfHeight = std::max(height / 2, 1u);
+
+	uint32_t channelCount = Image::getFormatChannelCount(format);
+	uint32_t pixelSize = Image::getFormatByteSize(format);
+	bool isFloat = format == Image::Format::RGBA32F;
+
+	std::vector<uint8_t> halved(halfWidth * halfHeight * pixelSize);
+
+	for (uint32_t y = 0; y < halfHeight; y++) {
+		uint32_t y0 = std::min(y * 2, height - 1);
+		uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+		for (uint32_t x = 0; x < halfWidth; x++) {
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+			const uint8_t *pTexels[4] = {
+				&data[(y0 * width + x0) * pixelSize],
+				&data[(y0 * width + x1) * pixelSize],
+				&data[(y1 * width + x0) * pixelSize],
+				&data[(y1 * width + x1) * pixelSize],
+			};
+
+			uint8_t *pDst = &halved[(y * halfWidth + x) * pixelSize];
+
+			for (uint32_t c = 0; c < channelCount; c++) {
+				if (isFloat) {
+					float sum = 0.0f;
+
+					for (const uint8_t *pTexel : pTexels)
+						sum += reinterpret_cast<const float *>(pTexel)[c];
+
+					reinterpret_cast<float *>(pDst)[c] = sum * 0.25f;
+				} else {
+					uint32_t sum = 2;
+
+					for (const uint8_t *pTexel : pTexels)
+						sum += pTexel[c];
+
+					pDst[c] = static_cast<uint8_t>(sum / 4);
+				}
+			}
+		}
+	}
+
+	return halved;
+}
+
 vk::ShaderModule createShaderModule(vk::Device device, const uint32_t *pCode, size_t size) {
 	vk::ShaderModuleCreateInfo createInfo;
 	createInfo.setPCode(pCode);
@@ -45,17 +100,18 @@ vk::ShaderModule createShaderModule(vk::Device device, const uint32_t *pCode, si
 	return device.createShaderModule(createInfo);
 }
 
-void updateInputAttachment(vk::Device device, vk::ImageView imageView, vk::DescriptorSet dstSet) {
+void updateTonemapInput(vk::Device device, vk::ImageView imageView, vk::Sampler sampler,
+		vk::DescriptorSet dstSet) {
 	vk::DescriptorImageInfo imageInfo;
 	imageInfo.setImageView(imageView);
 	imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-	imageInfo.setSampler(VK_NULL_HANDLE);
+	imageInfo.setSampler(sampler);
 
 	vk::WriteDescriptorSet writeInfo;
 	writeInfo.setDstSet(dstSet);
 	writeInfo.setDstBinding(0);
 	writeInfo.setDstArrayElement(0);
-	writeInfo.setDescriptorType(vk::DescriptorType::eInputAttachment);
+	writeInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
 	writeInfo.setDescriptorCount(1);
 	writeInfo.setImageInfo(imageInfo);
 
@@ -65,7 +121,9 @@ void updateInputAttachment(vk::Device device, vk::ImageView imageView, vk::Descr
 vk::Pipeline createPipeline(vk::Device device, vk::ShaderModule vertexStage,
 		vk::ShaderModule fragmentStage, vk::PipelineLayout pipelineLayout,
 		vk::RenderPass renderPass, uint32_t subpass,
-		vk::PipelineVertexInputStateCreateInfo vertexInput, bool writeDepth = false) {
+		vk::PipelineVertexInputStateCreateInfo vertexInput, bool writeDepth = false,
+		uint32_t colorAttachmentCount = 1,
+		const vk::SpecializationInfo *pFragmentSpecialization = nullptr) {
 	vk::PipelineShaderStageCreateInfo vertexStageInfo;
 	vertexStageInfo.setModule(vertexStage);
 	vertexStageInfo.setStage(vk::ShaderStageFlagBits::eVertex);
@@ -75,6 +133,7 @@ vk::Pipeline createPipeline(vk::Device device, vk::ShaderModule vertexStage,
 	fragmentStageInfo.setModule(fragmentStage);
 	fragmentStageInfo.setStage(vk::ShaderStageFlagBits::eFragment);
 	fragmentStageInfo.setPName("main");
+	fragmentStageInfo.setPSpecializationInfo(pFragmentSpecialization);
 
 	vk::PipelineShaderStageCreateInfo shaderStages[] = { vertexStageInfo, fragmentStageInfo };
 
@@ -109,6 +168,10 @@ vk::Pipeline createPipeline(vk::Device device, vk::ShaderModule vertexStage,
 			vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
 			vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
 
+	// depth pipelines drawn in a pass with color leave it untouched
+	if (writeDepth)
+		colorWriteMask = {};
+
 	vk::PipelineColorBlendAttachmentState colorBlendAttachment;
 	colorBlendAttachment.setColorWriteMask(colorWriteMask);
 	colorBlendAttachment.setBlendEnable(VK_FALSE);
@@ -116,7 +179,8 @@ vk::Pipeline createPipeline(vk::Device device, vk::ShaderModule vertexStage,
 	vk::PipelineColorBlendStateCreateInfo colorBlending;
 	colorBlending.setLogicOpEnable(VK_FALSE);
 	colorBlending.setLogicOp(vk::LogicOp::eCopy);
-	colorBlending.setAttachments(colorBlendAttachment);
+	colorBlending.setAttachmentCount(colorAttachmentCount);
+	colorBlending.setPAttachments(&colorBlendAttachment);
 	colorBlending.setBlendConstants({ 0.0f, 0.0f, 0.0f, 0.0f });
 
 	std::vector<vk::DynamicState> dynamicStates = {
@@ -176,9 +240,10 @@ void RD::endSingleTimeCommands(vk::CommandBuffer commandBuffer) {
 	_pContext->getDevice().freeCommandBuffers(_pContext->getCommandPool(), commandBuffer);
 }
 
-AllocatedBuffer RD::bufferCreate(
-		vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationInfo *pAllocInfo) {
-	return AllocatedBuffer::create(_allocator, usage, size, pAllocInfo);
+AllocatedBuffer RD::bufferCreate(MemoryCategory category, vk::BufferUsageFlags usage,
+		vk::DeviceSize size, VmaAllocationInfo *pAllocInfo, bool isReadback) {
+	return AllocatedBuffer::create(
+			&_pContext->getMemory(), category, usage, size, pAllocInfo, isReadback);
 }
 
 void RD::bufferCopy(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size) {
@@ -217,33 +282,26 @@ void RD::bufferCopyToImage(vk::Buffer buffer, vk::Image image, uint32_t width, u
 	endSingleTimeCommands(commandBuffer);
 }
 
-void RD::bufferSend(vk::Buffer dstBuffer, uint8_t *pData, size_t size) {
-	vk::BufferUsageFlagBits usage = vk::BufferUsageFlagBits::eTransferSrc;
-
-	VmaAllocationInfo stagingAllocInfo;
-	AllocatedBuffer stagingBuffer = bufferCreate(usage, size, &stagingAllocInfo);
-
-	memcpy(stagingAllocInfo.pMappedData, pData, size);
-	vmaFlushAllocation(_allocator, stagingBuffer.allocation, 0, VK_WHOLE_SIZE);
-	bufferCopy(stagingBuffer.buffer, dstBuffer, size);
-
-	vmaDestroyBuffer(_allocator, stagingBuffer.buffer, stagingBuffer.allocation);
+uint64_t RD::bufferSend(
+		vk::Buffer dstBuffer, uint8_t *pData, size_t size, UploadPriority priority) {
+	return _transferQueue.bufferUpload(dstBuffer, pData, size, priority);
 }
 
 void RD::bufferDestroy(AllocatedBuffer buffer) {
 	vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
 }
 
-AllocatedImage RD::imageCreate(uint32_t width, uint32_t height, vk::Format format,
-		uint32_t mipLevels, vk::ImageUsageFlags usage) {
-	return AllocatedImage::create(_allocator, width, height, mipLevels, 1, format, usage);
+AllocatedImage RD::imageCreate(MemoryCategory category, uint32_t width, uint32_t height,
+		vk::Format format, uint32_t mipLevels, vk::ImageUsageFlags usage) {
+	return AllocatedImage::create(
+			&_pContext->getMemory(), category, width, height, mipLevels, 1, format, usage);
 }
 
-AllocatedImage RD::imageCubeCreate(
-		uint32_t size, vk::Format format, uint32_t mipLevels, vk::ImageUsageFlags usage) {
+AllocatedImage RD::imageCubeCreate(MemoryCategory category, uint32_t size, vk::Format format,
+		uint32_t mipLevels, vk::ImageUsageFlags usage) {
 	uint32_t arrayLayers = 6;
-	return AllocatedImage::create(_allocator, size, size, mipLevels, arrayLayers, format, usage,
-			vk::ImageCreateFlagBits::eCubeCompatible);
+	return AllocatedImage::create(&_pContext->getMemory(), category, size, size, mipLevels,
+			arrayLayers, format, usage, vk::ImageCreateFlagBits::eCubeCompatible);
 }
 
 void RD::imageGenerateMipmaps(vk::Image image, int32_t width, int32_t height, vk::Format format,
@@ -256,7 +314,12 @@ void RD::imageGenerateMipmaps(vk::Image image, int32_t width, int32_t height, vk
 	assert(isBlittingSupported);
 
 	vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+	imageRecordMipmaps(commandBuffer, image, width, height, mipLevels, arrayLayers);
+	endSingleTimeCommands(commandBuffer);
+}
 
+void RD::imageRecordMipmaps(vk::CommandBuffer commandBuffer, vk::Image image, int32_t width,
+		int32_t height, uint32_t mipLevels, uint32_t arrayLayers) {
 	vk::ImageSubresourceRange subresourceRange;
 	subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
 	subresourceRange.setLevelCount(1);
@@ -336,80 +399,50 @@ void RD::imageGenerateMipmaps(vk::Image image, int32_t width, int32_t height, vk
 
 	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
 			vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
-
-	endSingleTimeCommands(commandBuffer);
 }
 
 void RD::imageLayoutTransition(vk::Image image, vk::Format format, uint32_t mipLevels,
 		uint32_t arrayLayers, vk::ImageLayout oldLayout, vk::ImageLayout newLayout) {
 	vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+	imageRecordLayoutTransition(
+			commandBuffer, image, format, mipLevels, arrayLayers, oldLayout, newLayout);
+	endSingleTimeCommands(commandBuffer);
+}
 
+void RD::imageRecordLayoutTransition(vk::CommandBuffer commandBuffer, vk::Image image,
+		vk::Format format, uint32_t mipLevels, uint32_t arrayLayers, vk::ImageLayout oldLayout,
+		vk::ImageLayout newLayout) {
 	vk::ImageSubresourceRange subresourceRange;
-	subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+	subresourceRange.setAspectMask(RenderGraph::getAspect(format));
 	subresourceRange.setBaseMipLevel(0);
 	subresourceRange.setLevelCount(mipLevels);
 	subresourceRange.setBaseArrayLayer(0);
 	subresourceRange.setLayerCount(arrayLayers);
 
+	vk::PipelineStageFlags sourceStage;
+	vk::AccessFlags sourceAccess;
+	RenderGraph::getLayoutAccess(oldLayout, sourceStage, sourceAccess);
+
+	vk::PipelineStageFlags destinationStage;
+	vk::AccessFlags destinationAccess;
+	RenderGraph::getLayoutAccess(newLayout, destinationStage, destinationAccess);
+
+	// only writes need to be made visible
+	sourceAccess &= vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite |
+			vk::AccessFlagBits::eColorAttachmentWrite |
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite | vk::AccessFlagBits::eMemoryWrite;
+
 	vk::ImageMemoryBarrier barrier;
 	barrier.setOldLayout(oldLayout);
 	barrier.setNewLayout(newLayout);
+	barrier.setSrcAccessMask(sourceAccess);
+	barrier.setDstAccessMask(destinationAccess);
 	barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
 	barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
 	barrier.setImage(image);
 	barrier.setSubresourceRange(subresourceRange);
 
-	vk::PipelineStageFlags sourceStage;
-	vk::PipelineStageFlags destinationStage;
-
-	if (oldLayout == vk::ImageLayout::eUndefined &&
-			newLayout == vk::ImageLayout::eTransferDstOptimal) {
-		barrier.setSrcAccessMask(vk::AccessFlagBits::eNone);
-		barrier.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-
-		sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		destinationStage = vk::PipelineStageFlagBits::eTransfer;
-	} else if (oldLayout == vk::ImageLayout::eTransferDstOptimal &&
-			   newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-		barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
-		barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-		sourceStage = vk::PipelineStageFlagBits::eTransfer;
-		destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-	} else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eGeneral) {
-		barrier.setSrcAccessMask(vk::AccessFlagBits::eNone);
-		barrier.setDstAccessMask(vk::AccessFlagBits::eNone);
-
-		sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		destinationStage = vk::PipelineStageFlagBits::eComputeShader;
-	} else if (oldLayout == vk::ImageLayout::eGeneral &&
-			   newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
-		barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-		sourceStage = vk::PipelineStageFlagBits::eComputeShader;
-		destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-	} else if (oldLayout == vk::ImageLayout::eGeneral &&
-			   newLayout == vk::ImageLayout::eTransferDstOptimal) {
-		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
-		barrier.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-
-		sourceStage = vk::PipelineStageFlagBits::eComputeShader;
-		destinationStage = vk::PipelineStageFlagBits::eTransfer;
-	} else if (oldLayout == vk::ImageLayout::eColorAttachmentOptimal &&
-			   newLayout == vk::ImageLayout::eTransferSrcOptimal) {
-		barrier.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
-		barrier.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
-
-		sourceStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		destinationStage = vk::PipelineStageFlagBits::eTransfer;
-	} else {
-		throw std::invalid_argument("Unsupported layout transition!");
-	}
-
 	commandBuffer.pipelineBarrier(sourceStage, destinationStage, {}, nullptr, nullptr, barrier);
-
-	endSingleTimeCommands(commandBuffer);
 }
 
 void RD::imageSend(vk::Image image, uint32_t width, uint32_t height, uint8_t *pData, size_t size,
@@ -417,13 +450,16 @@ void RD::imageSend(vk::Image image, uint32_t width, uint32_t height, uint8_t *pD
 	VmaAllocationInfo stagingAllocInfo;
 	vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eTransferSrc;
 
-	AllocatedBuffer stagingBuffer = bufferCreate(usage, size, &stagingAllocInfo);
+	AllocatedBuffer stagingBuffer =
+			bufferCreate(MemoryCategory::Staging, usage, size, &stagingAllocInfo);
 	memcpy(stagingAllocInfo.pMappedData, pData, size);
 	vmaFlushAllocation(_allocator, stagingBuffer.allocation, 0, VK_WHOLE_SIZE);
 
 	bufferCopyToImage(stagingBuffer.buffer, image, width, height, layout);
 
 	bufferDestroy(stagingBuffer);
+
+	_frameCounters.uploadBytes += size;
 }
 
 void RD::imageDestroy(AllocatedImage image) {
@@ -433,7 +469,7 @@ void RD::imageDestroy(AllocatedImage image) {
 vk::ImageView RD::imageViewCreate(vk::Image image, vk::Format format, uint32_t mipLevels,
 		uint32_t arrayLayers, vk::ImageViewType viewType) {
 	vk::ImageSubresourceRange subresourceRange;
-	subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+	subresourceRange.setAspectMask(RenderGraph::getAspect(format));
 	subresourceRange.setBaseMipLevel(0);
 	subresourceRange.setLevelCount(mipLevels);
 	subresourceRange.setBaseArrayLayer(0);
@@ -485,30 +521,45 @@ TextureRD RD::textureCreate(std::shared_ptr<Image> image) {
 	uint32_t width = image->getWidth();
 	uint32_t height = image->getHeight();
 
-	vk::Format format = getVkFormat(image->getFormat());
+	Image::Format imageFormat = image->getFormat();
+	vk::Format format = getVkFormat(imageFormat);
 	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
 
-	AllocatedImage allocatedImage = imageCreate(width, height, format, mipLevels,
-			vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
-					vk::ImageUsageFlagBits::eSampled);
-
 	std::vector<uint8_t> data = image->getData();
 
-	VmaAllocationInfo stagingAllocInfo;
-	AllocatedBuffer stagingBuffer =
-			bufferCreate(vk::BufferUsageFlagBits::eTransferSrc, data.size(), &stagingAllocInfo);
-	memcpy(stagingAllocInfo.pMappedData, data.data(), data.size());
-	vmaFlushAllocation(_allocator, stagingBuffer.allocation, 0, VK_WHOLE_SIZE);
+	// a full mip chain is a third larger than its top level
+	uint32_t droppedLevels = 0;
+	while (mipLevels > 1 &&
+			!_pContext->getMemory().isWithinBudget(
+					MemoryCategory::Textures, data.size() + data.size() / 3)) {
+		data = halveImage(data, width, height, imageFormat);
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+
+		mipLevels--;
+		droppedLevels++;
+	}
 
-	imageLayoutTransition(allocatedImage.image, format, mipLevels, 1, vk::ImageLayout::eUndefined,
-			vk::ImageLayout::eTransferDstOptimal);
+	if (droppedLevels > 0) {
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Texture over budget, dropped %u mip levels",
+				droppedLevels);
+	}
 
-	bufferCopyToImage(stagingBuffer.buffer, allocatedImage.image, width, height);
+	AllocatedImage allocatedImage = imageCreate(MemoryCategory::Textures, width, height, format,
+			mipLevels,
+			vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
+					vk::ImageUsageFlagBits::eSampled);
 
-	bufferDestroy(stagingBuffer);
+	vk::FormatProperties properties = _pContext->getPhysicalDevice().getFormatProperties(format);
+
+	bool isBlittingSupported = (bool)(properties.optimalTilingFeatures &
+									  vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+
+	assert(isBlittingSupported);
 
-	// Transfers image layout to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-	imageGenerateMipmaps(allocatedImage.image, width, height, format, mipLevels);
+	// mips are generated by the frame that acquires it, ending in shader read only layout
+	uint64_t upload = _transferQueue.imageUpload(allocatedImage.image, width, height, mipLevels,
+			std::move(data), UploadPriority::Low);
 
 	vk::ImageView imageView = imageViewCreate(allocatedImage.image, format, mipLevels);
 	vk::Sampler sampler =
@@ -518,6 +569,7 @@ TextureRD RD::textureCreate(std::shared_ptr<Image> image) {
 		allocatedImage,
 		imageView,
 		sampler,
+		upload,
 	};
 }
 
@@ -527,54 +579,132 @@ void RD::textureDestroy(TextureRD texture) {
 	samplerDestroy(texture.sampler);
 }
 
-void RD::environmentSkyUpdate(const std::shared_ptr<Image> image) {
-	uint32_t width = image->getWidth();
-	uint32_t height = image->getHeight();
+void RD::_environmentUpdate() {
+	// one bake at a time, its sets are reused by the next
+	if (_skyBake.has_value()) {
+		if (_pContext->getDevice().getFenceStatus(_skyBakeFence) != vk::Result::eSuccess)
+			return;
+
+		_environmentBakeFinish();
+	}
+
+	// uploaded in order, only the newest one resident is baked
+	size_t residentCount = 0;
+
+	while (residentCount < _pendingSkies.size() &&
+			_transferQueue.isResident(_pendingSkies[residentCount].upload))
+		residentCount++;
+
+	if (residentCount == 0)
+		return;
+
+	for (size_t i = 0; i + 1 < residentCount; i++) {
+		AllocatedImage image = _pendingSkies[i].image;
+		retire([this, image]() { imageDestroy(image); });
+	}
+
+	_environmentBakeBegin(_pendingSkies[residentCount - 1]);
+	_pendingSkies.erase(_pendingSkies.begin(), _pendingSkies.begin() + residentCount);
+}
+
+void RD::_environmentBakeBegin(const PendingSky &sky) {
+	PROFILE_SCOPE("RD::environmentBakeBegin");
 
 	vk::Format format = vk::Format::eR32G32B32A32Sfloat;
-	std::vector<uint8_t> data = image->getData();
 
-	uint32_t size = std::min(width, height);
-	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
+	uint32_t size = std::min(sky.width, sky.height);
 
-	AllocatedImage staging = imageCreate(width, height, format, 1,
-			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eStorage);
+	vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
 
-	imageLayoutTransition(
-			staging.image, format, 1, 1, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	// acquired by an earlier frame, the transition orders the bake after it
+	imageRecordLayoutTransition(commandBuffer, sky.image.image, format, 1, 1,
+			vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eGeneral);
 
-	imageSend(staging.image, width, height, data.data(), data.size(), vk::ImageLayout::eGeneral);
+	vk::ImageView skyView = imageViewCreate(sky.image.image, format, 1);
 
-	vk::ImageView stagingView = imageViewCreate(staging.image, format, 1);
+	EnvironmentEffects::Bake bake = _environmentEffects.bakeRecord(commandBuffer, skyView, size);
 
-	AllocatedImage cubemap = _environmentEffects.cubemapCreate(stagingView, size);
+	commandBuffer.end();
 
+	vk::SubmitInfo submitInfo;
+	submitInfo.setCommandBuffers(commandBuffer);
+
+	_pContext->getDevice().resetFences(_skyBakeFence);
+	_pContext->getGraphicsQueue().submit(submitInfo, _skyBakeFence);
+
+	_skyBake = SkyBake{ sky, skyView, commandBuffer, bake };
+}
+
+void RD::_environmentBakeFinish() {
+	PROFILE_SCOPE("RD::environmentBakeFinish");
+
+	vk::Format format = vk::Format::eR32G32B32A32Sfloat;
+
+	SkyBake skyBake = *_skyBake;
+	_skyBake.reset();
+
+	_pContext->getDevice().freeCommandBuffers(
+			_pContext->getCommandPool(), skyBake.commandBuffer);
+
+	_irradianceSH = _environmentEffects.bakeFinish();
+
+	uint32_t size = std::min(skyBake.sky.width, skyBake.sky.height);
+	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
+
+	AllocatedImage cubemap = skyBake.bake.cubemap;
 	vk::ImageView cubemapView =
 			imageViewCreate(cubemap.image, format, mipLevels, 6, vk::ImageViewType::eCube);
-
 	vk::Sampler cubemapSampler =
 			samplerCreate(vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge, mipLevels);
 
-	AllocatedImage irradiance = _environmentEffects.filterIrradiance(cubemapView);
-	vk::ImageView irradianceView =
-			imageViewCreate(irradiance.image, format, 1, 6, vk::ImageViewType::eCube);
-	vk::Sampler irradianceSampler =
-			samplerCreate(vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge, 1);
-
-	AllocatedImage specular = _environmentEffects.filterSpecular(cubemapView, size, mipLevels);
+	AllocatedImage specular = skyBake.bake.specular;
 	vk::ImageView specularView =
 			imageViewCreate(specular.image, format, 5, 6, vk::ImageViewType::eCube);
 	vk::Sampler specularSampler =
 			samplerCreate(vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge, 5);
 
+	// frames in flight still sample the previous environment through their sets
+	EnvironmentData data = _environmentData;
+
+	retire([this, data]() {
+		imageDestroy(data.cubemap);
+		imageViewDestroy(data.cubemapView);
+		samplerDestroy(data.cubemapSampler);
+
+		imageDestroy(data.specular);
+		imageViewDestroy(data.specularView);
+		samplerDestroy(data.specularSampler);
+	});
+
+	_environmentData = {
+		cubemap,
+		cubemapView,
+		cubemapSampler,
+		specular,
+		specularView,
+		specularSampler,
+	};
+
+	_environmentBakeCount++;
+
+	AllocatedImage skyImage = skyBake.sky.image;
+	vk::ImageView skyView = skyBake.skyView;
+
+	retire([this, skyImage, skyView]() {
+		imageViewDestroy(skyView);
+		imageDestroy(skyImage);
+	});
+}
+
+void RD::_environmentSetsUpdate() {
 	{
 		vk::DescriptorImageInfo imageInfo;
-		imageInfo.setImageView(cubemapView);
+		imageInfo.setImageView(_environmentData.cubemapView);
 		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-		imageInfo.setSampler(cubemapSampler);
+		imageInfo.setSampler(_environmentData.cubemapSampler);
 
 		vk::WriteDescriptorSet writeInfo;
-		writeInfo.setDstSet(_skySet);
+		writeInfo.setDstSet(_skySets[_frame]);
 		writeInfo.setDstBinding(0);
 		writeInfo.setDstArrayElement(0);
 		writeInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
@@ -585,67 +715,44 @@ void RD::environmentSkyUpdate(const std::shared_ptr<Image> image) {
 	}
 
 	{
-		vk::DescriptorImageInfo irradianceImageInfo;
-		irradianceImageInfo.setImageView(irradianceView);
-		irradianceImageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-		irradianceImageInfo.setSampler(irradianceSampler);
-
-		vk::DescriptorImageInfo specularImageInfo;
-		specularImageInfo.setImageView(specularView);
-		specularImageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-		specularImageInfo.setSampler(specularSampler);
-
-		vk::WriteDescriptorSet irradianceWriteInfo;
-		irradianceWriteInfo.setDstSet(_iblSet);
-		irradianceWriteInfo.setDstBinding(0);
-		irradianceWriteInfo.setDstArrayElement(0);
-		irradianceWriteInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		irradianceWriteInfo.setDescriptorCount(1);
-		irradianceWriteInfo.setImageInfo(irradianceImageInfo);
-
-		vk::WriteDescriptorSet specularWriteInfo;
-		specularWriteInfo.setDstSet(_iblSet);
-		specularWriteInfo.setDstBinding(1);
-		specularWriteInfo.setDstArrayElement(0);
-		specularWriteInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		specularWriteInfo.setDescriptorCount(1);
-		specularWriteInfo.setImageInfo(specularImageInfo);
-
-		std::array<vk::WriteDescriptorSet, 2> writeInfos = {
-			irradianceWriteInfo,
-			specularWriteInfo,
-		};
+		vk::DescriptorImageInfo imageInfo;
+		imageInfo.setImageView(_environmentData.specularView);
+		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+		imageInfo.setSampler(_environmentData.specularSampler);
 
-		_pContext->getDevice().updateDescriptorSets(writeInfos, nullptr);
+		vk::WriteDescriptorSet writeInfo;
+		writeInfo.setDstSet(_iblSets[_frame]);
+		writeInfo.setDstBinding(0);
+		writeInfo.setDstArrayElement(0);
+		writeInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		writeInfo.setDescriptorCount(1);
+		writeInfo.setImageInfo(imageInfo);
+
+		_pContext->getDevice().updateDescriptorSets(writeInfo, nullptr);
 	}
 
-	{
-		EnvironmentData data = _environmentData;
+	_environmentSetBakes[_frame] = _environmentBakeCount;
+}
 
-		imageDestroy(data.cubemap);
-		imageViewDestroy(data.cubemapView);
-		samplerDestroy(data.cubemapSampler);
+void RD::environmentSkyUpdate(const std::shared_ptr<Image> image) {
+	uint32_t width = image->getWidth();
+	uint32_t height = image->getHeight();
 
-		imageDestroy(data.irradiance);
-		imageViewDestroy(data.irradianceView);
-		samplerDestroy(data.irradianceSampler);
+	vk::Format format = vk::Format::eR32G32B32A32Sfloat;
 
-		imageDestroy(data.specular);
-		imageViewDestroy(data.specularView);
-		samplerDestroy(data.specularSampler);
+	// sampled only for the shader read only layout uploads end in
+	AllocatedImage staging = imageCreate(MemoryCategory::Staging, width, height, format, 1,
+			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eStorage |
+					vk::ImageUsageFlagBits::eSampled);
 
-		_environmentData = {
-			cubemap,
-			cubemapView,
-			cubemapSampler,
-			irradiance,
-			irradianceView,
-			irradianceSampler,
-			specular,
-			specularView,
-			specularSampler,
-		};
-	}
+	uint64_t upload = _transferQueue.imageUpload(
+			staging.image, width, height, 1, image->getData(), UploadPriority::Normal);
+
+	_pendingSkies.push_back({ upload, staging, width, height });
+}
+
+void RD::setSpecularFilter(bool isFiltered, bool isCompared) {
+	_environmentEffects.setSpecularFilter(isFiltered, isCompared);
 }
 
 void RD::updateUniformBuffer(const glm::vec3 &viewPosition) {
@@ -654,13 +761,61 @@ void RD::updateUniformBuffer(const glm::vec3 &viewPosition) {
 	ubo.directionalLightCount = _lightStorage.getDirectionalLightCount();
 	ubo.pointLightCount = _lightStorage.getPointLightCount();
 
+	ubo.shadowCascadeCount = _shadowMaps.getCascadeCount();
+	ubo.shadowOverlayMask = _shadowMaps.getOverlayMask();
+
+	for (uint32_t i = 0; i < ubo.shadowCascadeCount; i++) {
+		ubo.shadowTexelSizes[i] = _shadowMaps.getTexelSize(i);
+		ubo.shadowProjViews[i] = _shadowMaps.getProjView(i);
+	}
+
+	for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		ubo.irradianceSH[i] = _irradianceSH[i];
+
 	memcpy(_uniformAllocInfos[_frame].pMappedData, &ubo, sizeof(ubo));
+	_frameCounters.uploadBytes += sizeof(ubo);
 }
 
 LightStorage &RD::getLightStorage() {
 	return _lightStorage;
 }
 
+ClusterCulling &RD::getClusterCulling() {
+	return _clusterCulling;
+}
+
+DepthPyramid &RD::getDepthPyramid() {
+	return _depthPyramid;
+}
+
+ShadowMaps &RD::getShadowMaps() {
+	return _shadowMaps;
+}
+
+GpuProfiler &RD::getGpuProfiler() {
+	return _gpuProfiler;
+}
+
+RenderGraph &RD::getFrameGraph() {
+	return _frameGraph;
+}
+
+RenderGraph::Resource RD::getColorTarget() const {
+	return _colorTarget;
+}
+
+RenderGraph::Resource RD::getDepthTarget() const {
+	return _depthTarget;
+}
+
+FrameCounters &RD::getFrameCounters() {
+	return _frameCounters;
+}
+
+const FrameStats &RD::getFrameStats() const {
+	return _frameStats;
+}
+
 vk::Instance RD::getInstance() const {
 	return _pContext->getInstance();
 }
@@ -673,10 +828,18 @@ vk::Device RD::getDevice() const {
 	return _pContext->getDevice();
 }
 
+GpuMemory &RD::getMemory() {
+	return _pContext->getMemory();
+}
+
 vk::Extent2D RD::getSwapchainExtent() const {
 	return _pContext->getSwapchainExtent();
 }
 
+vk::Extent2D RD::getRenderExtent() const {
+	return _renderExtent;
+}
+
 vk::PipelineLayout RD::getDepthPipelineLayout() const {
 	return _depthLayout;
 }
@@ -685,6 +848,18 @@ vk::Pipeline RD::getDepthPipeline() const {
 	return _depthPipeline;
 }
 
+vk::Pipeline RD::getEarlyDepthPipeline() const {
+	return _earlyDepthPipeline;
+}
+
+vk::Pipeline RD::getShadowPipeline() const {
+	return _shadowPipeline;
+}
+
+vk::Pipeline RD::getShadowOverlayPipeline() const {
+	return _shadowOverlayPipeline;
+}
+
 vk::PipelineLayout RD::getSkyPipelineLayout() const {
 	return _skyLayout;
 }
@@ -694,19 +869,46 @@ vk::Pipeline RD::getSkyPipeline() const {
 }
 
 vk::DescriptorSet RD::getSkySet() const {
-	return _skySet;
+	return _skySets[_frame];
 }
 
 vk::PipelineLayout RD::getMaterialPipelineLayout() const {
 	return _materialLayout;
 }
 
-vk::Pipeline RD::getMaterialPipeline() const {
-	return _materialPipeline;
+vk::Pipeline RD::getMaterialPipeline(uint32_t features) {
+	if (!_isMaterialVariantsEnabled)
+		features = MATERIAL_ALL_FEATURES;
+
+	auto iter = _materialPipelines.find(features);
+
+	if (iter != _materialPipelines.end())
+		return iter->second;
+
+	vk::Pipeline pipeline = _materialPipelineCreate(features);
+	_materialPipelines[features] = pipeline;
+
+	return pipeline;
+}
+
+uint32_t RD::getMaterialLightFeatures() {
+	uint32_t features = 0;
+
+	if (_lightStorage.getPointLightCount() > 0)
+		features |= MATERIAL_POINT_LIGHTS;
+
+	if (_lightStorage.getDirectionalLightCount() > 1)
+		features |= MATERIAL_DIRECTIONAL_LIGHTS;
+
+	return features;
+}
+
+void RD::setMaterialVariantsEnabled(bool enabled) {
+	_isMaterialVariantsEnabled = enabled;
 }
 
 std::array<vk::DescriptorSet, 3> RD::getMaterialSets() const {
-	return { _uniformSets[_frame], _iblSet, _lightStorage.getLightSet() };
+	return { _uniformSets[_frame], _iblSets[_frame], _lightStorage.getLightSet() };
 }
 
 vk::DescriptorPool RD::getDescriptorPool() const {
@@ -725,30 +927,227 @@ void RD::setWhite(float white) {
 	_white = white;
 }
 
-vk::CommandBuffer RD::drawBegin() {
-	vk::CommandBuffer commandBuffer = _commandBuffers[_frame];
+void RD::_swapchainRecreate() {
+	PROFILE_SCOPE("RD::swapchainRecreate");
+
+	uint64_t start = SDL_GetPerformanceCounter();
+
+	// frames in flight still render into the old targets
+	VulkanContext::RenderTargets targets = _pContext->recreateSwapchain(_width, _height);
+
+	VulkanContext *pContext = _pContext;
+	retire([pContext, targets]() { pContext->destroyRenderTargets(targets); });
+
+	// they reference the old swapchain views, color and depth follow at the next compile
+	_frameGraph.releaseFramebuffers();
+
+	_resizeStart = start;
+	_resizeTime = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void RD::_depthPyramidCreate(vk::ImageView depthView) {
+	_depthPyramid.create(depthView, _renderTargetExtent.width, _renderTargetExtent.height);
+	_pyramidDepthView = depthView;
+}
+
+uint32_t RD::getFrame() const {
+	return _frame;
+}
+
+uint32_t RD::getFramesInFlight() const {
+	return _framesInFlight;
+}
+
+void RD::setFramesInFlight(uint32_t count) {
+	_framesInFlight = std::clamp(count, 1u, MAX_FRAMES_IN_FLIGHT);
+}
 
+void RD::setPresentMode(vk::PresentModeKHR presentMode) {
+	_pContext->setPresentMode(presentMode);
+}
+
+void RD::setRenderScale(float scale) {
+	scale = std::clamp(scale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+
+	_dynamicResolution.setScale(scale);
+}
+
+void RD::setDynamicResolution(double targetTime, float minScale, float maxScale) {
+	minScale = std::clamp(minScale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+	maxScale = std::clamp(maxScale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+
+	_dynamicResolution.enable(targetTime, minScale, maxScale);
+
+	SDL_Log("Dynamic resolution: target %.2f ms, scale %.2f to %.2f", targetTime,
+			std::min(minScale, maxScale), maxScale);
+}
+
+void RD::setGpuTimingRequired(bool isRequired) {
+	_isGpuTimingRequired = isRequired;
+}
+
+void RD::frameWait() {
+	PROFILE_SCOPE("Wait for frame");
+
+	// signaled fences return right away, drawBegin waiting again costs nothing
 	vk::Result result = _pContext->getDevice().waitForFences(_fences[_frame], VK_TRUE, UINT64_MAX);
 
 	if (result != vk::Result::eSuccess)
 		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Waiting for fences failed!");
+}
+
+void RD::inputSampled() {
+	_inputTime = SDL_GetPerformanceCounter();
+}
 
-	vk::ResultValue<uint32_t> image = _pContext->getDevice().acquireNextImageKHR(
-			_pContext->getSwapchain(), UINT64_MAX, _presentSemaphores[_frame], VK_NULL_HANDLE);
+void RD::uploadsUpdate() {
+	PROFILE_SCOPE("RD::uploadsUpdate");
+
+	// before the queue's update, skies resident by now were acquired by a submitted frame
+	_environmentUpdate();
+	_transferQueue.update();
+
+	_frameCounters.uploadBytes += _transferQueue.getFrameBytes();
+	_frameCounters.uploadQueueDepth = _transferQueue.getQueueDepth();
+}
 
-	_imageIndex = image.value;
+void RD::uploadsFlush() {
+	PROFILE_SCOPE("RD::uploadsFlush");
 
-	if (image.result == vk::Result::eErrorOutOfDateKHR) {
-		_pContext->recreateSwapchain(_width, _height);
-		updateInputAttachment(_pContext->getDevice(),
-				_pContext->getColorAttachment().getImageView(), _inputAttachmentSet);
-	} else if (image.result != vk::Result::eSuccess && image.result != vk::Result::eSuboptimalKHR) {
-		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Swapchain image acquire failed!");
+	_transferQueue.flush();
+	_environmentUpdate();
+
+	// flushed skies light the next frame, their bakes are waited for
+	while (_skyBake.has_value()) {
+		vk::Result result =
+				_pContext->getDevice().waitForFences(_skyBakeFence, VK_TRUE, UINT64_MAX);
+
+		if (result != vk::Result::eSuccess)
+			SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Waiting for the sky bake failed!");
+
+		_environmentUpdate();
+	}
+}
+
+bool RD::isUploadResident(uint64_t upload) const {
+	return _transferQueue.isResident(upload);
+}
+
+void RD::setUploadBudget(uint64_t bytes, double time) {
+	_transferQueue.setBudget(bytes, time);
+}
+
+void RD::retire(std::function<void()> destroy) {
+	_retired.push_back({ _submitCount, destroy });
+}
+
+void RD::_retiredCollect() {
+	// the fence of this frame covers every frame up to the one submitted frames in flight ago
+	uint64_t completedCount = 0;
+
+	if (_submitCount + 1 >= _framesInFlight)
+		completedCount = _submitCount + 1 - _framesInFlight;
+
+	size_t kept = 0;
+
+	for (size_t i = 0; i < _retired.size(); i++) {
+		if (_retired[i].submitCount <= completedCount)
+			_retired[i].destroy();
+		else
+			_retired[kept++] = std::move(_retired[i]);
+	}
+
+	_retired.resize(kept);
+}
+
+vk::Pipeline RD::_materialPipelineCreate(uint32_t features) {
+	std::array<vk::VertexInputBindingDescription, 3> bindings;
+	std::array<vk::VertexInputAttributeDescription, 8> attributes;
+
+	{
+		std::array<vk::VertexInputBindingDescription, 2> vertexBindings =
+				Vertex::getBindingDescriptions();
+		std::array<vk::VertexInputAttributeDescription, 4> vertexAttributes =
+				Vertex::getAttributeDescriptions();
+		std::array<vk::VertexInputAttributeDescription, 4> instanceAttributes =
+				Instance::getAttributeDescriptions();
+
+		std::copy(vertexBindings.begin(), vertexBindings.end(), bindings.begin());
+		bindings[2] = Instance::getBindingDescription();
+
+		std::copy(vertexAttributes.begin(), vertexAttributes.end(), attributes.begin());
+		std::copy(instanceAttributes.begin(), instanceAttributes.end(), attributes.begin() + 4);
+	}
+
+	vk::PipelineVertexInputStateCreateInfo vertexInput;
+	vertexInput.setVertexBindingDescriptions(bindings);
+	vertexInput.setVertexAttributeDescriptions(attributes);
+
+	// constant ids of material.frag, booleans are 32 bit
+	std::array<uint32_t, 5> constants = {
+		(features & MATERIAL_NORMAL_MAP) ? VK_TRUE : VK_FALSE,
+		(features & MATERIAL_METALLIC_MAP) ? VK_TRUE : VK_FALSE,
+		(features & MATERIAL_ROUGHNESS_MAP) ? VK_TRUE : VK_FALSE,
+		(features & MATERIAL_POINT_LIGHTS) ? VK_TRUE : VK_FALSE,
+		(features & MATERIAL_DIRECTIONAL_LIGHTS) ? MAX_DIRECTIONAL_LIGHT_COUNT : 1,
+	};
+
+	std::array<vk::SpecializationMapEntry, 5> entries;
+
+	for (uint32_t i = 0; i < entries.size(); i++) {
+		entries[i].setConstantID(i);
+		entries[i].setOffset(i * sizeof(uint32_t));
+		entries[i].setSize(sizeof(uint32_t));
+	}
+
+	vk::SpecializationInfo specialization;
+	specialization.setMapEntries(entries);
+	specialization.setDataSize(sizeof(constants));
+	specialization.setPData(constants.data());
+
+	return createPipeline(_pContext->getDevice(), _materialVertexStage, _materialFragmentStage,
+			_materialLayout, _materialRenderPass, 0, vertexInput, false, 1, &specialization);
+}
+
+vk::CommandBuffer RD::drawBegin() {
+	PROFILE_SCOPE("RD::drawBegin");
+
+	vk::CommandBuffer commandBuffer = _commandBuffers[_frame];
+
+	frameWait();
+	_retiredCollect();
+
+	// the fence above shows the frame's sets are no longer read
+	if (_environmentSetBakes[_frame] != _environmentBakeCount)
+		_environmentSetsUpdate();
+
+	if (_pContext->isHeadless()) {
+		// the fence above covers the last frame that rendered into this image
+		_imageIndex = _frame % _pContext->getImageCount();
+	} else {
+		PROFILE_SCOPE("Acquire image");
+
+		vk::ResultValue<uint32_t> image = _pContext->getDevice().acquireNextImageKHR(
+				_pContext->getSwapchain(), UINT64_MAX, _presentSemaphores[_frame], VK_NULL_HANDLE);
+
+		// the semaphore is left unsignaled, acquire again from the new swapchain
+		if (image.result == vk::Result::eErrorOutOfDateKHR) {
+			_swapchainRecreate();
+
+			image = _pContext->getDevice().acquireNextImageKHR(_pContext->getSwapchain(),
+					UINT64_MAX, _presentSemaphores[_frame], VK_NULL_HANDLE);
+		}
+
+		_imageIndex = image.value;
+
+		if (image.result != vk::Result::eSuccess && image.result != vk::Result::eSuboptimalKHR)
+			SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Swapchain image acquire failed!");
 	}
 
 	_pContext->getDevice().resetFences(_fences[_frame]);
 
-	_lightStorage.update();
+	_frameCounters.uploadBytes += _lightStorage.update();
+	_depthPyramid.swap();
 
 	commandBuffer.reset();
 
@@ -756,117 +1155,244 @@ vk::CommandBuffer RD::drawBegin() {
 
 	commandBuffer.begin(beginInfo);
 
-	std::array<vk::ClearValue, 3> clearValues;
-	clearValues[0] = vk::ClearValue();
-	clearValues[1].color = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
-	clearValues[2].depthStencil = vk::ClearDepthStencilValue(0.0f, 0);
+	uint64_t collectedFrameCount = _gpuProfiler.getCollectedFrameCount();
+	_gpuProfiler.frameBegin(commandBuffer, _frame);
+
+	// recorded before the frame graph, which reads meshes and textures resident from this frame on
+	_transferWaitValue = _transferQueue.record(commandBuffer);
 
-	vk::Extent2D extent = _pContext->getSwapchainExtent();
+	// the frame read back above is a few frames old, the controller smooths over that
+	if (_gpuProfiler.getCollectedFrameCount() != collectedFrameCount)
+		_dynamicResolution.update(_gpuProfiler.getFrameTime());
 
-	vk::Viewport viewport;
-	viewport.setX(0.0f);
-	viewport.setY(0.0f);
-	viewport.setWidth(extent.width);
-	viewport.setHeight(extent.height);
-	viewport.setMinDepth(0.0f);
-	viewport.setMaxDepth(1.0f);
+	// scaled from the swapchain, the attachments hold the largest scale
+	vk::Extent2D swapchainExtent = _pContext->getSwapchainExtent();
+	float maxScale = _dynamicResolution.getMaxScale();
+	float scale = _dynamicResolution.getScale();
 
-	vk::Rect2D scissor;
-	scissor.setOffset({ 0, 0 });
-	scissor.setExtent(extent);
+	uint32_t width = static_cast<uint32_t>(swapchainExtent.width * maxScale + 0.5f);
+	uint32_t height = static_cast<uint32_t>(swapchainExtent.height * maxScale + 0.5f);
 
-	vk::Rect2D renderArea;
-	renderArea.setOffset({ 0, 0 });
-	renderArea.setExtent(extent);
+	_renderTargetExtent.width = std::max(width, 1u);
+	_renderTargetExtent.height = std::max(height, 1u);
 
-	vk::RenderPassBeginInfo renderPassInfo;
-	renderPassInfo.setRenderPass(_pContext->getRenderPass());
-	renderPassInfo.setFramebuffer(_pContext->getFramebuffer(_imageIndex.value()));
-	renderPassInfo.setRenderArea(renderArea);
-	renderPassInfo.setClearValues(clearValues);
+	width = static_cast<uint32_t>(swapchainExtent.width * scale + 0.5f);
+	height = static_cast<uint32_t>(swapchainExtent.height * scale + 0.5f);
 
-	commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+	_renderExtent.width = std::clamp(width, 1u, _renderTargetExtent.width);
+	_renderExtent.height = std::clamp(height, 1u, _renderTargetExtent.height);
 
-	commandBuffer.setViewport(0, viewport);
-	commandBuffer.setScissor(0, scissor);
+	_frameCounters.renderScale = static_cast<uint64_t>(scale * 100.0f + 0.5f);
+
+	// headless images are left for readback
+	vk::ImageLayout presentLayout = _pContext->isHeadless()
+			? vk::ImageLayout::eTransferSrcOptimal
+			: vk::ImageLayout::ePresentSrcKHR;
+
+	RenderGraph::ImageDesc swapchainDesc = {
+		_pContext->getSwapchainFormat(),
+		swapchainExtent.width,
+		swapchainExtent.height,
+	};
+
+	RenderGraph::ImageDesc colorDesc = {
+		COLOR_FORMAT,
+		_renderTargetExtent.width,
+		_renderTargetExtent.height,
+	};
+
+	RenderGraph::ImageDesc depthDesc = {
+		DEPTH_FORMAT,
+		_renderTargetExtent.width,
+		_renderTargetExtent.height,
+	};
+
+	uint32_t imageIndex = _imageIndex.value();
+
+	_frameGraph.reset();
+	_swapchainTarget = _frameGraph.importImage("Swapchain", _pContext->getImage(imageIndex),
+			_pContext->getImageView(imageIndex), swapchainDesc, vk::ImageLayout::eUndefined,
+			presentLayout);
+	_colorTarget = _frameGraph.createImage("Color", colorDesc);
+	_depthTarget = _frameGraph.createImage("Depth", depthDesc);
+
+	_frameGraph.setOutput(_swapchainTarget);
 
 	return commandBuffer;
 }
 
 void RD::drawEnd(vk::CommandBuffer commandBuffer) {
+	PROFILE_SCOPE("RD::drawEnd");
+
 	bool isDrawStarted = _imageIndex.has_value();
 	assert(isDrawStarted);
 
-	commandBuffer.nextSubpass(vk::SubpassContents::eInline);
+	// tonemapping, upscales to the swapchain
 
-	// tonemapping
+	auto drawTonemap = [this](vk::CommandBuffer commandBuffer) {
+		uint32_t scope = _gpuProfiler.begin(commandBuffer, "Tonemap");
+
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, _tonemapPipeline);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _tonemapLayout, 0, 1,
+				&_tonemapSets[_frame], 0, nullptr);
+
+		_frameCounters.pipelineBindCount++;
+		_frameCounters.descriptorSetBindCount++;
+
+		vk::Extent2D extent = _pContext->getSwapchainExtent();
+
+		// sharpening grows as the render scale drops, so switching it on doesn't pop
+		float scale = _dynamicResolution.getScale();
+		float upscale = (MAX_RENDER_SCALE - scale) / (MAX_RENDER_SCALE - MIN_RENDER_SCALE);
+
+		glm::vec2 targetSize(_renderTargetExtent.width, _renderTargetExtent.height);
+
+		TonemapParameterConstants constants{};
+		constants.exposure = _exposure;
+		constants.white = _white;
+		constants.uvScale = glm::vec2(_renderExtent.width, _renderExtent.height) / targetSize;
+		constants.texelSize = 1.0f / targetSize;
+		constants.outputSize = glm::vec2(extent.width, extent.height);
+		constants.sharpness = UPSCALE_SHARPNESS * glm::clamp(upscale, 0.0f, 1.0f);
+
+		commandBuffer.pushConstants(_tonemapLayout, vk::ShaderStageFlagBits::eFragment, 0,
+				sizeof(constants), &constants);
+
+		commandBuffer.draw(3, 1, 0, 0);
+
+		_frameCounters.pushConstantBytes += sizeof(constants);
+		_frameCounters.drawCount++;
+
+		_gpuProfiler.end(commandBuffer, scope);
+	};
+
+	RenderGraph::Pass tonemapPass =
+			_frameGraph.addPass("Tonemap", RenderGraph::PassType::Graphics, drawTonemap);
+
+	_frameGraph.read(tonemapPass, _colorTarget, RenderGraph::ImageAccess::Sampled);
+	_frameGraph.write(tonemapPass, _swapchainTarget, RenderGraph::ImageAccess::ColorAttachment);
+
+	{
+		PROFILE_SCOPE("Compile frame graph");
+		_frameGraph.compile();
+	}
 
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, _tonemapPipeline);
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _tonemapLayout, 0, 1,
-			&_inputAttachmentSet, 0, nullptr);
+	// the previous frame using this set has completed
+	vk::ImageView colorView = _frameGraph.getImageView(_colorTarget);
 
-	TonemapParameterConstants constants{};
-	constants.exposure = _exposure;
-	constants.white = _white;
+	if (_tonemapViews[_frame] != colorView) {
+		updateTonemapInput(
+				_pContext->getDevice(), colorView, _tonemapSampler, _tonemapSets[_frame]);
+		_tonemapViews[_frame] = colorView;
+	}
+
+	// old images are retired, so a new view never matches a stale one
+	vk::ImageView depthView = _frameGraph.getImageView(_depthTarget);
 
-	commandBuffer.pushConstants(
-			_tonemapLayout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(constants), &constants);
+	if (depthView != _pyramidDepthView)
+		_depthPyramidCreate(depthView);
 
-	commandBuffer.draw(3, 1, 0, 0);
+	_frameGraph.execute(commandBuffer);
 
-	commandBuffer.endRenderPass();
+	_gpuProfiler.frameEnd(commandBuffer);
 	commandBuffer.end();
 
-	vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	bool isHeadless = _pContext->isHeadless();
+
+	std::array<vk::Semaphore, 2> waitSemaphores;
+	std::array<vk::PipelineStageFlags, 2> waitStages;
+	// binary semaphores ignore their value
+	std::array<uint64_t, 2> waitValues = {};
+	uint32_t waitCount = 0;
+
+	// headless frames have no image to wait for and nothing to present
+	if (!isHeadless) {
+		waitSemaphores[waitCount] = _presentSemaphores[_frame];
+		waitStages[waitCount] = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		waitCount++;
+	}
+
+	if (_transferWaitValue != 0) {
+		waitSemaphores[waitCount] = _transferQueue.getSemaphore();
+		waitStages[waitCount] = UPLOAD_WAIT_STAGES;
+		waitValues[waitCount] = _transferWaitValue;
+		waitCount++;
+	}
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.setWaitSemaphoreValueCount(waitCount);
+	timelineInfo.setPWaitSemaphoreValues(waitValues.data());
 
 	vk::SubmitInfo submitInfo;
-	submitInfo.setWaitSemaphores(_presentSemaphores[_frame]);
-	submitInfo.setWaitDstStageMask(waitStage);
 	submitInfo.setCommandBuffers(commandBuffer);
-	submitInfo.setSignalSemaphores(_renderSemaphores[_frame]);
+	submitInfo.setWaitSemaphoreCount(waitCount);
+	submitInfo.setPWaitSemaphores(waitSemaphores.data());
+	submitInfo.setPWaitDstStageMask(waitStages.data());
+	submitInfo.setPNext(&timelineInfo);
+
+	if (!isHeadless)
+		submitInfo.setSignalSemaphores(_renderSemaphores[_frame]);
 
-	_pContext->getGraphicsQueue().submit(submitInfo, _fences[_frame]);
+	{
+		PROFILE_SCOPE("Submit");
+		_pContext->getGraphicsQueue().submit(submitInfo, _fences[_frame]);
+	}
 
-	vk::SwapchainKHR swapchain = _pContext->getSwapchain();
+	_submitCount++;
 
-	vk::PresentInfoKHR presentInfo;
-	presentInfo.setWaitSemaphores(_renderSemaphores[_frame]);
-	presentInfo.setSwapchains(swapchain);
-	presentInfo.setImageIndices(_imageIndex.value());
+	if (_resizeStart != 0) {
+		uint64_t elapsed = SDL_GetPerformanceCounter() - _resizeStart;
+		double frameTime = elapsed * 1000.0 / SDL_GetPerformanceFrequency();
 
-	vk::Result err = _pContext->getPresentQueue().presentKHR(presentInfo);
+		vk::Extent2D extent = _pContext->getSwapchainExtent();
 
-	if (err == vk::Result::eErrorOutOfDateKHR || err == vk::Result::eSuboptimalKHR || _resized) {
-		_pContext->recreateSwapchain(_width, _height);
-		updateInputAttachment(_pContext->getDevice(),
-				_pContext->getColorAttachment().getImageView(), _inputAttachmentSet);
+		SDL_Log("Resized to %ux%u: recreate %.2f ms, resize to submit %.2f ms", extent.width,
+				extent.height, _resizeTime, frameTime);
 
+		_resizeStart = 0;
+	}
+
+	if (_inputTime != 0) {
+		uint64_t elapsed = SDL_GetPerformanceCounter() - _inputTime;
+		_frameCounters.inputLatency = elapsed * 1000000 / SDL_GetPerformanceFrequency();
+		_inputTime = 0;
+	}
+
+	_frameStats.push(_frameCounters);
+	_frameCounters = {};
+
+	vk::Result err = vk::Result::eSuccess;
+
+	if (!isHeadless) {
+		vk::SwapchainKHR swapchain = _pContext->getSwapchain();
+
+		vk::PresentInfoKHR presentInfo;
+		presentInfo.setWaitSemaphores(_renderSemaphores[_frame]);
+		presentInfo.setSwapchains(swapchain);
+		presentInfo.setImageIndices(_imageIndex.value());
+
+		PROFILE_SCOPE("Present");
+		err = _pContext->getPresentQueue().presentKHR(presentInfo);
+	}
+
+	if (err == vk::Result::eErrorOutOfDateKHR || err == vk::Result::eSuboptimalKHR || _resized) {
+		_swapchainRecreate();
 		_resized = false;
 	} else if (err != vk::Result::eSuccess) {
 		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Swapchain image presentation failed!");
 	}
 
 	_imageIndex.reset();
-	_frame = (_frame + 1) % FRAMES_IN_FLIGHT;
+	_frame = (_frame + 1) % _framesInFlight;
 }
 
 void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 	_pContext->initialize(surface, width, height);
 
-	// allocator
+	// render targets are allocated before the device exists here, the context owns the allocator
+	_allocator = _pContext->getAllocator();
 
-	VmaAllocatorCreateInfo allocatorCreateInfo = {};
-	allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_1;
-	allocatorCreateInfo.instance = _pContext->getInstance();
-	allocatorCreateInfo.physicalDevice = _pContext->getPhysicalDevice();
-	allocatorCreateInfo.device = _pContext->getDevice();
-
-	{
-		VkResult err = vmaCreateAllocator(&allocatorCreateInfo, &_allocator);
-
-		if (err != VK_SUCCESS)
-			throw std::runtime_error("VmaAllocator creation failed!");
-	}
+	_frameGraph.init(_pContext->getDevice(), &_pContext->getMemory());
 
 	// commands
 
@@ -875,33 +1401,40 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 	vk::CommandBufferAllocateInfo allocInfo;
 	allocInfo.setCommandPool(_pContext->getCommandPool());
 	allocInfo.setLevel(vk::CommandBufferLevel::ePrimary);
-	allocInfo.setCommandBufferCount(static_cast<uint32_t>(FRAMES_IN_FLIGHT));
+	allocInfo.setCommandBufferCount(_framesInFlight);
 
-	for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+	{
 		vk::Result err = device.allocateCommandBuffers(&allocInfo, _commandBuffers);
 
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("Command buffers allocation failed!");
 	}
 
+	_transferQueue.init(_pContext->getTransferQueue(), _pContext->getTransferQueueFamily(),
+			_pContext->getGraphicsQueueFamily());
+
 	// sync
 
 	vk::SemaphoreCreateInfo semaphoreInfo = {};
 	vk::FenceCreateInfo fenceInfo = { vk::FenceCreateFlagBits::eSignaled };
 
-	for (size_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+	for (uint32_t i = 0; i < _framesInFlight; i++) {
 		_presentSemaphores[i] = device.createSemaphore(semaphoreInfo);
 		_renderSemaphores[i] = device.createSemaphore(semaphoreInfo);
 		_fences[i] = device.createFence(fenceInfo);
 	}
 
+	// reset by each bake
+	_skyBakeFence = device.createFence(fenceInfo);
+
 	// descriptor pool
 
 	std::array<vk::DescriptorPoolSize, 4> poolSizes;
-	poolSizes[0] = { vk::DescriptorType::eUniformBuffer, FRAMES_IN_FLIGHT };
-	poolSizes[1] = { vk::DescriptorType::eInputAttachment, 1 };
-	poolSizes[2] = { vk::DescriptorType::eStorageBuffer, 1 };
-	poolSizes[3] = { vk::DescriptorType::eCombinedImageSampler, 1000 };
+	poolSizes[0] = { vk::DescriptorType::eUniformBuffer, MAX_FRAMES_IN_FLIGHT * 2 };
+	poolSizes[1] = { vk::DescriptorType::eStorageBuffer, 1000 };
+	poolSizes[2] = { vk::DescriptorType::eCombinedImageSampler, 1000 };
+	// room for depth pyramid sets retired by resizes
+	poolSizes[3] = { vk::DescriptorType::eStorageImage, 256 };
 
 	uint32_t maxSets = 0;
 
@@ -910,6 +1443,7 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 	}
 
 	vk::DescriptorPoolCreateInfo createInfo;
+	createInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
 	createInfo.setMaxSets(maxSets);
 	createInfo.setPoolSizes(poolSizes);
 
@@ -917,7 +1451,7 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 
 	// light
 
-	_lightStorage.initialize(_pContext->getDevice(), _allocator, _descriptorPool);
+	_lightStorage.initialize(_pContext->getDevice(), &_pContext->getMemory(), _descriptorPool);
 
 	// uniform
 
@@ -936,22 +1470,22 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("UBO descriptor set layout creation failed!");
 
-		std::vector<vk::DescriptorSetLayout> layouts(FRAMES_IN_FLIGHT, _uniformLayout);
+		std::vector<vk::DescriptorSetLayout> layouts(_framesInFlight, _uniformLayout);
 
 		vk::DescriptorSetAllocateInfo allocInfo;
 		allocInfo.setDescriptorPool(_descriptorPool);
-		allocInfo.setDescriptorSetCount(static_cast<uint32_t>(FRAMES_IN_FLIGHT));
+		allocInfo.setDescriptorSetCount(_framesInFlight);
 		allocInfo.setSetLayouts(layouts);
 
-		std::array<vk::DescriptorSet, FRAMES_IN_FLIGHT> uniformSets{};
+		std::array<vk::DescriptorSet, MAX_FRAMES_IN_FLIGHT> uniformSets{};
 
 		err = device.allocateDescriptorSets(&allocInfo, uniformSets.data());
 
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("UBO descriptor set allocation failed!");
 
-		for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
-			_uniformBuffers[i] = bufferCreate(
+		for (uint32_t i = 0; i < _framesInFlight; i++) {
+			_uniformBuffers[i] = bufferCreate(MemoryCategory::Frame,
 					vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
 					sizeof(UniformBufferObject), &_uniformAllocInfos[i]);
 
@@ -971,36 +1505,42 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		}
 	}
 
-	// input attachment
+	// tonemap input
 
 	{
 		vk::DescriptorSetLayoutBinding binding;
 		binding.setBinding(0);
-		binding.setDescriptorType(vk::DescriptorType::eInputAttachment);
+		binding.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
 		binding.setDescriptorCount(1);
 		binding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
 		vk::DescriptorSetLayoutCreateInfo createInfo;
 		createInfo.setBindings(binding);
 
-		vk::Result err =
-				device.createDescriptorSetLayout(&createInfo, nullptr, &_inputAttachmentLayout);
+		vk::Result err = device.createDescriptorSetLayout(&createInfo, nullptr, &_tonemapSetLayout);
 
 		if (err != vk::Result::eSuccess)
-			throw std::runtime_error("Input attachment descriptor set layout creation failed!");
+			throw std::runtime_error("Tonemap descriptor set layout creation failed!");
+
+		std::vector<vk::DescriptorSetLayout> layouts(_framesInFlight, _tonemapSetLayout);
 
 		vk::DescriptorSetAllocateInfo allocInfo;
 		allocInfo.setDescriptorPool(_descriptorPool);
-		allocInfo.setDescriptorSetCount(1);
-		allocInfo.setSetLayouts(_inputAttachmentLayout);
+		allocInfo.setDescriptorSetCount(_framesInFlight);
+		allocInfo.setSetLayouts(layouts);
 
-		err = device.allocateDescriptorSets(&allocInfo, &_inputAttachmentSet);
+		err = device.allocateDescriptorSets(&allocInfo, _tonemapSets);
 
 		if (err != vk::Result::eSuccess)
-			throw std::runtime_error("Input attachment descriptor set allocation failed!");
+			throw std::runtime_error("Tonemap descriptor set allocation failed!");
+
+		// bilinear, the rendered corner is upscaled to the swapchain
+		_tonemapSampler =
+				samplerCreate(vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge, 1);
 
-		updateInputAttachment(
-				device, _pContext->getColorAttachment().getImageView(), _inputAttachmentSet);
+		// written by drawBegin
+		for (uint32_t i = 0; i < _framesInFlight; i++)
+			_tonemapViews[i] = VK_NULL_HANDLE;
 	}
 
 	// textures
@@ -1054,12 +1594,14 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("Sky descriptor set layout creation failed!");
 
+		std::vector<vk::DescriptorSetLayout> layouts(_framesInFlight, _skySetLayout);
+
 		vk::DescriptorSetAllocateInfo allocInfo;
 		allocInfo.setDescriptorPool(_descriptorPool);
-		allocInfo.setDescriptorSetCount(1);
-		allocInfo.setSetLayouts(_skySetLayout);
+		allocInfo.setDescriptorSetCount(_framesInFlight);
+		allocInfo.setSetLayouts(layouts);
 
-		err = device.allocateDescriptorSets(&allocInfo, &_skySet);
+		err = device.allocateDescriptorSets(&allocInfo, _skySets);
 
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("Sky descriptor set allocation failed!");
@@ -1068,7 +1610,8 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 	// ibl
 
 	{
-		std::array<vk::DescriptorSetLayoutBinding, 3> bindings;
+		// specular and BRDF lut, irradiance is in the frame's uniforms
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings;
 		bindings[0].setBinding(0);
 		bindings[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
 		bindings[0].setDescriptorCount(1);
@@ -1079,11 +1622,6 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		bindings[1].setDescriptorCount(1);
 		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
-		bindings[2].setBinding(2);
-		bindings[2].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		bindings[2].setDescriptorCount(1);
-		bindings[2].setStageFlags(vk::ShaderStageFlagBits::eFragment);
-
 		vk::DescriptorSetLayoutCreateInfo createInfo;
 		createInfo.setBindings(bindings);
 
@@ -1092,15 +1630,21 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("IBL descriptor set layout creation failed!");
 
+		std::vector<vk::DescriptorSetLayout> layouts(_framesInFlight, _iblSetLayout);
+
 		vk::DescriptorSetAllocateInfo allocInfo;
 		allocInfo.setDescriptorPool(_descriptorPool);
-		allocInfo.setDescriptorSetCount(1);
-		allocInfo.setSetLayouts(_iblSetLayout);
+		allocInfo.setDescriptorSetCount(_framesInFlight);
+		allocInfo.setSetLayouts(layouts);
 
-		err = device.allocateDescriptorSets(&allocInfo, &_iblSet);
+		err = device.allocateDescriptorSets(&allocInfo, _iblSets);
 
 		if (err != vk::Result::eSuccess)
 			throw std::runtime_error("IBL descriptor set allocation failed!");
+
+		// written by drawBegin once the first sky is baked
+		for (uint32_t i = 0; i < _framesInFlight; i++)
+			_environmentSetBakes[i] = 0;
 	}
 
 	vk::PushConstantRange pushConstant;
@@ -1108,13 +1652,36 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 	pushConstant.setOffset(0);
 	pushConstant.setSize(sizeof(MeshPushConstants));
 
-	vk::VertexInputBindingDescription binding = Vertex::getBindingDescription();
-	std::array<vk::VertexInputAttributeDescription, 4> attribute =
-			Vertex::getAttributeDescriptions();
+	vk::VertexInputBindingDescription instanceBinding = Instance::getBindingDescription();
+	std::array<vk::VertexInputAttributeDescription, 4> instanceAttributes =
+			Instance::getAttributeDescriptions();
 
-	vk::PipelineVertexInputStateCreateInfo vertexInput;
-	vertexInput.setVertexBindingDescriptions(binding);
-	vertexInput.setVertexAttributeDescriptions(attribute);
+	std::array<vk::VertexInputBindingDescription, 2> positionBindings = {
+		Vertex::getPositionBindingDescription(),
+		instanceBinding,
+	};
+
+	std::array<vk::VertexInputAttributeDescription, 5> positionAttributes = {
+		Vertex::getPositionAttributeDescription(),
+		instanceAttributes[0],
+		instanceAttributes[1],
+		instanceAttributes[2],
+		instanceAttributes[3],
+	};
+
+	vk::PipelineVertexInputStateCreateInfo positionInput;
+	positionInput.setVertexBindingDescriptions(positionBindings);
+	positionInput.setVertexAttributeDescriptions(positionAttributes);
+
+	// the material layout takes the shadow map set
+	_shadowMaps.init(_framesInFlight);
+
+	// pipelines are built against render passes compatible with the frame graph's
+
+	vk::RenderPass depthRenderPass = _frameGraph.getRenderPass({}, DEPTH_FORMAT);
+	vk::RenderPass mainRenderPass = _frameGraph.getRenderPass({ COLOR_FORMAT }, DEPTH_FORMAT);
+	vk::RenderPass shadowRenderPass = _frameGraph.getRenderPass({}, SHADOW_FORMAT);
+	vk::RenderPass shadowOverlayRenderPass = _frameGraph.getRenderPass({}, SHADOW_OVERLAY_FORMAT);
 
 	// depth
 
@@ -1132,7 +1699,15 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 
 		_depthLayout = device.createPipelineLayout(createInfo);
 		_depthPipeline = createPipeline(device, vertexStage, fragmentStage, _depthLayout,
-				_pContext->getRenderPass(), 0, vertexInput, true);
+				mainRenderPass, 0, positionInput, true);
+		_earlyDepthPipeline = createPipeline(device, vertexStage, fragmentStage, _depthLayout,
+				depthRenderPass, 0, positionInput, true, 0);
+
+		// biased in the material shader, the lookup is offset toward the light
+		_shadowPipeline = createPipeline(device, vertexStage, fragmentStage, _depthLayout,
+				shadowRenderPass, 0, positionInput, true, 0);
+		_shadowOverlayPipeline = createPipeline(device, vertexStage, fragmentStage, _depthLayout,
+				shadowOverlayRenderPass, 0, positionInput, true, 0);
 
 		device.destroyShaderModule(vertexStage);
 		device.destroyShaderModule(fragmentStage);
@@ -1160,7 +1735,7 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 
 		_skyLayout = device.createPipelineLayout(createInfo);
 		_skyPipeline = createPipeline(
-				device, vertexStage, fragmentStage, _skyLayout, _pContext->getRenderPass(), 1, {});
+				device, vertexStage, fragmentStage, _skyLayout, mainRenderPass, 0, {});
 
 		device.destroyShaderModule(vertexStage);
 		device.destroyShaderModule(fragmentStage);
@@ -1177,11 +1752,12 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		codeSize = sizeof(shader.fragmentCode);
 		vk::ShaderModule fragmentStage = createShaderModule(device, shader.fragmentCode, codeSize);
 
-		std::array<vk::DescriptorSetLayout, 4> layouts = {
+		std::array<vk::DescriptorSetLayout, 5> layouts = {
 			_uniformLayout,
 			_iblSetLayout,
 			_lightStorage.getLightSetLayout(),
 			_textureLayout,
+			_shadowMaps.getSetLayout(),
 		};
 
 		vk::PipelineLayoutCreateInfo createInfo = {};
@@ -1189,11 +1765,11 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		createInfo.setPushConstantRanges(pushConstant);
 
 		_materialLayout = device.createPipelineLayout(createInfo);
-		_materialPipeline = createPipeline(device, vertexStage, fragmentStage, _materialLayout,
-				_pContext->getRenderPass(), 1, vertexInput);
 
-		device.destroyShaderModule(vertexStage);
-		device.destroyShaderModule(fragmentStage);
+		// kept for variants created later
+		_materialRenderPass = mainRenderPass;
+		_materialVertexStage = vertexStage;
+		_materialFragmentStage = fragmentStage;
 	}
 
 	// tonemapping
@@ -1213,17 +1789,29 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		pushConstant.setSize(sizeof(TonemapParameterConstants));
 
 		vk::PipelineLayoutCreateInfo createInfo;
-		createInfo.setSetLayouts(_inputAttachmentLayout);
+		createInfo.setSetLayouts(_tonemapSetLayout);
 		createInfo.setPushConstantRanges(pushConstant);
 
 		_tonemapLayout = device.createPipelineLayout(createInfo);
-		_tonemapPipeline = createPipeline(device, vertexStage, fragmentStage, _tonemapLayout,
-				_pContext->getRenderPass(), 2, {});
+		vk::RenderPass renderPass =
+				_frameGraph.getRenderPass({ _pContext->getSwapchainFormat() });
+
+		_tonemapPipeline = createPipeline(
+				device, vertexStage, fragmentStage, _tonemapLayout, renderPass, 0, {});
 
 		device.destroyShaderModule(vertexStage);
 		device.destroyShaderModule(fragmentStage);
 	}
 
+	// created once the frame graph has allocated depth
+	_depthPyramid.init();
+	_pyramidDepthView = VK_NULL_HANDLE;
+
+	_clusterCulling.init(_framesInFlight);
+	// dynamic resolution and benchmarks need GPU frame times, profiling or not
+	_gpuProfiler.init(_framesInFlight, _pContext->getGraphicsQueueFamily(),
+			_dynamicResolution.isEnabled() || _isGpuTimingRequired);
+
 	{
 		_environmentEffects.init();
 
@@ -1236,15 +1824,18 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
 		imageInfo.setSampler(_brdfSampler);
 
-		vk::WriteDescriptorSet writeInfo;
-		writeInfo.setDstSet(_iblSet);
-		writeInfo.setDstBinding(2);
-		writeInfo.setDstArrayElement(0);
-		writeInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		writeInfo.setDescriptorCount(1);
-		writeInfo.setImageInfo(imageInfo);
+		// the same in every frame's set, the environment rewrites only the specular
+		for (uint32_t i = 0; i < _framesInFlight; i++) {
+			vk::WriteDescriptorSet writeInfo;
+			writeInfo.setDstSet(_iblSets[i]);
+			writeInfo.setDstBinding(1);
+			writeInfo.setDstArrayElement(0);
+			writeInfo.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+			writeInfo.setDescriptorCount(1);
+			writeInfo.setImageInfo(imageInfo);
 
-		device.updateDescriptorSets(writeInfo, nullptr);
+			device.updateDescriptorSets(writeInfo, nullptr);
+		}
 	}
 
 	{
@@ -1258,6 +1849,9 @@ void RD::windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
 
 		environmentSkyUpdate(image);
 	}
+
+	// the first frame has an environment to light with
+	uploadsFlush();
 }
 
 void RD::windowResize(uint32_t width, uint32_t height) {
@@ -1270,6 +1864,6 @@ void RD::windowResize(uint32_t width, uint32_t height) {
 	_resized = true;
 }
 
-void RD::init(bool useValidation) {
-	_pContext = new VulkanContext(useValidation);
+void RD::init(bool useValidation, bool headless) {
+	_pContext = new VulkanContext(useValidation, headless);
 }
@@ -2,35 +2,81 @@
 #define RENDERING_DEVICE_H
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 #include "storage/light_storage.h"
 #include "types/allocated.h"
+#include "types/frame_stats.h"
 #include "types/resource.h"
 
+#include "effects/cluster_culling.h"
+#include "effects/depth_pyramid.h"
 #include "effects/environment_effects.h"
+#include "effects/shadow_maps.h"
 
+#include "dynamic_resolution.h"
+#include "gpu_profiler.h"
+#include "render_graph.h"
+#include "spherical_harmonics.h"
+#include "transfer_queue.h"
 #include "vulkan_context.h"
 
-const int FRAMES_IN_FLIGHT = 2;
+// frames the CPU may record ahead of the GPU, per frame resources are sized for the maximum
+const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
 
+// fraction of the swapchain size rendered per axis
+const float MIN_RENDER_SCALE = 0.25f;
+const float MAX_RENDER_SCALE = 1.0f;
+
+// strength of the tonemap pass sharpening at the minimum render scale, none at full size
+const float UPSCALE_SHARPNESS = 0.5f;
+
+// Feature bits of material pipeline variants, each specializes material.frag. Texture bits are
+// fixed per material, materials without a map shade with its fallback value and skip the sample.
+// Light bits follow the frame's light counts.
+const uint32_t MATERIAL_NORMAL_MAP = 1 << 0;
+const uint32_t MATERIAL_METALLIC_MAP = 1 << 1;
+const uint32_t MATERIAL_ROUGHNESS_MAP = 1 << 2;
+const uint32_t MATERIAL_POINT_LIGHTS = 1 << 3;
+// more than one directional light, without it the directional loop is bound to a single pass
+const uint32_t MATERIAL_DIRECTIONAL_LIGHTS = 1 << 4;
+
+const uint32_t MATERIAL_LIGHT_FEATURES = MATERIAL_POINT_LIGHTS | MATERIAL_DIRECTIONAL_LIGHTS;
+const uint32_t MATERIAL_ALL_FEATURES = (1 << 5) - 1;
+
+// std140, material.frag declares the same
 struct UniformBufferObject {
 	glm::vec3 viewPosition;
 	uint32_t directionalLightCount;
 	uint32_t pointLightCount;
+
+	uint32_t shadowCascadeCount;
+	uint32_t shadowOverlayMask;
+	uint32_t _padding;
+	glm::vec4 shadowTexelSizes;
+	glm::mat4 shadowProjViews[SHADOW_CASCADE_COUNT];
+
+	glm::vec4 irradianceSH[SH_COEFFICIENT_COUNT];
 };
 
 struct MeshPushConstants {
 	glm::mat4 projView;
-	glm::mat4 model;
 };
 
 struct TonemapParameterConstants {
 	float exposure;
 	float white;
+	glm::vec2 uvScale;
+	glm::vec2 texelSize;
+	glm::vec2 outputSize;
+	float sharpness;
 };
 
 struct SkyConstants {
@@ -55,41 +101,72 @@ private:
 	LightStorage _lightStorage;
 
 	uint32_t _frame = 0;
+	uint32_t _framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+
+	// performance counter at the last inputSampled(), 0 when not sampled this frame
+	uint64_t _inputTime = 0;
 
 	uint32_t _width, _height;
 	bool _resized;
 
+	// frames submitted so far, retired resources wait for the ones before them
+	uint64_t _submitCount = 0;
+
+	typedef struct {
+		uint64_t submitCount;
+		std::function<void()> destroy;
+	} Retired;
+
+	std::vector<Retired> _retired;
+
+	// performance counter at the last swapchain recreation, 0 once its frame was submitted
+	uint64_t _resizeStart = 0;
+	double _resizeTime = 0.0;
+
 	VmaAllocator _allocator;
-	vk::CommandBuffer _commandBuffers[FRAMES_IN_FLIGHT];
+	vk::CommandBuffer _commandBuffers[MAX_FRAMES_IN_FLIGHT];
 
-	vk::Semaphore _presentSemaphores[FRAMES_IN_FLIGHT];
-	vk::Semaphore _renderSemaphores[FRAMES_IN_FLIGHT];
-	vk::Fence _fences[FRAMES_IN_FLIGHT];
+	vk::Semaphore _presentSemaphores[MAX_FRAMES_IN_FLIGHT];
+	vk::Semaphore _renderSemaphores[MAX_FRAMES_IN_FLIGHT];
+	vk::Fence _fences[MAX_FRAMES_IN_FLIGHT];
 
 	vk::DescriptorPool _descriptorPool;
 
 	vk::DescriptorSetLayout _uniformLayout;
-	vk::DescriptorSetLayout _inputAttachmentLayout;
+	vk::DescriptorSetLayout _tonemapSetLayout;
 	vk::DescriptorSetLayout _textureLayout;
 	vk::DescriptorSetLayout _skySetLayout;
 	vk::DescriptorSetLayout _iblSetLayout;
 
-	vk::DescriptorSet _uniformSets[FRAMES_IN_FLIGHT];
-	vk::DescriptorSet _inputAttachmentSet;
-	vk::DescriptorSet _skySet;
-	vk::DescriptorSet _iblSet;
+	vk::DescriptorSet _uniformSets[MAX_FRAMES_IN_FLIGHT];
+	// one per frame, rewritten when the frame's fence shows the set is no longer read
+	vk::DescriptorSet _tonemapSets[MAX_FRAMES_IN_FLIGHT];
+	vk::ImageView _tonemapViews[MAX_FRAMES_IN_FLIGHT];
+	vk::Sampler _tonemapSampler;
+	// one per frame like the tonemap sets, rewritten once the frame's are behind the environment
+	vk::DescriptorSet _skySets[MAX_FRAMES_IN_FLIGHT];
+	vk::DescriptorSet _iblSets[MAX_FRAMES_IN_FLIGHT];
+	uint64_t _environmentSetBakes[MAX_FRAMES_IN_FLIGHT];
 
-	AllocatedBuffer _uniformBuffers[FRAMES_IN_FLIGHT];
-	VmaAllocationInfo _uniformAllocInfos[FRAMES_IN_FLIGHT];
+	AllocatedBuffer _uniformBuffers[MAX_FRAMES_IN_FLIGHT];
+	VmaAllocationInfo _uniformAllocInfos[MAX_FRAMES_IN_FLIGHT];
 
 	vk::PipelineLayout _depthLayout;
 	vk::Pipeline _depthPipeline;
+	vk::Pipeline _earlyDepthPipeline;
+	vk::Pipeline _shadowPipeline;
+	vk::Pipeline _shadowOverlayPipeline;
 
 	vk::PipelineLayout _skyLayout;
 	vk::Pipeline _skyPipeline;
 
 	vk::PipelineLayout _materialLayout;
-	vk::Pipeline _materialPipeline;
+	vk::RenderPass _materialRenderPass;
+	vk::ShaderModule _materialVertexStage;
+	vk::ShaderModule _materialFragmentStage;
+	// variants created so far by feature bits
+	std::unordered_map<uint32_t, vk::Pipeline> _materialPipelines;
+	bool _isMaterialVariantsEnabled = true;
 
 	vk::PipelineLayout _tonemapLayout;
 	vk::Pipeline _tonemapPipeline;
@@ -97,6 +174,33 @@ private:
 	std::optional<uint32_t> _imageIndex;
 
 	EnvironmentEffects _environmentEffects;
+	ClusterCulling _clusterCulling;
+	DepthPyramid _depthPyramid;
+	ShadowMaps _shadowMaps;
+	GpuProfiler _gpuProfiler;
+
+	TransferQueue _transferQueue;
+	// timeline value of the uploads the frame being recorded acquires, zero without any
+	uint64_t _transferWaitValue = 0;
+
+	// Rebuilt every frame between drawBegin and drawEnd, keeps its images while their sizes hold.
+	RenderGraph _frameGraph;
+	RenderGraph::Resource _swapchainTarget;
+	RenderGraph::Resource _colorTarget;
+	RenderGraph::Resource _depthTarget;
+	// depth the pyramid sets were written for, recreated when the graph reallocates it
+	vk::ImageView _pyramidDepthView;
+
+	DynamicResolution _dynamicResolution;
+	// GPU frame times are measured without the Profiler
+	bool _isGpuTimingRequired = false;
+	// attachment size, the swapchain scaled by the largest render scale
+	vk::Extent2D _renderTargetExtent;
+	// chosen in drawBegin, fixed for the frame
+	vk::Extent2D _renderExtent;
+
+	FrameCounters _frameCounters = {};
+	FrameStats _frameStats;
 
 	float _exposure = 1.25f;
 	float _white = 8.0f;
@@ -110,16 +214,49 @@ private:
 		vk::ImageView cubemapView;
 		vk::Sampler cubemapSampler;
 
-		AllocatedImage irradiance;
-		vk::ImageView irradianceView;
-		vk::Sampler irradianceSampler;
-
 		AllocatedImage specular;
 		vk::ImageView specularView;
 		vk::Sampler specularSampler;
 	} EnvironmentData;
 
 	EnvironmentData _environmentData;
+	// bakes finished so far, the environment the frame's sets were written for is one of them
+	uint64_t _environmentBakeCount = 0;
+	// of the baked sky, lights diffuse through the frame's uniforms
+	IrradianceSH _irradianceSH = {};
+
+	typedef struct {
+		uint64_t upload;
+		AllocatedImage image;
+		uint32_t width;
+		uint32_t height;
+	} PendingSky;
+
+	// uploading, baked once resident
+	std::vector<PendingSky> _pendingSkies;
+
+	typedef struct {
+		PendingSky sky;
+		vk::ImageView skyView;
+		vk::CommandBuffer commandBuffer;
+		EnvironmentEffects::Bake bake;
+	} SkyBake;
+
+	// Submitted on a fence of its own, no frame waits for it. The previous environment lights
+	// the scene until the fence signals.
+	std::optional<SkyBake> _skyBake;
+	vk::Fence _skyBakeFence;
+
+	void _swapchainRecreate();
+	void _depthPyramidCreate(vk::ImageView depthView);
+	void _retiredCollect();
+
+	vk::Pipeline _materialPipelineCreate(uint32_t features);
+
+	void _environmentUpdate();
+	void _environmentBakeBegin(const PendingSky &sky);
+	void _environmentBakeFinish();
+	void _environmentSetsUpdate();
 
 public:
 	RenderingDevice(RenderingDevice const &) = delete;
@@ -128,22 +265,32 @@ public:
 	vk::CommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(vk::CommandBuffer commandBuffer);
 
-	AllocatedBuffer bufferCreate(
-			vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationInfo *pAllocInfo = NULL);
+	AllocatedBuffer bufferCreate(MemoryCategory category, vk::BufferUsageFlags usage,
+			vk::DeviceSize size, VmaAllocationInfo *pAllocInfo = NULL, bool isReadback = false);
 	void bufferCopy(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size);
 	void bufferCopyToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height,
 			vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal);
-	void bufferSend(vk::Buffer dstBuffer, uint8_t *pData, size_t size);
+	// Queued for the transfer queue, frames may read the buffer once the returned upload is
+	// resident.
+	uint64_t bufferSend(vk::Buffer dstBuffer, uint8_t *pData, size_t size,
+			UploadPriority priority = UploadPriority::High);
 	void bufferDestroy(AllocatedBuffer buffer);
 
-	AllocatedImage imageCreate(uint32_t width, uint32_t height, vk::Format format,
+	AllocatedImage imageCreate(MemoryCategory category, uint32_t width, uint32_t height,
+			vk::Format format, uint32_t mipLevels, vk::ImageUsageFlags usage);
+	AllocatedImage imageCubeCreate(MemoryCategory category, uint32_t size, vk::Format format,
 			uint32_t mipLevels, vk::ImageUsageFlags usage);
-	AllocatedImage imageCubeCreate(
-			uint32_t size, vk::Format format, uint32_t mipLevels, vk::ImageUsageFlags usage);
 	void imageGenerateMipmaps(vk::Image image, int32_t width, int32_t height, vk::Format format,
 			uint32_t mipLevels, uint32_t arrayLayers = 1);
+	// From the top level in transfer destination layout, every level ends in shader read only.
+	void imageRecordMipmaps(vk::CommandBuffer commandBuffer, vk::Image image, int32_t width,
+			int32_t height, uint32_t mipLevels, uint32_t arrayLayers = 1);
+	// Stages and access are derived from the layouts, see RenderGraph::getLayoutAccess.
 	void imageLayoutTransition(vk::Image image, vk::Format format, uint32_t mipLevels,
 			uint32_t arrayLayers, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
+	void imageRecordLayoutTransition(vk::CommandBuffer commandBuffer, vk::Image image,
+			vk::Format format, uint32_t mipLevels, uint32_t arrayLayers,
+			vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
 	void imageSend(vk::Image image, uint32_t width, uint32_t height, uint8_t *pData, size_t size,
 			vk::ImageLayout layout);
 	void imageDestroy(AllocatedImage image);
@@ -156,23 +303,62 @@ public:
 			uint32_t mipLevels, float mipLodBias = 0.0f);
 	void samplerDestroy(vk::Sampler sampler);
 
+	// Over the texture budget the largest mip levels are dropped until the rest fits. Queued for
+	// the transfer queue, frames may sample it once its upload is resident.
 	TextureRD textureCreate(const std::shared_ptr<Image> image);
 	void textureDestroy(TextureRD texture);
 
+	// Queued for the transfer queue, baked by the first update the sky is resident at. The
+	// previous environment lights the scene until then.
 	void environmentSkyUpdate(const std::shared_ptr<Image> image);
-
+	// Whether specular prefiltering uses filtered importance sampling and compares every bake to
+	// the reference filter, see EnvironmentEffects::setSpecularFilter.
+	void setSpecularFilter(bool isFiltered, bool isCompared);
+
+	// Once per frame before its draws are chosen, see TransferQueue::update. Completed uploads
+	// become resident and queued ones are submitted within the budget.
+	void uploadsUpdate();
+	// Uploads everything queued and waits for it, for loading outside of frames.
+	void uploadsFlush();
+	// Zero, no upload, is always resident.
+	bool isUploadResident(uint64_t upload) const;
+	// Bytes and CPU milliseconds of uploads staged per frame, zero is unlimited.
+	void setUploadBudget(uint64_t bytes, double time);
+
+	// Shadow cascades have to be updated for the frame first.
 	void updateUniformBuffer(const glm::vec3 &viewPosition);
 
 	LightStorage &getLightStorage();
+	ClusterCulling &getClusterCulling();
+	DepthPyramid &getDepthPyramid();
+	ShadowMaps &getShadowMaps();
+	GpuProfiler &getGpuProfiler();
+
+	// Passes of the frame are added between drawBegin and drawEnd, which compiles and records
+	// them. Color and depth are transients at the render target size, tonemapping reads color.
+	RenderGraph &getFrameGraph();
+	RenderGraph::Resource getColorTarget() const;
+	RenderGraph::Resource getDepthTarget() const;
+
+	// Counters of the frame being recorded, pushed into the stats when it is submitted.
+	FrameCounters &getFrameCounters();
+	const FrameStats &getFrameStats() const;
 
 	vk::Instance getInstance() const;
 	vk::PhysicalDevice getPhysicalDevice() const;
 	vk::Device getDevice() const;
+	GpuMemory &getMemory();
 
 	vk::Extent2D getSwapchainExtent() const;
+	// Size the depth and main passes render at this frame, at most the attachment size.
+	vk::Extent2D getRenderExtent() const;
 
 	vk::PipelineLayout getDepthPipelineLayout() const;
 	vk::Pipeline getDepthPipeline() const;
+	vk::Pipeline getEarlyDepthPipeline() const;
+	// Depth pipelines of the shadow map and overlay formats, same layout.
+	vk::Pipeline getShadowPipeline() const;
+	vk::Pipeline getShadowOverlayPipeline() const;
 
 	vk::PipelineLayout getSkyPipelineLayout() const;
 	vk::Pipeline getSkyPipeline() const;
@@ -180,7 +366,13 @@ public:
 	vk::DescriptorSet getSkySet() const;
 
 	vk::PipelineLayout getMaterialPipelineLayout() const;
-	vk::Pipeline getMaterialPipeline() const;
+	// The variant with the feature bits, created on first use. Materials request theirs when
+	// created, draws don't wait on pipeline compilation.
+	vk::Pipeline getMaterialPipeline(uint32_t features);
+	// Light bits of the light counts this frame's uniform buffer holds.
+	uint32_t getMaterialLightFeatures();
+	// Disabled, every material draws with all features, to measure what the variants save.
+	void setMaterialVariantsEnabled(bool enabled);
 
 	std::array<vk::DescriptorSet, 3> getMaterialSets() const;
 
@@ -190,13 +382,41 @@ public:
 	void setExposure(float exposure);
 	void setWhite(float white);
 
+	uint32_t getFrame() const;
+	uint32_t getFramesInFlight() const;
+
+	// Clamped to 1..MAX_FRAMES_IN_FLIGHT, set before windowInit.
+	void setFramesInFlight(uint32_t count);
+	// Falls back to FIFO when the surface lacks the mode, set before windowInit.
+	void setPresentMode(vk::PresentModeKHR presentMode);
+
+	// Both clamped to MIN_RENDER_SCALE..MAX_RENDER_SCALE and set before windowInit, attachments
+	// are allocated for the largest scale so changing it never reallocates.
+	void setRenderScale(float scale);
+	// Scales between min and max to keep GPU frame time at the target, in milliseconds.
+	void setDynamicResolution(double targetTime, float minScale, float maxScale);
+	// Times frames on the GPU without the Profiler's events, set before windowInit.
+	void setGpuTimingRequired(bool isRequired);
+
+	// Blocks until the GPU is done with the next frame's resources. drawBegin waits anyway, calling
+	// it earlier lets input be read after the wait instead of before it.
+	void frameWait();
+	// Marks when input for the next frame was read, its submit records the latency since.
+	void inputSampled();
+
+	// Runs once every frame submitted so far has completed, instead of waiting for the device.
+	void retire(std::function<void()> destroy);
+
+	// Resets the frame graph and declares the swapchain image, color and depth targets.
 	vk::CommandBuffer drawBegin();
+	// Adds tonemapping, records the frame graph and submits.
 	void drawEnd(vk::CommandBuffer commandBuffer);
 
+	// surface is null for a headless context
 	void windowInit(vk::SurfaceKHR surface, uint32_t width, uint32_t height);
 	void windowResize(uint32_t width, uint32_t height);
 
-	void init(bool useValidation);
+	void init(bool useValidation, bool headless = false);
 };
 
 typedef RenderingDevice RD;
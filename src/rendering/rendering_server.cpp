@@ -1,16 +1,30 @@
+#include <cassert>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
 #include <glm/glm.hpp>
 
+#include <SDL3/SDL_events.h>
+#include <SDL3/SDL_log.h>
 #include <SDL3/SDL_vulkan.h>
 
 #include <io/image.h>
+#include <profiler.h>
 
 #include "rendering_device.h"
 #include "rendering_server.h"
 
+// Projected bounding sphere size, as fraction of screen height, below which each LOD is used.
+const float LOD_SCREEN_SIZES[MAX_LOD_COUNT] = { 1.0f, 0.25f, 0.125f, 0.0625f, 0.03125f };
+// Switching back needs the size to move this much past the threshold, stops popping at the edge.
+const float LOD_HYSTERESIS = 0.1f;
+
+// frames a moved instance has to rest before it casts into the cached shadow maps again
+const uint64_t SHADOW_REST_FRAMES = 30;
+
 #define CHECK_IF_VALID(owner, id, what)                                                            \
 	if (!owner.has(id)) {                                                                          \
 		std::cout << "ERROR: " << what << ": " << id << " is not valid resource!" << std::endl;    \
@@ -34,73 +48,74 @@ void RS::cameraSetZFar(float zFar) {
 }
 
 ObjectID RS::meshCreate(const Mesh &mesh) {
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
-
-	{
-		size_t totalVertexCount = 0;
-		size_t totalIndexCount = 0;
-
-		for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
-			totalVertexCount += mesh.pPrimitives[i].vertices.count;
-			totalIndexCount += mesh.pPrimitives[i].indices.count;
-		}
-
-		vertices.resize(totalVertexCount);
-		indices.resize(totalIndexCount);
-	}
+	MeshStreams streams;
+	meshFlatten(mesh, streams);
 
-	uint32_t vertexOffset = 0;
-	uint32_t indexOffset = 0;
+	const std::vector<glm::vec3> &positions = streams.positions;
+	const std::vector<VertexAttribute> &attributes = streams.attributes;
+	const std::vector<uint32_t> &indices = streams.indices;
+	std::vector<ClusterCulling::MeshletData> &meshlets = streams.meshlets;
 
-	std::vector<PrimitiveRD> _primitives = {};
+	RD &rd = RD::getSingleton();
 
-	for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
-		uint32_t indexCount = static_cast<uint32_t>(mesh.pPrimitives[i].indices.count);
-		uint32_t firstIndex = indexOffset;
-		ObjectID materialIndex = mesh.pPrimitives[i].materialIndex;
+	vk::DeviceSize positionBufferSize = sizeof(glm::vec3) * positions.size();
+	AllocatedBuffer positionBuffer = rd.bufferCreate(MemoryCategory::Geometry,
+			vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			positionBufferSize);
 
-		_primitives.push_back({
-				indexCount,
-				firstIndex,
-				materialIndex,
-		});
+	rd.bufferSend(positionBuffer.buffer, (uint8_t *)positions.data(), (size_t)positionBufferSize);
 
-		for (uint32_t j = 0; j < mesh.pPrimitives[i].indices.count; j++) {
-			indices[indexOffset] = vertexOffset + mesh.pPrimitives[i].indices.pData[j];
-			indexOffset++;
-		}
+	vk::DeviceSize attributeBufferSize = sizeof(VertexAttribute) * attributes.size();
+	AllocatedBuffer attributeBuffer = rd.bufferCreate(MemoryCategory::Geometry,
+			vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			attributeBufferSize);
 
-		Vertex *pDst = vertices.data();
-		const Vertex *pSrc = mesh.pPrimitives[i].vertices.pData;
-		size_t vertexCount = mesh.pPrimitives[i].vertices.count;
+	rd.bufferSend(
+			attributeBuffer.buffer, (uint8_t *)attributes.data(), (size_t)attributeBufferSize);
 
-		memcpy(&pDst[vertexOffset], pSrc, sizeof(Vertex) * vertexCount);
+	vk::DeviceSize indexBufferSize = sizeof(uint32_t) * indices.size();
+	AllocatedBuffer indexBuffer = rd.bufferCreate(MemoryCategory::Geometry,
+			vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+					vk::BufferUsageFlagBits::eTransferDst,
+			indexBufferSize);
 
-		vertexOffset += vertexCount;
-	}
+	rd.bufferSend(indexBuffer.buffer, (uint8_t *)indices.data(), (size_t)indexBufferSize);
 
-	RD &rd = RD::getSingleton();
+	// storage buffers can't be empty
+	if (meshlets.empty())
+		meshlets.push_back({});
 
-	vk::DeviceSize vertexBufferSize = sizeof(Vertex) * vertices.size();
-	AllocatedBuffer vertexBuffer = rd.bufferCreate(
-			vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-			vertexBufferSize);
+	vk::DeviceSize meshletBufferSize = sizeof(ClusterCulling::MeshletData) * meshlets.size();
+	AllocatedBuffer meshletBuffer = rd.bufferCreate(MemoryCategory::Geometry,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			meshletBufferSize);
 
-	rd.bufferSend(vertexBuffer.buffer, (uint8_t *)vertices.data(), (size_t)vertexBufferSize);
+	uint64_t upload = rd.bufferSend(
+			meshletBuffer.buffer, (uint8_t *)meshlets.data(), (size_t)meshletBufferSize);
 
-	vk::DeviceSize indexBufferSize = sizeof(uint32_t) * indices.size();
-	AllocatedBuffer indexBuffer = rd.bufferCreate(
-			vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-			indexBufferSize);
+	vk::DescriptorSet meshletSet =
+			rd.getClusterCulling().meshletSetCreate(meshletBuffer.buffer, indexBuffer.buffer);
 
-	rd.bufferSend(indexBuffer.buffer, (uint8_t *)indices.data(), (size_t)indexBufferSize);
+	// depth pass fetches only the position stream
+	SDL_LogVerbose(SDL_LOG_CATEGORY_RENDER,
+			"Mesh %s: %zu vertices, depth stream %llu bytes, material streams %llu bytes",
+			mesh.name.c_str(), positions.size(), (unsigned long long)positionBufferSize,
+			(unsigned long long)(positionBufferSize + attributeBufferSize));
 
-	return _meshes.insert({
-			vertexBuffer,
+	ObjectID id = _meshes.insert({
+			positionBuffer,
+			attributeBuffer,
 			indexBuffer,
-			_primitives,
+			streams.primitives,
+			meshletBuffer,
+			meshletSet,
+			streams.center,
+			streams.radius,
+			upload,
 	});
+
+	_pendingMeshes.push_back(id);
+	return id;
 }
 
 void RS::meshFree(ObjectID mesh) {
@@ -108,26 +123,96 @@ void RS::meshFree(ObjectID mesh) {
 }
 
 ObjectID RenderingServer::meshInstanceCreate() {
-	return _meshInstances.insert({});
+	uint32_t slot;
+
+	if (!_freeSlots.empty()) {
+		slot = _freeSlots.back();
+		_freeSlots.pop_back();
+	} else {
+		slot = static_cast<uint32_t>(_transforms.size());
+		_transforms.emplace_back();
+		_slotInstances.push_back(nullptr);
+	}
+
+	ObjectID id = _meshInstances.insert({});
+
+	MeshInstanceRD &data = _meshInstances[id];
+	data.transformSlot = slot;
+
+	_transforms[slot] = glm::mat4(1.0f);
+	_slotInstances[slot] = &data;
+
+	return id;
 }
 
 void RS::meshInstanceSetMesh(ObjectID meshInstance, ObjectID mesh) {
 	CHECK_IF_VALID(_meshInstances, meshInstance, "MeshInstance");
 	CHECK_IF_VALID(_meshes, mesh, "Mesh")
 
-	_meshInstances[meshInstance].mesh = mesh;
+	MeshInstanceRD &data = _meshInstances[meshInstance];
+	_shadowsInvalidate(data);
+
+	data.mesh = mesh;
+	data.isDirty = true;
 }
 
 void RS::meshInstanceSetTransform(ObjectID meshInstance, const glm::mat4 &transform) {
 	CHECK_IF_VALID(_meshInstances, meshInstance, "MeshInstance");
 
-	_meshInstances[meshInstance].transform = transform;
+	MeshInstanceRD &data = _meshInstances[meshInstance];
+	_meshInstanceMoved(data);
+
+	_transforms[data.transformSlot] = transform;
+}
+
+uint32_t RS::meshInstanceGetTransformSlot(ObjectID meshInstance) {
+	assert(_meshInstances.has(meshInstance));
+
+	return _meshInstances[meshInstance].transformSlot;
+}
+
+void RS::meshInstancesSetTransforms(const uint32_t *pSlots, const uint32_t *pIndices,
+		const glm::mat4 *pTransforms, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t slot = pSlots[i];
+		assert(slot < _slotInstances.size() && _slotInstances[slot] != nullptr);
+
+		_meshInstanceMoved(*_slotInstances[slot]);
+		_transforms[slot] = pTransforms[pIndices[i]];
+	}
 }
 
 void RS::meshInstanceFree(ObjectID meshInstance) {
+	if (!_meshInstances.has(meshInstance))
+		return;
+
+	MeshInstanceRD &data = _meshInstances[meshInstance];
+	_shadowsInvalidate(data);
+
+	_slotInstances[data.transformSlot] = nullptr;
+	_freeSlots.push_back(data.transformSlot);
+
 	_meshInstances.free(meshInstance);
 }
 
+void RS::_shadowsInvalidate(const MeshInstanceRD &meshInstance) {
+	if (!meshInstance.isDrawn || meshInstance.isDynamic)
+		return;
+
+	RD::getSingleton().getShadowMaps().invalidate(meshInstance.center, meshInstance.radius);
+}
+
+void RS::_meshInstanceMoved(MeshInstanceRD &meshInstance) {
+	if (!meshInstance.isDrawn)
+		return;
+
+	// leaves the cached maps for the overlay until it rests
+	_shadowsInvalidate(meshInstance);
+
+	meshInstance.isDynamic = true;
+	meshInstance.movedFrame = _frameCount;
+}
+
 ObjectID RS::lightCreate(LightType type) {
 	return RD::getSingleton().getLightStorage().lightCreate(type);
 }
@@ -164,13 +249,26 @@ void RS::textureFree(ObjectID texture) {
 	_textures.free(texture);
 }
 
-ObjectID RS::materialCreate(const MaterialInfo &info) {
-	TextureRD albedo = _textures.get_id_or_else(info.albedo, _albedoFallback);
-	TextureRD normal = _textures.get_id_or_else(info.normal, _normalFallback);
-	TextureRD metallic = _textures.get_id_or_else(info.metallic, _metallicFallback);
-	TextureRD roughness = _textures.get_id_or_else(info.roughness, _roughnessFallback);
-
+vk::DescriptorSet RS::_materialSetCreate(const MaterialInfo &info, uint32_t &features) {
 	RD &rd = RD::getSingleton();
+
+	// textures still uploading are sampled as their fallbacks, without their feature bits
+	auto getResident = [&](ObjectID texture, const TextureRD &fallback, uint32_t feature) {
+		if (!_textures.has(texture) || !rd.isUploadResident(_textures[texture].upload))
+			return fallback;
+
+		features |= feature;
+		return _textures[texture];
+	};
+
+	features = 0;
+
+	TextureRD albedo = getResident(info.albedo, _albedoFallback, 0);
+	TextureRD normal = getResident(info.normal, _normalFallback, MATERIAL_NORMAL_MAP);
+	TextureRD metallic = getResident(info.metallic, _metallicFallback, MATERIAL_METALLIC_MAP);
+	TextureRD roughness =
+			getResident(info.roughness, _roughnessFallback, MATERIAL_ROUGHNESS_MAP);
+
 	vk::Device device = rd.getDevice();
 	vk::DescriptorPool descriptorPool = rd.getDescriptorPool();
 
@@ -231,7 +329,50 @@ ObjectID RS::materialCreate(const MaterialInfo &info) {
 
 	device.updateDescriptorSets(writeInfos, nullptr);
 
-	return _materials.insert({ textureSet });
+	return textureSet;
+}
+
+bool RS::_isMaterialResident(const MaterialInfo &info) {
+	RD &rd = RD::getSingleton();
+
+	for (ObjectID texture : { info.albedo, info.normal, info.metallic, info.roughness }) {
+		if (_textures.has(texture) && !rd.isUploadResident(_textures[texture].upload))
+			return false;
+	}
+
+	return true;
+}
+
+ObjectID RS::materialCreate(const MaterialInfo &info) {
+	uint32_t features;
+	vk::DescriptorSet textureSet = _materialSetCreate(info, features);
+
+	RD &rd = RD::getSingleton();
+
+	// Light bits are the highest, stepping by the lowest one visits every combination. Texture
+	// bits are taken from the info, once resident the material switches to those variants.
+	uint32_t textureFeatures = 0;
+
+	if (_textures.has(info.normal))
+		textureFeatures |= MATERIAL_NORMAL_MAP;
+
+	if (_textures.has(info.metallic))
+		textureFeatures |= MATERIAL_METALLIC_MAP;
+
+	if (_textures.has(info.roughness))
+		textureFeatures |= MATERIAL_ROUGHNESS_MAP;
+
+	for (uint32_t lights = 0; lights <= MATERIAL_LIGHT_FEATURES; lights += MATERIAL_POINT_LIGHTS) {
+		rd.getMaterialPipeline(features | lights);
+		rd.getMaterialPipeline(textureFeatures | lights);
+	}
+
+	ObjectID id = _materials.insert({ textureSet, features });
+
+	if (!_isMaterialResident(info))
+		_pendingMaterials.push_back({ id, info });
+
+	return id;
 }
 
 void RS::materialFree(ObjectID material) {
@@ -250,9 +391,66 @@ void RS::environmentSkyUpdate(const std::shared_ptr<Image> image) {
 	RD::getSingleton().environmentSkyUpdate(image);
 }
 
+void RS::_uploadsUpdate() {
+	RD &rd = RD::getSingleton();
+	rd.uploadsUpdate();
+
+	size_t kept = 0;
+
+	for (ObjectID id : _pendingMeshes) {
+		if (!_meshes.has(id))
+			continue;
+
+		MeshRD &mesh = _meshes[id];
+		mesh.isResident = rd.isUploadResident(mesh.upload);
+
+		if (!mesh.isResident)
+			_pendingMeshes[kept++] = id;
+	}
+
+	_pendingMeshes.resize(kept);
+	kept = 0;
+
+	vk::Device device = rd.getDevice();
+	vk::DescriptorPool descriptorPool = rd.getDescriptorPool();
+
+	for (const PendingMaterial &pending : _pendingMaterials) {
+		if (!_materials.has(pending.material))
+			continue;
+
+		if (!_isMaterialResident(pending.info)) {
+			_pendingMaterials[kept++] = pending;
+			continue;
+		}
+
+		MaterialRD &material = _materials[pending.material];
+		vk::DescriptorSet textureSet = material.textureSet;
+
+		// frames in flight still bind the set with fallbacks
+		rd.retire([device, descriptorPool, textureSet]() {
+			device.freeDescriptorSets(descriptorPool, textureSet);
+		});
+
+		material.textureSet = _materialSetCreate(pending.info, material.features);
+	}
+
+	_pendingMaterials.resize(kept);
+}
+
+void RS::uploadsFlush() {
+	RD::getSingleton().uploadsFlush();
+	_uploadsUpdate();
+}
+
 void RenderingServer::draw() {
+	PROFILE_SCOPE("RS::draw");
+
 	RD &rd = RD::getSingleton();
-	rd.updateUniformBuffer(_camera.transform[3]);
+
+	{
+		PROFILE_SCOPE("Update uploads");
+		_uploadsUpdate();
+	}
 
 	vk::Extent2D extent = rd.getSwapchainExtent();
 	float aspect = static_cast<float>(extent.width) / static_cast<float>(extent.height);
@@ -265,79 +463,584 @@ void RenderingServer::draw() {
 
 	glm::mat4 projView = proj * view;
 
-	vk::CommandBuffer commandBuffer = rd.drawBegin();
+	ShadowMaps &shadowMaps = rd.getShadowMaps();
 
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, rd.getDepthPipeline());
+	{
+		PROFILE_SCOPE("Fit shadow cascades");
 
-	for (const auto &[_, meshInstance] : _meshInstances.map()) {
-		const MeshRD &mesh = _meshes[meshInstance.mesh];
+		glm::vec3 lightDirection;
 
-		vk::PipelineLayout pipelineLayout = rd.getDepthPipelineLayout();
+		if (rd.getLightStorage().getShadowLightDirection(lightDirection))
+			shadowMaps.update(_camera, aspect, lightDirection);
+		else
+			shadowMaps.disable();
+	}
 
-		vk::DeviceSize offset = 0;
-		commandBuffer.bindVertexBuffers(0, 1, &mesh.vertexBuffer.buffer, &offset);
-		commandBuffer.bindIndexBuffer(mesh.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+	{
+		PROFILE_SCOPE("Select LODs");
 
-		MeshPushConstants constants{};
-		constants.projView = projView;
-		constants.model = meshInstance.transform;
+		// pick LODs once, both passes must draw the same geometry or depth test fails
+		glm::vec3 viewPosition = glm::vec3(_camera.transform[3]);
+		float projScale = 1.0f / glm::tan(_camera.fovY * 0.5f);
 
-		commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0,
-				sizeof(MeshPushConstants), &constants);
+		glm::vec4 planes[6];
+		ClusterCulling::frustumPlanes(projView, planes);
+
+		for (auto &[_, meshInstance] : _meshInstances.map()) {
+			const MeshRD &mesh = _meshes[meshInstance.mesh];
+			meshInstance.isMeshResident = mesh.isResident;
+
+			if (!meshInstance.isMeshResident)
+				continue;
 
-		for (const PrimitiveRD &primitive : mesh.primitives) {
-			commandBuffer.drawIndexed(primitive.indexCount, 1, primitive.firstIndex, 0, 0);
+			const glm::mat4 &transform = _transforms[meshInstance.transformSlot];
+
+			float scale = glm::max(glm::length(glm::vec3(transform[0])),
+					glm::max(glm::length(glm::vec3(transform[1])),
+							glm::length(glm::vec3(transform[2]))));
+
+			glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.center, 1.0f));
+			float radius = mesh.radius * scale;
+			float distance = glm::max(glm::distance(viewPosition, center) - radius, _camera.zNear);
+
+			float screenSize = radius * projScale / distance;
+
+			uint32_t lod = 0;
+			for (uint32_t i = 1; i < MAX_LOD_COUNT; i++) {
+				// already at this level or coarser: require growing past threshold to refine
+				bool isCoarser = meshInstance.lod >= i;
+				float threshold = LOD_SCREEN_SIZES[i];
+				threshold *= isCoarser ? 1.0f + LOD_HYSTERESIS : 1.0f - LOD_HYSTERESIS;
+
+				if (screenSize >= threshold)
+					break;
+
+				lod = i;
+			}
+
+			meshInstance.lod = lod;
+
+			meshInstance.center = center;
+			meshInstance.radius = radius;
+
+			meshInstance.isInView = true;
+
+			for (const glm::vec4 &plane : planes) {
+				if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+					meshInstance.isInView = false;
+					break;
+				}
+			}
+
+			// rested long enough, casts into the cached maps again
+			bool isResting = _frameCount - meshInstance.movedFrame > SHADOW_REST_FRAMES;
+
+			if (meshInstance.isDynamic && isResting) {
+				meshInstance.isDynamic = false;
+				meshInstance.isDirty = true;
+			}
+
+			if (meshInstance.isDirty && !meshInstance.isDynamic)
+				shadowMaps.invalidate(center, radius);
+
+			meshInstance.isDirty = false;
+			meshInstance.isDrawn = true;
 		}
 	}
 
-	commandBuffer.nextSubpass(vk::SubpassContents::eInline);
+	uint32_t drawCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t dynamicCount = 0;
 
 	{
-		// sky
+		PROFILE_SCOPE("Group instances");
 
-		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, rd.getSkyPipeline());
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-				rd.getSkyPipelineLayout(), 0, rd.getSkySet(), nullptr);
+		// Instances sharing mesh and LOD draw each primitive, and so each material, with one
+		// instanced call per batch. Off-screen instances stay in their group as shadow casters
+		// only, batches bound the instances each meshlet is tested against.
+		_instanceGroups.clear();
+		_instanceGroupMap.clear();
+		_instanceGroupIndices.clear();
+		_instanceBatches.clear();
 
-		SkyConstants constants{};
-		constants.invProj = invProj;
-		constants.invView = invView;
+		for (const auto &[_, meshInstance] : _meshInstances.map()) {
+			if (!meshInstance.isMeshResident)
+				continue;
 
-		commandBuffer.pushConstants(rd.getSkyPipelineLayout(), vk::ShaderStageFlagBits::eFragment,
-				0, sizeof(constants), &constants);
-		commandBuffer.draw(3, 1, 0, 0);
+			uint64_t key = meshInstance.mesh * MAX_LOD_COUNT + meshInstance.lod;
+			auto [iter, isInserted] = _instanceGroupMap.emplace(key, _instanceGroups.size());
+
+			if (isInserted)
+				_instanceGroups.push_back({ meshInstance.mesh, meshInstance.lod, 0, 0, 0, 0 });
+
+			InstanceGroup &group = _instanceGroups[iter->second];
+			group.instanceCount++;
+			group.visibleCount += meshInstance.isInView;
+
+			_instanceGroupIndices.push_back(iter->second);
+		}
+
+		uint32_t instanceCount = 0;
+		uint32_t visibleCount = 0;
+
+		for (InstanceGroup &group : _instanceGroups) {
+			const MeshRD &mesh = _meshes[group.mesh];
+
+			for (uint32_t i = 0; i < group.visibleCount; i += CULL_BATCH_INSTANCES) {
+				uint32_t batchCount = glm::min(group.visibleCount - i, CULL_BATCH_INSTANCES);
+				_instanceBatches.push_back({ group.mesh, group.lod, visibleCount + i, batchCount });
+
+				for (const PrimitiveRD &primitive : mesh.primitives) {
+					uint32_t lod = glm::min(group.lod, primitive.lodCount - 1);
+					indexCount += primitive.lods[lod].indexCount;
+					drawCount++;
+				}
+			}
+
+			group.firstInstance = instanceCount;
+			group.firstVisible = visibleCount;
+			instanceCount += group.instanceCount;
+			visibleCount += group.visibleCount;
+			group.instanceCount = 0;
+			group.visibleCount = 0;
+		}
+
+		_instanceTransforms.resize(visibleCount);
+		_groupedInstances.resize(instanceCount);
+
+		uint32_t i = 0;
+
+		for (const auto &[_, meshInstance] : _meshInstances.map()) {
+			if (!meshInstance.isMeshResident)
+				continue;
+
+			InstanceGroup &group = _instanceGroups[_instanceGroupIndices[i++]];
+			_groupedInstances[group.firstInstance + group.instanceCount++] = &meshInstance;
+			dynamicCount += meshInstance.isDynamic;
+
+			if (meshInstance.isInView) {
+				uint32_t index = group.firstVisible + group.visibleCount++;
+				_instanceTransforms[index] = _transforms[meshInstance.transformSlot];
+			}
+		}
 	}
 
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, rd.getMaterialPipeline());
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-			rd.getMaterialPipelineLayout(), 0, rd.getMaterialSets(), nullptr);
+	{
+		PROFILE_SCOPE("Shadow casters");
 
-	for (const auto &[_, meshInstance] : _meshInstances.map()) {
-		const MeshRD &mesh = _meshes[meshInstance.mesh];
+		_shadowDraws.clear();
+		_shadowTransforms.clear();
 
-		vk::PipelineLayout pipelineLayout = rd.getMaterialPipelineLayout();
+		// groups keep their mesh and LOD, casters in the cascade get their transforms copied
+		auto addCasters = [&](uint32_t cascade, bool isDynamic) {
+			ShadowList list = { static_cast<uint32_t>(_shadowDraws.size()), 0 };
+
+			for (const InstanceGroup &group : _instanceGroups) {
+				uint32_t firstInstance = static_cast<uint32_t>(_shadowTransforms.size());
+				uint32_t groupEnd = group.firstInstance + group.instanceCount;
+
+				for (uint32_t i = group.firstInstance; i < groupEnd; i++) {
+					const MeshInstanceRD &meshInstance = *_groupedInstances[i];
 
+					if (meshInstance.isDynamic == isDynamic &&
+							shadowMaps.intersects(
+									cascade, meshInstance.center, meshInstance.radius))
+						_shadowTransforms.push_back(_transforms[meshInstance.transformSlot]);
+				}
+
+				uint32_t instanceCount =
+						static_cast<uint32_t>(_shadowTransforms.size()) - firstInstance;
+
+				if (instanceCount == 0)
+					continue;
+
+				_shadowDraws.push_back({ group.mesh, group.lod, firstInstance, instanceCount });
+				list.drawCount++;
+			}
+
+			return list;
+		};
+
+		for (uint32_t i = 0; i < shadowMaps.getCascadeCount(); i++) {
+			_staticShadowLists[i] = shadowMaps.isCached(i) ? ShadowList{} : addCasters(i, false);
+			_overlayShadowLists[i] = dynamicCount > 0 ? addCasters(i, true) : ShadowList{};
+		}
+	}
+
+	vk::CommandBuffer commandBuffer = rd.drawBegin();
+
+	PROFILE_SCOPE("Record");
+	GpuProfiler &gpuProfiler = rd.getGpuProfiler();
+	FrameCounters &counters = rd.getFrameCounters();
+
+	// Passes are declared here and recorded by drawEnd, in order, once the graph has placed the
+	// barriers between them. Everything they capture lives until then.
+	RenderGraph &graph = rd.getFrameGraph();
+	RenderGraph::Resource color = rd.getColorTarget();
+	RenderGraph::Resource depth = rd.getDepthTarget();
+	vk::Extent2D renderExtent = rd.getRenderExtent();
+
+	vk::ClearValue depthClear;
+	depthClear.depthStencil = vk::ClearDepthStencilValue(0.0f, 0);
+
+	// the frame's buffers are free once drawBegin waited on its fence
+	shadowMaps.upload(rd.getFrame(), _shadowTransforms.data(),
+			static_cast<uint32_t>(_shadowTransforms.size()));
+
+	auto drawShadows = [&](vk::CommandBuffer commandBuffer, uint32_t cascade,
+			const ShadowList &list, vk::Pipeline pipeline) {
+		// overlays without casters are only cleared
+		if (list.drawCount == 0)
+			return;
+
+		vk::Buffer shadowInstanceBuffer = shadowMaps.getInstanceBuffer();
 		vk::DeviceSize offset = 0;
-		commandBuffer.bindVertexBuffers(0, 1, &mesh.vertexBuffer.buffer, &offset);
-		commandBuffer.bindIndexBuffer(mesh.indexBuffer.buffer, 0, vk::IndexType::eUint32);
 
 		MeshPushConstants constants{};
-		constants.projView = projView;
-		constants.model = meshInstance.transform;
+		constants.projView = shadowMaps.getProjView(cascade);
 
-		commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0,
-				sizeof(MeshPushConstants), &constants);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+		commandBuffer.bindVertexBuffers(INSTANCE_BINDING, 1, &shadowInstanceBuffer, &offset);
+		commandBuffer.pushConstants(rd.getDepthPipelineLayout(), vk::ShaderStageFlagBits::eVertex,
+				0, sizeof(constants), &constants);
+
+		counters.pipelineBindCount++;
+		counters.pushConstantBytes += sizeof(constants);
+
+		for (uint32_t i = 0; i < list.drawCount; i++) {
+			const ShadowDraw &draw = _shadowDraws[list.firstDraw + i];
+			const MeshRD &mesh = _meshes[draw.mesh];
+
+			commandBuffer.bindVertexBuffers(
+					POSITION_BINDING, 1, &mesh.positionBuffer.buffer, &offset);
+			commandBuffer.bindIndexBuffer(mesh.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+
+			for (const PrimitiveRD &primitive : mesh.primitives) {
+				uint32_t lod = glm::min(draw.lod, primitive.lodCount - 1);
+				const IndexRange &range = primitive.lods[lod];
+
+				commandBuffer.drawIndexed(range.indexCount, draw.instanceCount, range.firstIndex, 0,
+						draw.firstInstance);
+
+				counters.triangleCount += range.indexCount / 3 * draw.instanceCount;
+				counters.drawCount++;
+			}
+		}
+	};
+
+	// Stale static maps are re-rendered, overlays whenever they hold dynamic casters or did last
+	// frame. Maps rendered this frame are read by the main pass, the rest stay as they were.
+	std::array<RenderGraph::Resource, SHADOW_CASCADE_COUNT * 2> shadowMapResources;
+	uint32_t shadowMapCount = 0;
+
+	for (uint32_t i = 0; i < shadowMaps.getCascadeCount(); i++) {
+		bool isStaticStale = !shadowMaps.isCached(i);
+		bool hasOverlayCasters = _overlayShadowLists[i].drawCount > 0;
+		bool isOverlayRendered = shadowMaps.setOverlayCasters(i, hasOverlayCasters);
+
+		for (bool isOverlay : { false, true }) {
+			if (isOverlay ? !isOverlayRendered : !isStaticStale)
+				continue;
+
+			const char *pName = ShadowMaps::getMapName(i, isOverlay);
+			RenderGraph::Resource map = shadowMaps.importMap(graph, i, isOverlay);
+
+			RenderGraph::Pass shadowPass = graph.addPass(pName, RenderGraph::PassType::Graphics,
+					[&, i, isOverlay, pName](vk::CommandBuffer commandBuffer) {
+						uint32_t scope = gpuProfiler.begin(commandBuffer, pName);
+
+						if (isOverlay)
+							drawShadows(commandBuffer, i, _overlayShadowLists[i],
+									rd.getShadowOverlayPipeline());
+						else
+							drawShadows(commandBuffer, i, _staticShadowLists[i],
+									rd.getShadowPipeline());
+
+						gpuProfiler.end(commandBuffer, scope);
+					});
+
+			graph.write(shadowPass, map, RenderGraph::ImageAccess::DepthAttachment,
+					vk::AttachmentLoadOp::eClear, depthClear);
 
-		for (const PrimitiveRD &primitive : mesh.primitives) {
-			MaterialRD material = _materials[primitive.material];
-			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 3,
-					material.textureSet, nullptr);
+			shadowMapResources[shadowMapCount++] = map;
 
-			commandBuffer.drawIndexed(primitive.indexCount, 1, primitive.firstIndex, 0, 0);
+			if (!isOverlay)
+				counters.shadowCascadeRenderCount++;
 		}
 	}
 
+	// after the overlay casters are known, the shader skips empty overlays
+	rd.updateUniformBuffer(_camera.transform[3]);
+
+	// Cull meshlets of the selected levels. Every primitive of a batch gets a draw, in the order
+	// all passes below iterate in.
+	ClusterCulling &clusterCulling = rd.getClusterCulling();
+
+	ClusterCulling::View cullView = {};
+	cullView.projView = projView;
+	cullView.position = glm::vec3(_camera.transform[3]);
+	cullView.previousProjView = _previousProjView;
+
+	_previousProjView = projView;
+
+	RenderGraph::Pass cullPass = graph.addPass(
+			"Cull", RenderGraph::PassType::Compute, [&](vk::CommandBuffer commandBuffer) {
+				uint32_t scope = gpuProfiler.begin(commandBuffer, "Cull");
+
+				clusterCulling.begin(commandBuffer, rd.getFrame(), drawCount, indexCount,
+						_instanceTransforms.data(), _instanceTransforms.size(), cullView);
+
+				for (const InstanceBatch &batch : _instanceBatches) {
+					const MeshRD &mesh = _meshes[batch.mesh];
+
+					for (const PrimitiveRD &primitive : mesh.primitives) {
+						uint32_t lod = glm::min(batch.lod, primitive.lodCount - 1);
+						const MeshletRange &meshlets = primitive.meshlets[lod];
+
+						clusterCulling.cull(commandBuffer, mesh.meshletSet, batch.firstInstance,
+								batch.instanceCount, meshlets.firstMeshlet,
+								meshlets.meshletCount, primitive.lods[lod].indexCount);
+					}
+				}
+
+				clusterCulling.end(commandBuffer);
+				gpuProfiler.end(commandBuffer, scope);
+			});
+
+	// draw lists are buffers the graph doesn't track
+	graph.setSideEffects(cullPass);
+
+	MeshPushConstants meshConstants{};
+	meshConstants.projView = projView;
+
+	vk::Buffer instanceBuffer = clusterCulling.getInstanceBuffer();
+	vk::DeviceSize instanceOffset = 0;
+
+	auto drawDepth = [&](vk::CommandBuffer commandBuffer, vk::Pipeline pipeline, bool isLate) {
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+		commandBuffer.bindIndexBuffer(clusterCulling.getIndexBuffer(), 0, vk::IndexType::eUint32);
+		commandBuffer.bindVertexBuffers(INSTANCE_BINDING, 1, &instanceBuffer, &instanceOffset);
+
+		commandBuffer.pushConstants(rd.getDepthPipelineLayout(), vk::ShaderStageFlagBits::eVertex,
+				0, sizeof(MeshPushConstants), &meshConstants);
+
+		counters.pipelineBindCount++;
+		counters.pushConstantBytes += sizeof(MeshPushConstants);
+
+		uint32_t drawIndex = 0;
+		ObjectID boundMesh = NULL_HANDLE;
+
+		for (const InstanceBatch &batch : _instanceBatches) {
+			const MeshRD &mesh = _meshes[batch.mesh];
+
+			// batches of a group follow each other
+			if (batch.mesh != boundMesh) {
+				vk::DeviceSize offset = 0;
+				commandBuffer.bindVertexBuffers(
+						POSITION_BINDING, 1, &mesh.positionBuffer.buffer, &offset);
+				boundMesh = batch.mesh;
+			}
+
+			for (size_t i = 0; i < mesh.primitives.size(); i++) {
+				clusterCulling.drawIndexed(commandBuffer, drawIndex, isLate);
+				counters.drawCount++;
+				drawIndex++;
+			}
+		}
+	};
+
+	// what the previous frame's depth showed, its depth becomes this frame's pyramid
+	RenderGraph::Pass earlyDepthPass = graph.addPass(
+			"Early depth", RenderGraph::PassType::Graphics, [&](vk::CommandBuffer commandBuffer) {
+				uint32_t scope = gpuProfiler.begin(commandBuffer, "Early depth");
+				drawDepth(commandBuffer, rd.getEarlyDepthPipeline(), false);
+				gpuProfiler.end(commandBuffer, scope);
+			});
+
+	graph.write(earlyDepthPass, depth, RenderGraph::ImageAccess::DepthAttachment,
+			vk::AttachmentLoadOp::eClear, depthClear);
+	graph.setRenderArea(earlyDepthPass, renderExtent);
+
+	RenderGraph::Pass pyramidPass = graph.addPass(
+			"Depth pyramid", RenderGraph::PassType::Compute, [&](vk::CommandBuffer commandBuffer) {
+				uint32_t scope = gpuProfiler.begin(commandBuffer, "Depth pyramid");
+				rd.getDepthPyramid().build(commandBuffer, renderExtent.width, renderExtent.height);
+				gpuProfiler.end(commandBuffer, scope);
+			});
+
+	graph.read(pyramidPass, depth, RenderGraph::ImageAccess::Sampled);
+	graph.setSideEffects(pyramidPass);
+
+	// what the early pass rejected but is not hidden by it
+	RenderGraph::Pass lateCullPass = graph.addPass(
+			"Late cull", RenderGraph::PassType::Compute, [&](vk::CommandBuffer commandBuffer) {
+				uint32_t scope = gpuProfiler.begin(commandBuffer, "Late cull");
+				clusterCulling.cullLate(commandBuffer);
+				clusterCulling.end(commandBuffer);
+				gpuProfiler.end(commandBuffer, scope);
+			});
+
+	graph.setSideEffects(lateCullPass);
+
+	auto drawMain = [&](vk::CommandBuffer commandBuffer) {
+		uint32_t scope = gpuProfiler.begin(commandBuffer, "Late depth");
+		drawDepth(commandBuffer, rd.getDepthPipeline(), true);
+		gpuProfiler.end(commandBuffer, scope);
+
+		{
+			// sky
+
+			scope = gpuProfiler.begin(commandBuffer, "Sky");
+
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, rd.getSkyPipeline());
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+					rd.getSkyPipelineLayout(), 0, rd.getSkySet(), nullptr);
+
+			SkyConstants constants{};
+			constants.invProj = invProj;
+			constants.invView = invView;
+
+			commandBuffer.pushConstants(rd.getSkyPipelineLayout(),
+					vk::ShaderStageFlagBits::eFragment, 0, sizeof(constants), &constants);
+			commandBuffer.draw(3, 1, 0, 0);
+
+			counters.pipelineBindCount++;
+			counters.descriptorSetBindCount++;
+			counters.pushConstantBytes += sizeof(constants);
+			counters.drawCount++;
+
+			gpuProfiler.end(commandBuffer, scope);
+		}
+
+		scope = gpuProfiler.begin(commandBuffer, "Material");
+
+		vk::PipelineLayout pipelineLayout = rd.getMaterialPipelineLayout();
+
+		// variants share the layout, sets stay bound across pipeline changes
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0,
+				rd.getMaterialSets(), nullptr);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 4,
+				shadowMaps.getSet(), nullptr);
+		commandBuffer.bindVertexBuffers(INSTANCE_BINDING, 1, &instanceBuffer, &instanceOffset);
+
+		commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0,
+				sizeof(MeshPushConstants), &meshConstants);
+
+		counters.descriptorSetBindCount += 2;
+		counters.pushConstantBytes += sizeof(MeshPushConstants);
+
+		uint32_t lightFeatures = rd.getMaterialLightFeatures();
+		vk::Pipeline boundPipeline = VK_NULL_HANDLE;
+
+		uint32_t drawIndex = 0;
+		ObjectID boundMesh = NULL_HANDLE;
+
+		for (const InstanceBatch &batch : _instanceBatches) {
+			const MeshRD &mesh = _meshes[batch.mesh];
+
+			if (batch.mesh != boundMesh) {
+				std::array<vk::Buffer, 2> vertexBuffers = {
+					mesh.positionBuffer.buffer,
+					mesh.attributeBuffer.buffer,
+				};
+				std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+
+				commandBuffer.bindVertexBuffers(POSITION_BINDING, vertexBuffers, offsets);
+				boundMesh = batch.mesh;
+			}
+
+			for (const PrimitiveRD &primitive : mesh.primitives) {
+				MaterialRD material = _materials[primitive.material];
+				vk::Pipeline pipeline = rd.getMaterialPipeline(material.features | lightFeatures);
+
+				if (pipeline != boundPipeline) {
+					commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+					boundPipeline = pipeline;
+					counters.pipelineBindCount++;
+				}
+
+				commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout,
+						3, material.textureSet, nullptr);
+
+				clusterCulling.drawIndexed(commandBuffer, drawIndex, false);
+				clusterCulling.drawIndexed(commandBuffer, drawIndex, true);
+				drawIndex++;
+
+				uint32_t lod = glm::min(batch.lod, primitive.lodCount - 1);
+				counters.triangleCount += primitive.lods[lod].indexCount / 3 * batch.instanceCount;
+				counters.descriptorSetBindCount++;
+				counters.drawCount += 2;
+			}
+		}
+
+		gpuProfiler.end(commandBuffer, scope);
+	};
+
+	// late depth is drawn first, sky and materials then only shade what is visible
+	RenderGraph::Pass mainPass = graph.addPass("Main", RenderGraph::PassType::Graphics, drawMain);
+
+	vk::ClearValue colorClear;
+	colorClear.color = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
+
+	graph.write(mainPass, color, RenderGraph::ImageAccess::ColorAttachment,
+			vk::AttachmentLoadOp::eClear, colorClear);
+	graph.write(mainPass, depth, RenderGraph::ImageAccess::DepthAttachment,
+			vk::AttachmentLoadOp::eLoad);
+	graph.setRenderArea(mainPass, renderExtent);
+
+	for (uint32_t i = 0; i < shadowMapCount; i++)
+		graph.read(mainPass, shadowMapResources[i], RenderGraph::ImageAccess::Sampled);
+
 	rd.drawEnd(commandBuffer);
+	_frameCount++;
+
+	if (_isStatsLogEnabled && ++_statsLogFrame == FRAME_STATS_WINDOW) {
+		_statsLogFrame = 0;
+
+		const FrameStats &stats = rd.getFrameStats();
+		const FrameCounters &min = stats.getMin();
+		const FrameCounters &avg = stats.getAvg();
+		const FrameCounters &max = stats.getMax();
+
+		// min/avg/max over the window
+		SDL_Log("Frame stats: draws %lu/%lu/%lu, triangles %lu/%lu/%lu, set binds %lu/%lu/%lu, "
+				"pipeline binds %lu/%lu/%lu, push constant bytes %lu/%lu/%lu, "
+				"upload bytes %lu/%lu/%lu, input latency us %lu/%lu/%lu, "
+				"render scale %% %lu/%lu/%lu, shadow cascade renders %lu/%lu/%lu, "
+				"upload queue depth %lu/%lu/%lu",
+				min.drawCount, avg.drawCount, max.drawCount, min.triangleCount, avg.triangleCount,
+				max.triangleCount, min.descriptorSetBindCount, avg.descriptorSetBindCount,
+				max.descriptorSetBindCount, min.pipelineBindCount, avg.pipelineBindCount,
+				max.pipelineBindCount, min.pushConstantBytes, avg.pushConstantBytes,
+				max.pushConstantBytes, min.uploadBytes, avg.uploadBytes, max.uploadBytes,
+				min.inputLatency, avg.inputLatency, max.inputLatency, min.renderScale,
+				avg.renderScale, max.renderScale, min.shadowCascadeRenderCount,
+				avg.shadowCascadeRenderCount, max.shadowCascadeRenderCount, min.uploadQueueDepth,
+				avg.uploadQueueDepth, max.uploadQueueDepth);
+
+		rd.getMemory().log();
+	}
+}
+
+void RS::inputBegin() {
+	RD &rd = RD::getSingleton();
+
+	// Events were pumped before this iteration, keyboard and mouse state is as old as the wait.
+	// Pumping again refreshes it, and the latency is measured from here.
+	if (_isLowLatency) {
+		rd.frameWait();
+		SDL_PumpEvents();
+	}
+
+	rd.inputSampled();
+}
+
+bool RS::isLowLatency() const {
+	return _isLowLatency;
+}
+
+const FrameStats &RS::getFrameStats() const {
+	return RD::getSingleton().getFrameStats();
 }
 
 vk::Instance RS::getVkInstance() const {
@@ -354,6 +1057,18 @@ void RS::windowInit(SDL_Window *pWindow) {
 	SDL_GetWindowSizeInPixels(pWindow, &width, &height);
 	rd.windowInit(surface, width, height);
 
+	_fallbacksCreate();
+}
+
+void RS::headlessInit(uint32_t width, uint32_t height) {
+	RD::getSingleton().windowInit(VK_NULL_HANDLE, width, height);
+
+	_fallbacksCreate();
+}
+
+void RS::_fallbacksCreate() {
+	RD &rd = RD::getSingleton();
+
 	{
 		std::vector<uint8_t> data = { 255, 255, 255, 255 };
 		std::shared_ptr<Image> albedo(new Image(1, 1, Image::Format::RGBA8, data));
@@ -381,19 +1096,110 @@ void RS::windowInit(SDL_Window *pWindow) {
 
 		_roughnessFallback = rd.textureCreate(roughness);
 	}
+
+	// materials sample them while their own textures upload
+	rd.uploadsFlush();
 }
 
 void RS::windowResized(uint32_t width, uint32_t height) {
 	RD::getSingleton().windowResize(width, height);
 }
 
-void RS::initialize(int argc, char **argv) {
+void RS::initialize(int argc, char **argv, bool headless) {
 	bool useValidation = false;
+	bool useMaterialVariants = true;
+	bool useFilteredSpecular = true;
+	bool compareSpecular = false;
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	vk::PresentModeKHR presentMode = vk::PresentModeKHR::eMailbox;
+
+	double targetFrameTime = 0.0;
+	float minRenderScale = 0.5f;
+	float maxRenderScale = 1.0f;
+
+	uint64_t textureBudget = 0;
+	uint64_t uploadBudget = DEFAULT_UPLOAD_BUDGET >> 20;
+	double uploadTime = DEFAULT_UPLOAD_TIME;
 
 	for (int i = 1; i < argc; i++) {
+		bool hasValue = i < argc - 1;
+
 		if (strcmp("--validation", argv[i]) == 0)
 			useValidation = true;
+
+		if (strcmp("--stats", argv[i]) == 0)
+			_isStatsLogEnabled = true;
+
+		if (strcmp("--low-latency", argv[i]) == 0)
+			_isLowLatency = true;
+
+		// every material shades with all features, the baseline material variants are measured to
+		if (strcmp("--no-material-variants", argv[i]) == 0)
+			useMaterialVariants = false;
+
+		// specular prefiltering samples the top level of the sky with the reference sample count
+		if (strcmp("--no-filtered-specular", argv[i]) == 0)
+			useFilteredSpecular = false;
+
+		// every environment bake also runs the reference filter and logs time and error
+		if (strcmp("--compare-specular", argv[i]) == 0)
+			compareSpecular = true;
+
+		// --frames-in-flight <1-3>
+		if (strcmp("--frames-in-flight", argv[i]) == 0 && hasValue)
+			framesInFlight = atoi(argv[i + 1]);
+
+		// --present-mode fifo|fifo-relaxed|mailbox|immediate
+		if (strcmp("--present-mode", argv[i]) == 0 && hasValue) {
+			const char *pMode = argv[i + 1];
+
+			if (strcmp("fifo", pMode) == 0)
+				presentMode = vk::PresentModeKHR::eFifo;
+			else if (strcmp("fifo-relaxed", pMode) == 0)
+				presentMode = vk::PresentModeKHR::eFifoRelaxed;
+			else if (strcmp("mailbox", pMode) == 0)
+				presentMode = vk::PresentModeKHR::eMailbox;
+			else if (strcmp("immediate", pMode) == 0)
+				presentMode = vk::PresentModeKHR::eImmediate;
+			else
+				SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Unknown present mode: %s", pMode);
+		}
+
+		// --dynamic-resolution <target GPU ms>
+		if (strcmp("--dynamic-resolution", argv[i]) == 0 && hasValue)
+			targetFrameTime = atof(argv[i + 1]);
+
+		// --render-scale-min <0-1>, --render-scale-max <0-1>
+		if (strcmp("--render-scale-min", argv[i]) == 0 && hasValue)
+			minRenderScale = atof(argv[i + 1]);
+
+		if (strcmp("--render-scale-max", argv[i]) == 0 && hasValue)
+			maxRenderScale = atof(argv[i + 1]);
+
+		// --texture-budget <MiB>, textures loaded past it drop their largest mip levels
+		if (strcmp("--texture-budget", argv[i]) == 0 && hasValue)
+			textureBudget = strtoull(argv[i + 1], nullptr, 10);
+
+		// --upload-budget <MiB>, --upload-time <ms>, staged per frame, 0 is unlimited
+		if (strcmp("--upload-budget", argv[i]) == 0 && hasValue)
+			uploadBudget = strtoull(argv[i + 1], nullptr, 10);
+
+		if (strcmp("--upload-time", argv[i]) == 0 && hasValue)
+			uploadTime = atof(argv[i + 1]);
 	}
 
-	RD::getSingleton().init(useValidation);
+	RD &rd = RD::getSingleton();
+
+	rd.init(useValidation, headless);
+	rd.setFramesInFlight(framesInFlight);
+	rd.setPresentMode(presentMode);
+	rd.setMaterialVariantsEnabled(useMaterialVariants);
+	rd.setSpecularFilter(useFilteredSpecular, compareSpecular);
+	rd.getMemory().setBudget(MemoryCategory::Textures, textureBudget << 20);
+	rd.setUploadBudget(uploadBudget << 20, uploadTime);
+
+	if (targetFrameTime > 0.0)
+		rd.setDynamicResolution(targetFrameTime, minRenderScale, maxRenderScale);
+	else
+		rd.setRenderScale(maxRenderScale);
 }
@@ -1,17 +1,23 @@
 #ifndef RENDERING_SERVER_H
 #define RENDERING_SERVER_H
 
+#include <array>
 #include <cstdint>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 #include <io/mesh.h>
 
+#include "effects/cluster_culling.h"
+#include "effects/shadow_maps.h"
 #include "object_owner.h"
 #include "storage/light_storage.h"
 
 #include "types/camera.h"
+#include "types/frame_stats.h"
 #include "types/resource.h"
 
 #define NULL_HANDLE 0
@@ -37,6 +43,19 @@ public:
 		ObjectID roughness;
 	};
 
+	// A mesh's primitives and levels packed into the shared streams meshCreate uploads.
+	struct MeshStreams {
+		std::vector<glm::vec3> positions;
+		std::vector<VertexAttribute> attributes;
+		std::vector<uint32_t> indices;
+		std::vector<PrimitiveRD> primitives;
+		std::vector<ClusterCulling::MeshletData> meshlets;
+
+		// bounding sphere in mesh space
+		glm::vec3 center;
+		float radius;
+	};
+
 private:
 	// fallbacks
 	TextureRD _albedoFallback;
@@ -50,6 +69,92 @@ private:
 	ObjectOwner<TextureRD> _textures;
 	ObjectOwner<MaterialRD> _materials;
 
+	// World matrices of mesh instances by slot, so batched updates index them directly.
+	// Map elements don't move on rehash, slots point back to their instances.
+	std::vector<glm::mat4> _transforms;
+	std::vector<MeshInstanceRD *> _slotInstances;
+	std::vector<uint32_t> _freeSlots;
+
+	// Resident instances sharing mesh and LOD, the ones in view also get a visible range.
+	struct InstanceGroup {
+		ObjectID mesh;
+		uint32_t lod;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		uint32_t firstVisible;
+		uint32_t visibleCount;
+	};
+
+	// Part of a group's visible range, each primitive of it is one culled draw.
+	struct InstanceBatch {
+		ObjectID mesh;
+		uint32_t lod;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	struct PendingMaterial {
+		ObjectID material;
+		MaterialInfo info;
+	};
+
+	// uploading, checked every frame until resident
+	std::vector<ObjectID> _pendingMeshes;
+	std::vector<PendingMaterial> _pendingMaterials;
+
+	// rebuilt every frame, kept to reuse allocations
+	std::vector<InstanceGroup> _instanceGroups;
+	std::unordered_map<uint64_t, uint32_t> _instanceGroupMap;
+	std::vector<uint32_t> _instanceGroupIndices;
+	std::vector<InstanceBatch> _instanceBatches;
+	// of the instances in view, in the order of the batches
+	std::vector<glm::mat4> _instanceTransforms;
+	// every resident instance, in the order of the groups
+	std::vector<const MeshInstanceRD *> _groupedInstances;
+
+	// Casters of one group into one shadow map, their transforms are contiguous.
+	struct ShadowDraw {
+		ObjectID mesh;
+		uint32_t lod;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	struct ShadowList {
+		uint32_t firstDraw;
+		uint32_t drawCount;
+	};
+
+	// rebuilt every frame, static lists only for cascades whose cache is stale
+	std::vector<ShadowDraw> _shadowDraws;
+	std::vector<glm::mat4> _shadowTransforms;
+	std::array<ShadowList, SHADOW_CASCADE_COUNT> _staticShadowLists = {};
+	std::array<ShadowList, SHADOW_CASCADE_COUNT> _overlayShadowLists = {};
+
+	uint64_t _frameCount = 0;
+
+	// view the last depth pyramid was built with
+	glm::mat4 _previousProjView = glm::mat4(1.0f);
+
+	// --stats, logs the frame stats and memory usage once per window
+	bool _isStatsLogEnabled = false;
+	uint32_t _statsLogFrame = 0;
+
+	// --low-latency, input is read after waiting for the frame's resources
+	bool _isLowLatency = false;
+
+	void _fallbacksCreate();
+
+	// Texture bits are set for the textures resident, the others are their fallbacks.
+	vk::DescriptorSet _materialSetCreate(const MaterialInfo &info, uint32_t &features);
+	bool _isMaterialResident(const MaterialInfo &info);
+	// Meshes and materials whose uploads completed are drawn as they are from this frame on.
+	void _uploadsUpdate();
+
+	// Drops cached shadows of a static instance's bounds as last drawn.
+	void _shadowsInvalidate(const MeshInstanceRD &meshInstance);
+	void _meshInstanceMoved(MeshInstanceRD &meshInstance);
+
 public:
 	RenderingServer(RenderingServer const &) = delete;
 	void operator=(RenderingServer const &) = delete;
@@ -59,12 +164,20 @@ public:
 	void cameraSetZNear(float zNear);
 	void cameraSetZFar(float zFar);
 
+	// Needs no device, streams are reused when passed again.
+	static void meshFlatten(const Mesh &mesh, MeshStreams &streams);
+
 	ObjectID meshCreate(const Mesh &mesh);
 	void meshFree(ObjectID mesh);
 
 	ObjectID meshInstanceCreate();
 	void meshInstanceSetMesh(ObjectID meshInstance, ObjectID mesh);
 	void meshInstanceSetTransform(ObjectID meshInstance, const glm::mat4 &transform);
+	// Stays the same until the instance is freed.
+	uint32_t meshInstanceGetTransformSlot(ObjectID meshInstance);
+	// Slot i takes pTransforms[pIndices[i]], so world matrices are read where they are stored.
+	void meshInstancesSetTransforms(const uint32_t *pSlots, const uint32_t *pIndices,
+			const glm::mat4 *pTransforms, uint32_t count);
 	void meshInstanceFree(ObjectID meshInstance);
 
 	ObjectID lightCreate(LightType type);
@@ -85,14 +198,29 @@ public:
 
 	void environmentSkyUpdate(const std::shared_ptr<Image> image);
 
+	// Uploads of meshes, textures and skies are spread over frames within the upload budget,
+	// meshes are drawn and textures sampled once resident. Blocks until everything queued is.
+	void uploadsFlush();
+
+	// Called before reading input for the next frame. In low latency mode it waits for the GPU
+	// first and pumps events after, so the input is as fresh as it can be when the frame is
+	// submitted.
+	void inputBegin();
+	bool isLowLatency() const;
+
 	void draw();
 
+	const FrameStats &getFrameStats() const;
+
 	vk::Instance getVkInstance() const;
 
 	void windowInit(SDL_Window *pWindow);
 	void windowResized(uint32_t width, uint32_t height);
 
-	void initialize(int argc, char **argv);
+	// Renders into offscreen images instead of a window, needs initialize() with headless set.
+	void headlessInit(uint32_t width, uint32_t height);
+
+	void initialize(int argc, char **argv, bool headless = false);
 };
 
 typedef RenderingServer RS;
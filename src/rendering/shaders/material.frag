@@ -13,16 +13,41 @@ layout(location = 4) in vec3 inBitangent;
 
 layout(location = 0) out vec4 outFragColor;
 
+#define SHADOW_CASCADE_COUNT 4
+
+// pipeline variants, RD specializes them per material textures and frame light counts
+layout(constant_id = 0) const bool HAS_NORMAL_MAP = true;
+layout(constant_id = 1) const bool HAS_METALLIC_MAP = true;
+layout(constant_id = 2) const bool HAS_ROUGHNESS_MAP = true;
+layout(constant_id = 3) const bool HAS_POINT_LIGHTS = true;
+layout(constant_id = 4) const int MAX_DIRECTIONAL_LIGHTS = 8;
+
+// values of the fallback textures bound in place of missing maps
+const float DEFAULT_METALLIC = 0.0;
+const float DEFAULT_ROUGHNESS = 127.0 / 255.0;
+
+// in texels of the cascade, along the surface normal and toward the light
+const float SHADOW_NORMAL_OFFSET = 1.5;
+const float SHADOW_LIGHT_OFFSET = 1.0;
+
 layout(set = 0, binding = 0) uniform UniformBufferObject {
 	vec3 viewPosition;
 
 	int directionalLightCount;
 	int pointLightCount;
+
+	int shadowCascadeCount;
+	uint shadowOverlayMask;
+
+	vec4 shadowTexelSizes;
+	mat4 shadowProjViews[SHADOW_CASCADE_COUNT];
+
+	// spherical harmonics of the sky's irradiance over pi, RGB
+	vec4 irradianceSH[9];
 };
 
-layout(set = 1, binding = 0) uniform samplerCube irradianceSampler;
-layout(set = 1, binding = 1) uniform samplerCube specularSampler;
-layout(set = 1, binding = 2) uniform sampler2D lutSampler;
+layout(set = 1, binding = 0) uniform samplerCube specularSampler;
+layout(set = 1, binding = 1) uniform sampler2D lutSampler;
 
 layout(set = 2, binding = 0) readonly buffer DirectionalLightSSBO {
 	DirectionalLight directionalLights[];
@@ -37,6 +62,10 @@ layout(set = 3, binding = 1) uniform sampler2D normalSampler;
 layout(set = 3, binding = 2) uniform sampler2D metallicSampler;
 layout(set = 3, binding = 3) uniform sampler2D roughnessSampler;
 
+// static casters cached between frames, dynamic ones rendered every frame
+layout(set = 4, binding = 0) uniform sampler2DShadow staticShadowMaps[SHADOW_CASCADE_COUNT];
+layout(set = 4, binding = 1) uniform sampler2DShadow overlayShadowMaps[SHADOW_CASCADE_COUNT];
+
 layout(early_fragment_tests) in;
 
 float distributionGGX(float nDotH, float roughness) {
@@ -89,13 +118,84 @@ vec3 cookTorranceBRDF(float nDotV, float nDotL, float nDotH, float cosTheta, vec
 	return (kD * albedo / PI + specular) * radiance * nDotL;
 }
 
+float sampleShadow(sampler2DShadow staticMap, sampler2DShadow overlayMap, bool hasOverlay, vec3 coord) {
+	float shadow = textureLod(staticMap, coord, 0.0);
+
+	if (hasOverlay)
+		shadow = min(shadow, textureLod(overlayMap, coord, 0.0));
+
+	return shadow;
+}
+
+// first cascade the position falls in, the smallest covering it
+float directionalShadow(vec3 lightDirection) {
+	vec3 normal = normalize(inNormal);
+
+	for (int i = 0; i < shadowCascadeCount; i++) {
+		float texelSize = shadowTexelSizes[i];
+		vec3 position = inPosition + normal * (texelSize * SHADOW_NORMAL_OFFSET);
+		position += lightDirection * (texelSize * SHADOW_LIGHT_OFFSET);
+
+		vec4 projected = shadowProjViews[i] * vec4(position, 1.0);
+		vec3 coord = vec3(projected.xy * 0.5 + 0.5, projected.z);
+
+		if (any(lessThan(coord.xy, vec2(0.0))) || any(greaterThan(coord.xy, vec2(1.0))))
+			continue;
+
+		bool hasOverlay = (shadowOverlayMask & (1u << i)) != 0u;
+
+		// sampler arrays take constant indices, the cascade varies per fragment
+		switch (i) {
+			case 0:
+				return sampleShadow(staticShadowMaps[0], overlayShadowMaps[0], hasOverlay, coord);
+			case 1:
+				return sampleShadow(staticShadowMaps[1], overlayShadowMaps[1], hasOverlay, coord);
+			case 2:
+				return sampleShadow(staticShadowMaps[2], overlayShadowMaps[2], hasOverlay, coord);
+			default:
+				return sampleShadow(staticShadowMaps[3], overlayShadowMaps[3], hasOverlay, coord);
+		}
+	}
+
+	return 1.0;
+}
+
+// same basis as spherical_harmonics.cpp, in the directions the sky cubemap is sampled with
+vec3 evaluateIrradiance(vec3 n) {
+	vec3 irradiance = irradianceSH[0].rgb * 0.282095;
+
+	irradiance += irradianceSH[1].rgb * (0.488603 * n.y);
+	irradiance += irradianceSH[2].rgb * (0.488603 * n.z);
+	irradiance += irradianceSH[3].rgb * (0.488603 * n.x);
+
+	irradiance += irradianceSH[4].rgb * (1.092548 * n.x * n.y);
+	irradiance += irradianceSH[5].rgb * (1.092548 * n.y * n.z);
+	irradiance += irradianceSH[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0));
+	irradiance += irradianceSH[7].rgb * (1.092548 * n.x * n.z);
+	irradiance += irradianceSH[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y));
+
+	// ringing around bright, small lights goes below zero opposite of them
+	return max(irradiance, vec3(0.0));
+}
+
 void main() {
 	vec3 albedo = sRGBToLinear(texture(albedoSampler, inUV).rgb);
-	float metallic = texture(metallicSampler, inUV).r;
-	float roughness = texture(roughnessSampler, inUV).r;
 
-	mat3 tbn = mat3(inTangent, inBitangent, inNormal);
-	vec3 normal = unpackNormal(texture(normalSampler, inUV).rg, tbn);
+	float metallic = DEFAULT_METALLIC;
+	if (HAS_METALLIC_MAP)
+		metallic = texture(metallicSampler, inUV).r;
+
+	float roughness = DEFAULT_ROUGHNESS;
+	if (HAS_ROUGHNESS_MAP)
+		roughness = texture(roughnessSampler, inUV).r;
+
+	vec3 normal = normalize(inNormal);
+
+	if (HAS_NORMAL_MAP) {
+		mat3 tbn = mat3(inTangent, inBitangent, inNormal);
+		normal = unpackNormal(texture(normalSampler, inUV).rg, tbn);
+	}
+
 	vec3 view = normalize(viewPosition - inPosition);
 
 	float nDotV = max(dot(normal, view), 0.0);
@@ -105,7 +205,10 @@ void main() {
 
 	vec3 lightValue = vec3(0.0);
 
-	for (int i = 0; i < directionalLightCount; i++) {
+	// a constant bound of one lets the compiler drop the loop
+	int directionalCount = min(directionalLightCount, MAX_DIRECTIONAL_LIGHTS);
+
+	for (int i = 0; i < directionalCount; i++) {
 		DirectionalLight light = directionalLights[i];
 
 		vec3 lightDirection = normalize(-light.direction);
@@ -117,10 +220,14 @@ void main() {
 
 		vec3 radiance = light.color * light.intensity;
 
+		// only the first directional light casts shadows
+		if (i == 0)
+			radiance *= directionalShadow(lightDirection);
+
 		lightValue += cookTorranceBRDF(nDotV, nDotL, nDotH, cosTheta, f0, roughness, metallic, albedo, radiance);
 	}
 
-	for (int i = 0; i < pointLightCount; i++) {
+	for (int i = 0; HAS_POINT_LIGHTS && i < pointLightCount; i++) {
 		PointLight light = pointLights[i];
 
 		vec3 lightDirection = normalize(light.position - inPosition);
@@ -143,7 +250,7 @@ void main() {
 	vec3 kD = vec3(1.0) - kS;
 	kD *= 1.0 - metallic;
 
-	vec3 irradiance = texture(irradianceSampler, normal).rgb;
+	vec3 irradiance = evaluateIrradiance(normal);
 	vec3 diffuse = irradiance * albedo;
 
 	const float MAX_REFLECTION_LOD = 4.0;
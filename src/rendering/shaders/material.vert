@@ -5,6 +5,8 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 inTangent;
 layout(location = 3) in vec2 inUV;
 
+layout(location = 4) in mat4 inModel;
+
 layout(location = 0) out vec3 outPosition;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec3 outTangent;
@@ -14,10 +16,10 @@ layout(location = 4) out vec3 outBitangent;
 
 layout(push_constant) uniform MeshPushConstants {
 	mat4 projView;
-	mat4 model;
 };
 
 void main() {
+	mat4 model = inModel;
 	vec4 vertPos4 = model * vec4(inPosition, 1.0);
 
 	vec3 T = normalize(vec3(model * vec4(inTangent, 0.0)));
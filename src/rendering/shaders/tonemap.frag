@@ -6,17 +6,50 @@
 
 layout(location = 0) out vec4 outFragColor;
 
-layout(set = 0, binding = 0, input_attachment_index = 0) uniform subpassInput inputColor;
+layout(set = 0, binding = 0) uniform sampler2D inputColor;
 
 layout(push_constant) uniform TonemapParameterConstants {
 	float exposure;
 	float white;
+	// rendered part of the color attachment, in attachment UV
+	vec2 uvScale;
+	vec2 texelSize;
+	vec2 outputSize;
+	float sharpness;
 };
 
 const float BLACK = 0.00017578;
 
 void main() {
-	vec3 color = subpassLoad(inputColor).rgb;
+	// bilinear upscale, kept half a texel inside what was rendered
+	vec2 minUV = texelSize * 0.5;
+	vec2 maxUV = uvScale - texelSize * 0.5;
+
+	vec2 uv = gl_FragCoord.xy / outputSize * uvScale;
+	uv = clamp(uv, minUV, maxUV);
+
+	vec3 color = texture(inputColor, uv).rgb;
+
+	// cross shaped unsharp mask, clamped to the neighbourhood so edges don't ring
+	if (sharpness > 0.0) {
+		// neighbours stay inside the rendered part too, past it are last frame's texels
+		vec2 leftUV = clamp(uv - vec2(texelSize.x, 0.0), minUV, maxUV);
+		vec2 rightUV = clamp(uv + vec2(texelSize.x, 0.0), minUV, maxUV);
+		vec2 upUV = clamp(uv - vec2(0.0, texelSize.y), minUV, maxUV);
+		vec2 downUV = clamp(uv + vec2(0.0, texelSize.y), minUV, maxUV);
+
+		vec3 left = texture(inputColor, leftUV).rgb;
+		vec3 right = texture(inputColor, rightUV).rgb;
+		vec3 up = texture(inputColor, upUV).rgb;
+		vec3 down = texture(inputColor, downUV).rgb;
+
+		vec3 minColor = min(min(min(left, right), min(up, down)), color);
+		vec3 maxColor = max(max(max(left, right), max(up, down)), color);
+
+		vec3 blurred = (left + right + up + down) * 0.25;
+		color = clamp(color + (color - blurred) * sharpness, minColor, maxColor);
+	}
+
 	color *= exposure;
 
 	color = agx(color, white, BLACK);
@@ -0,0 +1,165 @@
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define USE_SSE
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "spherical_harmonics.h"
+
+// real basis constants, irradiance_sh.comp and material.frag use the same
+const float SH_BAND_0 = 0.282095f;
+const float SH_BAND_1 = 0.488603f;
+const float SH_BAND_2 = 1.092548f;
+const float SH_BAND_2_ZZ = 0.315392f;
+const float SH_BAND_2_XX_YY = 0.546274f;
+
+static void _basis(const glm::vec3 &direction, float *pBasis) {
+	float x = direction.x;
+	float y = direction.y;
+	float z = direction.z;
+
+	pBasis[0] = SH_BAND_0;
+	pBasis[1] = SH_BAND_1 * y;
+	pBasis[2] = SH_BAND_1 * z;
+	pBasis[3] = SH_BAND_1 * x;
+	pBasis[4] = SH_BAND_2 * x * y;
+	pBasis[5] = SH_BAND_2 * y * z;
+	pBasis[6] = SH_BAND_2_ZZ * (3.0f * z * z - 1.0f);
+	pBasis[7] = SH_BAND_2 * x * z;
+	pBasis[8] = SH_BAND_2_XX_YY * (x * x - y * y);
+}
+
+IrradianceSH irradianceProject(const float *pData, uint32_t width, uint32_t height) {
+	const float PI = glm::pi<float>();
+
+	// Texels are sampled from the sky cubemap in the direction
+	// (-cos(lat) sin(lon), -sin(lat), cos(lat) cos(lon)), see cubemap.comp.
+	std::vector<float> sinLongitudes(width);
+	std::vector<float> cosLongitudes(width);
+
+	for (uint32_t x = 0; x < width; x++) {
+		float longitude = ((x + 0.5f) / width - 0.5f) * 2.0f * PI;
+		sinLongitudes[x] = std::sin(longitude);
+		cosLongitudes[x] = std::cos(longitude);
+	}
+
+	// rows are summed in float, the rows' sums in double
+	double sums[SH_COEFFICIENT_COUNT][3] = {};
+
+	for (uint32_t y = 0; y < height; y++) {
+		float latitude = ((y + 0.5f) / height - 0.5f) * PI;
+		float sinLatitude = std::sin(latitude);
+		float cosLatitude = std::cos(latitude);
+
+		// solid angle of every texel in the row
+		double weight = cosLatitude * (2.0 * PI / width) * (PI / height);
+
+		const float *pRow = pData + static_cast<size_t>(y) * width * 4;
+		float rowSums[SH_COEFFICIENT_COUNT][3] = {};
+		uint32_t x = 0;
+
+#ifdef USE_SSE
+		__m128 accumulators[SH_COEFFICIENT_COUNT][3];
+
+		for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+			for (uint32_t channel = 0; channel < 3; channel++)
+				accumulators[i][channel] = _mm_setzero_ps();
+		}
+
+		__m128 negCosLatitude = _mm_set1_ps(-cosLatitude);
+		__m128 posCosLatitude = _mm_set1_ps(cosLatitude);
+		__m128 directionY = _mm_set1_ps(-sinLatitude);
+
+		for (; x + 4 <= width; x += 4) {
+			// four RGBA texels transposed into channels of four
+			__m128 r = _mm_loadu_ps(pRow + x * 4 + 0);
+			__m128 g = _mm_loadu_ps(pRow + x * 4 + 4);
+			__m128 b = _mm_loadu_ps(pRow + x * 4 + 8);
+			__m128 a = _mm_loadu_ps(pRow + x * 4 + 12);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+
+			__m128 directionX = _mm_mul_ps(negCosLatitude, _mm_loadu_ps(&sinLongitudes[x]));
+			__m128 directionZ = _mm_mul_ps(posCosLatitude, _mm_loadu_ps(&cosLongitudes[x]));
+
+			__m128 xx = _mm_mul_ps(directionX, directionX);
+			__m128 yy = _mm_mul_ps(directionY, directionY);
+			__m128 zz = _mm_mul_ps(directionZ, directionZ);
+
+			__m128 basis[SH_COEFFICIENT_COUNT];
+			basis[0] = _mm_set1_ps(SH_BAND_0);
+			basis[1] = _mm_mul_ps(_mm_set1_ps(SH_BAND_1), directionY);
+			basis[2] = _mm_mul_ps(_mm_set1_ps(SH_BAND_1), directionZ);
+			basis[3] = _mm_mul_ps(_mm_set1_ps(SH_BAND_1), directionX);
+			basis[4] = _mm_mul_ps(_mm_set1_ps(SH_BAND_2), _mm_mul_ps(directionX, directionY));
+			basis[5] = _mm_mul_ps(_mm_set1_ps(SH_BAND_2), _mm_mul_ps(directionY, directionZ));
+			basis[6] = _mm_mul_ps(_mm_set1_ps(SH_BAND_2_ZZ),
+					_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), zz), _mm_set1_ps(1.0f)));
+			basis[7] = _mm_mul_ps(_mm_set1_ps(SH_BAND_2), _mm_mul_ps(directionX, directionZ));
+			basis[8] = _mm_mul_ps(_mm_set1_ps(SH_BAND_2_XX_YY), _mm_sub_ps(xx, yy));
+
+			for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+				accumulators[i][0] = _mm_add_ps(accumulators[i][0], _mm_mul_ps(basis[i], r));
+				accumulators[i][1] = _mm_add_ps(accumulators[i][1], _mm_mul_ps(basis[i], g));
+				accumulators[i][2] = _mm_add_ps(accumulators[i][2], _mm_mul_ps(basis[i], b));
+			}
+		}
+
+		for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+			for (uint32_t channel = 0; channel < 3; channel++) {
+				float lanes[4];
+				_mm_storeu_ps(lanes, accumulators[i][channel]);
+				rowSums[i][channel] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			}
+		}
+#endif
+
+		// what is left of the row, all of it without SSE
+		for (; x < width; x++) {
+			glm::vec3 direction = glm::vec3(-cosLatitude * sinLongitudes[x], -sinLatitude,
+					cosLatitude * cosLongitudes[x]);
+
+			float basis[SH_COEFFICIENT_COUNT];
+			_basis(direction, basis);
+
+			const float *pTexel = pRow + x * 4;
+
+			for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+				for (uint32_t channel = 0; channel < 3; channel++)
+					rowSums[i][channel] += basis[i] * pTexel[channel];
+			}
+		}
+
+		for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+			for (uint32_t channel = 0; channel < 3; channel++)
+				sums[i][channel] += rowSums[i][channel] * weight;
+		}
+	}
+
+	IrradianceSH irradiance;
+
+	for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+		glm::vec3 coefficient = glm::vec3(sums[i][0], sums[i][1], sums[i][2]);
+		irradiance[i] = glm::vec4(coefficient * SH_IRRADIANCE_SCALES[i], 0.0f);
+	}
+
+	return irradiance;
+}
+
+glm::vec3 irradianceEvaluate(const IrradianceSH &irradiance, const glm::vec3 &normal) {
+	float basis[SH_COEFFICIENT_COUNT];
+	_basis(normal, basis);
+
+	glm::vec3 value = glm::vec3(0.0f);
+
+	for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		value += glm::vec3(irradiance[i]) * basis[i];
+
+	// ringing around bright, small lights goes below zero opposite of them
+	return glm::max(value, glm::vec3(0.0f));
+}
@@ -0,0 +1,35 @@
+#ifndef SPHERICAL_HARMONICS_H
+#define SPHERICAL_HARMONICS_H
+
+#include <array>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+const uint32_t SH_COEFFICIENT_COUNT = 9;
+
+// Cosine lobe convolution of each band over pi, turns radiance coefficients into irradiance ones.
+const float SH_IRRADIANCE_SCALES[SH_COEFFICIENT_COUNT] = {
+	1.0f,
+	2.0f / 3.0f,
+	2.0f / 3.0f,
+	2.0f / 3.0f,
+	0.25f,
+	0.25f,
+	0.25f,
+	0.25f,
+	0.25f,
+};
+
+// Irradiance of a sky as its first three bands of spherical harmonics, over pi like the irradiance
+// cubemap it replaces, so diffuse light is the evaluation times albedo. RGB with a padding channel
+// for std140, material.frag evaluates it in the directions the sky cubemap is sampled with.
+typedef std::array<glm::vec4, SH_COEFFICIENT_COUNT> IrradianceSH;
+
+// Projects an equirectangular RGBA32F sky on the CPU, four texels at a time where SSE is there.
+// For offline use, the environment bake projects on the GPU.
+IrradianceSH irradianceProject(const float *pData, uint32_t width, uint32_t height);
+
+glm::vec3 irradianceEvaluate(const IrradianceSH &irradiance, const glm::vec3 &normal);
+
+#endif // !SPHERICAL_HARMONICS_H
@@ -0,0 +1,111 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <profiler.h>
+
+#include "light_storage.h"
+
+vk::DescriptorSetLayout LightStorage::getLightSetLayout() const {
+	return _lightSetLayout;
+}
+
+vk::DescriptorSet LightStorage::getLightSet() const {
+	return _lightSet;
+}
+
+void LightStorage::initialize(
+		vk::Device device, GpuMemory *pMemory, vk::DescriptorPool descriptorPool) {
+	if (_initialized)
+		return;
+
+	std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].setBinding(0);
+	bindings[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	bindings[0].setDescriptorCount(1);
+	bindings[0].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+	bindings[1].setBinding(1);
+	bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	bindings[1].setDescriptorCount(1);
+	bindings[1].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+	vk::DescriptorSetLayoutCreateInfo createInfo = {};
+	createInfo.setBindings(bindings);
+
+	vk::Result err = device.createDescriptorSetLayout(&createInfo, nullptr, &_lightSetLayout);
+
+	if (err != vk::Result::eSuccess)
+		throw std::runtime_error("Light descriptor set layout creation failed!");
+
+	vk::DescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.setDescriptorPool(descriptorPool);
+	allocInfo.setDescriptorSetCount(1);
+	allocInfo.setSetLayouts(_lightSetLayout);
+
+	err = device.allocateDescriptorSets(&allocInfo, &_lightSet);
+
+	if (err != vk::Result::eSuccess)
+		throw std::runtime_error("Light descriptor set allocation failed!");
+
+	vk::BufferUsageFlags usage =
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+
+	{
+		vk::DeviceSize size = sizeof(DirectionalData) * MAX_DIRECTIONAL_LIGHT_COUNT;
+		_directionalBuffer = AllocatedBuffer::create(
+				pMemory, MemoryCategory::Frame, usage, size, &_directionalAllocInfo);
+	}
+
+	{
+		vk::DeviceSize size = sizeof(PunctualData) * MAX_POINT_LIGHT_COUNT;
+		_pointBuffer = AllocatedBuffer::create(
+				pMemory, MemoryCategory::Frame, usage, size, &_pointAllocInfo);
+	}
+
+	vk::DescriptorBufferInfo directionalLightBufferInfo = _directionalBuffer.getBufferInfo();
+	vk::DescriptorBufferInfo pointLightBufferInfo = _pointBuffer.getBufferInfo();
+
+	std::array<vk::WriteDescriptorSet, 2> writeInfos = {};
+	writeInfos[0].setDstSet(_lightSet);
+	writeInfos[0].setDstBinding(0);
+	writeInfos[0].setDstArrayElement(0);
+	writeInfos[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[0].setDescriptorCount(1);
+	writeInfos[0].setBufferInfo(directionalLightBufferInfo);
+
+	writeInfos[1].setDstSet(_lightSet);
+	writeInfos[1].setDstBinding(1);
+	writeInfos[1].setDstArrayElement(0);
+	writeInfos[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+	writeInfos[1].setDescriptorCount(1);
+	writeInfos[1].setBufferInfo(pointLightBufferInfo);
+
+	device.updateDescriptorSets(writeInfos, nullptr);
+}
+
+size_t LightStorage::update() {
+	PROFILE_SCOPE("LightStorage::update");
+
+	pack();
+
+	size_t writtenSize = 0;
+
+	{
+		void *pDiretionalLightData = _directionalAllocInfo.pMappedData;
+		size_t size = sizeof(DirectionalData) * MAX_DIRECTIONAL_LIGHT_COUNT;
+		memcpy(pDiretionalLightData, _directionalData.data(), size);
+		writtenSize += size;
+	}
+
+	{
+		void *pPointLightData = _pointAllocInfo.pMappedData;
+		size_t size = sizeof(PunctualData) * MAX_POINT_LIGHT_COUNT;
+		memcpy(pPointLightData, _pointData.data(), size);
+		writtenSize += size;
+	}
+
+	return writtenSize;
+}
@@ -0,0 +1,10 @@
+#ifndef LIGHT_LIMITS_H
+#define LIGHT_LIMITS_H
+
+#include <cstdint>
+
+// Sizes of the light buffers, apart from LightStorage so tools can use them without Vulkan.
+const uint32_t MAX_DIRECTIONAL_LIGHT_COUNT = 8;
+const uint32_t MAX_POINT_LIGHT_COUNT = 2048;
+
+#endif // !LIGHT_LIMITS_H
@@ -2,7 +2,6 @@
 #include <cstdint>
 #include <cstring>
 #include <iostream>
-#include <stdexcept>
 #include <vector>
 
 #include "light_storage.h"
@@ -68,89 +67,26 @@ uint32_t LightStorage::getPointLightCount() {
 	return count;
 }
 
-vk::DescriptorSetLayout LightStorage::getLightSetLayout() const {
-	return _lightSetLayout;
-}
-
-vk::DescriptorSet LightStorage::getLightSet() const {
-	return _lightSet;
-}
-
-void LightStorage::initialize(
-		vk::Device device, VmaAllocator allocator, vk::DescriptorPool descriptorPool) {
-	if (_initialized)
-		return;
-
-	std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {};
-	bindings[0].setBinding(0);
-	bindings[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-	bindings[0].setDescriptorCount(1);
-	bindings[0].setStageFlags(vk::ShaderStageFlagBits::eFragment);
-
-	bindings[1].setBinding(1);
-	bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-	bindings[1].setDescriptorCount(1);
-	bindings[1].setStageFlags(vk::ShaderStageFlagBits::eFragment);
-
-	vk::DescriptorSetLayoutCreateInfo createInfo = {};
-	createInfo.setBindings(bindings);
-
-	vk::Result err = device.createDescriptorSetLayout(&createInfo, nullptr, &_lightSetLayout);
-
-	if (err != vk::Result::eSuccess)
-		throw std::runtime_error("Light descriptor set layout creation failed!");
-
-	vk::DescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.setDescriptorPool(descriptorPool);
-	allocInfo.setDescriptorSetCount(1);
-	allocInfo.setSetLayouts(_lightSetLayout);
-
-	err = device.allocateDescriptorSets(&allocInfo, &_lightSet);
-
-	if (err != vk::Result::eSuccess)
-		throw std::runtime_error("Light descriptor set allocation failed!");
-
-	vk::BufferUsageFlags usage =
-			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
-
-	{
-		vk::DeviceSize size = sizeof(DirectionalData) * MAX_DIRECTIONAL_LIGHT_COUNT;
-		_directionalBuffer =
-				AllocatedBuffer::create(allocator, usage, size, &_directionalAllocInfo);
-	}
+bool LightStorage::getShadowLightDirection(glm::vec3 &direction) {
+	// same order as pack()
+	for (const auto &[_, light] : _lights.map()) {
+		if (light.type != LightType::Directional)
+			continue;
 
-	{
-		vk::DeviceSize size = sizeof(PunctualData) * MAX_POINT_LIGHT_COUNT;
-		_pointBuffer = AllocatedBuffer::create(allocator, usage, size, &_pointAllocInfo);
+		direction = glm::mat3(light.transform) * glm::vec3(0.0, 0.0, -1.0);
+		return true;
 	}
 
-	vk::DescriptorBufferInfo directionalLightBufferInfo = _directionalBuffer.getBufferInfo();
-	vk::DescriptorBufferInfo pointLightBufferInfo = _pointBuffer.getBufferInfo();
-
-	std::array<vk::WriteDescriptorSet, 2> writeInfos = {};
-	writeInfos[0].setDstSet(_lightSet);
-	writeInfos[0].setDstBinding(0);
-	writeInfos[0].setDstArrayElement(0);
-	writeInfos[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-	writeInfos[0].setDescriptorCount(1);
-	writeInfos[0].setBufferInfo(directionalLightBufferInfo);
-
-	writeInfos[1].setDstSet(_lightSet);
-	writeInfos[1].setDstBinding(1);
-	writeInfos[1].setDstArrayElement(0);
-	writeInfos[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-	writeInfos[1].setDescriptorCount(1);
-	writeInfos[1].setBufferInfo(pointLightBufferInfo);
-
-	device.updateDescriptorSets(writeInfos, nullptr);
+	return false;
 }
 
-void LightStorage::update() {
-	uint32_t directionalLightIndex = 0;
-	std::vector<DirectionalData> directionalLightData(MAX_DIRECTIONAL_LIGHT_COUNT);
+void LightStorage::pack() {
+	// slots past the light counts are never read
+	_directionalData.resize(MAX_DIRECTIONAL_LIGHT_COUNT);
+	_pointData.resize(MAX_POINT_LIGHT_COUNT);
 
+	uint32_t directionalLightIndex = 0;
 	uint32_t pointLightIndex = 0;
-	std::vector<PunctualData> pointLightData(MAX_POINT_LIGHT_COUNT);
 
 	for (const auto &[_, light] : _lights.map()) {
 		if (light.type == LightType::Directional) {
@@ -162,7 +98,7 @@ void LightStorage::update() {
 			memcpy(data.color, &light.color, sizeof(data.color));
 			data.intensity = light.intensity;
 
-			directionalLightData[directionalLightIndex] = data;
+			_directionalData[directionalLightIndex] = data;
 			directionalLightIndex++;
 			continue;
 		}
@@ -175,21 +111,9 @@ void LightStorage::update() {
 			memcpy(data.color, &light.color, sizeof(data.color));
 			data.intensity = light.intensity;
 
-			pointLightData[pointLightIndex] = data;
+			_pointData[pointLightIndex] = data;
 			pointLightIndex++;
 			continue;
 		}
 	}
-
-	{
-		void *pDiretionalLightData = _directionalAllocInfo.pMappedData;
-		size_t size = sizeof(DirectionalData) * MAX_DIRECTIONAL_LIGHT_COUNT;
-		memcpy(pDiretionalLightData, directionalLightData.data(), size);
-	}
-
-	{
-		void *pPointLightData = _pointAllocInfo.pMappedData;
-		size_t size = sizeof(PunctualData) * MAX_POINT_LIGHT_COUNT;
-		memcpy(pPointLightData, pointLightData.data(), size);
-	}
 }
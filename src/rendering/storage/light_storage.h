@@ -1,13 +1,14 @@
 #ifndef LIGHT_STORAGE_H
 #define LIGHT_STORAGE_H
 
+#include <vector>
+
 #include <glm/glm.hpp>
 
 #include <rendering/object_owner.h>
 #include <rendering/types/allocated.h>
 
-const uint32_t MAX_DIRECTIONAL_LIGHT_COUNT = 8;
-const uint32_t MAX_POINT_LIGHT_COUNT = 2048;
+#include "light_limits.h"
 
 enum class LightType {
 	Directional,
@@ -45,6 +46,10 @@ class LightStorage {
 
 	ObjectOwner<LightRD> _lights;
 
+	// packed by pack(), kept to reuse allocations
+	std::vector<DirectionalData> _directionalData;
+	std::vector<PunctualData> _pointData;
+
 	AllocatedBuffer _directionalBuffer;
 	VmaAllocationInfo _directionalAllocInfo;
 
@@ -67,11 +72,20 @@ public:
 	uint32_t getDirectionalLightCount();
 	uint32_t getPointLightCount();
 
+	// Direction of the directional light packed first, the one casting shadows. False when there
+	// is no directional light.
+	bool getShadowLightDirection(glm::vec3 &direction);
+
 	vk::DescriptorSetLayout getLightSetLayout() const;
 	vk::DescriptorSet getLightSet() const;
 
-	void initialize(vk::Device device, VmaAllocator allocator, vk::DescriptorPool descriptorPool);
-	void update();
+	void initialize(vk::Device device, GpuMemory *pMemory, vk::DescriptorPool descriptorPool);
+
+	// Packs all lights into the layout of the light buffers, needs no device.
+	void pack();
+
+	// Packs and writes all lights into the light buffers, returns the number of bytes written.
+	size_t update();
 };
 
 #endif // !LIGHT_STORAGE_H
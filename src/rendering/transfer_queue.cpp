@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <SDL3/SDL_log.h>
+#include <SDL3/SDL_timer.h>
+
+#include <rendering/rendering_device.h>
+
+#include "transfer_queue.h"
+
+// what frames read uploaded buffers as, vertex and index streams or storage
+const vk::AccessFlags BUFFER_READ_ACCESS = vk::AccessFlagBits::eVertexAttributeRead |
+		vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eShaderRead;
+
+bool TransferQueue::_isDedicated() const {
+	return _queueFamily != _graphicsQueueFamily;
+}
+
+uint64_t TransferQueue::_ticketCreate() {
+	uint64_t ticket = ++_ticketCount;
+	_unresident.insert(ticket);
+	return ticket;
+}
+
+AllocatedBuffer TransferQueue::_stagingCreate(Batch &batch, const std::vector<uint8_t> &data) {
+	RD &rd = RD::getSingleton();
+
+	VmaAllocationInfo allocInfo;
+	AllocatedBuffer stagingBuffer = rd.bufferCreate(MemoryCategory::Staging,
+			vk::BufferUsageFlagBits::eTransferSrc, data.size(), &allocInfo);
+
+	memcpy(allocInfo.pMappedData, data.data(), data.size());
+	vmaFlushAllocation(rd.getMemory().getAllocator(), stagingBuffer.allocation, 0, VK_WHOLE_SIZE);
+
+	batch.stagingBuffers.push_back(stagingBuffer);
+	return stagingBuffer;
+}
+
+void TransferQueue::_bufferRecord(Batch &batch, const Request &request) {
+	AllocatedBuffer stagingBuffer = _stagingCreate(batch, request.data);
+
+	vk::BufferCopy region;
+	region.setSrcOffset(0);
+	region.setDstOffset(0);
+	region.setSize(request.data.size());
+
+	batch.commandBuffer.copyBuffer(stagingBuffer.buffer, request.buffer, region);
+
+	// on one family the semaphore wait alone makes the copy visible
+	if (!_isDedicated())
+		return;
+
+	vk::BufferMemoryBarrier barrier;
+	barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+	barrier.setSrcQueueFamilyIndex(_queueFamily);
+	barrier.setDstQueueFamilyIndex(_graphicsQueueFamily);
+	barrier.setBuffer(request.buffer);
+	barrier.setOffset(0);
+	barrier.setSize(VK_WHOLE_SIZE);
+
+	// release, the acquire in the frame is the one that waits
+	batch.commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, barrier, nullptr);
+
+	barrier.setSrcAccessMask({});
+	barrier.setDstAccessMask(BUFFER_READ_ACCESS);
+	batch.bufferAcquires.push_back(barrier);
+}
+
+void TransferQueue::_imageRecord(Batch &batch, const Request &request) {
+	AllocatedBuffer stagingBuffer = _stagingCreate(batch, request.data);
+
+	vk::ImageSubresourceRange subresourceRange;
+	subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+	subresourceRange.setBaseMipLevel(0);
+	subresourceRange.setLevelCount(request.mipLevels);
+	subresourceRange.setBaseArrayLayer(0);
+	subresourceRange.setLayerCount(1);
+
+	vk::ImageMemoryBarrier barrier;
+	barrier.setOldLayout(vk::ImageLayout::eUndefined);
+	barrier.setNewLayout(vk::ImageLayout::eTransferDstOptimal);
+	barrier.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+	barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+	barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+	barrier.setImage(request.image);
+	barrier.setSubresourceRange(subresourceRange);
+
+	batch.commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+			vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+	vk::ImageSubresourceLayers imageSubresource;
+	imageSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
+	imageSubresource.setMipLevel(0);
+	imageSubresource.setBaseArrayLayer(0);
+	imageSubresource.setLayerCount(1);
+
+	vk::BufferImageCopy region;
+	region.setImageSubresource(imageSubresource);
+	region.setImageExtent(vk::Extent3D{ request.width, request.height, 1 });
+
+	batch.commandBuffer.copyBufferToImage(
+			stagingBuffer.buffer, request.image, vk::ImageLayout::eTransferDstOptimal, region);
+
+	batch.imageUploads.push_back(
+			{ request.image, request.width, request.height, request.mipLevels });
+
+	if (!_isDedicated())
+		return;
+
+	// the layout is kept, mip generation in the frame starts from transfer destination
+	barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+	barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+	barrier.setDstAccessMask({});
+	barrier.setSrcQueueFamilyIndex(_queueFamily);
+	barrier.setDstQueueFamilyIndex(_graphicsQueueFamily);
+
+	batch.commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, barrier);
+}
+
+void TransferQueue::_schedule(bool isBudgeted) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	bool hasTimeBudget = _timeBudget > 0.0;
+
+	// rounded up, a budget shorter than a tick is as tight as it gets rather than unlimited
+	uint64_t timeBudget = static_cast<uint64_t>(
+			std::ceil(_timeBudget * SDL_GetPerformanceFrequency() / 1000.0));
+	timeBudget = std::max<uint64_t>(timeBudget, 1);
+
+	Batch batch = {};
+
+	for (std::deque<Request> &requests : _requests) {
+		while (!requests.empty()) {
+			const Request &request = requests.front();
+			size_t size = request.data.size();
+
+			// the first request of a frame always goes, one over the budget would never otherwise
+			if (isBudgeted && !batch.tickets.empty()) {
+				bool isOverBytes = _budget != 0 && _frameBytes + size > _budget;
+				bool isOverTime =
+						hasTimeBudget && SDL_GetPerformanceCounter() - start >= timeBudget;
+
+				if (isOverBytes || isOverTime)
+					break;
+			}
+
+			if (!batch.commandBuffer) {
+				vk::CommandBufferAllocateInfo allocInfo;
+				allocInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+				allocInfo.setCommandPool(_commandPool);
+				allocInfo.setCommandBufferCount(1);
+
+				batch.commandBuffer = _device.allocateCommandBuffers(allocInfo)[0];
+
+				vk::CommandBufferBeginInfo beginInfo = {
+					vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+				};
+				batch.commandBuffer.begin(beginInfo);
+			}
+
+			if (request.buffer)
+				_bufferRecord(batch, request);
+			else
+				_imageRecord(batch, request);
+
+			batch.tickets.push_back(request.ticket);
+			_frameBytes += size;
+
+			requests.pop_front();
+		}
+
+		// lower priorities wait while a higher one is left over
+		if (!requests.empty())
+			break;
+	}
+
+	if (!batch.commandBuffer)
+		return;
+
+	batch.commandBuffer.end();
+	batch.value = ++_submitCount;
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.setSignalSemaphoreValues(batch.value);
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.setCommandBuffers(batch.commandBuffer);
+	submitInfo.setSignalSemaphores(_semaphore);
+	submitInfo.setPNext(&timelineInfo);
+
+	_queue.submit(submitInfo, VK_NULL_HANDLE);
+
+	_batches.push_back(std::move(batch));
+}
+
+void TransferQueue::_collect() {
+	if (_batches.empty())
+		return;
+
+	uint64_t completed = _device.getSemaphoreCounterValue(_semaphore);
+	RD &rd = RD::getSingleton();
+
+	size_t kept = 0;
+
+	for (size_t i = 0; i < _batches.size(); i++) {
+		Batch &batch = _batches[i];
+
+		if (batch.value > completed) {
+			if (kept != i)
+				_batches[kept] = std::move(batch);
+
+			kept++;
+			continue;
+		}
+
+		for (const AllocatedBuffer &stagingBuffer : batch.stagingBuffers)
+			rd.bufferDestroy(stagingBuffer);
+
+		_device.freeCommandBuffers(_commandPool, batch.commandBuffer);
+
+		_bufferAcquires.insert(
+				_bufferAcquires.end(), batch.bufferAcquires.begin(), batch.bufferAcquires.end());
+		_imageUploads.insert(
+				_imageUploads.end(), batch.imageUploads.begin(), batch.imageUploads.end());
+
+		for (uint64_t ticket : batch.tickets)
+			_unresident.erase(ticket);
+
+		_waitValue = std::max(_waitValue, batch.value);
+	}
+
+	_batches.resize(kept);
+}
+
+uint64_t TransferQueue::bufferUpload(
+		vk::Buffer buffer, const void *pData, size_t size, UploadPriority priority) {
+	const uint8_t *pBytes = static_cast<const uint8_t *>(pData);
+
+	uint64_t ticket = _ticketCreate();
+
+	Request request = {};
+	request.ticket = ticket;
+	request.buffer = buffer;
+	request.data.assign(pBytes, pBytes + size);
+
+	_requests[static_cast<uint32_t>(priority)].push_back(std::move(request));
+	return ticket;
+}
+
+uint64_t TransferQueue::imageUpload(vk::Image image, uint32_t width, uint32_t height,
+		uint32_t mipLevels, std::vector<uint8_t> data, UploadPriority priority) {
+	uint64_t ticket = _ticketCreate();
+
+	Request request = {};
+	request.ticket = ticket;
+	request.image = image;
+	request.width = width;
+	request.height = height;
+	request.mipLevels = mipLevels;
+	request.data = std::move(data);
+
+	_requests[static_cast<uint32_t>(priority)].push_back(std::move(request));
+	return ticket;
+}
+
+void TransferQueue::update() {
+	_frameBytes = 0;
+
+	_collect();
+	_schedule(true);
+}
+
+uint64_t TransferQueue::record(vk::CommandBuffer commandBuffer) {
+	// the batches completed, the waits below cost nothing
+	if (!_bufferAcquires.empty()) {
+		commandBuffer.pipelineBarrier(
+				UPLOAD_WAIT_STAGES, UPLOAD_WAIT_STAGES, {}, nullptr, _bufferAcquires, nullptr);
+		_bufferAcquires.clear();
+	}
+
+	RD &rd = RD::getSingleton();
+
+	for (const ImageUpload &upload : _imageUploads) {
+		if (_isDedicated()) {
+			vk::ImageSubresourceRange subresourceRange;
+			subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+			subresourceRange.setBaseMipLevel(0);
+			subresourceRange.setLevelCount(upload.mipLevels);
+			subresourceRange.setBaseArrayLayer(0);
+			subresourceRange.setLayerCount(1);
+
+			vk::ImageMemoryBarrier barrier;
+			barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+			barrier.setNewLayout(vk::ImageLayout::eTransferDstOptimal);
+			barrier.setDstAccessMask(
+					vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+			barrier.setSrcQueueFamilyIndex(_queueFamily);
+			barrier.setDstQueueFamilyIndex(_graphicsQueueFamily);
+			barrier.setImage(upload.image);
+			barrier.setSubresourceRange(subresourceRange);
+
+			commandBuffer.pipelineBarrier(UPLOAD_WAIT_STAGES,
+					vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+		}
+
+		// leaves every level in shader read only layout
+		rd.imageRecordMipmaps(
+				commandBuffer, upload.image, upload.width, upload.height, upload.mipLevels);
+	}
+
+	_imageUploads.clear();
+
+	uint64_t value = _waitValue;
+	_waitValue = 0;
+
+	return value;
+}
+
+void TransferQueue::flush() {
+	_schedule(false);
+
+	if (_submitCount == 0)
+		return;
+
+	vk::SemaphoreWaitInfo waitInfo;
+	waitInfo.setSemaphores(_semaphore);
+	waitInfo.setValues(_submitCount);
+
+	if (_device.waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess)
+		throw std::runtime_error("Waiting for uploads failed!");
+
+	_collect();
+
+	// the host wait above orders the acquires after the uploads
+	RD &rd = RD::getSingleton();
+	vk::CommandBuffer commandBuffer = rd.beginSingleTimeCommands();
+	record(commandBuffer);
+	rd.endSingleTimeCommands(commandBuffer);
+}
+
+bool TransferQueue::isResident(uint64_t ticket) const {
+	return _unresident.count(ticket) == 0;
+}
+
+uint32_t TransferQueue::getQueueDepth() const {
+	size_t depth = 0;
+
+	for (const std::deque<Request> &requests : _requests)
+		depth += requests.size();
+
+	return static_cast<uint32_t>(depth);
+}
+
+uint64_t TransferQueue::getFrameBytes() const {
+	return _frameBytes;
+}
+
+void TransferQueue::setBudget(uint64_t bytes, double time) {
+	_budget = bytes;
+	_timeBudget = time;
+}
+
+vk::Semaphore TransferQueue::getSemaphore() const {
+	return _semaphore;
+}
+
+void TransferQueue::init(vk::Queue queue, uint32_t queueFamily, uint32_t graphicsQueueFamily) {
+	if (_initialized)
+		return;
+
+	_device = RD::getSingleton().getDevice();
+	_queue = queue;
+	_queueFamily = queueFamily;
+	_graphicsQueueFamily = graphicsQueueFamily;
+
+	vk::CommandPoolCreateInfo poolInfo;
+	poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+	poolInfo.setQueueFamilyIndex(_queueFamily);
+
+	_commandPool = _device.createCommandPool(poolInfo);
+
+	vk::SemaphoreTypeCreateInfo typeInfo;
+	typeInfo.setSemaphoreType(vk::SemaphoreType::eTimeline);
+	typeInfo.setInitialValue(0);
+
+	vk::SemaphoreCreateInfo semaphoreInfo;
+	semaphoreInfo.setPNext(&typeInfo);
+
+	_semaphore = _device.createSemaphore(semaphoreInfo);
+
+	if (_isDedicated())
+		SDL_Log("Uploads on transfer queue family %u", _queueFamily);
+	else
+		SDL_Log("No separate transfer queue family, uploads on the graphics queue");
+
+	_initialized = true;
+}
+
+TransferQueue::~TransferQueue() {
+	if (!_initialized)
+		return;
+
+	_queue.waitIdle();
+
+	RD &rd = RD::getSingleton();
+
+	for (const Batch &batch : _batches) {
+		for (const AllocatedBuffer &stagingBuffer : batch.stagingBuffers)
+			rd.bufferDestroy(stagingBuffer);
+	}
+
+	_device.destroySemaphore(_semaphore);
+	_device.destroyCommandPool(_commandPool);
+}
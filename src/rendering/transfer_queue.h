@@ -0,0 +1,149 @@
+#ifndef TRANSFER_QUEUE_H
+#define TRANSFER_QUEUE_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "types/allocated.h"
+
+// stages of the frame that may read uploads, its submit waits on the transfer queue there
+const vk::PipelineStageFlags UPLOAD_WAIT_STAGES = vk::PipelineStageFlagBits::eTransfer |
+		vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader |
+		vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+
+// per frame, a request larger than either still goes alone
+const uint64_t DEFAULT_UPLOAD_BUDGET = 32ull << 20;
+const double DEFAULT_UPLOAD_TIME = 2.0;
+
+// Queued requests are served highest first, in the order they came within one priority.
+enum class UploadPriority {
+	// meshes, not drawn at all until their streams are there
+	High,
+	// environments, the previous one lights the scene until then
+	Normal,
+	// textures, materials sample fallbacks until then
+	Low,
+};
+
+const uint32_t UPLOAD_PRIORITY_COUNT = 3;
+
+// Uploads through the transfer queue, on a family of its own when the device has one, so loading
+// doesn't wait on the GPU and copies overlap rendering. Requests are queued with a CPU copy of
+// their data and staged once per frame within a budget of bytes and CPU time, a large scene
+// streams in over frames instead of stalling one. Every frame's uploads are submitted together,
+// signaling a timeline semaphore.
+//
+// Uploads become resident for the first frame after they completed, which acquires them, frames
+// never wait for uploads in flight. Across families, resources are released by the transfer queue
+// and acquired by the frame. Transfer queues can't blit, images get their top level copied and
+// their mips generated by the frame that acquires them.
+class TransferQueue {
+private:
+	typedef struct {
+		uint64_t ticket;
+		// null for images
+		vk::Buffer buffer;
+		vk::Image image;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		std::vector<uint8_t> data;
+	} Request;
+
+	typedef struct {
+		vk::Image image;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+	} ImageUpload;
+
+	typedef struct {
+		// timeline value signaled once the batch completed
+		uint64_t value;
+		vk::CommandBuffer commandBuffer;
+		std::vector<AllocatedBuffer> stagingBuffers;
+		std::vector<uint64_t> tickets;
+		std::vector<vk::BufferMemoryBarrier> bufferAcquires;
+		std::vector<ImageUpload> imageUploads;
+	} Batch;
+
+	vk::Device _device;
+	vk::Queue _queue;
+	uint32_t _queueFamily = 0;
+	uint32_t _graphicsQueueFamily = 0;
+
+	vk::CommandPool _commandPool;
+	vk::Semaphore _semaphore;
+	uint64_t _submitCount = 0;
+
+	std::array<std::deque<Request>, UPLOAD_PRIORITY_COUNT> _requests;
+	uint64_t _ticketCount = 0;
+	// queued or in flight
+	std::unordered_set<uint64_t> _unresident;
+
+	uint64_t _budget = DEFAULT_UPLOAD_BUDGET;
+	double _timeBudget = DEFAULT_UPLOAD_TIME;
+	uint64_t _frameBytes = 0;
+
+	std::vector<Batch> _batches;
+
+	// completed, acquired by the next frame
+	std::vector<vk::BufferMemoryBarrier> _bufferAcquires;
+	std::vector<ImageUpload> _imageUploads;
+	uint64_t _waitValue = 0;
+
+	bool _initialized = false;
+
+	bool _isDedicated() const;
+	uint64_t _ticketCreate();
+
+	AllocatedBuffer _stagingCreate(Batch &batch, const std::vector<uint8_t> &data);
+	void _bufferRecord(Batch &batch, const Request &request);
+	void _imageRecord(Batch &batch, const Request &request);
+
+	// Records queued requests into a new batch and submits it, within budget unless told not to.
+	void _schedule(bool isBudgeted);
+	void _collect();
+
+public:
+	// The data is copied, the buffer is read by frames once the ticket is resident.
+	uint64_t bufferUpload(
+			vk::Buffer buffer, const void *pData, size_t size, UploadPriority priority);
+	// Fills the top level of an image in undefined layout. Once the ticket is resident it's in
+	// shader read only layout with its mips generated.
+	uint64_t imageUpload(vk::Image image, uint32_t width, uint32_t height, uint32_t mipLevels,
+			std::vector<uint8_t> data, UploadPriority priority);
+
+	// Once per frame before its draws are chosen. Completed uploads become resident, queued ones
+	// are staged and submitted within the budget.
+	void update();
+	// Records acquires and mip generation of uploads made resident by the last update. Returns the
+	// timeline value the frame's submit waits on, already signaled, zero when there is none.
+	uint64_t record(vk::CommandBuffer commandBuffer);
+	// Submits everything queued regardless of the budget and waits for it, acquired on the
+	// graphics queue. For loading outside of frames.
+	void flush();
+
+	// Zero, no upload, is always resident.
+	bool isResident(uint64_t ticket) const;
+	// requests queued and not yet staged
+	uint32_t getQueueDepth() const;
+	// staged by the last update
+	uint64_t getFrameBytes() const;
+
+	// Bytes and CPU milliseconds staged per frame, zero is unlimited.
+	void setBudget(uint64_t bytes, double time);
+
+	vk::Semaphore getSemaphore() const;
+
+	// Both families are the same without a dedicated transfer queue.
+	void init(vk::Queue queue, uint32_t queueFamily, uint32_t graphicsQueueFamily);
+	~TransferQueue();
+};
+
+#endif // !TRANSFER_QUEUE_H
@@ -1,16 +1,22 @@
 #ifndef VK_TYPES_H
 #define VK_TYPES_H
 
+#include <stdexcept>
+
 #include <vma/vk_mem_alloc.h>
 #include <vulkan/vulkan.hpp>
 
+#include "../gpu_memory.h"
+
 struct AllocatedBuffer {
 	VmaAllocation allocation;
 	vk::Buffer buffer;
 	vk::DeviceSize size;
 
-	static AllocatedBuffer create(VmaAllocator allocator, vk::BufferUsageFlags usage,
-			vk::DeviceSize size, VmaAllocationInfo *pAllocInfo) {
+	// Readback buffers are read by the CPU, they get cached memory instead of write combined.
+	static AllocatedBuffer create(GpuMemory *pMemory, MemoryCategory category,
+			vk::BufferUsageFlags usage, vk::DeviceSize size, VmaAllocationInfo *pAllocInfo,
+			bool isReadback = false) {
 		VkBufferCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		createInfo.size = size;
@@ -18,20 +24,21 @@ struct AllocatedBuffer {
 
 		VmaAllocationCreateInfo allocCreateInfo{};
 		allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-		allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-								VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		allocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+		if (isReadback)
+			allocCreateInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+		else
+			allocCreateInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
 
 		VkBuffer buffer;
 		VmaAllocation allocation;
 
-		if (pAllocInfo == nullptr) {
-			VmaAllocationInfo _allocInfo;
-			vmaCreateBuffer(
-					allocator, &createInfo, &allocCreateInfo, &buffer, &allocation, &_allocInfo);
-		} else {
-			vmaCreateBuffer(
-					allocator, &createInfo, &allocCreateInfo, &buffer, &allocation, pAllocInfo);
-		}
+		VkResult err = pMemory->createBuffer(
+				category, &createInfo, allocCreateInfo, &buffer, &allocation, pAllocInfo);
+
+		if (err != VK_SUCCESS)
+			throw std::runtime_error("Buffer allocation failed!");
 
 		return { allocation, buffer, size };
 	}
@@ -45,9 +52,9 @@ struct AllocatedImage {
 	VmaAllocation allocation;
 	vk::Image image;
 
-	static AllocatedImage create(VmaAllocator allocator, uint32_t width, uint32_t height,
-			uint32_t mipLevels, uint32_t arrayLayers, vk::Format format, vk::ImageUsageFlags usage,
-			vk::ImageCreateFlags flags = {}) {
+	static AllocatedImage create(GpuMemory *pMemory, MemoryCategory category, uint32_t width,
+			uint32_t height, uint32_t mipLevels, uint32_t arrayLayers, vk::Format format,
+			vk::ImageUsageFlags usage, vk::ImageCreateFlags flags = {}) {
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -64,14 +71,18 @@ struct AllocatedImage {
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageInfo.flags = static_cast<VkImageCreateFlags>(flags);
 
+		// suballocated, only images over half a pool block get memory of their own
 		VmaAllocationCreateInfo allocCreateInfo = {};
 		allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-		allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-		allocCreateInfo.priority = 1.0f;
 
 		VmaAllocation allocation;
 		VkImage image;
-		vmaCreateImage(allocator, &imageInfo, &allocCreateInfo, &image, &allocation, nullptr);
+
+		VkResult err = pMemory->createImage(
+				category, &imageInfo, allocCreateInfo, &image, &allocation);
+
+		if (err != VK_SUCCESS)
+			throw std::runtime_error("Image allocation failed!");
 
 		return { allocation, image };
 	}
@@ -2,64 +2,21 @@
 #define ATTACHMENT_H
 
 #include <cstdint>
+#include <stdexcept>
+#include <vma/vk_mem_alloc.h>
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_handles.hpp>
 
+#include "../gpu_memory.h"
+
 class Attachment {
 private:
 	vk::Image _image = {};
 	vk::ImageView _imageView = {};
-	vk::DeviceMemory _imageMemory = {};
 	vk::Format _format = vk::Format::eUndefined;
 
-	static uint32_t _findMemoryType(uint32_t typeFilter,
-			vk::PhysicalDeviceMemoryProperties memProperties, vk::MemoryPropertyFlags properties) {
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) &&
-					(memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
-			}
-		}
-
-		throw std::runtime_error("Could not find suitable memory type!");
-	}
-
-	static vk::Image _createImage(vk::Device device, uint32_t width, uint32_t height,
-			uint32_t arrayLayers, vk::Format format, vk::ImageUsageFlags usage,
-			vk::PhysicalDeviceMemoryProperties memProperties, vk::DeviceMemory *pMemory,
-			vk::ImageCreateFlags flags = {}) {
-		vk::ImageCreateInfo createInfo = {};
-		createInfo.setImageType(vk::ImageType::e2D);
-		createInfo.setExtent(vk::Extent3D(width, height, 1));
-		createInfo.setMipLevels(1);
-		createInfo.setArrayLayers(arrayLayers);
-		createInfo.setFormat(format);
-		createInfo.setTiling(vk::ImageTiling::eOptimal);
-		createInfo.setInitialLayout(vk::ImageLayout::eUndefined);
-		createInfo.setUsage(usage);
-		createInfo.setSamples(vk::SampleCountFlagBits::e1);
-		createInfo.setSharingMode(vk::SharingMode::eExclusive);
-		createInfo.setFlags(flags);
-
-		vk::Image image = device.createImage(createInfo);
-
-		vk::MemoryRequirements memRequirements = device.getImageMemoryRequirements(image);
-
-		uint32_t memoryTypeIndex = _findMemoryType(memRequirements.memoryTypeBits, memProperties,
-				vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-		vk::MemoryAllocateInfo allocInfo = {};
-		allocInfo.setAllocationSize(memRequirements.size);
-		allocInfo.setMemoryTypeIndex(memoryTypeIndex);
-
-		vk::Result err = device.allocateMemory(&allocInfo, nullptr, pMemory);
-
-		if (err != vk::Result::eSuccess)
-			throw std::runtime_error("Attachment image memory allocation failed!");
-
-		device.bindImageMemory(image, *pMemory, 0);
-		return image;
-	}
+	VmaAllocator _allocator = VK_NULL_HANDLE;
+	VmaAllocation _allocation = VK_NULL_HANDLE;
 
 	static vk::ImageView _createView(vk::Device device, vk::Image image, vk::ImageViewType viewType,
 			vk::Format format, vk::ImageAspectFlagBits aspectFlags, uint32_t arrayLayers) {
@@ -80,22 +37,49 @@ private:
 	}
 
 public:
-	static Attachment create(vk::Device device, uint32_t width, uint32_t height, vk::Format format,
-			vk::ImageUsageFlags usage, vk::ImageAspectFlagBits aspectFlags,
-			vk::PhysicalDeviceMemoryProperties memProperties, uint32_t arrayLayers = 1,
-			vk::ImageViewType viewType = vk::ImageViewType::e2D, vk::ImageCreateFlags flags = {}) {
-		vk::DeviceMemory memory;
-		vk::Image image = _createImage(
-				device, width, height, arrayLayers, format, usage, memProperties, &memory, flags);
-		vk::ImageView view = _createView(device, image, viewType, format, aspectFlags, arrayLayers);
-
-		return Attachment(image, view, memory, format);
+	// Suballocated from the attachment pools, render targets come and go with the window size
+	// and reuse the blocks of the ones before.
+	static Attachment create(vk::Device device, GpuMemory *pMemory, uint32_t width,
+			uint32_t height, vk::Format format, vk::ImageUsageFlags usage,
+			vk::ImageAspectFlagBits aspectFlags) {
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = static_cast<VkFormat>(format);
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = static_cast<VkImageUsageFlags>(usage);
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VmaAllocationCreateInfo allocCreateInfo = {};
+		allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+		VkImage image;
+		VmaAllocation allocation;
+
+		VkResult err = pMemory->createImage(MemoryCategory::Attachments, &imageInfo,
+				allocCreateInfo, &image, &allocation);
+
+		if (err != VK_SUCCESS)
+			throw std::runtime_error("Attachment image allocation failed!");
+
+		vk::ImageView view =
+				_createView(device, image, vk::ImageViewType::e2D, format, aspectFlags, 1);
+
+		Attachment attachment(image, view, format);
+		attachment._allocator = pMemory->getAllocator();
+		attachment._allocation = allocation;
+
+		return attachment;
 	}
 
 	void destroy(vk::Device device) {
 		device.destroyImageView(_imageView, nullptr);
-		device.destroyImage(_image, nullptr);
-		device.freeMemory(_imageMemory, nullptr);
+		vmaDestroyImage(_allocator, _image, _allocation);
 	}
 
 	vk::Image getImage() const {
@@ -112,10 +96,9 @@ public:
 
 	Attachment() {}
 
-	Attachment(vk::Image image, vk::ImageView view, vk::DeviceMemory memory, vk::Format format) {
+	Attachment(vk::Image image, vk::ImageView view, vk::Format format) {
 		_image = image;
 		_imageView = view;
-		_imageMemory = memory;
 		_format = format;
 	}
 };
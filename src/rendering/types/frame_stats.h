@@ -0,0 +1,100 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+
+const uint32_t FRAME_STATS_WINDOW = 120;
+
+// Counted at the sites recording the work, reset every frame. Triangles are the ones submitted
+// for shading before meshlet culling, uploads are host writes into GPU visible memory. Input
+// latency is the microseconds from reading input to submitting the frame, 0 when not marked.
+// Render scale is the percentage of the swapchain size rendered per axis. Shadow cascade renders
+// count cached static maps re-rendered, overlays of dynamic casters aren't counted. Upload queue
+// depth is the requests left queued once the frame's share of them was staged.
+struct FrameCounters {
+	uint64_t drawCount;
+	uint64_t triangleCount;
+	uint64_t descriptorSetBindCount;
+	uint64_t pipelineBindCount;
+	uint64_t pushConstantBytes;
+	uint64_t uploadBytes;
+	uint64_t inputLatency;
+	uint64_t renderScale;
+	uint64_t shadowCascadeRenderCount;
+	uint64_t uploadQueueDepth;
+};
+
+// Minimum, average and maximum of every counter over the last FRAME_STATS_WINDOW frames.
+class FrameStats {
+private:
+	static constexpr uint64_t FrameCounters::*COUNTERS[] = {
+		&FrameCounters::drawCount,
+		&FrameCounters::triangleCount,
+		&FrameCounters::descriptorSetBindCount,
+		&FrameCounters::pipelineBindCount,
+		&FrameCounters::pushConstantBytes,
+		&FrameCounters::uploadBytes,
+		&FrameCounters::inputLatency,
+		&FrameCounters::renderScale,
+		&FrameCounters::shadowCascadeRenderCount,
+		&FrameCounters::uploadQueueDepth,
+	};
+
+	FrameCounters _frames[FRAME_STATS_WINDOW] = {};
+	uint32_t _next = 0;
+	uint32_t _frameCount = 0;
+
+	FrameCounters _last = {};
+	FrameCounters _min = {};
+	FrameCounters _avg = {};
+	FrameCounters _max = {};
+
+public:
+	void push(const FrameCounters &counters) {
+		_last = counters;
+
+		_frames[_next] = counters;
+		_next = (_next + 1) % FRAME_STATS_WINDOW;
+		_frameCount = std::min(_frameCount + 1, FRAME_STATS_WINDOW);
+
+		for (uint64_t FrameCounters::*pCounter : COUNTERS) {
+			uint64_t min = UINT64_MAX;
+			uint64_t max = 0;
+			uint64_t sum = 0;
+
+			for (uint32_t i = 0; i < _frameCount; i++) {
+				uint64_t value = _frames[i].*pCounter;
+				min = std::min(min, value);
+				max = std::max(max, value);
+				sum += value;
+			}
+
+			_min.*pCounter = min;
+			_avg.*pCounter = sum / _frameCount;
+			_max.*pCounter = max;
+		}
+	}
+
+	const FrameCounters &getLast() const {
+		return _last;
+	}
+
+	const FrameCounters &getMin() const {
+		return _min;
+	}
+
+	const FrameCounters &getAvg() const {
+		return _avg;
+	}
+
+	const FrameCounters &getMax() const {
+		return _max;
+	}
+
+	uint32_t getFrameCount() const {
+		return _frameCount;
+	}
+};
+
+#endif // !FRAME_STATS_H
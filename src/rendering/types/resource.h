@@ -4,35 +4,84 @@
 #include <cstdint>
 #include <glm/glm.hpp>
 
+#include <io/mesh.h>
+
 #include "allocated.h"
 
 typedef uint64_t ObjectID;
 
-struct PrimitiveRD {
+struct IndexRange {
 	uint32_t indexCount;
 	uint32_t firstIndex;
+};
+
+struct MeshletRange {
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+struct PrimitiveRD {
+	// all levels live in the mesh index buffer, level 0 is full detail
+	IndexRange lods[MAX_LOD_COUNT];
+	MeshletRange meshlets[MAX_LOD_COUNT];
+	uint32_t lodCount;
 	ObjectID material;
 };
 
 struct MeshRD {
-	AllocatedBuffer vertexBuffer;
+	AllocatedBuffer positionBuffer;
+	AllocatedBuffer attributeBuffer;
 	AllocatedBuffer indexBuffer;
 	std::vector<PrimitiveRD> primitives;
+
+	// meshlets of every primitive and level, read with the index buffer by cluster culling
+	AllocatedBuffer meshletBuffer;
+	vk::DescriptorSet meshletSet;
+
+	// bounding sphere in mesh space
+	glm::vec3 center;
+	float radius;
+
+	// the last stream queued, the others complete with or before it
+	uint64_t upload;
+	bool isResident = false;
 };
 
 struct MeshInstanceRD {
-	glm::mat4 transform;
+	// index of the world matrix in RS's dense transforms, kept until the instance is freed
+	uint32_t transformSlot = 0;
 	ObjectID mesh;
+	uint32_t lod = 0;
+
+	// world bounding sphere as last drawn, what cached shadows of the instance cover
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	// Moved within the last frames, casts into the shadow overlay instead of the cached maps.
+	// Transforms set before the first draw place the instance rather than move it.
+	bool isDynamic = false;
+	bool isDrawn = false;
+	// draws skip the instance until its mesh is resident
+	bool isMeshResident = false;
+	// inside the camera frustum this frame, off-screen instances only cast shadows
+	bool isInView = false;
+	uint64_t movedFrame = 0;
+	// placed or changed mesh since last drawn, cached shadows around its new bounds are stale
+	bool isDirty = true;
 };
 
 struct MaterialRD {
 	vk::DescriptorSet textureSet;
+	// texture bits of the pipeline variant, draws add the frame's light bits
+	uint32_t features;
 };
 
 struct TextureRD {
 	AllocatedImage image;
 	vk::ImageView imageView;
 	vk::Sampler sampler;
+	// sampled by materials once resident
+	uint64_t upload;
 };
 
 #endif // !RESOURCE_H
@@ -8,47 +8,84 @@
 
 #include <vulkan/vulkan.hpp>
 
+// Geometry is uploaded as two streams: tightly packed positions and everything else. Depth-only
+// passes bind just the position stream, so they fetch 12 bytes per vertex instead of 44.
+const uint32_t POSITION_BINDING = 0;
+const uint32_t ATTRIBUTE_BINDING = 1;
+
+// Per instance model matrix, one vec4 column per location.
+const uint32_t INSTANCE_BINDING = 2;
+const uint32_t INSTANCE_LOCATION = 4;
+
+struct VertexAttribute {
+	glm::vec3 normal;
+	glm::vec3 tangent;
+	glm::vec2 uv;
+
+	bool operator==(const VertexAttribute &a) const {
+		return normal == a.normal && tangent == a.tangent && uv == a.uv;
+	}
+};
+
 struct Vertex {
 	glm::vec3 position;
 	glm::vec3 normal;
 	glm::vec3 tangent;
 	glm::vec2 uv;
 
-	static vk::VertexInputBindingDescription getBindingDescription() {
+	static vk::VertexInputBindingDescription getPositionBindingDescription() {
 		vk::VertexInputBindingDescription bindingDescription;
-		bindingDescription.setBinding(0);
-		bindingDescription.setStride(sizeof(Vertex));
+		bindingDescription.setBinding(POSITION_BINDING);
+		bindingDescription.setStride(sizeof(glm::vec3));
 		bindingDescription.setInputRate(vk::VertexInputRate::eVertex);
 
 		return bindingDescription;
 	}
 
+	static vk::VertexInputAttributeDescription getPositionAttributeDescription() {
+		vk::VertexInputAttributeDescription attributeDescription;
+		attributeDescription.setLocation(0);
+		attributeDescription.setBinding(POSITION_BINDING);
+		attributeDescription.setFormat(vk::Format::eR32G32B32Sfloat);
+		attributeDescription.setOffset(0);
+
+		return attributeDescription;
+	}
+
+	static std::array<vk::VertexInputBindingDescription, 2> getBindingDescriptions() {
+		std::array<vk::VertexInputBindingDescription, 2> bindingDescriptions;
+		bindingDescriptions[0] = getPositionBindingDescription();
+
+		bindingDescriptions[1].setBinding(ATTRIBUTE_BINDING);
+		bindingDescriptions[1].setStride(sizeof(VertexAttribute));
+		bindingDescriptions[1].setInputRate(vk::VertexInputRate::eVertex);
+
+		return bindingDescriptions;
+	}
+
 	static std::array<vk::VertexInputAttributeDescription, 4> getAttributeDescriptions() {
 		std::array<vk::VertexInputAttributeDescription, 4> attributeDescriptions;
 
 		// Position
-		attributeDescriptions[0].setLocation(0);
-		attributeDescriptions[0].setBinding(0);
-		attributeDescriptions[0].setFormat(vk::Format::eR32G32B32Sfloat);
-		attributeDescriptions[0].setOffset(offsetof(Vertex, position));
+		attributeDescriptions[0] = getPositionAttributeDescription();
 
 		// Normal
 		attributeDescriptions[1].setLocation(1);
-		attributeDescriptions[1].setBinding(0);
+		attributeDescriptions[1].setBinding(ATTRIBUTE_BINDING);
 		attributeDescriptions[1].setFormat(vk::Format::eR32G32B32Sfloat);
-		attributeDescriptions[1].setOffset(offsetof(Vertex, normal));
+		attributeDescriptions[1].setOffset(offsetof(VertexAttribute, normal));
 
 		// Tangent
 		attributeDescriptions[2].setLocation(2);
-		attributeDescriptions[2].setBinding(0);
+		attributeDescriptions[2].setBinding(ATTRIBUTE_BINDING);
 		attributeDescriptions[2].setFormat(vk::Format::eR32G32B32Sfloat);
-		attributeDescriptions[2].setOffset(offsetof(Vertex, tangent));
+		attributeDescriptions[2].setOffset(offsetof(VertexAttribute, tangent));
 
 		// TexCoord
 		attributeDescriptions[3].setLocation(3);
-		attributeDescriptions[3].setBinding(0);
+		attributeDescriptions[3].setBinding(ATTRIBUTE_BINDING);
 		attributeDescriptions[3].setFormat(vk::Format::eR32G32Sfloat);
-		attributeDescriptions[3].setOffset(offsetof(Vertex, uv));
+		attributeDescriptions[3].setOffset(offsetof(VertexAttribute, uv));
 
 		return attributeDescriptions;
 	}
@@ -58,6 +95,32 @@ struct Vertex {
 	}
 };
 
+struct Instance {
+	glm::mat4 model;
+
+	static vk::VertexInputBindingDescription getBindingDescription() {
+		vk::VertexInputBindingDescription bindingDescription;
+		bindingDescription.setBinding(INSTANCE_BINDING);
+		bindingDescription.setStride(sizeof(Instance));
+		bindingDescription.setInputRate(vk::VertexInputRate::eInstance);
+
+		return bindingDescription;
+	}
+
+	static std::array<vk::VertexInputAttributeDescription, 4> getAttributeDescriptions() {
+		std::array<vk::VertexInputAttributeDescription, 4> attributeDescriptions;
+
+		for (uint32_t i = 0; i < 4; i++) {
+			attributeDescriptions[i].setLocation(INSTANCE_LOCATION + i);
+			attributeDescriptions[i].setBinding(INSTANCE_BINDING);
+			attributeDescriptions[i].setFormat(vk::Format::eR32G32B32A32Sfloat);
+			attributeDescriptions[i].setOffset(offsetof(Instance, model) + sizeof(glm::vec4) * i);
+		}
+
+		return attributeDescriptions;
+	}
+};
+
 namespace std {
 template <> struct hash<Vertex> {
 	size_t operator()(Vertex const &v) const {
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <set>
@@ -14,6 +15,8 @@
 struct QueueFamilyIndices {
 	uint32_t graphicsFamily = UINT32_MAX;
 	uint32_t presentFamily = UINT32_MAX;
+	// the graphics family when the device has no separate one
+	uint32_t transferFamily = UINT32_MAX;
 
 	bool isComplete() {
 		return graphicsFamily != UINT32_MAX && presentFamily != UINT32_MAX;
@@ -59,13 +62,17 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 	return VK_FALSE;
 }
 
-std::vector<const char *> requiredExtensions(bool validationEnabled) {
-	uint32_t count = 0;
-	const char *const *pExtensions = SDL_Vulkan_GetInstanceExtensions(&count);
+std::vector<const char *> requiredExtensions(bool validationEnabled, bool headless) {
+	std::vector<const char *> extensions;
 
-	std::vector<const char *> extensions(count);
-	for (int i = 0; i < count; i++)
-		extensions[i] = pExtensions[i];
+	// surface extensions come from the window system, there is none when headless
+	if (!headless) {
+		uint32_t count = 0;
+		const char *const *pExtensions = SDL_Vulkan_GetInstanceExtensions(&count);
+
+		for (uint32_t i = 0; i < count; i++)
+			extensions.push_back(pExtensions[i]);
+	}
 
 	if (validationEnabled) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -74,7 +81,8 @@ std::vector<const char *> requiredExtensions(bool validationEnabled) {
 	return extensions;
 }
 
-vk::Instance createInstance(bool useValidation, VkDebugUtilsMessengerEXT *pDebugMessenger) {
+vk::Instance createInstance(
+		bool useValidation, bool headless, VkDebugUtilsMessengerEXT *pDebugMessenger) {
 	uint32_t version = VK_MAKE_VERSION(VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
 
 	vk::ApplicationInfo appInfo{};
@@ -82,9 +90,9 @@ vk::Instance createInstance(bool useValidation, VkDebugUtilsMessengerEXT *pDebug
 	appInfo.setApplicationVersion(version);
 	appInfo.setPEngineName("Hayaku Engine");
 	appInfo.setEngineVersion(version);
-	appInfo.setApiVersion(VK_API_VERSION_1_1);
+	appInfo.setApiVersion(VK_API_VERSION_1_2);
 
-	std::vector<const char *> extensions = requiredExtensions(useValidation);
+	std::vector<const char *> extensions = requiredExtensions(useValidation, headless);
 
 	vk::InstanceCreateInfo createInfo = {};
 	createInfo.setPApplicationInfo(&appInfo);
@@ -137,6 +145,12 @@ QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice physicalDevice, vk::Surf
 			indices.graphicsFamily = i;
 		}
 
+		// headless, nothing is presented
+		if (!surface && indices.graphicsFamily != UINT32_MAX) {
+			indices.presentFamily = indices.graphicsFamily;
+			break;
+		}
+
 		VkBool32 presentSupport = physicalDevice.getSurfaceSupportKHR(i, surface);
 
 		if (presentSupport) {
@@ -150,13 +164,57 @@ QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice physicalDevice, vk::Surf
 		i++;
 	}
 
+	indices.transferFamily = indices.graphicsFamily;
+
+	// copy engines run alongside rendering, families with compute but no graphics come second
+	vk::QueueFlags transferFlags = vk::QueueFlagBits::eTransfer;
+	vk::QueueFlags excludedFlags = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+
+	for (uint32_t pass = 0; pass < 2 && indices.transferFamily == indices.graphicsFamily; pass++) {
+		for (uint32_t j = 0; j < queueFamilies.size(); j++) {
+			vk::QueueFlags flags = queueFamilies[j].queueFlags;
+
+			if ((flags & transferFlags) && !(flags & excludedFlags)) {
+				indices.transferFamily = j;
+				break;
+			}
+		}
+
+		excludedFlags = vk::QueueFlagBits::eGraphics;
+	}
+
 	return indices;
 }
 
-bool checkDeviceExtensionSupport(vk::PhysicalDevice physicalDevice) {
+std::vector<const char *> deviceExtensions(vk::SurfaceKHR surface) {
+	std::vector<const char *> extensions;
+
+	for (const char *pExtension : DEVICE_EXTENSIONS) {
+		// headless renders into plain images
+		if (!surface && strcmp(pExtension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0)
+			continue;
+
+		extensions.push_back(pExtension);
+	}
+
+	return extensions;
+}
+
+bool hasDeviceExtension(vk::PhysicalDevice physicalDevice, const char *pName) {
+	for (const vk::ExtensionProperties &extension :
+			physicalDevice.enumerateDeviceExtensionProperties()) {
+		if (strcmp(extension.extensionName, pName) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool checkDeviceExtensionSupport(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface) {
 	std::vector<vk::ExtensionProperties> extensions =
 			physicalDevice.enumerateDeviceExtensionProperties();
-	std::set<std::string> requiredExtensions(DEVICE_EXTENSIONS.begin(), DEVICE_EXTENSIONS.end());
+	std::vector<const char *> required = deviceExtensions(surface);
+	std::set<std::string> requiredExtensions(required.begin(), required.end());
 
 	for (const auto &extension : extensions) {
 		requiredExtensions.erase(extension.extensionName);
@@ -177,10 +235,10 @@ SwapchainSupportDetails querySwapchainSupport(
 
 bool isDeviceSuitable(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface) {
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice, surface);
-	bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice);
+	bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice, surface);
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	bool swapChainAdequate = !surface;
+	if (extensionsSupported && surface) {
 		SwapchainSupportDetails swapChainSupport = querySwapchainSupport(physicalDevice, surface);
 		swapChainAdequate =
 				!swapChainSupport.surfaceFormats.empty() && !swapChainSupport.presentModes.empty();
@@ -188,8 +246,18 @@ bool isDeviceSuitable(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface)
 
 	vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
 
+	// uploads signal frames through a timeline semaphore
+	bool isTimelineSupported = false;
+
+	if (physicalDevice.getProperties().apiVersion >= VK_API_VERSION_1_2) {
+		auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+				vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+		isTimelineSupported =
+				features.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>().timelineSemaphore;
+	}
+
 	return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-		   supportedFeatures.samplerAnisotropy;
+		   supportedFeatures.samplerAnisotropy && isTimelineSupported;
 }
 
 vk::PhysicalDevice pickPhysicalDevice(vk::Instance instance, vk::SurfaceKHR surface) {
@@ -219,6 +287,7 @@ vk::Device createDevice(
 	std::set<uint32_t> uniqueQueueFamilies = {
 		indices.graphicsFamily,
 		indices.presentFamily,
+		indices.transferFamily,
 	};
 
 	float queuePriority = 1.0f;
@@ -234,14 +303,27 @@ vk::Device createDevice(
 	vk::PhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+	// optional, the GPU profiler counts pipeline statistics when present
+	deviceFeatures.pipelineStatisticsQuery = physicalDevice.getFeatures().pipelineStatisticsQuery;
+
+	vk::PhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+	timelineFeatures.timelineSemaphore = VK_TRUE;
+
 	vk::PhysicalDeviceMultiviewFeaturesKHR multiviewFeatures = {};
 	multiviewFeatures.multiview = VK_TRUE;
+	multiviewFeatures.setPNext(&timelineFeatures);
+
+	std::vector<const char *> extensions = deviceExtensions(surface);
+
+	// optional, memory usage is reported against the budget the driver gives us
+	if (hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
 	vk::DeviceCreateInfo createInfo = {};
 	createInfo.setQueueCreateInfos(queueCreateInfos);
 	createInfo.setPEnabledFeatures(&deviceFeatures);
-	createInfo.setEnabledExtensionCount(DEVICE_EXTENSIONS.size());
-	createInfo.setPpEnabledExtensionNames(DEVICE_EXTENSIONS.data());
+	createInfo.setEnabledExtensionCount(extensions.size());
+	createInfo.setPpEnabledExtensionNames(extensions.data());
 	createInfo.setPNext(&multiviewFeatures);
 
 	if (useValidation) {
@@ -300,7 +382,27 @@ vk::PresentModeKHR choosePresentMode(std::vector<vk::PresentModeKHR> presentMode
 	return vk::PresentModeKHR::eFifo;
 }
 
-void VulkanContext::_createSwapchain(uint32_t width, uint32_t height) {
+void VulkanContext::_createAllocator() {
+	VmaAllocatorCreateInfo allocatorCreateInfo = {};
+	allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_2;
+	allocatorCreateInfo.instance = _instance;
+	allocatorCreateInfo.physicalDevice = _physicalDevice;
+	allocatorCreateInfo.device = _device;
+
+	// heap budgets are estimated from the heap sizes without it
+	if (hasDeviceExtension(_physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		allocatorCreateInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
+	VkResult err = vmaCreateAllocator(&allocatorCreateInfo, &_allocator);
+
+	if (err != VK_SUCCESS)
+		throw std::runtime_error("VmaAllocator creation failed!");
+
+	_memory.init(_allocator);
+}
+
+std::vector<vk::Image> VulkanContext::_createSwapchain(
+		uint32_t width, uint32_t height, vk::SwapchainKHR oldSwapchain) {
 	SwapchainSupportDetails support = querySwapchainSupport(_physicalDevice, _surface);
 
 	if (support.capabilities.currentExtent.width == UINT32_MAX) {
@@ -335,8 +437,12 @@ void VulkanContext::_createSwapchain(uint32_t width, uint32_t height) {
 
 	vk::SurfaceFormatKHR surfaceFormat = getSurfaceFormat(support.surfaceFormats);
 
-	vk::PresentModeKHR presentMode =
-			choosePresentMode(support.presentModes, vk::PresentModeKHR::eMailbox);
+	vk::PresentModeKHR presentMode = choosePresentMode(support.presentModes, _presentMode);
+
+	if (presentMode != _presentMode) {
+		SDL_LogWarn(SDL_LOG_CATEGORY_RENDER, "Present mode %s unsupported, using %s",
+				vk::to_string(_presentMode).c_str(), vk::to_string(presentMode).c_str());
+	}
 
 	vk::SwapchainCreateInfoKHR createInfo = {};
 	createInfo.setSurface(_surface);
@@ -352,142 +458,39 @@ void VulkanContext::_createSwapchain(uint32_t width, uint32_t height) {
 	createInfo.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque);
 	createInfo.setPresentMode(presentMode);
 	createInfo.setClipped(true);
+	// images still queued for presentation stay valid until the old swapchain is destroyed
+	createInfo.setOldSwapchain(oldSwapchain);
 
-	_swapchain = _device.createSwapchainKHR(createInfo);
-
-	std::vector<vk::Image> images = _device.getSwapchainImagesKHR(_swapchain);
-	_swapchainImages.resize(images.size());
-
-	// Resources
-
-	uint32_t _width = _swapchainExtent.width;
-	uint32_t _height = _swapchainExtent.height;
-
-	vk::PhysicalDeviceMemoryProperties memProperties = _physicalDevice.getMemoryProperties();
-
-	vk::Format colorFormat = vk::Format::eB10G11R11UfloatPack32;
-	_color = Attachment::create(_device, _width, _height, colorFormat,
-			vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment,
-			vk::ImageAspectFlagBits::eColor, memProperties);
-
-	vk::Format depthFormat = vk::Format::eD32Sfloat;
-	_depth = Attachment::create(_device, _width, _height, depthFormat,
-			vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::ImageAspectFlagBits::eDepth,
-			memProperties);
-
-	// attachments
-
-	vk::AttachmentDescription finalColorAttachment = {};
-	finalColorAttachment.setFormat(surfaceFormat.format);
-	finalColorAttachment.setSamples(vk::SampleCountFlagBits::e1);
-	finalColorAttachment.setLoadOp(vk::AttachmentLoadOp::eDontCare);
-	finalColorAttachment.setStoreOp(vk::AttachmentStoreOp::eStore);
-	finalColorAttachment.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
-	finalColorAttachment.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
-	finalColorAttachment.setInitialLayout(vk::ImageLayout::eUndefined);
-	finalColorAttachment.setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
-
-	vk::AttachmentDescription colorAttachment = {};
-	colorAttachment.setFormat(colorFormat);
-	colorAttachment.setSamples(vk::SampleCountFlagBits::e1);
-	colorAttachment.setLoadOp(vk::AttachmentLoadOp::eClear);
-	colorAttachment.setStoreOp(vk::AttachmentStoreOp::eStore);
-	colorAttachment.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
-	colorAttachment.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
-	colorAttachment.setInitialLayout(vk::ImageLayout::eUndefined);
-	colorAttachment.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-	vk::AttachmentDescription depthAttachment = {};
-	depthAttachment.setFormat(depthFormat);
-	depthAttachment.setSamples(vk::SampleCountFlagBits::e1);
-	depthAttachment.setLoadOp(vk::AttachmentLoadOp::eClear);
-	depthAttachment.setStoreOp(vk::AttachmentStoreOp::eStore);
-	depthAttachment.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
-	depthAttachment.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
-	depthAttachment.setInitialLayout(vk::ImageLayout::eUndefined);
-	depthAttachment.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
-
-	// references
-
-	vk::AttachmentReference finalColorRef = {};
-	finalColorRef.setAttachment(0);
-	finalColorRef.setLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-	vk::AttachmentReference colorRef = {};
-	colorRef.setAttachment(1);
-	colorRef.setLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-	vk::AttachmentReference colorShaderReadRef = {};
-	colorShaderReadRef.setAttachment(1);
-	colorShaderReadRef.setLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-
-	vk::AttachmentReference depthRef = {};
-	depthRef.setAttachment(2);
-	depthRef.setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
-
-	// subpasses
-
-	vk::SubpassDescription depthPass = {};
-	depthPass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics);
-	depthPass.setPDepthStencilAttachment(&depthRef);
-
-	vk::SubpassDescription mainPass = {};
-	mainPass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics);
-	mainPass.setColorAttachments(colorRef);
-	mainPass.setPDepthStencilAttachment(&depthRef);
-
-	vk::SubpassDescription tonemapPass = {};
-	tonemapPass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics);
-	tonemapPass.setColorAttachments(finalColorRef);
-	tonemapPass.setInputAttachments(colorShaderReadRef);
-
-	// dependencies
-
-	vk::SubpassDependency depthDependency = {};
-	depthDependency.setSrcSubpass(DEPTH_PASS);
-	depthDependency.setDstSubpass(MAIN_PASS);
-	depthDependency.setSrcStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests |
-									vk::PipelineStageFlagBits::eLateFragmentTests);
-	depthDependency.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader);
-	depthDependency.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite);
-	depthDependency.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-	vk::SubpassDependency mainDependency = {};
-	mainDependency.setSrcSubpass(MAIN_PASS);
-	mainDependency.setDstSubpass(TONEMAP_PASS);
-	mainDependency.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-	mainDependency.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader);
-	mainDependency.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
-	mainDependency.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-	// render pass
-
-	std::array<vk::AttachmentDescription, 3> attachments = {
-		finalColorAttachment,
-		colorAttachment,
-		depthAttachment,
-	};
+	if (_swapchainFormat != vk::Format::eUndefined && surfaceFormat.format != _swapchainFormat)
+		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Swapchain format changed, pipelines reused!");
 
-	std::array<vk::SubpassDescription, 3> subpasses = {
-		depthPass,
-		mainPass,
-		tonemapPass,
-	};
+	_swapchainFormat = surfaceFormat.format;
+	_targets.swapchain = _device.createSwapchainKHR(createInfo);
 
-	std::array<vk::SubpassDependency, 2> dependencies = {
-		depthDependency,
-		mainDependency,
-	};
+	return _device.getSwapchainImagesKHR(_targets.swapchain);
+}
+
+std::vector<vk::Image> VulkanContext::_createOffscreen(uint32_t width, uint32_t height) {
+	_swapchainExtent = vk::Extent2D(width, height);
+
+	// what a swapchain would usually pick, transfer source to read frames back
+	_swapchainFormat = vk::Format::eB8G8R8A8Srgb;
 
-	vk::RenderPassCreateInfo renderPassInfo = {};
-	renderPassInfo.setAttachments(attachments);
-	renderPassInfo.setSubpasses(subpasses);
-	renderPassInfo.setDependencies(dependencies);
+	std::vector<vk::Image> images;
 
-	_renderPass = _device.createRenderPass(renderPassInfo);
+	for (uint32_t i = 0; i < OFFSCREEN_IMAGE_COUNT; i++) {
+		Attachment image = Attachment::create(_device, &_memory, width, height, _swapchainFormat,
+				vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+				vk::ImageAspectFlagBits::eColor);
 
-	// framebuffers
+		_targets.offscreenImages.push_back(image);
+		images.push_back(image.getImage());
+	}
+
+	return images;
+}
 
+void VulkanContext::_createRenderTargets(const std::vector<vk::Image> &images) {
 	vk::ImageSubresourceRange subresourceRange = {};
 	subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
 	subresourceRange.setBaseMipLevel(0);
@@ -495,50 +498,28 @@ void VulkanContext::_createSwapchain(uint32_t width, uint32_t height) {
 	subresourceRange.setBaseArrayLayer(0);
 	subresourceRange.setLayerCount(1);
 
-	for (size_t i = 0; i < images.size(); i++) {
+	_targets.images = images;
+
+	for (vk::Image image : images) {
 		vk::ImageViewCreateInfo createInfo = {};
-		createInfo.setImage(images[i]);
+		createInfo.setImage(image);
 		createInfo.setViewType(vk::ImageViewType::e2D);
-		createInfo.setFormat(surfaceFormat.format);
+		createInfo.setFormat(_swapchainFormat);
 		createInfo.setSubresourceRange(subresourceRange);
 
-		vk::ImageView finalColorView = _device.createImageView(createInfo);
-
-		std::array<vk::ImageView, 3> attachmentViews = {
-			finalColorView,
-			_color.getImageView(),
-			_depth.getImageView(),
-		};
-
-		vk::FramebufferCreateInfo framebufferInfo = {};
-		framebufferInfo.setRenderPass(_renderPass);
-		framebufferInfo.setAttachments(attachmentViews);
-		framebufferInfo.setWidth(_swapchainExtent.width);
-		framebufferInfo.setHeight(_swapchainExtent.height);
-		framebufferInfo.setLayers(1);
-
-		vk::Framebuffer framebuffer;
-		vk::Result err = _device.createFramebuffer(&framebufferInfo, nullptr, &framebuffer);
-
-		if (err != vk::Result::eSuccess)
-			throw std::runtime_error("Swapchain framebuffer creation failed!");
-
-		_swapchainImages[i] = { finalColorView, framebuffer };
+		_targets.views.push_back(_device.createImageView(createInfo));
 	}
 }
 
-void VulkanContext::_destroySwapchain() {
-	_color.destroy(_device);
-	_depth.destroy(_device);
+void VulkanContext::destroyRenderTargets(const RenderTargets &targets) {
+	for (vk::ImageView view : targets.views)
+		_device.destroyImageView(view, nullptr);
 
-	for (uint32_t i = 0; i < _swapchainImages.size(); i++) {
-		_device.destroyFramebuffer(_swapchainImages[i].framebuffer, nullptr);
-		_device.destroyImageView(_swapchainImages[i].view, nullptr);
-	}
-	_swapchainImages.clear();
+	for (Attachment image : targets.offscreenImages)
+		image.destroy(_device);
 
-	_device.destroySwapchainKHR(_swapchain, nullptr);
-	_device.destroyRenderPass(_renderPass, nullptr);
+	if (targets.swapchain)
+		_device.destroySwapchainKHR(targets.swapchain, nullptr);
 }
 
 void VulkanContext::initialize(vk::SurfaceKHR surface, uint32_t width, uint32_t height) {
@@ -552,10 +533,17 @@ void VulkanContext::initialize(vk::SurfaceKHR surface, uint32_t width, uint32_t
 	QueueFamilyIndices indices = findQueueFamilies(_physicalDevice, surface);
 	_graphicsQueue = _device.getQueue(indices.graphicsFamily, 0);
 	_presentQueue = _device.getQueue(indices.presentFamily, 0);
+	_transferQueue = _device.getQueue(indices.transferFamily, 0);
 
 	_graphicsQueueFamily = indices.graphicsFamily;
+	_transferQueueFamily = indices.transferFamily;
 
-	_createSwapchain(width, height);
+	_createAllocator();
+
+	std::vector<vk::Image> images =
+			_headless ? _createOffscreen(width, height) : _createSwapchain(width, height);
+
+	_createRenderTargets(images);
 
 	vk::CommandPoolCreateInfo createInfo = {};
 	createInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
@@ -566,17 +554,30 @@ void VulkanContext::initialize(vk::SurfaceKHR surface, uint32_t width, uint32_t
 	_initialized = true;
 }
 
-void VulkanContext::recreateSwapchain(uint32_t width, uint32_t height) {
-	_device.waitIdle();
+VulkanContext::RenderTargets VulkanContext::recreateSwapchain(uint32_t width, uint32_t height) {
+	RenderTargets retired = _targets;
+	_targets = {};
+
+	std::vector<vk::Image> images = _headless ? _createOffscreen(width, height)
+											  : _createSwapchain(width, height, retired.swapchain);
 
-	_destroySwapchain();
-	_createSwapchain(width, height);
+	_createRenderTargets(images);
+
+	return retired;
 }
 
 vk::Instance VulkanContext::getInstance() const {
 	return _instance;
 }
 
+VmaAllocator VulkanContext::getAllocator() const {
+	return _allocator;
+}
+
+GpuMemory &VulkanContext::getMemory() {
+	return _memory;
+}
+
 vk::SurfaceKHR VulkanContext::getSurface() const {
 	return _surface;
 }
@@ -601,43 +602,68 @@ uint32_t VulkanContext::getGraphicsQueueFamily() const {
 	return _graphicsQueueFamily;
 }
 
+vk::Queue VulkanContext::getTransferQueue() const {
+	return _transferQueue;
+}
+
+uint32_t VulkanContext::getTransferQueueFamily() const {
+	return _transferQueueFamily;
+}
+
+void VulkanContext::setPresentMode(vk::PresentModeKHR presentMode) {
+	_presentMode = presentMode;
+}
+
+bool VulkanContext::isHeadless() const {
+	return _headless;
+}
+
+uint32_t VulkanContext::getImageCount() const {
+	return _targets.images.size();
+}
+
 vk::SwapchainKHR VulkanContext::getSwapchain() const {
-	return _swapchain;
+	return _targets.swapchain;
 }
 
 vk::Extent2D VulkanContext::getSwapchainExtent() const {
 	return _swapchainExtent;
 }
 
-vk::RenderPass VulkanContext::getRenderPass() const {
-	return _renderPass;
+vk::Format VulkanContext::getSwapchainFormat() const {
+	return _swapchainFormat;
 }
 
-vk::Framebuffer VulkanContext::getFramebuffer(uint32_t imageIndex) const {
-	return _swapchainImages[imageIndex].framebuffer;
+vk::Image VulkanContext::getImage(uint32_t imageIndex) const {
+	return _targets.images[imageIndex];
 }
 
-Attachment VulkanContext::getColorAttachment() const {
-	return _color;
+vk::ImageView VulkanContext::getImageView(uint32_t imageIndex) const {
+	return _targets.views[imageIndex];
 }
 
 vk::CommandPool VulkanContext::getCommandPool() const {
 	return _commandPool;
 }
 
-VulkanContext::VulkanContext(bool validation) {
+VulkanContext::VulkanContext(bool validation, bool headless) {
 	if (validation && !checkValidationLayerSupport()) {
 		SDL_LogWarn(SDL_LOG_PRIORITY_WARN, "Validation not supported!");
 		validation = false;
 	}
 
 	this->_validation = validation;
-	_instance = createInstance(validation, &_debugMessenger);
+	this->_headless = headless;
+	_instance = createInstance(validation, headless, &_debugMessenger);
 }
 
 VulkanContext::~VulkanContext() {
 	if (_initialized) {
-		_destroySwapchain();
+		destroyRenderTargets(_targets);
+
+		// pools before the allocator, VMA asserts on live ones
+		_memory.finish();
+		vmaDestroyAllocator(_allocator);
 
 		_device.destroyCommandPool(_commandPool);
 		_device.destroy();
@@ -645,7 +671,8 @@ VulkanContext::~VulkanContext() {
 		if (_validation)
 			DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
 
-		_instance.destroySurfaceKHR(_surface);
+		if (_surface)
+			_instance.destroySurfaceKHR(_surface);
 	}
 
 	_instance.destroy();
@@ -4,8 +4,10 @@
 #include <cstdint>
 #include <vector>
 
+#include <vma/vk_mem_alloc.h>
 #include <vulkan/vulkan.hpp>
 
+#include "gpu_memory.h"
 #include "types/attachment.h"
 
 const std::vector<const char *> VALIDATION_LAYERS = { "VK_LAYER_KHRONOS_validation" };
@@ -15,13 +17,29 @@ const std::vector<const char *> DEVICE_EXTENSIONS = {
 	VK_KHR_MULTIVIEW_EXTENSION_NAME,
 };
 
-const uint32_t DEPTH_PASS = 0;
-const uint32_t MAIN_PASS = 1;
-const uint32_t TONEMAP_PASS = 2;
+// headless rendering cycles through these instead of swapchain images, at least as many as
+// frames in flight so no two frames write the same image
+const uint32_t OFFSCREEN_IMAGE_COUNT = 3;
+
+// HDR color and depth the frame renders into before tonemapping
+const vk::Format COLOR_FORMAT = vk::Format::eB10G11R11UfloatPack32;
+const vk::Format DEPTH_FORMAT = vk::Format::eD32Sfloat;
 
 class VulkanContext {
+public:
+	// The images frames are presented from. Recreation hands the old set back, to be destroyed
+	// once no frame in flight uses it.
+	typedef struct {
+		vk::SwapchainKHR swapchain;
+		// swapchain images, or offscreen images when headless
+		std::vector<vk::Image> images;
+		std::vector<vk::ImageView> views;
+		std::vector<Attachment> offscreenImages;
+	} RenderTargets;
+
 private:
 	bool _validation = false;
+	bool _headless = false;
 
 	vk::Instance _instance;
 	VkDebugUtilsMessengerEXT _debugMessenger;
@@ -32,34 +50,45 @@ private:
 
 	vk::Queue _graphicsQueue;
 	vk::Queue _presentQueue;
+	vk::Queue _transferQueue;
 
 	uint32_t _graphicsQueueFamily;
+	uint32_t _transferQueueFamily;
 
-	typedef struct {
-		vk::ImageView view;
-		vk::Framebuffer framebuffer;
-	} SwapchainImageResource;
+	VmaAllocator _allocator;
+	GpuMemory _memory;
 
-	std::vector<SwapchainImageResource> _swapchainImages;
-	vk::SwapchainKHR _swapchain;
+	RenderTargets _targets;
 	vk::Extent2D _swapchainExtent;
-	vk::RenderPass _renderPass;
-
-	Attachment _color;
-	Attachment _depth;
+	vk::Format _swapchainFormat = vk::Format::eUndefined;
 
 	vk::CommandPool _commandPool;
 
+	// preferred, the swapchain falls back to FIFO which every surface supports
+	vk::PresentModeKHR _presentMode = vk::PresentModeKHR::eMailbox;
+
 	bool _initialized = false;
 
-	void _createSwapchain(uint32_t width, uint32_t height);
-	void _destroySwapchain();
+	void _createAllocator();
+	std::vector<vk::Image> _createSwapchain(
+			uint32_t width, uint32_t height, vk::SwapchainKHR oldSwapchain = {});
+	std::vector<vk::Image> _createOffscreen(uint32_t width, uint32_t height);
+	void _createRenderTargets(const std::vector<vk::Image> &images);
 
 public:
+	// A headless context takes no surface, frames render into offscreen images instead of a
+	// swapchain and are left in transfer source layout.
 	void initialize(vk::SurfaceKHR surface, uint32_t width, uint32_t height);
-	void recreateSwapchain(uint32_t width, uint32_t height);
+	// Doesn't wait for the device, the returned targets may still be in use by frames in flight.
+	RenderTargets recreateSwapchain(uint32_t width, uint32_t height);
+	void destroyRenderTargets(const RenderTargets &targets);
+
+	// Takes effect when the swapchain is next created.
+	void setPresentMode(vk::PresentModeKHR presentMode);
 
 	vk::Instance getInstance() const;
+	VmaAllocator getAllocator() const;
+	GpuMemory &getMemory();
 
 	vk::SurfaceKHR getSurface() const;
 	vk::PhysicalDevice getPhysicalDevice() const;
@@ -70,17 +99,23 @@ public:
 
 	uint32_t getGraphicsQueueFamily() const;
 
+	// A queue of a family without graphics when the device has one, the graphics queue otherwise.
+	vk::Queue getTransferQueue() const;
+	uint32_t getTransferQueueFamily() const;
+
+	bool isHeadless() const;
+	uint32_t getImageCount() const;
+
 	vk::SwapchainKHR getSwapchain() const;
 	vk::Extent2D getSwapchainExtent() const;
+	vk::Format getSwapchainFormat() const;
 
-	vk::RenderPass getRenderPass() const;
-	vk::Framebuffer getFramebuffer(uint32_t imageIndex) const;
-
-	Attachment getColorAttachment() const;
+	vk::Image getImage(uint32_t imageIndex) const;
+	vk::ImageView getImageView(uint32_t imageIndex) const;
 
 	vk::CommandPool getCommandPool() const;
 
-	VulkanContext(bool validation = false);
+	VulkanContext(bool validation = false, bool headless = false);
 	~VulkanContext();
 };
 
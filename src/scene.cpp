@@ -1,23 +1,40 @@
 #include <cstdint>
 #include <filesystem>
 #include <optional>
+#include <string>
 
 #include "io/asset_loader.h"
 #include "rendering/rendering_server.h"
 
+#include "load_profiler.h"
+#include "profiler.h"
 #include "scene.h"
 
+// Uploads and builds mips, the time includes waiting for the GPU.
+static ObjectID _textureCreate(const std::shared_ptr<Image> &image, const std::string &asset) {
+	LoadPhase phase("Texture create", asset.c_str());
+	phase.addBytes(image->getByteSize());
+
+	return RS::getSingleton().textureCreate(image);
+}
+
 bool Scene::load(const std::filesystem::path &path) {
+	PROFILE_SCOPE("Scene::load");
+
+	LoadProfiler::getSingleton().loadBegin(path.c_str());
+
 	AssetLoader::Scene scene = AssetLoader::loadGltf(path);
 
 	for (const AssetLoader::Material &sceneMaterial : scene.materials) {
 		RS::MaterialInfo info;
 
+		std::string asset = "material " + std::to_string(_materials.size());
+
 		std::optional<size_t> albedoIndex = sceneMaterial.albedoIndex;
 		if (albedoIndex.has_value()) {
 			std::shared_ptr<Image> albedoMap = scene.images[albedoIndex.value()];
 
-			ObjectID t = RS::getSingleton().textureCreate(albedoMap);
+			ObjectID t = _textureCreate(albedoMap, asset + " albedo");
 			_textures.push_back(t);
 
 			info.albedo = t;
@@ -27,7 +44,7 @@ bool Scene::load(const std::filesystem::path &path) {
 		if (normalIndex.has_value()) {
 			std::shared_ptr<Image> normalMap = scene.images[normalIndex.value()];
 
-			ObjectID t = RS::getSingleton().textureCreate(normalMap);
+			ObjectID t = _textureCreate(normalMap, asset + " normal");
 			_textures.push_back(t);
 
 			info.normal = t;
@@ -37,7 +54,7 @@ bool Scene::load(const std::filesystem::path &path) {
 		if (metallicIndex.has_value()) {
 			std::shared_ptr<Image> metallicMap = scene.images[metallicIndex.value()];
 
-			ObjectID t = RS::getSingleton().textureCreate(metallicMap);
+			ObjectID t = _textureCreate(metallicMap, asset + " metallic");
 			_textures.push_back(t);
 
 			info.metallic = t;
@@ -47,12 +64,14 @@ bool Scene::load(const std::filesystem::path &path) {
 		if (roughnessIndex.has_value()) {
 			std::shared_ptr<Image> roughnessMap = scene.images[roughnessIndex.value()];
 
-			ObjectID t = RS::getSingleton().textureCreate(roughnessMap);
+			ObjectID t = _textureCreate(roughnessMap, asset + " roughness");
 			_textures.push_back(t);
 
 			info.roughness = t;
 		}
 
+		LoadPhase phase("Material descriptors", asset.c_str());
+
 		ObjectID material = RS::getSingleton().materialCreate(info);
 		_materials.push_back(material);
 	}
@@ -63,51 +82,117 @@ bool Scene::load(const std::filesystem::path &path) {
 					_materials[sceneMesh.pPrimitives[i].materialIndex];
 		}
 
+		LoadPhase phase("Mesh create", sceneMesh.name.c_str());
+		phase.addBytes(meshGetByteSize(sceneMesh));
+
 		ObjectID mesh = RS::getSingleton().meshCreate(sceneMesh);
 		_meshes.push_back(mesh);
 	}
 
-	for (const AssetLoader::MeshInstance &sceneMeshInstance : scene.meshInstances) {
-		uint64_t meshIndex = sceneMeshInstance.meshIndex;
+	{
+		LoadPhase phase("Nodes");
 
-		ObjectID mesh = _meshes[meshIndex];
-		glm::mat4 transform = sceneMeshInstance.transform;
+		// scenes can be loaded on top of each other
+		uint32_t nodeOffset = _hierarchy.size();
 
-		ObjectID meshInstance = RS::getSingleton().meshInstanceCreate();
-		RS::getSingleton().meshInstanceSetMesh(meshInstance, mesh);
-		RS::getSingleton().meshInstanceSetTransform(meshInstance, transform);
+		for (const AssetLoader::Node &sceneNode : scene.nodes) {
+			uint32_t parent = NO_PARENT;
 
-		_meshInstances.push_back(meshInstance);
-	}
+			if (sceneNode.parentIndex.has_value())
+				parent = nodeOffset + static_cast<uint32_t>(sceneNode.parentIndex.value());
 
-	for (const AssetLoader::Light &sceneLight : scene.lights) {
-		glm::mat4 transform = sceneLight.transform;
-		float range = sceneLight.range.value_or(0.0f);
-		glm::vec3 color = sceneLight.color;
-		float intensity = sceneLight.intensity;
-
-		ObjectID light;
-
-		switch (sceneLight.type) {
-			case AssetLoader::LightType::Directional:
-				light = RS::getSingleton().lightCreate(LightType::Directional);
-				break;
-			case AssetLoader::LightType::Point:
-				light = RS::getSingleton().lightCreate(LightType::Point);
-				break;
+			_hierarchy.add(parent, sceneNode.transform);
 		}
 
-		RS::getSingleton().lightSetTransform(light, transform);
-		RS::getSingleton().lightSetRange(light, range);
-		RS::getSingleton().lightSetColor(light, color);
-		RS::getSingleton().lightSetIntensity(light, intensity);
+		_hierarchy.update();
+
+		_nodeLights.resize(_hierarchy.size(), NULL_HANDLE);
+		_nodeTransformSlots.resize(_hierarchy.size(), NO_TRANSFORM_SLOT);
+
+		for (const AssetLoader::MeshInstance &sceneMeshInstance : scene.meshInstances) {
+			uint64_t meshIndex = sceneMeshInstance.meshIndex;
+			uint64_t nodeIndex = nodeOffset + sceneMeshInstance.nodeIndex;
+
+			ObjectID mesh = _meshes[meshIndex];
+			glm::mat4 transform = _hierarchy.getWorldTransform(nodeIndex);
+
+			ObjectID meshInstance = RS::getSingleton().meshInstanceCreate();
+			RS::getSingleton().meshInstanceSetMesh(meshInstance, mesh);
+			RS::getSingleton().meshInstanceSetTransform(meshInstance, transform);
+
+			_meshInstances.push_back(meshInstance);
+			_nodeTransformSlots[nodeIndex] =
+					RS::getSingleton().meshInstanceGetTransformSlot(meshInstance);
+		}
+
+		for (const AssetLoader::Light &sceneLight : scene.lights) {
+			uint64_t nodeIndex = nodeOffset + sceneLight.nodeIndex;
+
+			glm::mat4 transform = _hierarchy.getWorldTransform(nodeIndex);
+			float range = sceneLight.range.value_or(0.0f);
+			glm::vec3 color = sceneLight.color;
+			float intensity = sceneLight.intensity;
+
+			ObjectID light;
+
+			switch (sceneLight.type) {
+				case AssetLoader::LightType::Directional:
+					light = RS::getSingleton().lightCreate(LightType::Directional);
+					break;
+				case AssetLoader::LightType::Point:
+					light = RS::getSingleton().lightCreate(LightType::Point);
+					break;
+			}
 
-		_lights.push_back(light);
+			RS::getSingleton().lightSetTransform(light, transform);
+			RS::getSingleton().lightSetRange(light, range);
+			RS::getSingleton().lightSetColor(light, color);
+			RS::getSingleton().lightSetIntensity(light, intensity);
+
+			_lights.push_back(light);
+			_nodeLights[nodeIndex] = light;
+		}
 	}
 
+	LoadProfiler::getSingleton().loadEnd();
+
 	return true;
 }
 
+void Scene::nodeSetTransform(uint32_t node, const glm::mat4 &transform) {
+	_hierarchy.setLocalTransform(node, transform);
+}
+
+uint32_t Scene::getNodeCount() const {
+	return _hierarchy.size();
+}
+
+void Scene::update() {
+	PROFILE_SCOPE("Scene::update");
+
+	if (!_hierarchy.update())
+		return;
+
+	_changedSlots.clear();
+	_changedNodes.clear();
+
+	for (uint32_t node : _hierarchy.getChanged()) {
+		if (_nodeTransformSlots[node] != NO_TRANSFORM_SLOT) {
+			_changedSlots.push_back(_nodeTransformSlots[node]);
+			_changedNodes.push_back(node);
+		}
+
+		if (_nodeLights[node] != NULL_HANDLE) {
+			const glm::mat4 &transform = _hierarchy.getWorldTransform(node);
+			RS::getSingleton().lightSetTransform(_nodeLights[node], transform);
+		}
+	}
+
+	// matrices are copied once, from the hierarchy's storage into the renderer's
+	RS::getSingleton().meshInstancesSetTransforms(_changedSlots.data(), _changedNodes.data(),
+			_hierarchy.getWorldTransforms(), static_cast<uint32_t>(_changedSlots.size()));
+}
+
 void Scene::clear() {
 	for (ObjectID meshInstance : _meshInstances)
 		RS::getSingleton().meshInstanceFree(meshInstance);
@@ -129,4 +214,8 @@ void Scene::clear() {
 	_meshes.clear();
 	_materials.clear();
 	_textures.clear();
+
+	_hierarchy.clear();
+	_nodeLights.clear();
+	_nodeTransformSlots.clear();
 }
@@ -5,8 +5,14 @@
 #include <filesystem>
 #include <vector>
 
+#include <glm/glm.hpp>
+
+#include "transform_hierarchy.h"
+
 typedef uint64_t ObjectID;
 
+const uint32_t NO_TRANSFORM_SLOT = UINT32_MAX;
+
 class Scene {
 private:
 	std::vector<ObjectID> _textures;
@@ -17,9 +23,26 @@ private:
 
 	std::vector<ObjectID> _lights;
 
+	TransformHierarchy _hierarchy;
+
+	// per node, 0 when the node has none
+	std::vector<ObjectID> _nodeLights;
+	// per node, transform slot of its mesh instance or NO_TRANSFORM_SLOT
+	std::vector<uint32_t> _nodeTransformSlots;
+
+	// changed mesh instances, with the nodes whose world matrices they take
+	std::vector<uint32_t> _changedSlots;
+	std::vector<uint32_t> _changedNodes;
+
 public:
 	bool load(const std::filesystem::path &path);
 	void clear();
+
+	void nodeSetTransform(uint32_t node, const glm::mat4 &transform);
+	uint32_t getNodeCount() const;
+
+	// Propagates changed node transforms and sends them to the rendering server.
+	void update();
 };
 
 #endif // !SCENE_H
@@ -0,0 +1,140 @@
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define USE_SSE
+#endif
+
+#include <glm/glm.hpp>
+
+#include "transform_hierarchy.h"
+
+// dst = parent * local for column major matrices, the kernel every level batch runs through.
+static void _multiply(glm::mat4 &dst, const glm::mat4 &parent, const glm::mat4 &local) {
+#ifdef USE_SSE
+	const float *pA = &parent[0][0];
+	const float *pB = &local[0][0];
+	float *pOut = &dst[0][0];
+
+	__m128 a0 = _mm_loadu_ps(pA + 0);
+	__m128 a1 = _mm_loadu_ps(pA + 4);
+	__m128 a2 = _mm_loadu_ps(pA + 8);
+	__m128 a3 = _mm_loadu_ps(pA + 12);
+
+	for (int i = 0; i < 4; i++) {
+		// column i of the result is parent times column i of local
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(pB[i * 4 + 0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(pB[i * 4 + 1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(pB[i * 4 + 2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(pB[i * 4 + 3])));
+
+		_mm_storeu_ps(pOut + i * 4, column);
+	}
+#else
+	dst = parent * local;
+#endif
+}
+
+uint32_t TransformHierarchy::add(uint32_t parent, const glm::mat4 &localTransform) {
+	uint32_t node = static_cast<uint32_t>(_parents.size());
+	assert(parent == NO_PARENT || parent < node);
+
+	uint32_t depth = parent == NO_PARENT ? 0 : _depths[parent] + 1;
+
+	_parents.push_back(parent);
+	_depths.push_back(depth);
+	_localTransforms.push_back(localTransform);
+	_worldTransforms.push_back(glm::mat4(1.0f));
+	_dirty.push_back(1);
+
+	if (depth >= _levels.size())
+		_levels.resize(depth + 1);
+
+	_isDirty = true;
+	return node;
+}
+
+void TransformHierarchy::clear() {
+	_parents.clear();
+	_depths.clear();
+	_localTransforms.clear();
+	_worldTransforms.clear();
+	_dirty.clear();
+	_levels.clear();
+	_changed.clear();
+
+	_isDirty = false;
+}
+
+void TransformHierarchy::setLocalTransform(uint32_t node, const glm::mat4 &localTransform) {
+	_localTransforms[node] = localTransform;
+	_dirty[node] = 1;
+	_isDirty = true;
+}
+
+const glm::mat4 &TransformHierarchy::getLocalTransform(uint32_t node) const {
+	return _localTransforms[node];
+}
+
+bool TransformHierarchy::update() {
+	_changed.clear();
+
+	if (!_isDirty)
+		return false;
+
+	uint32_t count = size();
+
+	for (std::vector<uint32_t> &level : _levels)
+		level.clear();
+
+	// parents come first, so their flag is final before any child reads it
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t parent = _parents[i];
+
+		if (parent != NO_PARENT)
+			_dirty[i] |= _dirty[parent];
+
+		if (_dirty[i]) {
+			_levels[_depths[i]].push_back(i);
+			_changed.push_back(i);
+		}
+	}
+
+	for (uint32_t node : _levels[0])
+		_worldTransforms[node] = _localTransforms[node];
+
+	for (size_t depth = 1; depth < _levels.size(); depth++) {
+		for (uint32_t node : _levels[depth]) {
+			const glm::mat4 &parent = _worldTransforms[_parents[node]];
+			_multiply(_worldTransforms[node], parent, _localTransforms[node]);
+		}
+	}
+
+	for (uint32_t node : _changed)
+		_dirty[node] = 0;
+
+	_isDirty = false;
+	return true;
+}
+
+const glm::mat4 *TransformHierarchy::getWorldTransforms() const {
+	return _worldTransforms.data();
+}
+
+const glm::mat4 &TransformHierarchy::getWorldTransform(uint32_t node) const {
+	return _worldTransforms[node];
+}
+
+const std::vector<uint32_t> &TransformHierarchy::getChanged() const {
+	return _changed;
+}
+
+uint32_t TransformHierarchy::getParent(uint32_t node) const {
+	return _parents[node];
+}
+
+uint32_t TransformHierarchy::size() const {
+	return static_cast<uint32_t>(_parents.size());
+}
@@ -0,0 +1,50 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+const uint32_t NO_PARENT = UINT32_MAX;
+
+// Node transforms stored as structure of arrays, parents always before their children.
+//
+// Changing a local transform marks the node dirty; update() recomputes world matrices of dirty
+// nodes and everything below them, one depth level at a time so each level is a single batch.
+class TransformHierarchy {
+private:
+	std::vector<uint32_t> _parents;
+	std::vector<uint32_t> _depths;
+	std::vector<glm::mat4> _localTransforms;
+	std::vector<glm::mat4> _worldTransforms;
+	std::vector<uint8_t> _dirty;
+
+	std::vector<std::vector<uint32_t>> _levels;
+	std::vector<uint32_t> _changed;
+
+	bool _isDirty = false;
+
+public:
+	// `parent` has to be added before, or NO_PARENT.
+	uint32_t add(uint32_t parent, const glm::mat4 &localTransform);
+	void clear();
+
+	void setLocalTransform(uint32_t node, const glm::mat4 &localTransform);
+	const glm::mat4 &getLocalTransform(uint32_t node) const;
+
+	// Returns true if any world matrix changed.
+	bool update();
+
+	// Contiguous world matrices, indexed by node.
+	const glm::mat4 *getWorldTransforms() const;
+	const glm::mat4 &getWorldTransform(uint32_t node) const;
+
+	// Nodes recomputed by the last update(), in parent before child order.
+	const std::vector<uint32_t> &getChanged() const;
+
+	uint32_t getParent(uint32_t node) const;
+	uint32_t size() const;
+};
+
+#endif // !TRANSFORM_HIERARCHY_H